@@ -0,0 +1,137 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_async_image_writer.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/Error.hpp>
+#include <vtkh/utils/AsyncImageWriter.hpp>
+
+#include <stdio.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+std::vector<unsigned char> TestImage(const int width, const int height, const int seed)
+{
+  std::vector<unsigned char> rgba(width * height * 4);
+  for(size_t i = 0; i < rgba.size(); ++i)
+  {
+    rgba[i] = static_cast<unsigned char>(i * 7 + seed);
+  }
+  return rgba;
+}
+
+bool FileExists(const std::string &filename)
+{
+  std::ifstream file(filename.c_str());
+  return file.good();
+}
+
+std::string FileName(const std::string &base, const int index, const std::string &ext)
+{
+  return base + "_" + std::to_string(index) + "." + ext;
+}
+
+// throws for the files named in m_bad_file, writes the rest
+class FailingWriter : public vtkh::QOIImageWriter
+{
+public:
+  void Write(const unsigned char *rgba,
+             const float *depth,
+             const int width,
+             const int height,
+             const std::string &filename) override
+  {
+    if(filename == m_bad_file)
+    {
+      throw vtkh::Error("FailingWriter: can't write " + filename);
+    }
+    vtkh::QOIImageWriter::Write(rgba, depth, width, height, filename);
+  }
+
+  std::string m_bad_file;
+};
+
+} // namespace
+
+//----------------------------------------------------------------------------
+TEST(vtkh_async_image_writer, vtkh_flush_full_queue)
+{
+  const int queue_size = 2;
+  const int num_images = 5 * queue_size;
+  vtkh::AsyncImageWriter writer;
+  writer.SetQueueSize(queue_size);
+  EXPECT_EQ(writer.GetQueueSize(), queue_size);
+
+  auto qoi = vtkh::ImageWriter::Create(vtkh::ImageWriter::QOI);
+  for(int i = 0; i < num_images; ++i)
+  {
+    remove(FileName("async_png", i, "png").c_str());
+    remove(FileName("async_qoi", i, "qoi").c_str());
+  }
+  // more images than the queue holds, so writes have to block
+  for(int i = 0; i < num_images; ++i)
+  {
+    writer.Write(TestImage(64, 48, i), 64, 48, FileName("async_png", i, "png"));
+    writer.Write(qoi,
+                 TestImage(64, 48, i),
+                 std::vector<float>(),
+                 64,
+                 48,
+                 FileName("async_qoi", i, "qoi"));
+  }
+  writer.Flush();
+
+  for(int i = 0; i < num_images; ++i)
+  {
+    EXPECT_TRUE(FileExists(FileName("async_png", i, "png"))) << i;
+    EXPECT_TRUE(FileExists(FileName("async_qoi", i, "qoi"))) << i;
+  }
+
+  // the thread starts again after a finalize
+  writer.Finalize();
+  remove("async_restart.png");
+  writer.Write(TestImage(8, 8, 0), 8, 8, "async_restart.png");
+  writer.Flush();
+  EXPECT_TRUE(FileExists("async_restart.png"));
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_async_image_writer, vtkh_write_errors)
+{
+  auto failing = std::make_shared<FailingWriter>();
+  failing->m_bad_file = FileName("async_error", 1, "qoi");
+
+  vtkh::AsyncImageWriter writer;
+  for(int i = 0; i < 3; ++i)
+  {
+    remove(FileName("async_error", i, "qoi").c_str());
+    writer.Write(failing,
+                 TestImage(16, 16, i),
+                 std::vector<float>(),
+                 16,
+                 16,
+                 FileName("async_error", i, "qoi"));
+  }
+  EXPECT_THROW(writer.Flush(), vtkh::Error);
+  // the images after the bad one are still written
+  EXPECT_TRUE(FileExists(FileName("async_error", 0, "qoi")));
+  EXPECT_FALSE(FileExists(FileName("async_error", 1, "qoi")));
+  EXPECT_TRUE(FileExists(FileName("async_error", 2, "qoi")));
+  // the error is only reported once
+  EXPECT_NO_THROW(writer.Flush());
+
+  writer.Write(failing,
+               TestImage(16, 16, 0),
+               std::vector<float>(),
+               16,
+               16,
+               FileName("async_error", 1, "qoi"));
+  EXPECT_THROW(writer.Finalize(), vtkh::Error);
+}
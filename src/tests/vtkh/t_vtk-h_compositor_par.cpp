@@ -0,0 +1,293 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_compositor_par.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <mpi.h>
+#include <vtkh/vtkh.hpp>
+#include <vtkh/rendering/compositing/DIYCompositor.hpp>
+
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <string>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+const int width = 97;
+const int height = 61;
+// images in the batched composites
+const int batch_size = 3;
+
+//
+// Fills a random footprint of a width x height canvas with random
+// surfaces. The rest of the canvas is background.
+//
+void RandomCanvas(std::mt19937 &gen,
+                  std::vector<unsigned char> &colors,
+                  std::vector<float> &depths,
+                  vtkm::Bounds &footprint)
+{
+  colors.assign(width * height * 4, 0);
+  depths.assign(width * height, 2.f);
+  std::uniform_int_distribution<int> x_dist(0, width - 1);
+  std::uniform_int_distribution<int> y_dist(0, height - 1);
+  std::uniform_int_distribution<int> color(0, 255);
+  std::uniform_real_distribution<float> depth(0.f, 1.f);
+
+  const int x0 = x_dist(gen);
+  const int y0 = y_dist(gen);
+  const int x1 = std::min(width - 1, x0 + x_dist(gen));
+  const int y1 = std::min(height - 1, y0 + y_dist(gen));
+  footprint.X.Min = x0 + 1;
+  footprint.X.Max = x1 + 1;
+  footprint.Y.Min = y0 + 1;
+  footprint.Y.Max = y1 + 1;
+  for(int y = y0; y <= y1; ++y)
+  {
+    for(int x = x0; x <= x1; ++x)
+    {
+      const int i = y * width + x;
+      // leave some holes
+      if(color(gen) < 32)
+      {
+        continue;
+      }
+      depths[i] = depth(gen);
+      for(int c = 0; c < 3; ++c)
+      {
+        colors[i * 4 + c] = static_cast<unsigned char>(color(gen));
+      }
+      colors[i * 4 + 3] = 255;
+    }
+  }
+}
+
+//
+// How a composite is run. The defaults give the plain z-buffer
+// exchange every other setting is checked against.
+//
+struct CompositeSettings
+{
+  std::string                           m_name;
+  bool                                  m_depth_only;
+  bool                                  m_node_local;
+  bool                                  m_async;
+  vtkh::Compositor::CompositeStrategy   m_strategy;
+  std::vector<int>                      m_factors;
+  int                                   m_threads;
+  int                                   m_blocks_per_rank;
+  // images composited in one exchange
+  int                                   m_batch_size;
+
+  CompositeSettings(const std::string &name)
+    : m_name(name),
+      m_depth_only(false),
+      m_node_local(false),
+      m_async(false),
+      m_strategy(vtkh::Compositor::AUTO),
+      m_threads(1),
+      m_blocks_per_rank(1),
+      m_batch_size(1)
+  {}
+};
+
+//
+// Composites settings.m_batch_size images from image_start on.
+// Every rank draws two canvases per image, the same for any settings.
+//
+std::vector<vtkh::Image> CompositeSurfaces(const int rank,
+                                           const CompositeSettings &settings,
+                                           const bool footprints,
+                                           const int image_start,
+                                           const bool use_thread)
+{
+  vtkh::DIYCompositor compositor;
+  compositor.SetCompositeMode(vtkh::Compositor::Z_BUFFER_SURFACE);
+  compositor.SetDepthOnlyExchange(settings.m_depth_only);
+  compositor.SetNodeLocalComposite(settings.m_node_local);
+  compositor.SetCompositeStrategy(settings.m_strategy);
+  if(!settings.m_factors.empty())
+  {
+    compositor.SetRadixKFactors(settings.m_factors);
+  }
+  compositor.SetThreads(settings.m_threads);
+  compositor.SetBlocksPerRank(settings.m_blocks_per_rank);
+  compositor.SetAsync(settings.m_async);
+
+  for(int image = image_start; image < image_start + settings.m_batch_size; ++image)
+  {
+    std::mt19937 gen(1234 + rank * 1000 + image);
+    for(int i = 0; i < 2; ++i)
+    {
+      std::vector<unsigned char> colors;
+      std::vector<float> depths;
+      vtkm::Bounds footprint;
+      RandomCanvas(gen, colors, depths, footprint);
+      if(footprints)
+      {
+        compositor.AddImage(&colors[0], &depths[0], width, height, footprint);
+      }
+      else
+      {
+        compositor.AddImage(&colors[0], &depths[0], width, height);
+      }
+    }
+    if(settings.m_batch_size > 1)
+    {
+      compositor.FinishImage();
+    }
+  }
+
+  auto composite = [&compositor, &settings]()
+  {
+    if(settings.m_batch_size > 1)
+    {
+      return compositor.CompositeBatch();
+    }
+    return std::vector<vtkh::Image>(1, compositor.Composite());
+  };
+  if(use_thread)
+  {
+    // like an async composite of a renderer, on a helper thread
+    return std::async(std::launch::async, composite).get();
+  }
+  return composite();
+}
+
+// the number of pixels that differ, on rank 0 where the image is
+int CountMismatches(const vtkh::Image &expected, const vtkh::Image &actual)
+{
+  if(expected.m_bounds != actual.m_bounds ||
+     expected.m_pixels.size() != actual.m_pixels.size())
+  {
+    return -1;
+  }
+  const int size = expected.GetNumberOfPixels();
+  int mismatches = 0;
+  for(int i = 0; i < size; ++i)
+  {
+    const float expected_depth = expected.m_depths[i];
+    const float actual_depth = actual.m_depths[i];
+    bool match = true;
+    if(expected_depth > 1.f || actual_depth > 1.f)
+    {
+      // background on both, however it is marked
+      match = expected_depth > 1.f && actual_depth > 1.f;
+    }
+    else
+    {
+      // depth only keys are quantized
+      match = std::abs(expected_depth - actual_depth) < 1e-6f;
+    }
+    for(int c = 0; c < 4; ++c)
+    {
+      match = match && expected.m_pixels[i * 4 + c] == actual.m_pixels[i * 4 + c];
+    }
+    if(!match)
+    {
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+} // namespace
+
+//-----------------------------------------------------------------------------
+TEST(vtkh_compositor_par, vtkh_composite_settings_par)
+{
+  int provided;
+  MPI_Init_thread(NULL, NULL, MPI_THREAD_MULTIPLE, &provided);
+  int comm_size, rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  vtkh::SetMPICommHandle(MPI_Comm_c2f(MPI_COMM_WORLD));
+
+  std::vector<CompositeSettings> all_settings;
+  all_settings.push_back(CompositeSettings("depth only"));
+  all_settings.back().m_depth_only = true;
+  all_settings.push_back(CompositeSettings("node local"));
+  all_settings.back().m_node_local = true;
+  all_settings.push_back(CompositeSettings("node local depth only"));
+  all_settings.back().m_node_local = true;
+  all_settings.back().m_depth_only = true;
+  all_settings.push_back(CompositeSettings("async"));
+  all_settings.back().m_async = true;
+  all_settings.push_back(CompositeSettings("binary swap"));
+  all_settings.back().m_strategy = vtkh::Compositor::BINARY_SWAP;
+  all_settings.push_back(CompositeSettings("2-3 swap"));
+  all_settings.back().m_strategy = vtkh::Compositor::TWO_THREE_SWAP;
+  all_settings.push_back(CompositeSettings("direct send"));
+  all_settings.back().m_strategy = vtkh::Compositor::DIRECT_SEND;
+  // explicit radix-k factors, which multiply to the number of ranks
+  all_settings.push_back(CompositeSettings("radix-k single round"));
+  all_settings.back().m_strategy = vtkh::Compositor::RADIX_K;
+  all_settings.back().m_factors.push_back(comm_size);
+  if(comm_size % 2 == 0 && comm_size > 2)
+  {
+    all_settings.push_back(CompositeSettings("radix-k two rounds"));
+    all_settings.back().m_strategy = vtkh::Compositor::RADIX_K;
+    all_settings.back().m_factors.push_back(2);
+    all_settings.back().m_factors.push_back(comm_size / 2);
+  }
+  all_settings.push_back(CompositeSettings("threads"));
+  all_settings.back().m_threads = 2;
+  all_settings.back().m_blocks_per_rank = 3;
+  all_settings.push_back(CompositeSettings("threads depth only"));
+  all_settings.back().m_threads = 2;
+  all_settings.back().m_blocks_per_rank = 2;
+  all_settings.back().m_depth_only = true;
+  all_settings.push_back(CompositeSettings("batch"));
+  all_settings.back().m_batch_size = batch_size;
+  all_settings.push_back(CompositeSettings("batch depth only threads"));
+  all_settings.back().m_batch_size = batch_size;
+  all_settings.back().m_depth_only = true;
+  all_settings.back().m_threads = 2;
+  all_settings.back().m_blocks_per_rank = 2;
+
+  const CompositeSettings plain("z-buffer");
+  // the same surfaces are resolved however they are composited, for
+  // whole canvases and footprints
+  for(int test = 0; test < 2; ++test)
+  {
+    const bool footprints = test == 1;
+    // composites are collective, so every rank makes the references
+    std::vector<vtkh::Image> expected;
+    for(int image = 0; image < batch_size; ++image)
+    {
+      std::vector<vtkh::Image> result = CompositeSurfaces(rank, plain, footprints, image, false);
+      expected.push_back(vtkh::Image());
+      expected.back().Swap(result[0]);
+    }
+
+    for(size_t s = 0; s < all_settings.size(); ++s)
+    {
+      const CompositeSettings &settings = all_settings[s];
+      // without MPI_THREAD_MULTIPLE async only gets its own comm
+      const bool use_thread = settings.m_async && provided == MPI_THREAD_MULTIPLE;
+      std::vector<vtkh::Image> results =
+        CompositeSurfaces(rank, settings, footprints, 0, use_thread);
+
+      if(rank != 0)
+      {
+        continue;
+      }
+      ASSERT_EQ(results.size(), (size_t) settings.m_batch_size) << settings.m_name;
+      for(int image = 0; image < settings.m_batch_size; ++image)
+      {
+        EXPECT_EQ(CountMismatches(expected[image], results[image]), 0)
+          << settings.m_name << " image " << image
+          << (footprints ? " with footprints" : "");
+      }
+    }
+  }
+
+  MPI_Finalize();
+}
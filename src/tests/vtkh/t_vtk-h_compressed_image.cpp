@@ -0,0 +1,260 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_compressed_image.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/rendering/CompressedImage.hpp>
+#include <vtkh/rendering/ImageCompositor.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+vtkm::Bounds MakeBounds(const int x_min, const int x_max,
+                        const int y_min, const int y_max)
+{
+  vtkm::Bounds bounds;
+  bounds.X.Min = x_min;
+  bounds.X.Max = x_max;
+  bounds.Y.Min = y_min;
+  bounds.Y.Max = y_max;
+  return bounds;
+}
+
+//
+// Random image over bounds with empty pixels, empty rows and an empty
+// block in the middle, so runs start and end everywhere
+//
+vtkh::Image RandomImage(const vtkm::Bounds &bounds,
+                        const vtkm::Bounds &orig_bounds,
+                        std::mt19937 &gen)
+{
+  std::uniform_int_distribution<int> color(0, 255);
+  std::uniform_int_distribution<int> kind(0, 9);
+  std::uniform_real_distribution<float> depth(0.f, 1.f);
+
+  vtkh::Image image(bounds);
+  image.m_orig_bounds = orig_bounds;
+  const int dx = bounds.X.Max - bounds.X.Min + 1;
+  const int dy = bounds.Y.Max - bounds.Y.Min + 1;
+  for(int y = 0; y < dy; ++y)
+  {
+    for(int x = 0; x < dx; ++x)
+    {
+      const int i = y * dx + x;
+      const bool empty_row = y % 7 == 3;
+      const bool empty_block = x > dx / 3 && x < dx / 2 && y > dy / 3 && y < dy / 2;
+      const int k = kind(gen);
+      if(empty_row || empty_block || k < 3)
+      {
+        // background
+        continue;
+      }
+      for(int c = 0; c < 4; ++c)
+      {
+        image.m_pixels[i * 4 + c] = static_cast<unsigned char>(color(gen));
+      }
+      if(k == 3)
+      {
+        // coverage without a surface
+        image.m_pixels[i * 4 + 3] = std::max(1, color(gen));
+        continue;
+      }
+      if(k == 4)
+      {
+        // a surface without coverage
+        image.m_pixels[i * 4 + 3] = 0;
+      }
+      image.m_depths[i] = depth(gen);
+    }
+  }
+  return image;
+}
+
+//
+// What a compressed image should decompress to: the sub-region of the
+// image with every inactive pixel cleared to background
+//
+vtkh::Image Expected(const vtkh::Image &image, const vtkm::Bounds &sub_region)
+{
+  vtkh::Image expected;
+  expected.SubsetFrom(image, sub_region);
+  const int size = static_cast<int>(expected.m_depths.size());
+  for(int i = 0; i < size; ++i)
+  {
+    if(!vtkh::CompressedImage::IsActive(&expected.m_pixels[i * 4],
+                                       expected.m_depths[i]))
+    {
+      std::fill(&expected.m_pixels[i * 4], &expected.m_pixels[i * 4] + 4, 0);
+      expected.m_depths[i] = 2.f;
+    }
+  }
+  return expected;
+}
+
+void CheckRuns(const vtkh::CompressedImage &compressed)
+{
+  int pixels = 0;
+  int active = 0;
+  for(int r = 0; r < compressed.GetNumberOfRuns(); ++r)
+  {
+    EXPECT_GE(compressed.m_runs[r * 2 + 0], 0);
+    EXPECT_GE(compressed.m_runs[r * 2 + 1], 0);
+    pixels += compressed.m_runs[r * 2 + 0] + compressed.m_runs[r * 2 + 1];
+    active += compressed.m_runs[r * 2 + 1];
+  }
+  EXPECT_EQ(pixels, compressed.GetNumberOfPixels());
+  EXPECT_EQ(active, compressed.GetNumberOfActivePixels());
+  EXPECT_EQ(compressed.m_pixels.size(), compressed.m_depths.size() * 4);
+}
+
+void CheckRoundTrip(const vtkh::Image &image, const vtkm::Bounds &sub_region)
+{
+  vtkh::CompressedImage compressed;
+  compressed.Compress(image, sub_region);
+  CheckRuns(compressed);
+
+  vtkh::Image decompressed;
+  compressed.Decompress(decompressed);
+  vtkh::Image expected = Expected(image, sub_region);
+
+  EXPECT_EQ(decompressed.m_bounds, sub_region);
+  EXPECT_EQ(decompressed.m_orig_bounds, image.m_orig_bounds);
+  EXPECT_EQ(decompressed.m_pixels, expected.m_pixels);
+  EXPECT_EQ(decompressed.m_depths, expected.m_depths);
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+TEST(vtkh_compressed_image, vtkh_round_trip)
+{
+  std::mt19937 gen(7);
+  const vtkm::Bounds screen = MakeBounds(1, 97, 1, 61);
+  vtkh::Image image = RandomImage(screen, screen, gen);
+
+  CheckRoundTrip(image, screen);
+
+  // sub-regions inside the image, on its edges and corners
+  CheckRoundTrip(image, MakeBounds(10, 40, 12, 30));
+  CheckRoundTrip(image, MakeBounds(1, 97, 1, 1));
+  CheckRoundTrip(image, MakeBounds(97, 97, 1, 61));
+  CheckRoundTrip(image, MakeBounds(1, 1, 61, 61));
+  CheckRoundTrip(image, MakeBounds(97, 97, 61, 61));
+  CheckRoundTrip(image, MakeBounds(60, 97, 40, 61));
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_compressed_image, vtkh_round_trip_outside)
+{
+  // an image covering part of the screen compressed over regions
+  // that stick out of it or miss it completely
+  std::mt19937 gen(11);
+  const vtkm::Bounds screen = MakeBounds(1, 128, 1, 96);
+  const vtkm::Bounds bounds = MakeBounds(20, 70, 30, 60);
+  vtkh::Image image = RandomImage(bounds, screen, gen);
+
+  CheckRoundTrip(image, MakeBounds(1, 128, 1, 96));
+  CheckRoundTrip(image, MakeBounds(10, 40, 25, 45));
+  CheckRoundTrip(image, MakeBounds(60, 90, 50, 80));
+  CheckRoundTrip(image, MakeBounds(1, 19, 1, 96));
+  CheckRoundTrip(image, MakeBounds(71, 128, 1, 96));
+  CheckRoundTrip(image, MakeBounds(1, 128, 61, 96));
+
+  vtkh::CompressedImage missed;
+  missed.Compress(image, MakeBounds(80, 128, 1, 20));
+  EXPECT_TRUE(missed.IsEmpty());
+  EXPECT_EQ(missed.GetNumberOfRuns(), 1);
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_compressed_image, vtkh_empty)
+{
+  const vtkm::Bounds screen = MakeBounds(1, 33, 1, 17);
+  vtkh::Image image(screen);
+
+  vtkh::CompressedImage compressed;
+  compressed.Compress(image);
+  CheckRuns(compressed);
+  EXPECT_TRUE(compressed.IsEmpty());
+  EXPECT_EQ(compressed.GetNumberOfRuns(), 1);
+  EXPECT_EQ(compressed.m_runs[0], 33 * 17);
+
+  vtkh::Image decompressed;
+  compressed.Decompress(decompressed);
+  EXPECT_EQ(decompressed.m_pixels, image.m_pixels);
+  EXPECT_EQ(decompressed.m_depths, image.m_depths);
+
+  // composites with nothing in them leave the front alone
+  std::mt19937 gen(3);
+  vtkh::Image front = RandomImage(screen, screen, gen);
+  vtkh::Image before = front;
+  vtkh::ImageCompositor compositor;
+  compositor.ZBufferComposite(front, compressed);
+  compositor.Blend(front, compressed);
+  EXPECT_EQ(front.m_pixels, before.m_pixels);
+  EXPECT_EQ(front.m_depths, before.m_depths);
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_compressed_image, vtkh_composite)
+{
+  // compositing compressed images matches compositing the dense ones
+  std::mt19937 gen(5);
+  const vtkm::Bounds screen = MakeBounds(1, 80, 1, 50);
+  const vtkm::Bounds tile = MakeBounds(11, 60, 5, 45);
+  vtkh::ImageCompositor compositor;
+
+  for(int test = 0; test < 4; ++test)
+  {
+    vtkh::Image front;
+    front.SubsetFrom(RandomImage(screen, screen, gen), tile);
+    vtkh::Image back;
+    back.SubsetFrom(RandomImage(screen, screen, gen), tile);
+    vtkh::CompressedImage compressed;
+    compressed.Compress(back);
+
+    vtkh::Image dense_z = front;
+    vtkh::Image compressed_z = front;
+    compositor.ZBufferComposite(dense_z, back);
+    compositor.ZBufferComposite(compressed_z, compressed);
+    EXPECT_EQ(dense_z.m_pixels, compressed_z.m_pixels);
+    EXPECT_EQ(dense_z.m_depths, compressed_z.m_depths);
+
+    vtkh::Image dense_blend = front;
+    vtkh::Image compressed_blend = front;
+    compositor.Blend(dense_blend, back);
+    compositor.Blend(compressed_blend, compressed);
+    EXPECT_EQ(dense_blend.m_pixels, compressed_blend.m_pixels);
+    // skipped pixels keep the front depth instead of clamping it,
+    // which is the same for anything in front of the far plane
+    const int size = static_cast<int>(front.m_depths.size());
+    for(int i = 0; i < size; ++i)
+    {
+      EXPECT_EQ(dense_blend.m_depths[i],
+                std::min(compressed_blend.m_depths[i], 1.001f));
+    }
+  }
+
+  // ordered composites of compressed images over a shared tile
+  std::vector<vtkh::Image> dense;
+  std::vector<vtkh::CompressedImage> compressed(3);
+  for(int i = 0; i < 3; ++i)
+  {
+    dense.push_back(RandomImage(tile, screen, gen));
+    dense[i].m_composite_order = 2 - i;
+    compressed[i].Compress(dense[i]);
+  }
+  vtkh::Image output;
+  compositor.OrderedComposite(compressed, output);
+  compositor.OrderedComposite(dense);
+  EXPECT_EQ(output.m_bounds, tile);
+  EXPECT_EQ(output.m_pixels, dense[0].m_pixels);
+}
@@ -0,0 +1,205 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_depth_image.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/rendering/compositing/DepthImage.hpp>
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+vtkm::Bounds MakeBounds(const int x_min, const int x_max,
+                        const int y_min, const int y_max)
+{
+  vtkm::Bounds bounds;
+  bounds.X.Min = x_min;
+  bounds.X.Max = x_max;
+  bounds.Y.Min = y_min;
+  bounds.Y.Max = y_max;
+  return bounds;
+}
+
+vtkh::Image RandomDepths(const vtkm::Bounds &bounds,
+                         const vtkm::Bounds &orig_bounds,
+                         std::mt19937 &gen)
+{
+  std::uniform_real_distribution<float> depth(0.f, 1.2f);
+  vtkh::Image image(bounds);
+  image.m_orig_bounds = orig_bounds;
+  const int size = static_cast<int>(image.m_depths.size());
+  for(int i = 0; i < size; ++i)
+  {
+    const float d = depth(gen);
+    // anything past the far plane is background
+    image.m_depths[i] = d > 1.f ? 2.f : d;
+  }
+  return image;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+TEST(vtkh_depth_image, vtkh_rank_bits)
+{
+  EXPECT_EQ(vtkh::DepthImage::RankBits(1), 1);
+  EXPECT_EQ(vtkh::DepthImage::RankBits(2), 1);
+  EXPECT_EQ(vtkh::DepthImage::RankBits(3), 2);
+  EXPECT_EQ(vtkh::DepthImage::RankBits(1024), 10);
+  EXPECT_EQ(vtkh::DepthImage::RankBits(1025), 11);
+  EXPECT_EQ(vtkh::DepthImage::RankBits(65536), 16);
+  EXPECT_TRUE(vtkh::DepthImage::SupportsRanks(65536));
+  EXPECT_FALSE(vtkh::DepthImage::SupportsRanks(65537));
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_depth_image, vtkh_key_packing)
+{
+  const int rank_bits[3] = {1, 7, 16};
+  const float depths[7] = {0.f, 1e-7f, 0.25f, 0.5f, 0.7071f, 0.999999f, 1.f};
+  for(int b = 0; b < 3; ++b)
+  {
+    vtkh::DepthImage keys;
+    keys.m_rank_bits = rank_bits[b];
+    const int max_rank = (1 << rank_bits[b]) - 1;
+    const float step = 1.f / vtkh::DepthImage::MaxDepth(rank_bits[b]);
+    const int ranks[3] = {0, max_rank / 2, max_rank};
+
+    for(int r = 0; r < 3; ++r)
+    {
+      for(int d = 0; d < 7; ++d)
+      {
+        const unsigned int key = vtkh::DepthImage::MakeKey(depths[d], ranks[r], rank_bits[b]);
+        EXPECT_NE(key, (unsigned int) vtkh::DepthImage::EmptyKey);
+        EXPECT_EQ(keys.KeyRank(key), ranks[r]);
+        EXPECT_NEAR(keys.KeyDepth(key), depths[d], step + 1e-6f);
+        // depth is never rounded towards the camera
+        EXPECT_LE(keys.KeyDepth(key), depths[d] + 1e-6f);
+      }
+
+      // background and depths past the far plane are empty,
+      // depths in front of the near plane clamp to it
+      EXPECT_EQ(vtkh::DepthImage::MakeKey(2.f, ranks[r], rank_bits[b]),
+                (unsigned int) vtkh::DepthImage::EmptyKey);
+      EXPECT_EQ(vtkh::DepthImage::MakeKey(1.0001f, ranks[r], rank_bits[b]),
+                (unsigned int) vtkh::DepthImage::EmptyKey);
+      EXPECT_EQ(vtkh::DepthImage::MakeKey(-0.5f, ranks[r], rank_bits[b]),
+                vtkh::DepthImage::MakeKey(0.f, ranks[r], rank_bits[b]));
+    }
+
+    EXPECT_EQ(keys.KeyDepth(vtkh::DepthImage::EmptyKey), 2.f);
+
+    // the closer surface has the smaller key whatever the ranks are,
+    // as long as the depths are further apart than a quantization
+    // step, and equal depths go to the lower rank
+    for(int d = 1; d < 7; ++d)
+    {
+      if(depths[d] - depths[d - 1] > step)
+      {
+        EXPECT_LT(vtkh::DepthImage::MakeKey(depths[d - 1], max_rank, rank_bits[b]),
+                  vtkh::DepthImage::MakeKey(depths[d], 0, rank_bits[b]));
+      }
+      EXPECT_LT(vtkh::DepthImage::MakeKey(depths[d], 0, rank_bits[b]),
+                vtkh::DepthImage::MakeKey(depths[d], max_rank, rank_bits[b]));
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_depth_image, vtkh_subset)
+{
+  std::mt19937 gen(13);
+  const vtkm::Bounds screen = MakeBounds(1, 64, 1, 48);
+  const vtkm::Bounds footprint = MakeBounds(10, 40, 5, 30);
+  vtkh::Image image = RandomDepths(footprint, screen, gen);
+
+  vtkh::DepthImage keys;
+  keys.Init(image, 3, 2);
+  EXPECT_EQ(keys.m_bounds, footprint);
+  EXPECT_EQ(keys.m_orig_bounds, screen);
+
+  // sub-regions inside the image, on its edges, sticking out of it
+  // and missing it completely
+  const vtkm::Bounds regions[6] = { MakeBounds(12, 20, 6, 9),
+                                    MakeBounds(10, 40, 5, 5),
+                                    MakeBounds(40, 40, 5, 30),
+                                    MakeBounds(1, 64, 1, 48),
+                                    MakeBounds(30, 60, 20, 48),
+                                    MakeBounds(41, 64, 1, 48) };
+  for(int r = 0; r < 6; ++r)
+  {
+    vtkh::DepthImage subset;
+    subset.SubsetFrom(keys, regions[r]);
+    EXPECT_EQ(subset.m_bounds, regions[r]);
+    EXPECT_EQ(subset.m_rank_bits, 2);
+
+    vtkh::Image expected;
+    expected.SubsetFrom(image, regions[r]);
+    ASSERT_EQ(subset.m_keys.size(), expected.m_depths.size());
+    const int size = subset.GetNumberOfPixels();
+    for(int i = 0; i < size; ++i)
+    {
+      EXPECT_EQ(subset.m_keys[i], vtkh::DepthImage::MakeKey(expected.m_depths[i], 3, 2));
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_depth_image, vtkh_composite)
+{
+  // compositing keys resolves the same surfaces as a z-buffer
+  // composite of the depths, with ties going to the lower rank
+  std::mt19937 gen(17);
+  const vtkm::Bounds screen = MakeBounds(1, 50, 1, 40);
+  const int num_ranks = 5;
+  const int rank_bits = vtkh::DepthImage::RankBits(num_ranks);
+
+  std::vector<vtkh::Image> images;
+  for(int r = 0; r < num_ranks; ++r)
+  {
+    images.push_back(RandomDepths(screen, screen, gen));
+  }
+  // a few exact ties
+  for(int i = 0; i < 40; ++i)
+  {
+    images[3].m_depths[i] = images[1].m_depths[i];
+  }
+
+  vtkh::DepthImage result;
+  result.Init(images[num_ranks - 1], num_ranks - 1, rank_bits);
+  for(int r = num_ranks - 2; r >= 0; --r)
+  {
+    vtkh::DepthImage keys;
+    keys.Init(images[r], r, rank_bits);
+    result.Composite(keys);
+  }
+
+  const int size = result.GetNumberOfPixels();
+  for(int i = 0; i < size; ++i)
+  {
+    float closest = 2.f;
+    int owner = -1;
+    for(int r = 0; r < num_ranks; ++r)
+    {
+      if(images[r].m_depths[i] <= 1.f && images[r].m_depths[i] < closest)
+      {
+        closest = images[r].m_depths[i];
+        owner = r;
+      }
+    }
+
+    if(owner == -1)
+    {
+      EXPECT_EQ(result.m_keys[i], (unsigned int) vtkh::DepthImage::EmptyKey);
+      continue;
+    }
+    EXPECT_EQ(result.KeyRank(result.m_keys[i]), owner);
+    EXPECT_NEAR(result.KeyDepth(result.m_keys[i]), closest, 1e-6f);
+  }
+}
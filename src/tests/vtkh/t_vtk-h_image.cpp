@@ -0,0 +1,158 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_image.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/rendering/Image.hpp>
+
+#include <iostream>
+#include <vector>
+
+namespace
+{
+
+vtkm::Bounds MakeBounds(const int x_min, const int x_max,
+                        const int y_min, const int y_max)
+{
+  vtkm::Bounds bounds;
+  bounds.X.Min = x_min;
+  bounds.X.Max = x_max;
+  bounds.Y.Min = y_min;
+  bounds.Y.Max = y_max;
+  return bounds;
+}
+
+// every pixel and depth tells where it is on the screen
+vtkh::Image NumberedImage(const vtkm::Bounds &bounds)
+{
+  vtkh::Image image(bounds);
+  const int dx = bounds.X.Max - bounds.X.Min + 1;
+  const int size = image.GetNumberOfPixels();
+  for(int i = 0; i < size; ++i)
+  {
+    const int x = i % dx + static_cast<int>(bounds.X.Min);
+    const int y = i / dx + static_cast<int>(bounds.Y.Min);
+    image.m_pixels[i * 4 + 0] = static_cast<unsigned char>(x);
+    image.m_pixels[i * 4 + 1] = static_cast<unsigned char>(y);
+    image.m_pixels[i * 4 + 2] = 7;
+    image.m_pixels[i * 4 + 3] = 255;
+    image.m_depths[i] = static_cast<float>(x * 1000 + y) * 1e-6f;
+  }
+  return image;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image, vtkh_pool_reuse)
+{
+  vtkh::Image::SetPoolCapacity(size_t(1) << 30);
+
+  // a recycled buffer is handed to the next image of about its size
+  vtkh::Image first;
+  first.Allocate(10000);
+  const float *depths = &first.m_depths[0];
+  first.Recycle();
+  EXPECT_EQ(first.GetNumberOfPixels(), 0);
+
+  vtkh::Image second;
+  second.Allocate(7000);
+  EXPECT_EQ(&second.m_depths[0], depths);
+  EXPECT_EQ(second.m_depths.size(), 7000u);
+  EXPECT_EQ(second.m_pixels.size(), 7000u * 4);
+
+  // but not to one that would waste most of it
+  second.Recycle();
+  vtkh::Image small;
+  small.Allocate(1000);
+  EXPECT_LT(small.m_depths.capacity(), 10000u);
+
+  // nor to one that does not fit
+  vtkh::Image large;
+  large.Allocate(20000);
+  EXPECT_GE(large.m_depths.capacity(), 20000u);
+  small.Recycle();
+  large.Recycle();
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image, vtkh_pool_capacity)
+{
+  vtkh::Image::SetPoolCapacity(size_t(1) << 30);
+  vtkh::Image first;
+  first.Allocate(30000);
+  first.Recycle();
+
+  // shrinking the pool frees what it holds
+  vtkh::Image::SetPoolCapacity(0);
+  vtkh::Image second;
+  second.Allocate(20000);
+  EXPECT_EQ(second.m_depths.capacity(), 20000u);
+
+  // and buffers larger than the capacity are not kept
+  vtkh::Image big;
+  big.Allocate(30000);
+  big.Recycle();
+  vtkh::Image third;
+  third.Allocate(20000);
+  EXPECT_EQ(third.m_depths.capacity(), 20000u);
+  second.Recycle();
+  third.Recycle();
+
+  vtkh::Image::SetPoolCapacity(size_t(1) << 30);
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image, vtkh_subset_outside)
+{
+  const vtkm::Bounds bounds = MakeBounds(10, 40, 5, 30);
+  vtkh::Image image = NumberedImage(bounds);
+
+  // inside, sticking out on every side, on a corner and missing it
+  const vtkm::Bounds regions[4] = { MakeBounds(12, 20, 6, 9),
+                                    MakeBounds(1, 64, 1, 48),
+                                    MakeBounds(35, 60, 25, 48),
+                                    MakeBounds(41, 64, 1, 48) };
+  for(int r = 0; r < 4; ++r)
+  {
+    const vtkm::Bounds &region = regions[r];
+    vtkh::Image subset;
+    subset.SubsetFrom(image, region);
+    EXPECT_EQ(subset.m_bounds, region);
+
+    const int dx = region.X.Max - region.X.Min + 1;
+    const int size = subset.GetNumberOfPixels();
+    ASSERT_EQ(size, dx * static_cast<int>(region.Y.Max - region.Y.Min + 1));
+    int mismatches = 0;
+    for(int i = 0; i < size; ++i)
+    {
+      const int x = i % dx + static_cast<int>(region.X.Min);
+      const int y = i / dx + static_cast<int>(region.Y.Min);
+      const bool inside = x >= bounds.X.Min && x <= bounds.X.Max &&
+                          y >= bounds.Y.Min && y <= bounds.Y.Max;
+      const unsigned char *pixel = &subset.m_pixels[i * 4];
+      bool match;
+      if(inside)
+      {
+        match = pixel[0] == static_cast<unsigned char>(x) &&
+                pixel[1] == static_cast<unsigned char>(y) &&
+                pixel[2] == 7 && pixel[3] == 255 &&
+                subset.m_depths[i] == static_cast<float>(x * 1000 + y) * 1e-6f;
+      }
+      else
+      {
+        // background
+        match = pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0 && pixel[3] == 0 &&
+                subset.m_depths[i] > 1.f;
+      }
+      if(!match)
+      {
+        mismatches++;
+      }
+    }
+    EXPECT_EQ(mismatches, 0) << "region " << r;
+  }
+}
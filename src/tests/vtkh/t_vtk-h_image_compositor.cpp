@@ -0,0 +1,333 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_image_compositor.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/rendering/ImageCompositor.hpp>
+#include <vtkh/rendering/ImageKernels.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+void RandomPixels(const int size,
+                  std::mt19937 &gen,
+                  std::vector<unsigned char> &pixels,
+                  std::vector<float> &depths)
+{
+  std::uniform_int_distribution<int> color(0, 255);
+  std::uniform_int_distribution<int> depth(0, 1200);
+  pixels.resize(size * 4);
+  depths.resize(size);
+  for(int i = 0; i < size; ++i)
+  {
+    for(int c = 0; c < 4; ++c)
+    {
+      pixels[i * 4 + c] = static_cast<unsigned char>(color(gen));
+    }
+    // mix in some empty pixels with background depth
+    depths[i] = depth(gen) / 1000.f;
+    if(depths[i] > 1.1f)
+    {
+      depths[i] = 2.f;
+    }
+  }
+}
+
+template<typename Kernel>
+double TimeKernel(Kernel kernel, const int reps)
+{
+  auto start = std::chrono::high_resolution_clock::now();
+  for(int r = 0; r < reps; ++r)
+  {
+    kernel();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count() / reps;
+}
+
+vtkm::Bounds MakeBounds(const int x_min, const int x_max,
+                        const int y_min, const int y_max)
+{
+  vtkm::Bounds bounds;
+  bounds.X.Min = x_min;
+  bounds.X.Max = x_max;
+  bounds.Y.Min = y_min;
+  bounds.Y.Max = y_max;
+  return bounds;
+}
+
+//
+// Random translucent (premultiplied) fragments over bounds with some
+// empty pixels and some opaque ones
+//
+vtkh::Image TranslucentImage(const vtkm::Bounds &bounds,
+                             const vtkm::Bounds &orig_bounds,
+                             std::mt19937 &gen)
+{
+  std::uniform_int_distribution<int> value(0, 255);
+  std::uniform_real_distribution<float> depth(0.f, 1.f);
+  vtkh::Image image(bounds);
+  image.m_orig_bounds = orig_bounds;
+  const int size = image.GetNumberOfPixels();
+  for(int i = 0; i < size; ++i)
+  {
+    const int kind = value(gen);
+    if(kind < 40)
+    {
+      continue;
+    }
+    const int alpha = kind > 230 ? 255 : value(gen) / 2 + 1;
+    for(int c = 0; c < 3; ++c)
+    {
+      image.m_pixels[i * 4 + c] = static_cast<unsigned char>(value(gen) * alpha / 255);
+    }
+    image.m_pixels[i * 4 + 3] = static_cast<unsigned char>(alpha);
+    image.m_depths[i] = depth(gen);
+  }
+  return image;
+}
+
+//
+// Sorts the fragments of each pixel by depth and blends them front
+// to back in floating point
+//
+void ReferenceBlend(const std::vector<vtkh::Image> &images,
+                    const vtkm::Bounds &bounds,
+                    std::vector<float> &colors,
+                    std::vector<float> &depths)
+{
+  const int dx = bounds.X.Max - bounds.X.Min + 1;
+  const int dy = bounds.Y.Max - bounds.Y.Min + 1;
+  colors.assign(dx * dy * 4, 0.f);
+  depths.assign(dx * dy, 2.f);
+  for(int y = 0; y < dy; ++y)
+  {
+    for(int x = 0; x < dx; ++x)
+    {
+      const int screen_x = x + bounds.X.Min;
+      const int screen_y = y + bounds.Y.Min;
+      std::vector<std::pair<float,const unsigned char*>> fragments;
+      float min_depth = 2.f;
+      for(size_t i = 0; i < images.size(); ++i)
+      {
+        const vtkm::Bounds &b = images[i].m_bounds;
+        if(screen_x < b.X.Min || screen_x > b.X.Max ||
+           screen_y < b.Y.Min || screen_y > b.Y.Max)
+        {
+          continue;
+        }
+        const int image_dx = b.X.Max - b.X.Min + 1;
+        const int index = (screen_y - b.Y.Min) * image_dx + screen_x - b.X.Min;
+        const float depth = images[i].m_depths[index];
+        const unsigned char *pixel = &images[i].m_pixels[index * 4];
+        min_depth = std::min(min_depth, depth);
+        if(pixel[3] != 0 || depth <= 1.f)
+        {
+          fragments.push_back(std::make_pair(depth, pixel));
+        }
+      }
+      std::stable_sort(fragments.begin(), fragments.end(),
+                       [](const std::pair<float,const unsigned char*> &a,
+                          const std::pair<float,const unsigned char*> &b)
+                       { return a.first < b.first; });
+
+      const int i = y * dx + x;
+      float *color = &colors[i * 4];
+      for(size_t f = 0; f < fragments.size(); ++f)
+      {
+        const float opacity = 1.f - color[3];
+        for(int c = 0; c < 4; ++c)
+        {
+          color[c] += opacity * fragments[f].second[c] / 255.f;
+        }
+      }
+      depths[i] = fragments.size() > 0 ? fragments[0].first : min_depth;
+    }
+  }
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image_compositor, vtkh_image_kernels)
+{
+  using namespace vtkh::detail;
+  // odd size so the vector loops also run their tails
+  const int size = 1024 * 1024 + 7;
+  const int reps = 10;
+  std::mt19937 gen(0);
+
+  std::vector<unsigned char> front, back;
+  std::vector<float> front_depths, back_depths;
+  RandomPixels(size, gen, front, front_depths);
+  RandomPixels(size, gen, back, back_depths);
+  const unsigned char bg_color[4] = {255, 128, 3, 255};
+
+  std::vector<SIMDLevel> levels;
+  levels.push_back(SIMD_SCALAR);
+  if(GetSIMDLevel() != SIMD_SCALAR)
+  {
+    levels.push_back(SIMD_SSE2);
+  }
+  if(GetSIMDLevel() == SIMD_AVX2)
+  {
+    levels.push_back(SIMD_AVX2);
+  }
+  const char *names[3] = {"scalar", "sse2", "avx2"};
+
+  std::vector<unsigned char> ref_blend, ref_zbuffer, ref_bg;
+  std::vector<float> ref_blend_depths, ref_zbuffer_depths;
+
+  for(size_t l = 0; l < levels.size(); ++l)
+  {
+    const SIMDLevel level = levels[l];
+
+    std::vector<unsigned char> blend = front;
+    std::vector<float> blend_depths = front_depths;
+    BlendPixels(&blend[0], &blend_depths[0], &back[0], &back_depths[0], size, level);
+
+    std::vector<unsigned char> zbuffer = front;
+    std::vector<float> zbuffer_depths = front_depths;
+    ZBufferPixels(&zbuffer[0], &zbuffer_depths[0], &back[0], &back_depths[0], size, level);
+
+    std::vector<unsigned char> bg = front;
+    BlendBackgroundPixels(&bg[0], bg_color, size, level);
+
+    if(level == SIMD_SCALAR)
+    {
+      ref_blend = blend;
+      ref_blend_depths = blend_depths;
+      ref_zbuffer = zbuffer;
+      ref_zbuffer_depths = zbuffer_depths;
+      ref_bg = bg;
+    }
+    else
+    {
+      // vector kernels must match the scalar ones exactly
+      EXPECT_TRUE(blend == ref_blend);
+      EXPECT_TRUE(blend_depths == ref_blend_depths);
+      EXPECT_TRUE(zbuffer == ref_zbuffer);
+      EXPECT_TRUE(zbuffer_depths == ref_zbuffer_depths);
+      EXPECT_TRUE(bg == ref_bg);
+    }
+
+    std::vector<unsigned char> pixels = front;
+    std::vector<float> depths = front_depths;
+    double blend_time = TimeKernel([&]()
+    {
+      BlendPixels(&pixels[0], &depths[0], &back[0], &back_depths[0], size, level);
+    }, reps);
+    double zbuffer_time = TimeKernel([&]()
+    {
+      ZBufferPixels(&pixels[0], &depths[0], &back[0], &back_depths[0], size, level);
+    }, reps);
+    double bg_time = TimeKernel([&]()
+    {
+      BlendBackgroundPixels(&pixels[0], bg_color, size, level);
+    }, reps);
+
+    std::cout<<names[level]<<" blend "<<blend_time<<" ms"
+             <<" zbuffer "<<zbuffer_time<<" ms"
+             <<" background "<<bg_time<<" ms\n";
+  }
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image_compositor, vtkh_zbuffer_blend)
+{
+  vtkh::ImageCompositor compositor;
+  const vtkm::Bounds screen = MakeBounds(1, 64, 1, 48);
+
+  // three fragments handed over back to front must be blended front
+  // to back, and an opaque fragment hides everything behind it
+  {
+    const vtkm::Bounds pixels = MakeBounds(5, 6, 7, 7);
+    const unsigned char colors[4][4] = { {0, 0, 200, 255},
+                                         {100, 0, 0, 128},
+                                         {0, 100, 0, 128},
+                                         {10, 20, 30, 255} };
+    const float depths[4] = {0.8f, 0.2f, 0.5f, 0.1f};
+    std::vector<vtkh::Image> images;
+    for(int i = 0; i < 4; ++i)
+    {
+      images.push_back(vtkh::Image(pixels));
+      images[i].m_orig_bounds = screen;
+      std::copy(colors[i], colors[i] + 4, &images[i].m_pixels[0]);
+      images[i].m_depths[0] = depths[i];
+      // the second pixel only has the translucent fragments
+      if(i < 3)
+      {
+        std::copy(colors[i], colors[i] + 4, &images[i].m_pixels[4]);
+        images[i].m_depths[1] = depths[i];
+      }
+    }
+
+    compositor.ZBufferBlend(images);
+    const vtkh::Image &result = images[0];
+    EXPECT_EQ(result.m_bounds, pixels);
+    EXPECT_EQ(result.m_orig_bounds, screen);
+
+    // the opaque fragment in front is all there is
+    EXPECT_EQ(result.m_pixels[0], 10);
+    EXPECT_EQ(result.m_pixels[1], 20);
+    EXPECT_EQ(result.m_pixels[2], 30);
+    EXPECT_EQ(result.m_pixels[3], 255);
+    EXPECT_EQ(result.m_depths[0], 0.1f);
+
+    // red over green over blue
+    EXPECT_EQ(result.m_pixels[4], 100);
+    EXPECT_EQ(result.m_pixels[5], 127 * 100 / 255);
+    EXPECT_EQ(result.m_pixels[6], 64 * 200 / 255);
+    EXPECT_EQ(result.m_pixels[7], 255);
+    EXPECT_EQ(result.m_depths[1], 0.2f);
+  }
+
+  // overlapping translucent images covering different regions
+  std::mt19937 gen(21);
+  const vtkm::Bounds regions[5] = { MakeBounds(1, 40, 1, 30),
+                                    MakeBounds(20, 64, 10, 48),
+                                    MakeBounds(10, 30, 5, 45),
+                                    MakeBounds(35, 50, 1, 20),
+                                    MakeBounds(60, 64, 40, 48) };
+  for(int test = 0; test < 3; ++test)
+  {
+    std::vector<vtkh::Image> images;
+    vtkm::Bounds bounds;
+    for(int i = 0; i < 5; ++i)
+    {
+      images.push_back(TranslucentImage(regions[(i + test) % 5], screen, gen));
+      bounds.Include(images[i].m_bounds);
+    }
+
+    std::vector<float> ref_colors, ref_depths;
+    ReferenceBlend(images, bounds, ref_colors, ref_depths);
+
+    compositor.ZBufferBlend(images);
+    const vtkh::Image &result = images[0];
+    ASSERT_EQ(result.m_bounds, bounds);
+    ASSERT_EQ(result.m_depths.size(), ref_depths.size());
+
+    const int size = result.GetNumberOfPixels();
+    int max_error = 0;
+    for(int i = 0; i < size; ++i)
+    {
+      EXPECT_EQ(result.m_depths[i], ref_depths[i]);
+      for(int c = 0; c < 4; ++c)
+      {
+        const int expected = static_cast<int>(ref_colors[i * 4 + c] * 255.f + 0.5f);
+        max_error = std::max(max_error, std::abs(expected - result.m_pixels[i * 4 + c]));
+      }
+    }
+    // each fragment can truncate a channel by one
+    EXPECT_LE(max_error, 5);
+  }
+}
@@ -0,0 +1,292 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_image_writer.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/utils/ImageWriter.hpp>
+#include <lodepng.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+//
+// Flat areas, gradients, alpha changes and noise, so the qoi writer
+// uses runs, the index, diffs, lumas and full pixels
+//
+void TestImage(const int width,
+               const int height,
+               std::vector<unsigned char> &rgba)
+{
+  std::mt19937 gen(0);
+  std::uniform_int_distribution<int> noise(0, 255);
+  rgba.resize(width * height * 4);
+  for(int y = 0; y < height; ++y)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      unsigned char *pixel = &rgba[(y * width + x) * 4];
+      const int region = (x * 4 / width + y * 4 / height) % 4;
+      if(region == 0)
+      {
+        pixel[0] = 10;
+        pixel[1] = 20;
+        pixel[2] = 30;
+        pixel[3] = 255;
+      }
+      else if(region == 1)
+      {
+        pixel[0] = static_cast<unsigned char>(x);
+        pixel[1] = static_cast<unsigned char>(y * 2);
+        pixel[2] = static_cast<unsigned char>(x + y);
+        pixel[3] = 255;
+      }
+      else if(region == 2)
+      {
+        pixel[0] = static_cast<unsigned char>((x % 3) * 20);
+        pixel[1] = static_cast<unsigned char>((x % 3) * 20);
+        pixel[2] = 0;
+        pixel[3] = static_cast<unsigned char>(y);
+      }
+      else
+      {
+        for(int c = 0; c < 4; ++c)
+        {
+          pixel[c] = static_cast<unsigned char>(noise(gen));
+        }
+      }
+    }
+  }
+}
+
+std::vector<unsigned char> ReadFile(const std::string &filename)
+{
+  std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+  return std::vector<unsigned char>(std::istreambuf_iterator<char>(file),
+                                    std::istreambuf_iterator<char>());
+}
+
+uint32_t GetBigEndian(const unsigned char *p)
+{
+  return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+}
+
+uint32_t GetLittleEndian(const unsigned char *p)
+{
+  return uint32_t(p[3]) << 24 | uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 | p[0];
+}
+
+//
+// Decodes a qoi file into top first rgba, following the spec rather
+// than the writer
+//
+bool DecodeQOI(const std::vector<unsigned char> &data,
+               int &width,
+               int &height,
+               std::vector<unsigned char> &rgba)
+{
+  if(data.size() < 22 || memcmp(&data[0], "qoif", 4) != 0 || data[12] != 4)
+  {
+    return false;
+  }
+  width = static_cast<int>(GetBigEndian(&data[4]));
+  height = static_cast<int>(GetBigEndian(&data[8]));
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  rgba.resize(num_pixels * 4);
+
+  unsigned char index[64][4];
+  memset(index, 0, sizeof(index));
+  unsigned char px[4] = {0, 0, 0, 255};
+  size_t pos = 14;
+  const size_t end = data.size() - 8;
+  int run = 0;
+  for(size_t i = 0; i < num_pixels; ++i)
+  {
+    if(run > 0)
+    {
+      run--;
+    }
+    else
+    {
+      if(pos >= end) return false;
+      const unsigned char op = data[pos++];
+      if(op == 0xfe)
+      {
+        px[0] = data[pos++];
+        px[1] = data[pos++];
+        px[2] = data[pos++];
+      }
+      else if(op == 0xff)
+      {
+        memcpy(px, &data[pos], 4);
+        pos += 4;
+      }
+      else if((op & 0xc0) == 0x00)
+      {
+        memcpy(px, index[op], 4);
+      }
+      else if((op & 0xc0) == 0x40)
+      {
+        px[0] += ((op >> 4) & 3) - 2;
+        px[1] += ((op >> 2) & 3) - 2;
+        px[2] += (op & 3) - 2;
+      }
+      else if((op & 0xc0) == 0x80)
+      {
+        const int dg = (op & 0x3f) - 32;
+        const unsigned char next = data[pos++];
+        px[0] += dg + ((next >> 4) & 0xf) - 8;
+        px[1] += dg;
+        px[2] += dg + (next & 0xf) - 8;
+      }
+      else
+      {
+        run = op & 0x3f;
+      }
+      memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+    }
+    memcpy(&rgba[i * 4], px, 4);
+  }
+  const unsigned char end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  return pos == end && memcmp(&data[end], end_marker, 8) == 0;
+}
+
+// the number of bytes that differ, with expected stored bottom row first
+int CountTopFirstMismatches(const std::vector<unsigned char> &expected,
+                            const unsigned char *actual,
+                            const int width,
+                            const int height,
+                            const int channels)
+{
+  int mismatches = 0;
+  for(int y = 0; y < height; ++y)
+  {
+    const unsigned char *in = &expected[(height - y - 1) * width * 4];
+    const unsigned char *out = actual + y * width * channels;
+    for(int x = 0; x < width; ++x)
+    {
+      for(int c = 0; c < channels; ++c)
+      {
+        if(in[x * 4 + c] != out[x * channels + c]) mismatches++;
+      }
+    }
+  }
+  return mismatches;
+}
+
+} // namespace
+
+const int WIDTH = 67;
+const int HEIGHT = 45;
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image_writer, vtkh_qoi)
+{
+  std::vector<unsigned char> rgba;
+  TestImage(WIDTH, HEIGHT, rgba);
+  auto writer = vtkh::ImageWriter::Create(vtkh::ImageWriter::QOI);
+  EXPECT_EQ(writer->GetExtension(), "qoi");
+  writer->Write(&rgba[0], nullptr, WIDTH, HEIGHT, "image_writer.qoi");
+
+  int width = 0, height = 0;
+  std::vector<unsigned char> decoded;
+  ASSERT_TRUE(DecodeQOI(ReadFile("image_writer.qoi"), width, height, decoded));
+  ASSERT_EQ(width, WIDTH);
+  ASSERT_EQ(height, HEIGHT);
+  EXPECT_EQ(CountTopFirstMismatches(rgba, &decoded[0], WIDTH, HEIGHT, 4), 0);
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image_writer, vtkh_ppm)
+{
+  std::vector<unsigned char> rgba;
+  TestImage(WIDTH, HEIGHT, rgba);
+  auto writer = vtkh::ImageWriter::Create(vtkh::ImageWriter::PPM);
+  EXPECT_EQ(writer->GetExtension(), "ppm");
+  writer->Write(&rgba[0], nullptr, WIDTH, HEIGHT, "image_writer.ppm");
+
+  const std::vector<unsigned char> data = ReadFile("image_writer.ppm");
+  const std::string header = "P6\n" + std::to_string(WIDTH) + " " +
+                             std::to_string(HEIGHT) + "\n255\n";
+  ASSERT_EQ(data.size(), header.size() + WIDTH * HEIGHT * 3);
+  EXPECT_EQ(std::string(data.begin(), data.begin() + header.size()), header);
+  // rgb only, top row first
+  EXPECT_EQ(CountTopFirstMismatches(rgba, &data[header.size()], WIDTH, HEIGHT, 3), 0);
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image_writer, vtkh_raw)
+{
+  std::vector<unsigned char> rgba;
+  TestImage(WIDTH, HEIGHT, rgba);
+  std::vector<float> depth(WIDTH * HEIGHT);
+  for(size_t i = 0; i < depth.size(); ++i)
+  {
+    depth[i] = static_cast<float>(i) * 0.25f - 3.f;
+  }
+
+  auto writer = vtkh::ImageWriter::Create(vtkh::ImageWriter::RAW);
+  EXPECT_EQ(writer->GetExtension(), "raw");
+  EXPECT_TRUE(writer->SavesDepth());
+  writer->Write(&rgba[0], &depth[0], WIDTH, HEIGHT, "image_writer.raw");
+  writer->Write(&rgba[0], nullptr, WIDTH, HEIGHT, "image_writer_no_depth.raw");
+
+  const std::vector<unsigned char> data = ReadFile("image_writer.raw");
+  const size_t num_pixels = WIDTH * HEIGHT;
+  ASSERT_EQ(data.size(), 32 + num_pixels * 4 + num_pixels * 4);
+  EXPECT_EQ(memcmp(&data[0], "VTKHRAW\0", 8), 0);
+  EXPECT_EQ(GetLittleEndian(&data[8]), 1u);
+  EXPECT_EQ(GetLittleEndian(&data[12]), (uint32_t) WIDTH);
+  EXPECT_EQ(GetLittleEndian(&data[16]), (uint32_t) HEIGHT);
+  EXPECT_EQ(GetLittleEndian(&data[20]), 4u);
+  EXPECT_EQ(GetLittleEndian(&data[24]), 1u);
+  EXPECT_EQ(GetLittleEndian(&data[28]), 0u);
+  // rows stay bottom first
+  EXPECT_EQ(memcmp(&data[32], &rgba[0], num_pixels * 4), 0);
+
+  int mismatches = 0;
+  const unsigned char *depth_bytes = &data[32 + num_pixels * 4];
+  for(size_t i = 0; i < num_pixels; ++i)
+  {
+    const uint32_t bits = GetLittleEndian(depth_bytes + i * 4);
+    float value;
+    memcpy(&value, &bits, 4);
+    if(value != depth[i]) mismatches++;
+  }
+  EXPECT_EQ(mismatches, 0);
+
+  const std::vector<unsigned char> no_depth = ReadFile("image_writer_no_depth.raw");
+  ASSERT_EQ(no_depth.size(), 32 + num_pixels * 4);
+  EXPECT_EQ(GetLittleEndian(&no_depth[24]), 0u);
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_image_writer, vtkh_png)
+{
+  std::vector<unsigned char> rgba;
+  TestImage(WIDTH, HEIGHT, rgba);
+  auto writer = vtkh::ImageWriter::Create(vtkh::ImageWriter::PNG);
+  EXPECT_EQ(writer->GetExtension(), "png");
+  EXPECT_FALSE(writer->SavesDepth());
+  writer->Write(&rgba[0], nullptr, WIDTH, HEIGHT, "image_writer.png");
+
+  unsigned char *decoded = nullptr;
+  unsigned width, height;
+  const unsigned error = lodepng_decode32_file(&decoded, &width, &height, "image_writer.png");
+  ASSERT_EQ(error, 0u) << lodepng_error_text(error);
+  ASSERT_EQ(width, (unsigned) WIDTH);
+  ASSERT_EQ(height, (unsigned) HEIGHT);
+  EXPECT_EQ(CountTopFirstMismatches(rgba, decoded, WIDTH, HEIGHT, 4), 0);
+  free(decoded);
+}
@@ -0,0 +1,186 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_macrocell_grid.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/vtkh.hpp>
+#include <vtkh/rendering/MacrocellGrid.hpp>
+
+#include <vtkm/cont/ArrayHandleUniformPointCoordinates.h>
+#include <vtkm/cont/CellSetStructured.h>
+
+#include <string>
+
+namespace
+{
+
+// 3 x 2 x 1 macrocells, the last ones partly filled along x and y
+const vtkm::Id3 cell_dims(20, 13, 8);
+const vtkm::Vec<vtkm::FloatDefault,3> origin(1.f, 2.f, 3.f);
+const vtkm::Vec<vtkm::FloatDefault,3> spacing(0.5f, 1.f, 2.f);
+
+vtkm::Id Index(const vtkm::Id3 &ijk, const vtkm::Id3 &dims)
+{
+  return (ijk[2] * dims[1] + ijk[1]) * dims[0] + ijk[0];
+}
+
+//
+// A uniform grid with a point field that is 0 except for 1 at
+// hot_point, and a cell field that is 0 except for 1 at hot_cell.
+// Neither hot spot is on a face shared by two macrocells.
+//
+vtkm::cont::DataSet CreateGrid(const vtkm::Id3 &hot_point, const vtkm::Id3 &hot_cell)
+{
+  const vtkm::Id3 point_dims = cell_dims + vtkm::Id3(1, 1, 1);
+  vtkm::cont::DataSet data_set;
+  data_set.AddCoordinateSystem(
+    vtkm::cont::CoordinateSystem("coords", point_dims, origin, spacing));
+  vtkm::cont::CellSetStructured<3> cellset("cells");
+  cellset.SetPointDimensions(point_dims);
+  data_set.AddCellSet(cellset);
+
+  vtkm::cont::ArrayHandle<vtkm::Float32> point_values;
+  point_values.Allocate(point_dims[0] * point_dims[1] * point_dims[2]);
+  for(vtkm::Id i = 0; i < point_values.GetNumberOfValues(); ++i)
+  {
+    point_values.GetPortalControl().Set(i, 0.f);
+  }
+  point_values.GetPortalControl().Set(Index(hot_point, point_dims), 1.f);
+  data_set.AddField(vtkm::cont::Field("point_data",
+                                      vtkm::cont::Field::Association::POINTS,
+                                      point_values));
+
+  vtkm::cont::ArrayHandle<vtkm::Float64> cell_values;
+  cell_values.Allocate(cell_dims[0] * cell_dims[1] * cell_dims[2]);
+  for(vtkm::Id i = 0; i < cell_values.GetNumberOfValues(); ++i)
+  {
+    cell_values.GetPortalControl().Set(i, 0.);
+  }
+  cell_values.GetPortalControl().Set(Index(hot_cell, cell_dims), 1.);
+  data_set.AddField(vtkm::cont::Field("cell_data",
+                                      vtkm::cont::Field::Association::CELL_SET,
+                                      "cells",
+                                      cell_values));
+  return data_set;
+}
+
+struct AboveHalf
+{
+  bool operator()(const vtkm::Float64 min, const vtkm::Float64 max) const
+  {
+    (void) min;
+    return max > 0.5;
+  }
+};
+
+struct Nothing
+{
+  bool operator()(const vtkm::Float64, const vtkm::Float64) const
+  {
+    return false;
+  }
+};
+
+//
+// The crop has the box of cells from cell_min to cell_max, placed where
+// they were, and the values of the field there
+//
+template<typename T>
+void CheckCrop(const vtkm::cont::DataSet &domain,
+               const vtkm::cont::DataSet &crop,
+               const std::string &field_name,
+               const bool points,
+               const vtkm::Id3 &cell_min,
+               const vtkm::Id3 &cell_max)
+{
+  const vtkm::Id3 crop_cells = cell_max - cell_min + vtkm::Id3(1, 1, 1);
+  vtkm::cont::CellSetStructured<3> cellset;
+  crop.GetCellSet().CopyTo(cellset);
+  EXPECT_EQ(cellset.GetPointDimensions(), crop_cells + vtkm::Id3(1, 1, 1));
+
+  const vtkm::Bounds bounds = crop.GetCoordinateSystem().GetBounds();
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    const vtkm::Range axis_range = axis == 0 ? bounds.X : (axis == 1 ? bounds.Y : bounds.Z);
+    EXPECT_NEAR(axis_range.Min, origin[axis] + cell_min[axis] * spacing[axis], 1e-5);
+    EXPECT_NEAR(axis_range.Max, origin[axis] + (cell_max[axis] + 1) * spacing[axis], 1e-5);
+  }
+
+  const vtkm::Id3 extra = points ? vtkm::Id3(1, 1, 1) : vtkm::Id3(0, 0, 0);
+  const vtkm::Id3 in_dims = cell_dims + extra;
+  const vtkm::Id3 out_dims = crop_cells + extra;
+  auto in = domain.GetField(field_name).GetData()
+              .Cast<vtkm::cont::ArrayHandle<T>>().GetPortalConstControl();
+  auto out = crop.GetField(field_name).GetData()
+               .Cast<vtkm::cont::ArrayHandle<T>>().GetPortalConstControl();
+  ASSERT_EQ(out.GetNumberOfValues(), out_dims[0] * out_dims[1] * out_dims[2]);
+  int mismatches = 0;
+  for(vtkm::Id k = 0; k < out_dims[2]; ++k)
+    for(vtkm::Id j = 0; j < out_dims[1]; ++j)
+      for(vtkm::Id i = 0; i < out_dims[0]; ++i)
+      {
+        const vtkm::Id3 ijk(i, j, k);
+        if(out.Get(Index(ijk, out_dims)) != in.Get(Index(ijk + cell_min, in_dims)))
+        {
+          mismatches++;
+        }
+      }
+  EXPECT_EQ(mismatches, 0);
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+TEST(vtkh_macrocell_grid, vtkh_point_field)
+{
+  // in the macrocell of cells (16-19, 0-7, 0-7)
+  const vtkm::Id3 hot_point(18, 5, 3);
+  vtkm::cont::DataSet domain = CreateGrid(hot_point, vtkm::Id3(0, 0, 0));
+
+  vtkh::MacrocellGrid grid;
+  ASSERT_TRUE(grid.Build(domain, "point_data"));
+  EXPECT_TRUE(grid.IsBuiltFrom(domain, "point_data"));
+  EXPECT_FALSE(grid.IsBuiltFrom(domain, "cell_data"));
+  EXPECT_EQ(grid.GetCellDims(), cell_dims);
+
+  vtkm::Id3 cell_min, cell_max;
+  EXPECT_FALSE(grid.FindVisibleCells(Nothing(), cell_min, cell_max));
+  ASSERT_TRUE(grid.FindVisibleCells(AboveHalf(), cell_min, cell_max));
+  EXPECT_EQ(cell_min, vtkm::Id3(16, 0, 0));
+  EXPECT_EQ(cell_max, vtkm::Id3(19, 7, 7));
+
+  vtkm::cont::DataSet crop = vtkh::MacrocellGrid::Crop(domain, "point_data", cell_min, cell_max);
+  CheckCrop<vtkm::Float32>(domain, crop, "point_data", true, cell_min, cell_max);
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_macrocell_grid, vtkh_cell_field)
+{
+  // in the macrocell of cells (8-15, 8-12, 0-7)
+  const vtkm::Id3 hot_cell(10, 12, 6);
+  vtkm::cont::DataSet domain = CreateGrid(vtkm::Id3(0, 0, 0), hot_cell);
+
+  vtkh::MacrocellGrid grid;
+  ASSERT_TRUE(grid.Build(domain, "cell_data"));
+
+  vtkm::Id3 cell_min, cell_max;
+  ASSERT_TRUE(grid.FindVisibleCells(AboveHalf(), cell_min, cell_max));
+  EXPECT_EQ(cell_min, vtkm::Id3(8, 8, 0));
+  EXPECT_EQ(cell_max, vtkm::Id3(15, 12, 7));
+
+  vtkm::cont::DataSet crop = vtkh::MacrocellGrid::Crop(domain, "cell_data", cell_min, cell_max);
+  CheckCrop<vtkm::Float64>(domain, crop, "cell_data", false, cell_min, cell_max);
+
+  // a box of several macrocells
+  ASSERT_TRUE(grid.FindVisibleCells([](const vtkm::Float64 min, const vtkm::Float64)
+                                    {
+                                      return min < 0.5;
+                                    },
+                                    cell_min,
+                                    cell_max));
+  EXPECT_EQ(cell_min, vtkm::Id3(0, 0, 0));
+  EXPECT_EQ(cell_max, cell_dims - vtkm::Id3(1, 1, 1));
+}
@@ -0,0 +1,159 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_png_encoder.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/utils/PNGEncoder.hpp>
+#include <lodepng.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace
+{
+
+//
+// Smooth gradients, flat areas, repeated patterns and noise, so every
+// filter and both literals and matches show up in the streams
+//
+void TestImage(const int width,
+               const int height,
+               std::mt19937 &gen,
+               std::vector<unsigned char> &rgba)
+{
+  std::uniform_int_distribution<int> noise(0, 255);
+  rgba.resize(width * height * 4);
+  for(int y = 0; y < height; ++y)
+  {
+    for(int x = 0; x < width; ++x)
+    {
+      unsigned char *pixel = &rgba[(y * width + x) * 4];
+      const int region = (x * 4 / width + y * 4 / height) % 4;
+      if(region == 0)
+      {
+        pixel[0] = static_cast<unsigned char>(x);
+        pixel[1] = static_cast<unsigned char>(y);
+        pixel[2] = static_cast<unsigned char>(x + y);
+        pixel[3] = 255;
+      }
+      else if(region == 1)
+      {
+        pixel[0] = 12;
+        pixel[1] = 34;
+        pixel[2] = 56;
+        pixel[3] = 78;
+      }
+      else if(region == 2)
+      {
+        pixel[0] = static_cast<unsigned char>((x % 7) * 30);
+        pixel[1] = static_cast<unsigned char>((y % 5) * 50);
+        pixel[2] = static_cast<unsigned char>((x % 3) * 80);
+        pixel[3] = 200;
+      }
+      else
+      {
+        for(int c = 0; c < 4; ++c)
+        {
+          pixel[c] = static_cast<unsigned char>(noise(gen));
+        }
+      }
+    }
+  }
+}
+
+//
+// Encodes and decodes with lodepng, which checks the crcs, the zlib
+// header and the adler32 of the stream along the way
+//
+void CheckRoundTrip(const std::vector<unsigned char> &rgba,
+                    const int width,
+                    const int height,
+                    const int level,
+                    const vtkh::PNGEncoder::FilterStrategy strategy)
+{
+  vtkh::PNGEncoder encoder;
+  encoder.SetCompressionLevel(level);
+  encoder.SetFilterStrategy(strategy);
+  encoder.Encode(&rgba[0], width, height);
+  ASSERT_NE(encoder.PngBuffer(), nullptr);
+
+  unsigned char *decoded = nullptr;
+  unsigned decoded_width, decoded_height;
+  const unsigned error =
+    lodepng_decode32(&decoded,
+                     &decoded_width,
+                     &decoded_height,
+                     static_cast<const unsigned char*>(encoder.PngBuffer()),
+                     encoder.PngBufferSize());
+  ASSERT_EQ(error, 0u) << lodepng_error_text(error)
+                       << " level " << level << " filter " << strategy
+                       << " size " << width << "x" << height;
+  ASSERT_EQ(decoded_width, (unsigned) width);
+  ASSERT_EQ(decoded_height, (unsigned) height);
+
+  // the encoder input is bottom row first
+  int mismatches = 0;
+  const int stride = width * 4;
+  for(int y = 0; y < height; ++y)
+  {
+    const unsigned char *expected = &rgba[(height - y - 1) * stride];
+    const unsigned char *actual = decoded + y * stride;
+    for(int i = 0; i < stride; ++i)
+    {
+      if(expected[i] != actual[i])
+      {
+        mismatches++;
+      }
+    }
+  }
+  free(decoded);
+  EXPECT_EQ(mismatches, 0) << " level " << level << " filter " << strategy
+                           << " size " << width << "x" << height;
+}
+
+} // namespace
+
+//----------------------------------------------------------------------------
+TEST(vtkh_png_encoder, vtkh_round_trip)
+{
+  //
+  // Rows are deflated in chunks of about 256 KiB of filtered bytes,
+  // so these give single rows, a single chunk, a chunk that ends
+  // exactly at the last row, and several chunks with a short one last
+  //
+  const int sizes[6][2] = { {1, 1},
+                            {7, 3},
+                            {1024, 63},
+                            {1024, 64},
+                            {1024, 200},
+                            {300, 1000} };
+  const vtkh::PNGEncoder::FilterStrategy strategies[6] =
+    { vtkh::PNGEncoder::FILTER_NONE,
+      vtkh::PNGEncoder::FILTER_SUB,
+      vtkh::PNGEncoder::FILTER_UP,
+      vtkh::PNGEncoder::FILTER_AVERAGE,
+      vtkh::PNGEncoder::FILTER_PAETH,
+      vtkh::PNGEncoder::FILTER_ADAPTIVE };
+
+  std::mt19937 gen(0);
+  for(int s = 0; s < 6; ++s)
+  {
+    const int width = sizes[s][0];
+    const int height = sizes[s][1];
+    std::vector<unsigned char> rgba;
+    TestImage(width, height, gen, rgba);
+    for(int level = 0; level <= 9; ++level)
+    {
+      for(int f = 0; f < 6; ++f)
+      {
+        CheckRoundTrip(rgba, width, height, level, strategies[f]);
+      }
+    }
+  }
+}
+
@@ -12,7 +12,9 @@
 #include <vtkh/rendering/Scene.hpp>
 #include "t_test_utils.hpp"
 
+#include <cstring>
 #include <iostream>
+#include <vector>
 
 
 
@@ -49,3 +51,86 @@ TEST(vtkh_raytracer, vtkh_serial_render)
   scene.AddRenderer(&tracer);
   scene.Render();
 }
+
+//----------------------------------------------------------------------------
+void RenderCameras(vtkh::DataSet &data_set,
+                   const int num_threads,
+                   std::vector<vtkh::Render> &renders)
+{
+  vtkm::Bounds bounds = data_set.GetGlobalBounds();
+  renders.clear();
+  for(int i = 0; i < 6; ++i)
+  {
+    vtkm::rendering::Camera camera;
+    camera.SetPosition(vtkm::Vec<vtkm::Float64,3>(-16, -16, -16));
+    camera.ResetToBounds(bounds);
+    camera.Azimuth(60.f * i);
+    if(i % 2 == 1)
+    {
+      // close enough that some domains are off screen
+      camera.Zoom(2.f);
+    }
+    renders.push_back(vtkh::MakeRender(256, 
+                                       256, 
+                                       camera, 
+                                       data_set, 
+                                       "ray_tracer_threads"));
+  }
+
+  vtkh::RayTracer tracer;
+  tracer.SetInput(&data_set);
+  tracer.SetField("point_data"); 
+  tracer.SetRenders(renders);
+  tracer.SetRenderThreads(num_threads);
+  // the canvases are compared before anything is composited
+  tracer.SetDoComposite(false);
+  tracer.Update();
+  renders = tracer.GetRenders();
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_raytracer, vtkh_render_threads)
+{
+  vtkh::DataSet data_set;
+ 
+  const int base_size = 32;
+  const int num_blocks = 4; 
+  
+  for(int i = 0; i < num_blocks; ++i)
+  {
+    data_set.AddDomain(CreateTestData(i, num_blocks, base_size), i);
+  }
+
+  std::vector<vtkh::Render> serial, threaded;
+  RenderCameras(data_set, 1, serial);
+  RenderCameras(data_set, 4, threaded);
+
+  ASSERT_EQ(serial.size(), threaded.size());
+  for(size_t i = 0; i < serial.size(); ++i)
+  {
+    ASSERT_EQ(serial[i].GetNumberOfCanvases(), threaded[i].GetNumberOfCanvases());
+    for(int c = 0; c < serial[i].GetNumberOfCanvases(); ++c)
+    {
+      auto serial_colors = serial[i].GetCanvas(c)->GetColorBuffer().GetPortalConstControl();
+      auto serial_depths = serial[i].GetCanvas(c)->GetDepthBuffer().GetPortalConstControl();
+      auto colors = threaded[i].GetCanvas(c)->GetColorBuffer().GetPortalConstControl();
+      auto depths = threaded[i].GetCanvas(c)->GetDepthBuffer().GetPortalConstControl();
+      ASSERT_EQ(serial_colors.GetNumberOfValues(), colors.GetNumberOfValues());
+
+      // bit for bit the same images
+      int mismatches = 0;
+      for(vtkm::Id p = 0; p < colors.GetNumberOfValues(); ++p)
+      {
+        const vtkm::Vec<vtkm::Float32,4> a = serial_colors.Get(p);
+        const vtkm::Vec<vtkm::Float32,4> b = colors.Get(p);
+        const vtkm::Float32 da = serial_depths.Get(p);
+        const vtkm::Float32 db = depths.Get(p);
+        if(memcmp(&a, &b, sizeof(a)) != 0 || memcmp(&da, &db, sizeof(da)) != 0)
+        {
+          mismatches++;
+        }
+      }
+      EXPECT_EQ(mismatches, 0);
+    }
+  }
+}
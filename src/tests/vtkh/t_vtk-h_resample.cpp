@@ -0,0 +1,231 @@
+//-----------------------------------------------------------------------------
+///
+/// file: t_vtk-h_resample.cpp
+///
+//-----------------------------------------------------------------------------
+
+#include "gtest/gtest.h"
+
+#include <vtkh/vtkh.hpp>
+#include <vtkh/DataSet.hpp>
+#include <vtkh/filters/Resample.hpp>
+#include <vtkh/filters/Threshold.hpp>
+#include <vtkh/rendering/VolumeRenderer.hpp>
+#include <vtkh/rendering/Scene.hpp>
+#include "t_test_utils.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+
+//
+// Volume renders the data from straight above (x, y) with a narrow
+// view, and returns the colors of every pixel before compositing
+//
+std::vector<float> RenderColumn(vtkh::DataSet &data_set,
+                                const vtkm::Float64 x,
+                                const vtkm::Float64 y,
+                                const vtkm::cont::ColorTable *color_table)
+{
+  vtkm::rendering::Camera camera;
+  camera.SetPosition(vtkm::Vec<vtkm::Float64,3>(x, y, 200.));
+  camera.SetLookAt(vtkm::Vec<vtkm::Float64,3>(x, y, 16.));
+  camera.SetViewUp(vtkm::Vec<vtkm::Float64,3>(0., 1., 0.));
+  camera.SetFieldOfView(1.f);
+  camera.SetClippingRange(1., 1000.);
+  std::vector<vtkh::Render> renders;
+  renders.push_back(vtkh::MakeRender(32, 32, camera, data_set, "resample_holes"));
+
+  vtkh::VolumeRenderer tracer;
+  tracer.SetInput(&data_set);
+  tracer.SetField("point_data");
+  if(color_table != nullptr)
+  {
+    tracer.SetColorTable(*color_table);
+  }
+  // every column is sampled, whatever the transfer function
+  tracer.SetEmptySpaceSkipping(false);
+  tracer.SetRenders(renders);
+  tracer.SetDoComposite(false);
+  tracer.Update();
+  renders = tracer.GetRenders();
+
+  auto colors = renders[0].GetCanvas(0)->GetColorBuffer().GetPortalConstControl();
+  std::vector<float> values;
+  for(vtkm::Id i = 0; i < colors.GetNumberOfValues(); ++i)
+  {
+    for(int c = 0; c < 4; ++c)
+    {
+      values.push_back(colors.Get(i)[c]);
+    }
+  }
+  return values;
+}
+
+} // namespace
+
+
+//----------------------------------------------------------------------------
+TEST(vtkh_resample, vtkh_serial_resample)
+{
+  vtkh::DataSet data_set;
+
+  const int base_size = 32;
+  const int num_blocks = 2;
+
+  for(int i = 0; i < num_blocks; ++i)
+  {
+    data_set.AddDomain(CreateTestData(i, num_blocks, base_size), i);
+  }
+
+  // threshold makes explicit cell sets to resample
+  vtkh::Threshold thresher;
+  thresher.SetInput(&data_set);
+  thresher.SetField("point_data");
+  thresher.SetUpperThreshold((float)base_size * (float)num_blocks * 0.5f);
+  thresher.SetLowerThreshold(0.);
+  thresher.Update();
+  vtkh::DataSet *unstructured = thresher.GetOutput();
+
+  vtkh::Resample resampler;
+  resampler.SetInput(unstructured);
+  resampler.SetField("point_data");
+  resampler.SetDimensions(vtkm::Id3(32, 32, 32));
+  resampler.Update();
+  vtkh::DataSet *output = resampler.GetOutput();
+
+  // one grid for all of the explicit domains
+  EXPECT_EQ(output->GetNumberOfDomains(), 1);
+  int topo_dims;
+  EXPECT_TRUE(output->IsStructured(topo_dims));
+  EXPECT_EQ(topo_dims, 3);
+
+  vtkm::cont::DataSet grid = output->GetDomain(0);
+  EXPECT_EQ(grid.GetCellSet().GetNumberOfPoints(), 32 * 32 * 32);
+  vtkm::Range in_range = unstructured->GetGlobalRange("point_data").GetPortalControl().Get(0);
+  vtkm::Range out_range = output->GetGlobalRange("point_data").GetPortalControl().Get(0);
+  EXPECT_LE(out_range.Max, in_range.Max + 1e-3);
+
+  // the grid knows the range of the samples inside cells, and the
+  // samples outside every cell are below it
+  const std::string valid_name = vtkh::Resample::GetValidRangeName("point_data");
+  ASSERT_TRUE(grid.HasField(valid_name));
+  vtkm::Range valid_range = output->GetGlobalRange(valid_name).GetPortalControl().Get(0);
+  EXPECT_EQ(valid_range.Min, in_range.Min);
+  EXPECT_EQ(valid_range.Max, in_range.Max);
+
+  vtkm::cont::ArrayHandle<vtkm::Float32> samples;
+  grid.GetField("point_data").GetData().CopyTo(samples);
+  auto portal = samples.GetPortalConstControl();
+  int holes = 0;
+  int outside = 0;
+  for(vtkm::Id i = 0; i < portal.GetNumberOfValues(); ++i)
+  {
+    const vtkm::Float64 value = portal.Get(i);
+    if(value < in_range.Min - 0.5 * in_range.Length())
+    {
+      holes++;
+    }
+    else if(value < in_range.Min - 1e-3 || value > in_range.Max + 1e-3)
+    {
+      outside++;
+    }
+  }
+  EXPECT_GT(holes, 0);
+  EXPECT_EQ(outside, 0);
+
+  // the second update reuses the cell locations
+  vtkh::Resample again;
+  again.SetInput(unstructured);
+  again.SetField("point_data");
+  again.SetDimensions(vtkm::Id3(32, 32, 32));
+  again.Update();
+  vtkh::DataSet *cached = again.GetOutput();
+  vtkm::Range cached_range = cached->GetGlobalRange("point_data").GetPortalControl().Get(0);
+  EXPECT_EQ(cached_range.Min, out_range.Min);
+  EXPECT_EQ(cached_range.Max, out_range.Max);
+
+  vtkm::Bounds bounds = output->GetGlobalBounds();
+  vtkm::rendering::Camera camera;
+  camera.SetPosition(vtkm::Vec<vtkm::Float64,3>(-16, -16, -16));
+  camera.ResetToBounds(bounds);
+  vtkh::Render render = vtkh::MakeRender(512,
+                                         512,
+                                         camera,
+                                         *output,
+                                         "resample_volume");
+  vtkh::VolumeRenderer tracer;
+  tracer.SetInput(output);
+  tracer.SetField("point_data");
+
+  vtkh::Scene scene;
+  scene.AddRender(render);
+  scene.AddRenderer(&tracer);
+  scene.Render();
+
+  vtkh::Resample::ClearLocatorCache();
+  delete cached;
+  delete output;
+  delete unstructured;
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_resample, vtkh_resample_holes)
+{
+  vtkh::DataSet data_set;
+  const int base_size = 32;
+  const int num_blocks = 2;
+  for(int i = 0; i < num_blocks; ++i)
+  {
+    data_set.AddDomain(CreateTestData(i, num_blocks, base_size), i);
+  }
+
+  // keeps the cells within about 32 of the origin
+  vtkh::Threshold thresher;
+  thresher.SetInput(&data_set);
+  thresher.SetField("point_data");
+  thresher.SetUpperThreshold((float)base_size);
+  thresher.SetLowerThreshold(0.);
+  thresher.Update();
+  vtkh::DataSet *unstructured = thresher.GetOutput();
+
+  vtkh::Resample resampler;
+  resampler.SetInput(unstructured);
+  resampler.SetField("point_data");
+  resampler.SetDimensions(vtkm::Id3(32, 32, 32));
+  resampler.Update();
+  vtkh::DataSet *output = resampler.GetOutput();
+
+  // only the largest values of the field are visible, so the column
+  // above (28, 28), which only goes through the holes in the corner of
+  // the grid, is sampled without drawing anything
+  vtkm::cont::ColorTable top_only("Cool to Warm");
+  top_only.AddPointAlpha(0., 0.f);
+  top_only.AddPointAlpha(.98, 0.f);
+  top_only.AddPointAlpha(1., 1.f);
+  std::vector<float> nothing = RenderColumn(*output, 28., 28., &top_only);
+
+  // the default transfer function is not transparent anywhere, but
+  // the holes are
+  EXPECT_EQ(RenderColumn(*output, 28., 28., nullptr), nothing);
+  EXPECT_NE(RenderColumn(*output, 4., 4., nullptr), nothing);
+
+  // holes given the minimum of the field are drawn like it
+  vtkh::Resample min_fill;
+  min_fill.SetInput(unstructured);
+  min_fill.SetField("point_data");
+  min_fill.SetDimensions(vtkm::Id3(32, 32, 32));
+  min_fill.SetInvalidValue(
+    unstructured->GetGlobalRange("point_data").GetPortalControl().Get(0).Min);
+  min_fill.Update();
+  vtkh::DataSet *filled = min_fill.GetOutput();
+  EXPECT_NE(RenderColumn(*filled, 28., 28., nullptr), nothing);
+
+  vtkh::Resample::ClearLocatorCache();
+  delete filled;
+  delete output;
+  delete unstructured;
+}
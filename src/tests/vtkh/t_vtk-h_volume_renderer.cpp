@@ -12,7 +12,61 @@
 #include <vtkh/rendering/VolumeRenderer.hpp>
 #include "t_test_utils.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
+
+namespace
+{
+
+//
+// Exposes the visibility ordering, and sorts the domains of the input
+// from scratch to check it against
+//
+class VisOrderRenderer : public vtkh::VolumeRenderer
+{
+public:
+  std::vector<std::vector<int>> FindOrders()
+  {
+    FindVisibilityOrdering();
+    return m_visibility_orders;
+  }
+
+  std::vector<int> FreshOrder(const vtkm::rendering::Camera &camera) const
+  {
+    const int num_domains = static_cast<int>(m_input->GetNumberOfDomains());
+    std::vector<float> depths(num_domains);
+    std::vector<int> order(num_domains);
+    for(int dom = 0; dom < num_domains; ++dom)
+    {
+      depths[dom] = FindMinDepth(camera, m_input->GetDomainBounds(dom));
+      order[dom] = dom;
+    }
+    std::stable_sort(order.begin(), order.end(), [&depths](const int lhs, const int rhs)
+    {
+      return depths[lhs] < depths[rhs];
+    });
+    std::vector<int> vis_order(num_domains);
+    for(int i = 0; i < num_domains; ++i)
+    {
+      vis_order[order[i]] = i;
+    }
+    return vis_order;
+  }
+};
+
+vtkm::rendering::Camera LookAt(const vtkm::Bounds &bounds,
+                               const vtkm::Vec<vtkm::Float64,3> &position)
+{
+  vtkm::rendering::Camera camera;
+  camera.ResetToBounds(bounds);
+  camera.SetPosition(position);
+  camera.SetLookAt(bounds.Center());
+  camera.SetViewUp(vtkm::Vec<vtkm::Float64,3>(0., 0., 1.));
+  return camera;
+}
+
+} // namespace
 
 
 
@@ -59,3 +113,89 @@ TEST(vtkh_volume_renderer, vtkh_parallel_render)
   scene.AddRenderer(&tracer);
   scene.Render();
 }
+
+//----------------------------------------------------------------------------
+TEST(vtkh_volume_renderer, vtkh_on_screen)
+{
+  vtkh::DataSet data_set;
+  data_set.AddDomain(CreateTestData(0, 1, 16), 0);
+  const vtkm::Bounds bounds = data_set.GetGlobalBounds();
+
+  vtkm::rendering::Camera camera;
+  camera.ResetToBounds(bounds);
+  vtkh::Render render = vtkh::MakeRender(64, 64, camera, data_set, "on_screen");
+
+  EXPECT_TRUE(render.IsOnScreen(bounds));
+  // a box well to the side of the view
+  vtkm::Bounds side = bounds;
+  side.X.Min += 100. * bounds.X.Length();
+  side.X.Max += 100. * bounds.X.Length();
+  EXPECT_FALSE(render.IsOnScreen(side));
+  // a box behind the camera
+  const vtkm::Vec<vtkm::Float32,3> position = camera.GetPosition();
+  const vtkm::Vec<vtkm::Float32,3> look_at = camera.GetLookAt();
+  const vtkm::Vec<vtkm::Float32,3> behind = position + (position - look_at) * 2.f;
+  const vtkm::Bounds behind_bounds(behind[0] - 1., behind[0] + 1.,
+                                   behind[1] - 1., behind[1] + 1.,
+                                   behind[2] - 1., behind[2] + 1.);
+  EXPECT_FALSE(render.IsOnScreen(behind_bounds));
+  // a box that only reaches into the view
+  vtkm::Bounds partial = side;
+  partial.X.Min = bounds.X.Max - 1.;
+  EXPECT_TRUE(render.IsOnScreen(partial));
+}
+
+//----------------------------------------------------------------------------
+TEST(vtkh_volume_renderer, vtkh_visibility_order_cache)
+{
+  const int num_blocks = 4;
+  vtkh::DataSet data_set;
+  for(int i = 0; i < num_blocks; ++i)
+  {
+    data_set.AddDomain(CreateTestData(i, num_blocks, 8), i);
+  }
+  const vtkm::Bounds bounds = data_set.GetGlobalBounds();
+  const vtkm::Vec<vtkm::Float64,3> center = bounds.Center();
+  const vtkm::Float64 far = 4. * bounds.X.Length();
+
+  std::vector<vtkm::rendering::Camera> cameras;
+  cameras.push_back(LookAt(bounds, center + vtkm::Vec<vtkm::Float64,3>(-far, -0.5 * far, 1.)));
+  cameras.push_back(LookAt(bounds, center + vtkm::Vec<vtkm::Float64,3>(far, 0.5 * far, 1.)));
+  cameras.push_back(LookAt(bounds, center + vtkm::Vec<vtkm::Float64,3>(0.3 * far, -far, 1.)));
+
+  VisOrderRenderer renderer;
+  renderer.SetInput(&data_set);
+  renderer.SetField("point_data");
+
+  // every camera twice, so the second time comes from the cache
+  for(int pass = 0; pass < 2; ++pass)
+  {
+    for(size_t c = 0; c < cameras.size(); ++c)
+    {
+      vtkh::Render render = vtkh::MakeRender(32, 32, cameras[c], data_set, "vis_order");
+      renderer.SetRenders(std::vector<vtkh::Render>(1, render));
+      std::vector<std::vector<int>> orders = renderer.FindOrders();
+      ASSERT_EQ(orders.size(), 1u);
+      EXPECT_EQ(orders[0], renderer.FreshOrder(cameras[c])) << "camera " << c;
+    }
+  }
+
+  // the cameras have different orders, or the cache would not matter
+  EXPECT_NE(renderer.FreshOrder(cameras[0]), renderer.FreshOrder(cameras[1]));
+
+  // the same cameras on domains that moved
+  vtkh::DataSet moved;
+  for(int i = 0; i < num_blocks; ++i)
+  {
+    moved.AddDomain(CreateTestData(num_blocks - 1 - i, num_blocks, 8), i);
+  }
+  renderer.SetInput(&moved);
+  for(size_t c = 0; c < cameras.size(); ++c)
+  {
+    vtkh::Render render = vtkh::MakeRender(32, 32, cameras[c], moved, "vis_order");
+    renderer.SetRenders(std::vector<vtkh::Render>(1, render));
+    std::vector<std::vector<int>> orders = renderer.FindOrders();
+    ASSERT_EQ(orders.size(), 1u);
+    EXPECT_EQ(orders[0], renderer.FreshOrder(cameras[c])) << "moved, camera " << c;
+  }
+}
@@ -0,0 +1,830 @@
+#include <vtkh/filters/Resample.hpp>
+#include <vtkh/Error.hpp>
+#include <vtkh/utils/vtkm_dataset_info.hpp>
+
+#include <vtkm/CellShape.h>
+#include <vtkm/VecVariable.h>
+#include <vtkm/cont/Algorithm.h>
+#include <vtkm/cont/ArrayHandleConstant.h>
+#include <vtkm/cont/ArrayHandleCounting.h>
+#include <vtkm/cont/ArrayHandleUniformPointCoordinates.h>
+#include <vtkm/cont/CellSetStructured.h>
+#include <vtkm/cont/TryExecute.h>
+#include <vtkm/exec/CellInside.h>
+#include <vtkm/exec/CellInterpolate.h>
+#include <vtkm/exec/ParametricCoordinates.h>
+#include <vtkm/worklet/DispatcherMapField.h>
+#include <vtkm/worklet/WorkletMapField.h>
+
+#include <algorithm>
+#include <cmath>
+#include <list>
+
+#ifdef VTKH_PARALLEL
+#include <mpi.h>
+#include <vtkh/utils/vtkh_mpi_utils.hpp>
+#endif
+
+namespace vtkh
+{
+
+namespace detail
+{
+
+typedef vtkm::Vec<vtkm::FloatDefault,3> Point;
+
+VTKM_EXEC_CONT
+inline bool IsVolumetric(const vtkm::UInt8 shape_id)
+{
+  return shape_id == vtkm::CELL_SHAPE_TETRA ||
+         shape_id == vtkm::CELL_SHAPE_HEXAHEDRON ||
+         shape_id == vtkm::CELL_SHAPE_WEDGE ||
+         shape_id == vtkm::CELL_SHAPE_PYRAMID;
+}
+
+// bounding box of every cell
+class CellBounds : public vtkm::worklet::WorkletMapField
+{
+public:
+  typedef void ControlSignature(FieldIn<>, WholeCellSetIn<>, WholeArrayIn<>, FieldOut<>, FieldOut<>);
+  typedef void ExecutionSignature(_1, _2, _3, _4, _5);
+
+  template<typename CellSetType, typename CoordsPortal>
+  VTKM_EXEC
+  void operator()(const vtkm::Id &cell,
+                  const CellSetType &cellset,
+                  const CoordsPortal &coords,
+                  Point &min_point,
+                  Point &max_point) const
+  {
+    auto indices = cellset.GetIndices(cell);
+    const vtkm::IdComponent num_indices = cellset.GetNumberOfIndices(cell);
+    min_point = Point(0.f, 0.f, 0.f);
+    max_point = Point(0.f, 0.f, 0.f);
+    for(vtkm::IdComponent i = 0; i < num_indices; ++i)
+    {
+      const Point point(coords.Get(indices[i]));
+      for(int axis = 0; axis < 3; ++axis)
+      {
+        min_point[axis] = i == 0 ? point[axis] : vtkm::Min(min_point[axis], point[axis]);
+        max_point[axis] = i == 0 ? point[axis] : vtkm::Max(max_point[axis], point[axis]);
+      }
+    }
+  }
+}; //class CellBounds
+
+struct CellBoundsCaller
+{
+  template <typename Device>
+  VTKM_CONT bool operator()(Device,
+                            const vtkm::cont::DynamicCellSet &cellset,
+                            const vtkm::cont::CoordinateSystem &coords,
+                            vtkm::cont::ArrayHandle<Point> &mins,
+                            vtkm::cont::ArrayHandle<Point> &maxs) const
+  {
+    VTKM_IS_DEVICE_ADAPTER_TAG(Device);
+    vtkm::cont::ArrayHandleCounting<vtkm::Id> cells(0, 1, cellset.GetNumberOfCells());
+    vtkm::worklet::DispatcherMapField<CellBounds, Device>()
+      .Invoke(cells, cellset, coords.GetData(), mins, maxs);
+    return true;
+  }
+};
+
+//
+// A uniform grid of bins over a domain, each with the cells whose
+// bounding boxes overlap it
+//
+struct Bins
+{
+  vtkm::Vec<vtkm::Float64,3>        m_origin;
+  vtkm::Vec<vtkm::Float64,3>        m_inv_size;
+  vtkm::Id3                         m_dims;
+  // the cells of bin i are m_cells[m_offsets[i]] up to m_cells[m_offsets[i+1]]
+  vtkm::cont::ArrayHandle<vtkm::Id> m_offsets;
+  vtkm::cont::ArrayHandle<vtkm::Id> m_cells;
+
+  void Range(const Point &min_point,
+             const Point &max_point,
+             vtkm::Id3 &first,
+             vtkm::Id3 &last) const
+  {
+    for(int axis = 0; axis < 3; ++axis)
+    {
+      const vtkm::Float64 lo = (min_point[axis] - m_origin[axis]) * m_inv_size[axis];
+      const vtkm::Float64 hi = (max_point[axis] - m_origin[axis]) * m_inv_size[axis];
+      first[axis] = std::max(vtkm::Id(0), std::min(m_dims[axis] - 1, vtkm::Id(lo)));
+      last[axis] = std::max(vtkm::Id(0), std::min(m_dims[axis] - 1, vtkm::Id(hi)));
+    }
+  }
+};
+
+static void BuildBins(const vtkm::cont::DataSet &domain, Bins &bins)
+{
+  const vtkm::cont::DynamicCellSet &cellset = domain.GetCellSet();
+  const vtkm::cont::CoordinateSystem &coords = domain.GetCoordinateSystem();
+  const vtkm::Id num_cells = cellset.GetNumberOfCells();
+
+  vtkm::cont::ArrayHandle<Point> mins, maxs;
+  if(!vtkm::cont::TryExecute(CellBoundsCaller(), cellset, coords, mins, maxs))
+  {
+    throw Error("Resample: failed to find the bounds of the cells");
+  }
+
+  //
+  // about one cell per bin, with the bins as close to cubes as
+  // the bounds allow
+  //
+  const vtkm::Bounds bounds = coords.GetBounds();
+  const vtkm::Float64 lengths[3] = {bounds.X.Length(), bounds.Y.Length(), bounds.Z.Length()};
+  const vtkm::Float64 starts[3] = {bounds.X.Min, bounds.Y.Min, bounds.Z.Min};
+  vtkm::Float64 volume = 1.;
+  int flat_axes = 0;
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    if(lengths[axis] > 0.) volume *= lengths[axis];
+    else flat_axes++;
+  }
+  const vtkm::Float64 bins_per_length =
+    flat_axes == 3 ? 0. : std::pow(vtkm::Float64(num_cells) / volume, 1. / (3 - flat_axes));
+
+  vtkm::Id num_bins = 1;
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    const vtkm::Float64 count = std::ceil(lengths[axis] * bins_per_length);
+    bins.m_dims[axis] = std::max(vtkm::Id(1), std::min(vtkm::Id(512), vtkm::Id(count)));
+    bins.m_origin[axis] = starts[axis];
+    bins.m_inv_size[axis] =
+      lengths[axis] > 0. ? vtkm::Float64(bins.m_dims[axis]) / lengths[axis] : 0.;
+    num_bins *= bins.m_dims[axis];
+  }
+
+  auto min_portal = mins.GetPortalConstControl();
+  auto max_portal = maxs.GetPortalConstControl();
+  std::vector<vtkm::Id> offsets(num_bins + 1, 0);
+  vtkm::Id3 first, last;
+  for(vtkm::Id cell = 0; cell < num_cells; ++cell)
+  {
+    bins.Range(min_portal.Get(cell), max_portal.Get(cell), first, last);
+    for(vtkm::Id z = first[2]; z <= last[2]; ++z)
+      for(vtkm::Id y = first[1]; y <= last[1]; ++y)
+        for(vtkm::Id x = first[0]; x <= last[0]; ++x)
+        {
+          offsets[(z * bins.m_dims[1] + y) * bins.m_dims[0] + x + 1]++;
+        }
+  }
+  for(vtkm::Id i = 0; i < num_bins; ++i)
+  {
+    offsets[i + 1] += offsets[i];
+  }
+
+  bins.m_cells.Allocate(offsets[num_bins]);
+  auto cell_portal = bins.m_cells.GetPortalControl();
+  std::vector<vtkm::Id> next(offsets.begin(), offsets.end() - 1);
+  for(vtkm::Id cell = 0; cell < num_cells; ++cell)
+  {
+    bins.Range(min_portal.Get(cell), max_portal.Get(cell), first, last);
+    for(vtkm::Id z = first[2]; z <= last[2]; ++z)
+      for(vtkm::Id y = first[1]; y <= last[1]; ++y)
+        for(vtkm::Id x = first[0]; x <= last[0]; ++x)
+        {
+          cell_portal.Set(next[(z * bins.m_dims[1] + y) * bins.m_dims[0] + x]++, cell);
+        }
+  }
+
+  bins.m_offsets.Allocate(num_bins + 1);
+  auto offset_portal = bins.m_offsets.GetPortalControl();
+  for(vtkm::Id i = 0; i <= num_bins; ++i)
+  {
+    offset_portal.Set(i, offsets[i]);
+  }
+}
+
+//
+// Finds the cell of the domain, and the parametric coordinates in it,
+// of each sample not already found in another domain
+//
+class LocateSamples : public vtkm::worklet::WorkletMapField
+{
+protected:
+  vtkm::Vec<vtkm::Float64,3> m_origin;
+  vtkm::Vec<vtkm::Float64,3> m_inv_size;
+  vtkm::Id3                  m_dims;
+  vtkm::Int32                m_domain;
+public:
+  VTKM_CONT
+  LocateSamples(const Bins &bins, const vtkm::Int32 domain)
+    : m_origin(bins.m_origin),
+      m_inv_size(bins.m_inv_size),
+      m_dims(bins.m_dims),
+      m_domain(domain)
+  {
+  }
+
+  typedef void ControlSignature(FieldIn<>,
+                                WholeCellSetIn<>,
+                                WholeArrayIn<>,
+                                WholeArrayIn<>,
+                                WholeArrayIn<>,
+                                FieldInOut<>,
+                                FieldInOut<>,
+                                FieldInOut<>);
+  typedef void ExecutionSignature(_1, _2, _3, _4, _5, _6, _7, _8);
+
+  template<typename PointType,
+           typename CellSetType,
+           typename CoordsPortal,
+           typename IdPortal>
+  VTKM_EXEC
+  void operator()(const PointType &sample,
+                  const CellSetType &cellset,
+                  const CoordsPortal &coords,
+                  const IdPortal &offsets,
+                  const IdPortal &bin_cells,
+                  vtkm::Int32 &domain,
+                  vtkm::Id &cell_id,
+                  Point &pcoords) const
+  {
+    if(domain != -1)
+    {
+      return;
+    }
+
+    const Point point(sample);
+    vtkm::Id3 bin;
+    for(int axis = 0; axis < 3; ++axis)
+    {
+      const vtkm::Float64 pos = (point[axis] - m_origin[axis]) * m_inv_size[axis];
+      if(pos < 0. || pos > vtkm::Float64(m_dims[axis]))
+      {
+        return;
+      }
+      bin[axis] = vtkm::Min(static_cast<vtkm::Id>(pos), m_dims[axis] - 1);
+    }
+
+    const vtkm::Id index = (bin[2] * m_dims[1] + bin[1]) * m_dims[0] + bin[0];
+    const vtkm::Id end = offsets.Get(index + 1);
+    for(vtkm::Id i = offsets.Get(index); i < end; ++i)
+    {
+      const vtkm::Id cell = bin_cells.Get(i);
+      auto shape = cellset.GetCellShape(cell);
+      const vtkm::IdComponent num_indices = cellset.GetNumberOfIndices(cell);
+      if(!IsVolumetric(shape.Id) || num_indices > 8)
+      {
+        continue;
+      }
+
+      auto indices = cellset.GetIndices(cell);
+      vtkm::VecVariable<Point,8> points;
+      for(vtkm::IdComponent p = 0; p < num_indices; ++p)
+      {
+        points.Append(Point(coords.Get(indices[p])));
+      }
+      const Point cell_pcoords =
+        vtkm::exec::WorldCoordinatesToParametricCoordinates(points, point, shape, *this);
+      if(vtkm::exec::CellInside(cell_pcoords, shape))
+      {
+        domain = m_domain;
+        cell_id = cell;
+        pcoords = cell_pcoords;
+        return;
+      }
+    }
+  }
+}; //class LocateSamples
+
+struct LocateCaller
+{
+  template <typename Device>
+  VTKM_CONT bool operator()(Device,
+                            const vtkm::cont::ArrayHandleUniformPointCoordinates &samples,
+                            const vtkm::cont::DataSet &domain,
+                            const Bins &bins,
+                            const vtkm::Int32 domain_index,
+                            vtkm::cont::ArrayHandle<vtkm::Int32> &sample_domains,
+                            vtkm::cont::ArrayHandle<vtkm::Id> &sample_cells,
+                            vtkm::cont::ArrayHandle<Point> &sample_pcoords) const
+  {
+    VTKM_IS_DEVICE_ADAPTER_TAG(Device);
+    vtkm::worklet::DispatcherMapField<LocateSamples, Device>(LocateSamples(bins, domain_index))
+      .Invoke(samples,
+              domain.GetCellSet(),
+              domain.GetCoordinateSystem().GetData(),
+              bins.m_offsets,
+              bins.m_cells,
+              sample_domains,
+              sample_cells,
+              sample_pcoords);
+    return true;
+  }
+};
+
+// the value of the field at the samples found in the domain
+class InterpolateSamples : public vtkm::worklet::WorkletMapField
+{
+protected:
+  vtkm::Int32 m_domain;
+  bool        m_points;
+public:
+  VTKM_CONT
+  InterpolateSamples(const vtkm::Int32 domain, const bool points)
+    : m_domain(domain),
+      m_points(points)
+  {
+  }
+
+  typedef void ControlSignature(FieldIn<>,
+                                FieldIn<>,
+                                FieldIn<>,
+                                WholeCellSetIn<>,
+                                WholeArrayIn<>,
+                                FieldInOut<>);
+  typedef void ExecutionSignature(_1, _2, _3, _4, _5, _6);
+
+  template<typename CellSetType, typename FieldPortal, typename OutType>
+  VTKM_EXEC
+  void operator()(const vtkm::Int32 &domain,
+                  const vtkm::Id &cell,
+                  const Point &pcoords,
+                  const CellSetType &cellset,
+                  const FieldPortal &field,
+                  OutType &value) const
+  {
+    if(domain != m_domain)
+    {
+      return;
+    }
+    if(!m_points)
+    {
+      value = static_cast<OutType>(field.Get(cell));
+      return;
+    }
+
+    typedef typename FieldPortal::ValueType ValueType;
+    auto indices = cellset.GetIndices(cell);
+    const vtkm::IdComponent num_indices = cellset.GetNumberOfIndices(cell);
+    vtkm::VecVariable<ValueType,8> values;
+    for(vtkm::IdComponent p = 0; p < num_indices; ++p)
+    {
+      values.Append(field.Get(indices[p]));
+    }
+    value = static_cast<OutType>(
+      vtkm::exec::CellInterpolate(values, pcoords, cellset.GetCellShape(cell), *this));
+  }
+}; //class InterpolateSamples
+
+struct InterpolateCaller
+{
+  template <typename Device, typename InType, typename OutType>
+  VTKM_CONT bool operator()(Device,
+                            const vtkm::cont::ArrayHandle<vtkm::Int32> &sample_domains,
+                            const vtkm::cont::ArrayHandle<vtkm::Id> &sample_cells,
+                            const vtkm::cont::ArrayHandle<Point> &sample_pcoords,
+                            const vtkm::cont::DynamicCellSet &cellset,
+                            const vtkm::cont::ArrayHandle<InType> &field,
+                            const vtkm::Int32 domain_index,
+                            const bool points,
+                            vtkm::cont::ArrayHandle<OutType> &values) const
+  {
+    VTKM_IS_DEVICE_ADAPTER_TAG(Device);
+    vtkm::worklet::DispatcherMapField<InterpolateSamples, Device>(
+      InterpolateSamples(domain_index, points))
+      .Invoke(sample_domains, sample_cells, sample_pcoords, cellset, field, values);
+    return true;
+  }
+};
+
+//
+// A domain the cell locations were found in, and what identifies it
+//
+struct LocatorDomain
+{
+  vtkm::Id                     m_domain_id;
+  // held so the arrays can't be freed and replaced by new ones at
+  // the same address while the entry exists
+  vtkm::cont::DynamicCellSet   m_cellset;
+  vtkm::cont::CoordinateSystem m_coords;
+  vtkm::Id                     m_num_cells;
+  vtkm::Bounds                 m_bounds;
+
+  bool Matches(const LocatorDomain &other, const bool static_mesh) const
+  {
+    if(m_domain_id != other.m_domain_id ||
+       m_num_cells != other.m_num_cells ||
+       !(m_bounds == other.m_bounds))
+    {
+      return false;
+    }
+    return static_mesh ||
+           (&m_cellset.CastToBase() == &other.m_cellset.CastToBase() &&
+            m_coords.GetData() == other.m_coords.GetData());
+  }
+};
+
+struct LocatorCacheEntry
+{
+  std::vector<LocatorDomain>           m_domains;
+  vtkm::Id3                            m_dims;
+  // for each sample, the index of the domain it is in (-1 if none),
+  // and the cell and parametric coordinates in that domain
+  vtkm::cont::ArrayHandle<vtkm::Int32> m_sample_domains;
+  vtkm::cont::ArrayHandle<vtkm::Id>    m_sample_cells;
+  vtkm::cont::ArrayHandle<Point>       m_sample_pcoords;
+
+  bool Matches(const std::vector<LocatorDomain> &domains,
+               const vtkm::Id3 &dims,
+               const bool static_mesh) const
+  {
+    if(m_dims != dims || m_domains.size() != domains.size())
+    {
+      return false;
+    }
+    for(size_t i = 0; i < domains.size(); ++i)
+    {
+      if(!m_domains[i].Matches(domains[i], static_mesh)) return false;
+    }
+    return true;
+  }
+};
+
+//
+// The cell locations are a few words per sample, so only the
+// meshes of the last few resamplings are kept
+//
+class LocatorCache
+{
+public:
+  LocatorCache()
+    : m_max_entries(4)
+  {}
+
+  LocatorCacheEntry* Find(const std::vector<LocatorDomain> &domains,
+                          const vtkm::Id3 &dims,
+                          const bool static_mesh)
+  {
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+      if(it->Matches(domains, dims, static_mesh))
+      {
+        // most recently used first
+        m_entries.splice(m_entries.begin(), m_entries, it);
+        return &m_entries.front();
+      }
+    }
+    return nullptr;
+  }
+
+  LocatorCacheEntry& Add(const LocatorCacheEntry &entry)
+  {
+    m_entries.push_front(entry);
+    while(m_entries.size() > m_max_entries)
+    {
+      m_entries.pop_back();
+    }
+    return m_entries.front();
+  }
+
+  void Clear()
+  {
+    m_entries.clear();
+  }
+
+private:
+  std::list<LocatorCacheEntry> m_entries;
+  size_t                       m_max_entries;
+};
+
+static LocatorCache& GetLocatorCache()
+{
+  static LocatorCache cache;
+  return cache;
+}
+
+static bool IsStructuredGrid(const vtkm::cont::DataSet &domain)
+{
+  int topo_dims;
+  if(!VTKMDataSetInfo::IsStructured(domain, topo_dims) || topo_dims != 3)
+  {
+    return false;
+  }
+  const vtkm::cont::CoordinateSystem coords = domain.GetCoordinateSystem();
+  return VTKMDataSetInfo::IsUniform(coords) || VTKMDataSetInfo::IsRectilinear(coords);
+}
+
+static bool IsFloat32(const vtkm::cont::Field &field)
+{
+  return field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float32>());
+}
+
+static bool IsFloat64(const vtkm::cont::Field &field)
+{
+  return field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float64>());
+}
+
+static vtkm::Vec<vtkm::FloatDefault,3> GridSpacing(const vtkm::Bounds &bounds,
+                                                   const vtkm::Id3 &dims)
+{
+  const vtkm::Float64 lengths[3] = {bounds.X.Length(), bounds.Y.Length(), bounds.Z.Length()};
+  vtkm::Vec<vtkm::FloatDefault,3> spacing;
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    spacing[axis] = lengths[axis] > 0.
+      ? static_cast<vtkm::FloatDefault>(lengths[axis] / vtkm::Float64(dims[axis] - 1))
+      : vtkm::FloatDefault(1);
+  }
+  return spacing;
+}
+
+template<typename OutType>
+void Interpolate(const LocatorCacheEntry &entry,
+                 const std::vector<vtkm::cont::DataSet> &domains,
+                 const std::string &field_name,
+                 const vtkm::Float64 fill_value,
+                 vtkm::cont::ArrayHandle<OutType> &values)
+{
+  const vtkm::Id num_samples = entry.m_dims[0] * entry.m_dims[1] * entry.m_dims[2];
+  vtkm::cont::Algorithm::Copy(
+    vtkm::cont::make_ArrayHandleConstant(static_cast<OutType>(fill_value), num_samples),
+    values);
+
+  for(size_t i = 0; i < domains.size(); ++i)
+  {
+    const vtkm::cont::Field &field = domains[i].GetField(field_name);
+    const bool points = field.GetAssociation() == vtkm::cont::Field::Association::POINTS;
+    const vtkm::Int32 index = static_cast<vtkm::Int32>(i);
+    bool valid;
+    if(IsFloat32(field))
+    {
+      valid = vtkm::cont::TryExecute(InterpolateCaller(),
+                                     entry.m_sample_domains,
+                                     entry.m_sample_cells,
+                                     entry.m_sample_pcoords,
+                                     domains[i].GetCellSet(),
+                                     field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float32>>(),
+                                     index,
+                                     points,
+                                     values);
+    }
+    else
+    {
+      valid = vtkm::cont::TryExecute(InterpolateCaller(),
+                                     entry.m_sample_domains,
+                                     entry.m_sample_cells,
+                                     entry.m_sample_pcoords,
+                                     domains[i].GetCellSet(),
+                                     field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float64>>(),
+                                     index,
+                                     points,
+                                     values);
+    }
+    if(!valid)
+    {
+      throw Error("Resample: failed to interpolate the field");
+    }
+  }
+}
+
+} // namespace detail
+
+Resample::Resample()
+  : m_dims(128, 128, 128),
+    m_has_invalid_value(false),
+    m_invalid_value(0.),
+    m_static_mesh(false),
+    m_fill_value(0.),
+    m_valid_range(0., 0.)
+{
+
+}
+
+Resample::~Resample()
+{
+
+}
+
+void
+Resample::SetField(const std::string &field_name)
+{
+  m_field_name = field_name;
+}
+
+void
+Resample::SetDimensions(const vtkm::Id3 &dims)
+{
+  if(dims[0] < 2 || dims[1] < 2 || dims[2] < 2)
+  {
+    throw Error("Resample: the grid needs at least 2 points along each axis");
+  }
+  m_dims = dims;
+}
+
+void
+Resample::SetInvalidValue(const vtkm::Float64 value)
+{
+  m_has_invalid_value = true;
+  m_invalid_value = value;
+}
+
+std::string
+Resample::GetValidRangeName(const std::string &field_name)
+{
+  return field_name + "_valid_range";
+}
+
+void
+Resample::SetStaticMesh(bool on)
+{
+  m_static_mesh = on;
+}
+
+void
+Resample::ClearLocatorCache()
+{
+  detail::GetLocatorCache().Clear();
+}
+
+void Resample::PreExecute()
+{
+  Filter::PreExecute();
+  assert(m_field_name != "");
+  if(!m_input->GlobalFieldExists(m_field_name))
+  {
+    throw Error("Resample: field '" + m_field_name + "' does not exist");
+  }
+
+  // samples inside cells are interpolated, so they stay in this range
+  m_valid_range = m_input->GetGlobalRange(m_field_name).GetPortalControl().Get(0);
+  m_fill_value = m_invalid_value;
+  if(!m_has_invalid_value)
+  {
+    m_fill_value = m_valid_range.Min - std::max(m_valid_range.Length(), 1.);
+  }
+}
+
+void Resample::PostExecute()
+{
+  Filter::PostExecute();
+}
+
+void Resample::DoExecute()
+{
+  this->m_output = new DataSet();
+  const int num_domains = this->m_input->GetNumberOfDomains();
+
+  std::vector<vtkm::cont::DataSet> domains;
+  std::vector<detail::LocatorDomain> locator_domains;
+  vtkm::Bounds bounds;
+  vtkm::Id max_domain_id = -1;
+  bool has_float64 = false;
+  for(int i = 0; i < num_domains; ++i)
+  {
+    vtkm::Id domain_id;
+    vtkm::cont::DataSet dom;
+    this->m_input->GetDomain(i, dom, domain_id);
+    max_domain_id = std::max(max_domain_id, domain_id);
+
+    if(detail::IsStructuredGrid(dom))
+    {
+      // already on the fast path
+      m_output->AddDomain(dom, domain_id);
+      continue;
+    }
+
+    if(!dom.HasField(m_field_name) || dom.GetCellSet().GetNumberOfCells() == 0)
+    {
+      continue;
+    }
+
+    const vtkm::cont::Field &field = dom.GetField(m_field_name);
+    if(field.GetAssociation() != vtkm::cont::Field::Association::POINTS &&
+       field.GetAssociation() != vtkm::cont::Field::Association::CELL_SET)
+    {
+      throw Error("Resample: input field must be zonal or nodal");
+    }
+    if(!detail::IsFloat32(field) && !detail::IsFloat64(field))
+    {
+      throw Error("Resample: input field must be a 32 or 64 bit scalar");
+    }
+    has_float64 = has_float64 || detail::IsFloat64(field);
+
+    detail::LocatorDomain locator_domain;
+    locator_domain.m_domain_id = domain_id;
+    locator_domain.m_cellset = dom.GetCellSet();
+    locator_domain.m_coords = dom.GetCoordinateSystem();
+    locator_domain.m_num_cells = dom.GetCellSet().GetNumberOfCells();
+    locator_domain.m_bounds = dom.GetCoordinateSystem().GetBounds();
+    bounds.Include(locator_domain.m_bounds);
+    locator_domains.push_back(locator_domain);
+    domains.push_back(dom);
+  }
+
+  //
+  // the grid of each rank is a new domain, with an id no domain
+  // on any rank has
+  //
+  vtkm::Id grid_id = max_domain_id + 1;
+#ifdef VTKH_PARALLEL
+  long long local_max = static_cast<long long>(max_domain_id);
+  long long global_max = local_max;
+  MPI_Allreduce(&local_max, &global_max, 1, MPI_LONG_LONG, MPI_MAX, vtkh::GetMPIComm());
+  grid_id = static_cast<vtkm::Id>(global_max) + 1 + vtkh::GetMPIRank();
+#endif
+
+  if(domains.empty())
+  {
+    return;
+  }
+
+  const vtkm::Vec<vtkm::FloatDefault,3> origin(static_cast<vtkm::FloatDefault>(bounds.X.Min),
+                                                static_cast<vtkm::FloatDefault>(bounds.Y.Min),
+                                                static_cast<vtkm::FloatDefault>(bounds.Z.Min));
+  const vtkm::Vec<vtkm::FloatDefault,3> spacing = detail::GridSpacing(bounds, m_dims);
+
+  detail::LocatorCache &cache = detail::GetLocatorCache();
+  detail::LocatorCacheEntry *entry = cache.Find(locator_domains, m_dims, m_static_mesh);
+  if(entry == nullptr)
+  {
+    detail::LocatorCacheEntry new_entry;
+    new_entry.m_domains = locator_domains;
+    new_entry.m_dims = m_dims;
+
+    const vtkm::Id num_samples = m_dims[0] * m_dims[1] * m_dims[2];
+    vtkm::cont::Algorithm::Copy(vtkm::cont::make_ArrayHandleConstant(vtkm::Int32(-1), num_samples),
+                                new_entry.m_sample_domains);
+    vtkm::cont::Algorithm::Copy(vtkm::cont::make_ArrayHandleConstant(vtkm::Id(-1), num_samples),
+                                new_entry.m_sample_cells);
+    vtkm::cont::Algorithm::Copy(vtkm::cont::make_ArrayHandleConstant(detail::Point(0.f, 0.f, 0.f),
+                                                                     num_samples),
+                                new_entry.m_sample_pcoords);
+
+    vtkm::cont::ArrayHandleUniformPointCoordinates samples(m_dims, origin, spacing);
+    for(size_t i = 0; i < domains.size(); ++i)
+    {
+      detail::Bins bins;
+      detail::BuildBins(domains[i], bins);
+      if(!vtkm::cont::TryExecute(detail::LocateCaller(),
+                                 samples,
+                                 domains[i],
+                                 bins,
+                                 static_cast<vtkm::Int32>(i),
+                                 new_entry.m_sample_domains,
+                                 new_entry.m_sample_cells,
+                                 new_entry.m_sample_pcoords))
+      {
+        throw Error("Resample: failed to locate the samples");
+      }
+    }
+    entry = &cache.Add(new_entry);
+  }
+  else
+  {
+    // a static mesh can match in new arrays, so hold those instead of
+    // keeping the old ones alive
+    entry->m_domains = locator_domains;
+  }
+
+  vtkm::cont::DynamicArrayHandle values;
+  if(has_float64)
+  {
+    vtkm::cont::ArrayHandle<vtkm::Float64> double_values;
+    detail::Interpolate(*entry, domains, m_field_name, m_fill_value, double_values);
+    values = double_values;
+  }
+  else
+  {
+    vtkm::cont::ArrayHandle<vtkm::Float32> float_values;
+    detail::Interpolate(*entry, domains, m_field_name, m_fill_value, float_values);
+    values = float_values;
+  }
+
+  vtkm::cont::DataSet grid;
+  grid.AddCoordinateSystem(
+    vtkm::cont::CoordinateSystem(domains[0].GetCoordinateSystem().GetName(),
+                                 m_dims,
+                                 origin,
+                                 spacing));
+  vtkm::cont::CellSetStructured<3> cellset(domains[0].GetCellSet().GetName());
+  cellset.SetPointDimensions(m_dims);
+  grid.AddCellSet(cellset);
+  grid.AddField(vtkm::cont::Field(m_field_name,
+                                  vtkm::cont::Field::Association::POINTS,
+                                  values));
+  if(!m_has_invalid_value)
+  {
+    vtkm::cont::ArrayHandle<vtkm::Float64> valid_range;
+    valid_range.Allocate(2);
+    valid_range.GetPortalControl().Set(0, m_valid_range.Min);
+    valid_range.GetPortalControl().Set(1, m_valid_range.Max);
+    grid.AddField(vtkm::cont::Field(GetValidRangeName(m_field_name),
+                                    vtkm::cont::Field::Association::WHOLE_MESH,
+                                    valid_range));
+  }
+  m_output->AddDomain(grid, grid_id);
+}
+
+std::string
+Resample::GetName() const
+{
+  return "vtkh::Resample";
+}
+
+} //  namespace vtkh
@@ -0,0 +1,72 @@
+#ifndef VTK_H_RESAMPLE_HPP
+#define VTK_H_RESAMPLE_HPP
+
+#include <vtkh/vtkh.hpp>
+#include <vtkh/filters/Filter.hpp>
+#include <vtkh/DataSet.hpp>
+
+namespace vtkh
+{
+//
+// Samples a field of the unstructured (and curvilinear) domains of each
+// rank onto a single uniform grid covering their bounds, so they can be
+// volume rendered by the structured mappers. Domains that are already
+// uniform or rectilinear 3D grids are passed through as they are.
+//
+// Finding the cell of each sample is the expensive part. It is kept
+// between updates, and reused as long as the meshes don't change.
+//
+// The grid of a rank covers the bounds of all of its domains, so it
+// can overlap the grids of other ranks when their domains interleave.
+// Volume rendering orders whole domains by depth, which is only
+// right when they don't overlap, so the resampled domains of each
+// rank should fill a box that no other rank's domains reach into.
+//
+class Resample : public Filter
+{
+public:
+  Resample();
+  virtual ~Resample();
+  std::string GetName() const override;
+  void SetField(const std::string &field_name);
+  //
+  // Points along each axis of the grid of each rank. Defaults to 128
+  // in every direction.
+  //
+  void SetDimensions(const vtkm::Id3 &dims);
+  //
+  // The value of samples outside every cell, which is then rendered
+  // like any other value. By default they get a value below the range
+  // of the field, and each grid gets a field named by GetValidRangeName
+  // with the range of the samples inside cells. The volume renderer
+  // takes its range from it and leaves samples below it transparent.
+  //
+  void SetInvalidValue(const vtkm::Float64 value);
+  static std::string GetValidRangeName(const std::string &field_name);
+  //
+  // In situ, the same mesh often comes back in new arrays every cycle.
+  // When the mesh is static, domains are matched to the cached cell
+  // locations by domain id, number of cells, and bounds instead of by
+  // their arrays.
+  //
+  void SetStaticMesh(bool on);
+  // forgets the cell locations of every mesh
+  static void ClearLocatorCache();
+
+protected:
+  void PreExecute() override;
+  void PostExecute() override;
+  void DoExecute() override;
+
+  std::string   m_field_name;
+  vtkm::Id3     m_dims;
+  bool          m_has_invalid_value;
+  vtkm::Float64 m_invalid_value;
+  bool          m_static_mesh;
+  // what samples outside every cell get in this update
+  vtkm::Float64 m_fill_value;
+  vtkm::Range   m_valid_range;
+};
+
+} //namespace vtkh
+#endif
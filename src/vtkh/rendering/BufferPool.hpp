@@ -0,0 +1,110 @@
+#ifndef VTKH_BUFFER_POOL_HPP
+#define VTKH_BUFFER_POOL_HPP
+
+#include <list>
+#include <mutex>
+#include <utility>
+
+namespace vtkh
+{
+//
+// Holds on to buffers that are no longer in use so the next request
+// for one of the same size can skip the allocation and the page
+// faults of touching new memory. Buffers are given back with their
+// size in bytes, and once the pool holds more than its capacity the
+// buffers that have been idle the longest are freed.
+//
+template<typename Buffer>
+class BufferPool
+{
+public:
+  explicit BufferPool(const size_t capacity)
+    : m_bytes(0),
+      m_capacity(capacity)
+  {}
+  //
+  // Takes the most recently returned buffer that satisfies match,
+  // or returns false if there is none.
+  //
+  template<typename Match>
+  bool Take(Match match, Buffer &buffer)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+      if(match(it->m_buffer))
+      {
+        buffer = std::move(it->m_buffer);
+        m_bytes -= it->m_bytes;
+        m_entries.erase(it);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Give(Buffer &&buffer, const size_t bytes)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(bytes > m_capacity)
+    {
+      return;
+    }
+    m_entries.push_front(Entry());
+    m_entries.front().m_buffer = std::move(buffer);
+    m_entries.front().m_bytes = bytes;
+    m_bytes += bytes;
+    Evict();
+  }
+
+  void SetCapacity(const size_t capacity)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capacity = capacity;
+    Evict();
+  }
+
+  size_t GetCapacity()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_capacity;
+  }
+  // bytes currently held by the pool
+  size_t GetSize()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+  }
+
+  void Clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_bytes = 0;
+  }
+
+private:
+  struct Entry
+  {
+    Buffer m_buffer;
+    size_t m_bytes;
+  };
+
+  void Evict()
+  {
+    while(m_bytes > m_capacity)
+    {
+      m_bytes -= m_entries.back().m_bytes;
+      m_entries.pop_back();
+    }
+  }
+
+  // most recently returned first
+  std::list<Entry> m_entries;
+  size_t           m_bytes;
+  size_t           m_capacity;
+  std::mutex       m_mutex;
+};
+
+} // namespace vtkh
+#endif
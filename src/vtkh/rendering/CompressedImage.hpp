@@ -0,0 +1,216 @@
+#ifndef VTKH_DIY_COMPRESSED_IMAGE_HPP
+#define VTKH_DIY_COMPRESSED_IMAGE_HPP
+
+#include <vtkh/rendering/Image.hpp>
+#include <sstream>
+#include <vector>
+#include <vtkm/Bounds.h>
+
+namespace vtkh
+{
+//
+// Active pixel encoding of an Image used for compositing exchanges.
+// Pixels are visited in row major order over m_bounds and m_runs holds
+// alternating counts of empty and active pixels:
+// {empty, active, empty, active, ...}.
+// Only the active pixels are stored in m_pixels and m_depths. A pixel
+// is empty if it has no coverage (alpha == 0) and no surface (depth > 1),
+// i.e., it cannot change the result of a z-buffer or blend composite.
+//
+struct CompressedImage
+{
+    vtkm::Bounds                 m_orig_bounds;
+    vtkm::Bounds                 m_bounds;
+    std::vector<int>             m_runs;
+    std::vector<unsigned char>   m_pixels;
+    std::vector<float>           m_depths;
+    int                          m_orig_rank;
+    int                          m_composite_order;
+
+    CompressedImage()
+      : m_orig_rank(-1),
+        m_composite_order(-1)
+    {}
+
+    static bool IsActive(const unsigned char *pixel, const float depth)
+    {
+      return pixel[3] != 0 || depth <= 1.f;
+    }
+
+    int GetNumberOfPixels() const
+    {
+      const int dx  = m_bounds.X.Max - m_bounds.X.Min + 1;
+      const int dy  = m_bounds.Y.Max - m_bounds.Y.Min + 1;
+      return dx * dy;
+    }
+
+    int GetNumberOfActivePixels() const
+    {
+      return static_cast<int>(m_depths.size());
+    }
+
+    int GetNumberOfRuns() const
+    {
+      return static_cast<int>(m_runs.size() / 2);
+    }
+
+    bool IsEmpty() const
+    {
+      return m_depths.size() == 0;
+    }
+
+    void Compress(const Image &image)
+    {
+      Compress(image, image.m_bounds);
+    }
+    //
+    // Encode a sub-region of the image. Parts of the sub-region
+    // outside of the image are empty, so they cost nothing to scan
+    // or to send.
+    //
+    void Compress(const Image &image,
+                  const vtkm::Bounds &sub_region)
+    {
+      m_orig_bounds = image.m_orig_bounds;
+      m_bounds = sub_region;
+      m_orig_rank = image.m_orig_rank;
+      m_composite_order = image.m_composite_order;
+
+      const int s_dx  = m_bounds.X.Max - m_bounds.X.Min + 1;
+      const int s_dy  = m_bounds.Y.Max - m_bounds.Y.Min + 1;
+
+      const int dx  = image.m_bounds.X.Max - image.m_bounds.X.Min + 1;
+
+      // the part of each row that overlaps the image
+      const int x_begin = std::max(m_bounds.X.Min, image.m_bounds.X.Min) - m_bounds.X.Min;
+      const int x_end = std::min(m_bounds.X.Max, image.m_bounds.X.Max) - m_bounds.X.Min + 1;
+
+      m_runs.clear();
+      m_pixels.clear();
+      m_depths.clear();
+
+      int empty = 0;
+      int active = 0;
+      for(int y = 0; y < s_dy; ++y)
+      {
+        const int image_y = y + m_bounds.Y.Min - image.m_bounds.Y.Min;
+        if(image_y < 0 || image_y >= image.m_bounds.Y.Max - image.m_bounds.Y.Min + 1 ||
+           x_begin >= x_end)
+        {
+          AddEmpty(s_dx, empty, active);
+          continue;
+        }
+
+        AddEmpty(x_begin, empty, active);
+        const int row = image_y * dx + m_bounds.X.Min - image.m_bounds.X.Min;
+        for(int x = x_begin; x < x_end; ++x)
+        {
+          const int index = row + x;
+          const unsigned char *pixel = &image.m_pixels[index * 4];
+          const float depth = image.m_depths[index];
+          if(IsActive(pixel, depth))
+          {
+            m_pixels.insert(m_pixels.end(), pixel, pixel + 4);
+            m_depths.push_back(depth);
+            active++;
+          }
+          else
+          {
+            AddEmpty(1, empty, active);
+          }
+        } // x
+        AddEmpty(s_dx - x_end, empty, active);
+      } // y
+
+      if(empty != 0 || active != 0)
+      {
+        m_runs.push_back(empty);
+        m_runs.push_back(active);
+      }
+    }
+    //
+    // Expand into a dense image. Empty pixels are cleared to
+    // transparent black with background depth
+    //
+    void Decompress(Image &image) const
+    {
+      image.m_orig_bounds = m_orig_bounds;
+      image.m_bounds = m_bounds;
+      image.m_orig_rank = m_orig_rank;
+      image.m_composite_order = m_composite_order;
+
+      const int size = GetNumberOfPixels();
+      image.m_pixels.assign(size * 4, 0);
+      image.m_depths.assign(size, 2.f);
+
+      const int num_runs = GetNumberOfRuns();
+      int pixel = 0;
+      int active = 0;
+      for(int r = 0; r < num_runs; ++r)
+      {
+        pixel += m_runs[r * 2 + 0];
+        const int count = m_runs[r * 2 + 1];
+        std::copy(m_pixels.begin() + active * 4,
+                  m_pixels.begin() + (active + count) * 4,
+                  image.m_pixels.begin() + pixel * 4);
+        std::copy(m_depths.begin() + active,
+                  m_depths.begin() + active + count,
+                  image.m_depths.begin() + pixel);
+        pixel += count;
+        active += count;
+      }
+    }
+    //
+    // Computes the starting pixel and active pixel index of each run
+    // so runs can be processed independently
+    //
+    void GetRunOffsets(std::vector<int> &pixel_offsets,
+                       std::vector<int> &active_offsets) const
+    {
+      const int num_runs = GetNumberOfRuns();
+      pixel_offsets.resize(num_runs);
+      active_offsets.resize(num_runs);
+      int pixel = 0;
+      int active = 0;
+      for(int r = 0; r < num_runs; ++r)
+      {
+        pixel += m_runs[r * 2 + 0];
+        pixel_offsets[r] = pixel;
+        active_offsets[r] = active;
+        pixel += m_runs[r * 2 + 1];
+        active += m_runs[r * 2 + 1];
+      }
+    }
+
+    std::string ToString() const
+    {
+      std::stringstream ss;
+      ss<<"Active pixels "<< GetNumberOfActivePixels()<<" / "<<GetNumberOfPixels();
+      ss<<" runs "<< GetNumberOfRuns();
+      ss<<" tile dims: {"<<m_bounds.X.Min<<","<< m_bounds.Y.Min<<"} - ";
+      ss<<"{"<<m_bounds.X.Max<<","<<m_bounds.Y.Max<<"}\n";
+      return ss.str();
+    }
+
+private:
+    // closes the current run if it has active pixels
+    // and extends the empty span
+    void AddEmpty(const int count, int &empty, int &active)
+    {
+      if(count <= 0)
+      {
+        return;
+      }
+      if(active != 0)
+      {
+        m_runs.push_back(empty);
+        m_runs.push_back(active);
+        empty = 0;
+        active = 0;
+      }
+      empty += count;
+    }
+};
+
+} //namespace  vtkh
+#endif
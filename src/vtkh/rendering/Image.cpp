@@ -1,11 +1,92 @@
 // See License.txt
 
 #include "Image.hpp"
+#include <vtkh/rendering/BufferPool.hpp>
 #include <vtkh/utils/PNGEncoder.hpp>
 
 namespace vtkh
 {
 
+namespace detail
+{
+
+struct ImageStorage
+{
+  std::vector<unsigned char> m_pixels;
+  std::vector<float>         m_depths;
+};
+
+// images are freed after the pool during shutdown
+static bool image_pool_alive = false;
+
+struct ImagePool
+{
+  BufferPool<ImageStorage> m_buffers;
+
+  ImagePool()
+    : m_buffers(size_t(1) << 30)
+  {
+    image_pool_alive = true;
+  }
+
+  ~ImagePool()
+  {
+    image_pool_alive = false;
+  }
+};
+
+static ImagePool& GetImagePool()
+{
+  static ImagePool pool;
+  return pool;
+}
+
+} // namespace detail
+
+void Image::Allocate(const int num_pixels)
+{
+  const size_t size = static_cast<size_t>(num_pixels);
+  if(m_depths.capacity() < size)
+  {
+    //
+    // don't take buffers much bigger than needed, they would be
+    // wasted on a small image
+    //
+    detail::ImageStorage storage;
+    auto fits = [size](const detail::ImageStorage &buffers)
+    {
+      return buffers.m_depths.capacity() >= size &&
+             buffers.m_depths.capacity() <= size * 2;
+    };
+    if(detail::GetImagePool().m_buffers.Take(fits, storage))
+    {
+      m_pixels.swap(storage.m_pixels);
+      m_depths.swap(storage.m_depths);
+    }
+  }
+  m_pixels.resize(size * 4);
+  m_depths.resize(size);
+}
+
+void Image::Recycle()
+{
+  if(detail::image_pool_alive && m_depths.capacity() != 0)
+  {
+    const size_t bytes = m_pixels.capacity() + m_depths.capacity() * sizeof(float);
+    // the contents are kept, so sizing them back up is free
+    detail::ImageStorage storage;
+    storage.m_pixels.swap(m_pixels);
+    storage.m_depths.swap(m_depths);
+    detail::GetImagePool().m_buffers.Give(std::move(storage), bytes);
+  }
+  Clear();
+}
+
+void Image::SetPoolCapacity(const size_t bytes)
+{
+  detail::GetImagePool().m_buffers.SetCapacity(bytes);
+}
+
 void Image::Save(std::string name)
 {
     PNGEncoder encoder;
@@ -1,6 +1,8 @@
 #ifndef VTKH_DIY_IMAGE_HPP
 #define VTKH_DIY_IMAGE_HPP
 
+#include <vtkh/rendering/ImageKernels.hpp>
+#include <algorithm>
 #include <sstream>
 #include <vector>
 #include <vtkm/Bounds.h>
@@ -23,6 +25,9 @@ struct Image
     int                          m_composite_order;
 
     Image()
+      : m_orig_rank(-1),
+        m_has_transparency(false),
+        m_composite_order(-1)
     {}
 
     Image(const vtkm::Bounds &bounds)
@@ -36,9 +41,27 @@ struct Image
         const int dx  = bounds.X.Max - bounds.X.Min + 1;
         const int dy  = bounds.Y.Max - bounds.Y.Min + 1;
         m_pixels.resize(dx * dy * 4);
-        m_depths.resize(dx * dy);
+        // pixels nobody writes to are background
+        m_depths.resize(dx * dy, 2.f);
     }
 
+    //
+    // Sizes the image for num_pixels. When the current storage is too
+    // small, storage left over from recycled images is used if there
+    // is some of about the right size.
+    //
+    void Allocate(const int num_pixels);
+    //
+    // Gives the storage of the image to the pool for later images and
+    // clears it. Images that are simply destroyed free their storage.
+    //
+    void Recycle();
+    //
+    // Bytes of recycled storage kept around for later images. The
+    // storage idle the longest is freed first. Defaults to 1 GiB.
+    //
+    static void SetPoolCapacity(const size_t bytes);
+
     int GetNumberOfPixels() const 
     {
       return static_cast<int>(m_pixels.size() / 4); 
@@ -59,31 +82,76 @@ struct Image
               int width,
               int height,
               int composite_order = -1)
+    {
+      Init(color_buffer,
+           depth_buffer,
+           width,
+           height,
+           CanvasBounds(width, height),
+           composite_order);
+    }
+
+    void Init(const unsigned char *color_buffer,
+              const float *depth_buffer,
+              int width,
+              int height,
+              int composite_order = -1)
+    {
+      Init(color_buffer,
+           depth_buffer,
+           width,
+           height,
+           CanvasBounds(width, height),
+           composite_order);
+    }
+    //
+    // Initialize from a sub-region of a width x height canvas.
+    // Only the pixels inside of sub_region are copied.
+    //
+    void Init(const float *color_buffer,
+              const float *depth_buffer,
+              int width,
+              int height,
+              const vtkm::Bounds &sub_region,
+              int composite_order = -1)
     {
       m_composite_order = composite_order;
-      m_bounds.X.Min = 1;
-      m_bounds.Y.Min = 1;
-      m_bounds.X.Max = width;
-      m_bounds.Y.Max = height;
-      m_orig_bounds = m_bounds; 
-      const int size = width * height;
-      m_pixels.resize(size * 4);
-      m_depths.resize(size);
+      m_orig_bounds = CanvasBounds(width, height);
+      m_bounds = sub_region;
+
+      assert(sub_region.X.Min >= 1);
+      assert(sub_region.Y.Min >= 1);
+      assert(sub_region.X.Max <= width);
+      assert(sub_region.Y.Max <= height);
+
+      const int s_dx  = m_bounds.X.Max - m_bounds.X.Min + 1;
+      const int s_dy  = m_bounds.Y.Max - m_bounds.Y.Min + 1;
+      const int start_x = m_bounds.X.Min - 1;
+      const int start_y = m_bounds.Y.Min - 1;
+
+      const int size = s_dx * s_dy;
+      Allocate(size);
       
 #ifdef VTKH_USE_OPENMP
       #pragma omp parallel for 
 #endif
-      for(int i = 0; i < size; ++i)
+      for(int y = 0; y < s_dy; ++y)
       {
-        const int offset = i * 4;
-        m_pixels[offset + 0] = static_cast<unsigned char>(color_buffer[offset + 0] * 255.f);
-        m_pixels[offset + 1] = static_cast<unsigned char>(color_buffer[offset + 1] * 255.f);
-        m_pixels[offset + 2] = static_cast<unsigned char>(color_buffer[offset + 2] * 255.f);
-        m_pixels[offset + 3] = static_cast<unsigned char>(color_buffer[offset + 3] * 255.f);
-        float depth = depth_buffer[i];
-        //make sure we can do a single comparison on depth
-        depth = depth < 0 ? 2.f : depth;
-        m_depths[i] =  depth;
+        for(int x = 0; x < s_dx; ++x)
+        {
+          const int i = y * s_dx + x;
+          const int in_index = (y + start_y) * width + x + start_x;
+          const int offset = i * 4;
+          const int in_offset = in_index * 4;
+          m_pixels[offset + 0] = static_cast<unsigned char>(color_buffer[in_offset + 0] * 255.f);
+          m_pixels[offset + 1] = static_cast<unsigned char>(color_buffer[in_offset + 1] * 255.f);
+          m_pixels[offset + 2] = static_cast<unsigned char>(color_buffer[in_offset + 2] * 255.f);
+          m_pixels[offset + 3] = static_cast<unsigned char>(color_buffer[in_offset + 3] * 255.f);
+          float depth = depth_buffer[in_index];
+          //make sure we can do a single comparison on depth
+          depth = depth < 0 ? 2.f : depth;
+          m_depths[i] =  depth;
+        }
       }
     }
 
@@ -91,35 +159,75 @@ struct Image
               const float *depth_buffer,
               int width,
               int height,
+              const vtkm::Bounds &sub_region,
               int composite_order = -1)
     {
       m_composite_order = composite_order;
-      m_bounds.X.Min = 1;
-      m_bounds.Y.Min = 1;
-      m_bounds.X.Max = width;
-      m_bounds.Y.Max = height;
-      m_orig_bounds = m_bounds; 
+      m_orig_bounds = CanvasBounds(width, height);
+      m_bounds = sub_region;
 
-      const int size = width * height;
-      m_pixels.resize(size * 4);
-      m_depths.resize(size);
+      assert(sub_region.X.Min >= 1);
+      assert(sub_region.Y.Min >= 1);
+      assert(sub_region.X.Max <= width);
+      assert(sub_region.Y.Max <= height);
 
-      std::copy(color_buffer,
-                color_buffer + size * 4,
-                &m_pixels[0]);
+      const int s_dx  = m_bounds.X.Max - m_bounds.X.Min + 1;
+      const int s_dy  = m_bounds.Y.Max - m_bounds.Y.Min + 1;
+      const int start_x = m_bounds.X.Min - 1;
+      const int start_y = m_bounds.Y.Min - 1;
 
-#ifdef vtkh_USE_OPENMP
+      const int size = s_dx * s_dy;
+      Allocate(size);
+
+#ifdef VTKH_USE_OPENMP
       #pragma omp parallel for 
 #endif
-      for(int i = 0; i < size; ++i)
+      for(int y = 0; y < s_dy; ++y)
       {
-        float depth = depth_buffer[i];
-        //make sure we can do a single comparison on depth
-        depth = depth < 0 ? 2.f : depth;
-        m_depths[i] =  depth;
+        const int in_index = (y + start_y) * width + start_x;
+        std::copy(color_buffer + in_index * 4,
+                  color_buffer + (in_index + s_dx) * 4,
+                  &m_pixels[y * s_dx * 4]);
+        for(int x = 0; x < s_dx; ++x)
+        {
+          float depth = depth_buffer[in_index + x];
+          //make sure we can do a single comparison on depth
+          depth = depth < 0 ? 2.f : depth;
+          m_depths[y * s_dx + x] =  depth;
+        }
       } // for
     }
 
+    static vtkm::Bounds CanvasBounds(int width, int height)
+    {
+      vtkm::Bounds bounds;
+      bounds.X.Min = 1;
+      bounds.Y.Min = 1;
+      bounds.X.Max = width;
+      bounds.Y.Max = height;
+      return bounds;
+    }
+    //
+    // Returns the overlap of two image regions. The result
+    // is empty (min > max) if they do not overlap
+    //
+    static vtkm::Bounds Intersect(const vtkm::Bounds &a, const vtkm::Bounds &b)
+    {
+      vtkm::Bounds res;
+      res.X.Min = std::max(a.X.Min, b.X.Min);
+      res.Y.Min = std::max(a.Y.Min, b.Y.Min);
+      res.X.Max = std::min(a.X.Max, b.X.Max);
+      res.Y.Max = std::min(a.Y.Max, b.Y.Max);
+      return res;
+    }
+
+    static bool Contains(const vtkm::Bounds &outer, const vtkm::Bounds &inner)
+    {
+      return inner.X.Min >= outer.X.Min &&
+             inner.Y.Min >= outer.Y.Min &&
+             inner.X.Max <= outer.X.Max &&
+             inner.Y.Max <= outer.Y.Max;
+    }
     
     void CompositeBackground(const float *color)
     {
@@ -131,22 +239,22 @@ struct Image
         bg_color[i] = static_cast<unsigned char>(color[i] * 255.f);
       }
 
+      // blend in chunks so threads get whole vectors
+      const int chunk = 1024;
+      const int num_chunks = (size + chunk - 1) / chunk;
 #ifdef VTKH_USE_OPENMP
       #pragma omp parallel for 
 #endif
-      for(int i = 0; i < size; ++i)
+      for(int c = 0; c < num_chunks; ++c)
       {
-        const int offset = i * 4;
-        unsigned int alpha = static_cast<unsigned int>(m_pixels[offset + 3]);
-        const float opacity = (255 - alpha);
-        m_pixels[offset + 0] += static_cast<unsigned char>(opacity * bg_color[0] / 255); 
-        m_pixels[offset + 1] += static_cast<unsigned char>(opacity * bg_color[1] / 255); 
-        m_pixels[offset + 2] += static_cast<unsigned char>(opacity * bg_color[2] / 255); 
-        m_pixels[offset + 3] += static_cast<unsigned char>(opacity * bg_color[3] / 255); 
+        const int start = c * chunk;
+        const int count = std::min(chunk, size - start);
+        detail::BlendBackgroundPixels(&m_pixels[start * 4], bg_color, count);
       }
     }
     //
-    // Fill this image with a sub-region of another image 
+    // Fill this image with a sub-region of another image. Parts of
+    // the sub-region outside of the other image are background
     //
     void SubsetFrom(const Image &image,
                     const vtkm::Bounds &sub_region)
@@ -156,14 +264,44 @@ struct Image
       m_orig_rank = image.m_orig_rank;
       m_composite_order = image.m_composite_order;
 
-      assert(sub_region.X.Min >= image.m_bounds.X.Min);
-      assert(sub_region.Y.Min >= image.m_bounds.Y.Min);
-      assert(sub_region.X.Max <= image.m_bounds.X.Max);
-      assert(sub_region.Y.Max <= image.m_bounds.Y.Max);
-
       const int s_dx  = m_bounds.X.Max - m_bounds.X.Min + 1;
       const int s_dy  = m_bounds.Y.Max - m_bounds.Y.Min + 1;
 
+      if(!Contains(image.m_bounds, sub_region))
+      {
+        Allocate(s_dx * s_dy);
+        std::fill(m_pixels.begin(), m_pixels.end(), 0);
+        std::fill(m_depths.begin(), m_depths.end(), 2.f);
+        const vtkm::Bounds overlap = Intersect(image.m_bounds, sub_region);
+        if(overlap.X.Min > overlap.X.Max || overlap.Y.Min > overlap.Y.Max)
+        {
+          return;
+        }
+        // copy the overlap straight across
+        const int src_dx = image.m_bounds.X.Max - image.m_bounds.X.Min + 1;
+        const int o_dx = overlap.X.Max - overlap.X.Min + 1;
+        const int o_dy = overlap.Y.Max - overlap.Y.Min + 1;
+        const int src_x = overlap.X.Min - image.m_bounds.X.Min;
+        const int src_y = overlap.Y.Min - image.m_bounds.Y.Min;
+        const int dst_x = overlap.X.Min - m_bounds.X.Min;
+        const int dst_y = overlap.Y.Min - m_bounds.Y.Min;
+#ifdef VTKH_USE_OPENMP
+        #pragma omp parallel for
+#endif
+        for(int y = 0; y < o_dy; ++y)
+        {
+          const int copy_from = (src_y + y) * src_dx + src_x;
+          const int copy_to = (dst_y + y) * s_dx + dst_x;
+          std::copy(&image.m_pixels[copy_from * 4],
+                    &image.m_pixels[copy_from * 4] + o_dx * 4,
+                    &m_pixels[copy_to * 4]);
+          std::copy(&image.m_depths[copy_from],
+                    &image.m_depths[copy_from] + o_dx,
+                    &m_depths[copy_to]);
+        }
+        return;
+      }
+
       const int dx  = image.m_bounds.X.Max - image.m_bounds.X.Min + 1;
       //const int dy  = image.m_bounds.Y.Max - image.m_bounds.Y.Min + 1;
       
@@ -171,8 +309,7 @@ struct Image
       const int start_y = m_bounds.Y.Min - image.m_bounds.Y.Min;
       const int end_y = start_y + s_dy;
 
-      m_pixels.resize(s_dx * s_dy * 4);
-      m_depths.resize(s_dx * s_dy);
+      Allocate(s_dx * s_dy);
       
       
       
@@ -296,7 +433,8 @@ struct Image
 
 struct CompositeOrderSort
 {
-  inline bool operator()(const Image &lhs, const Image &rhs) const
+  template<typename ImageType>
+  inline bool operator()(const ImageType &lhs, const ImageType &rhs) const
   {
     return lhs.m_composite_order < rhs.m_composite_order;
   }
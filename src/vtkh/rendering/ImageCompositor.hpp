@@ -2,6 +2,8 @@
 #define VTKH_DIY_IMAGE_COMPOSITOR_HPP
 
 #include <vtkh/rendering/Image.hpp>
+#include <vtkh/rendering/CompressedImage.hpp>
+#include <vtkh/rendering/ImageKernels.hpp>
 #include <algorithm>
 
 namespace vtkh
@@ -10,41 +12,166 @@ namespace vtkh
 class ImageCompositor
 {
 public:
+  //
+  // Blend back behind front. The back image may cover a sub-region
+  // of front, everything outside of it is left untouched.
+  //
   void Blend(vtkh::Image &front, vtkh::Image &back)
   {
+    assert(Image::Contains(front.m_bounds, back.m_bounds));
 
+    const int front_dx = front.m_bounds.X.Max - front.m_bounds.X.Min + 1;
+    const int dx = back.m_bounds.X.Max - back.m_bounds.X.Min + 1;
+    const int dy = back.m_bounds.Y.Max - back.m_bounds.Y.Min + 1;
+    const int start_x = back.m_bounds.X.Min - front.m_bounds.X.Min;
+    const int start_y = back.m_bounds.Y.Min - front.m_bounds.Y.Min;
+  
+#ifdef VTKH_USE_OPENMP
+    #pragma omp parallel for 
+#endif
+    for(int y = 0; y < dy; ++y)
+    {
+      const int b = y * dx;
+      const int i = (y + start_y) * front_dx + start_x;
+      detail::BlendPixels(&front.m_pixels[i * 4],
+                          &front.m_depths[i],
+                          &back.m_pixels[b * 4],
+                          &back.m_depths[b],
+                          dx);
+    }
+  }
+
+  //
+  // Blend the active pixels of a compressed image behind front.
+  // Empty pixels contribute nothing so they are skipped.
+  //
+  void Blend(vtkh::Image &front, const vtkh::CompressedImage &back)
+  {
     assert(front.m_bounds.X.Min == back.m_bounds.X.Min); 
     assert(front.m_bounds.Y.Min == back.m_bounds.Y.Min); 
     assert(front.m_bounds.X.Max == back.m_bounds.X.Max); 
     assert(front.m_bounds.Y.Max == back.m_bounds.Y.Max); 
-    const int size = static_cast<int>(front.m_pixels.size() / 4); 
-  
+
+    std::vector<int> pixel_offsets, active_offsets;
+    back.GetRunOffsets(pixel_offsets, active_offsets);
+    const int num_runs = back.GetNumberOfRuns();
+
 #ifdef VTKH_USE_OPENMP
     #pragma omp parallel for 
 #endif
-    for(int i = 0; i < size; ++i)
+    for(int r = 0; r < num_runs; ++r)
+    {
+      const int count = back.m_runs[r * 2 + 1];
+      if(count == 0)
+      {
+        continue;
+      }
+      const int start = pixel_offsets[r];
+      const int active_start = active_offsets[r];
+      detail::BlendPixels(&front.m_pixels[start * 4],
+                          &front.m_depths[start],
+                          &back.m_pixels[active_start * 4],
+                          &back.m_depths[active_start],
+                          count);
+    } // for runs
+  }
+
+//
+// Z-buffer composite image into front. The image may cover a
+// sub-region of front.
+//
+void ZBufferComposite(vtkh::Image &front, const vtkh::Image &image)
+{
+  assert(front.m_depths.size() == front.m_pixels.size() / 4);
+  assert(Image::Contains(front.m_bounds, image.m_bounds));
+
+  const int front_dx = front.m_bounds.X.Max - front.m_bounds.X.Min + 1;
+  const int dx = image.m_bounds.X.Max - image.m_bounds.X.Min + 1;
+  const int dy = image.m_bounds.Y.Max - image.m_bounds.Y.Min + 1;
+  const int start_x = image.m_bounds.X.Min - front.m_bounds.X.Min;
+  const int start_y = image.m_bounds.Y.Min - front.m_bounds.Y.Min;
+
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for 
+#endif
+  for(int y = 0; y < dy; ++y)
+  {
+    const int j = y * dx;
+    const int i = (y + start_y) * front_dx + start_x;
+    detail::ZBufferPixels(&front.m_pixels[i * 4],
+                          &front.m_depths[i],
+                          &image.m_pixels[j * 4],
+                          &image.m_depths[j],
+                          dx);
+  }
+}
+
+//
+// Z-buffer composite a sub-region of a width x height canvas into
+// front, reading the canvas buffers in place. Only the pixels that
+// end up in front are converted.
+//
+template<typename ColorType>
+void ZBufferComposite(vtkh::Image &front,
+                      const ColorType *color_buffer,
+                      const float *depth_buffer,
+                      const int width,
+                      const int height,
+                      const vtkm::Bounds &sub_region)
+{
+  assert(Image::Contains(front.m_bounds, sub_region));
+  assert(sub_region.X.Max <= width);
+  assert(sub_region.Y.Max <= height);
+  (void) height;
+
+  const int front_dx = front.m_bounds.X.Max - front.m_bounds.X.Min + 1;
+  const int dx = sub_region.X.Max - sub_region.X.Min + 1;
+  const int dy = sub_region.Y.Max - sub_region.Y.Min + 1;
+  const int start_x = sub_region.X.Min - front.m_bounds.X.Min;
+  const int start_y = sub_region.Y.Min - front.m_bounds.Y.Min;
+  const int canvas_x = sub_region.X.Min - 1;
+  const int canvas_y = sub_region.Y.Min - 1;
+
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int y = 0; y < dy; ++y)
+  {
+    const int in_row = (y + canvas_y) * width + canvas_x;
+    const int row = (y + start_y) * front_dx + start_x;
+    for(int x = 0; x < dx; ++x)
     {
-      const int offset = i * 4;
-      unsigned int alpha = front.m_pixels[offset + 3];
-      const unsigned int opacity = 255 - alpha;
-
-      front.m_pixels[offset + 0] += 
-        static_cast<unsigned char>(opacity * back.m_pixels[offset + 0] / 255); 
-      front.m_pixels[offset + 1] += 
-        static_cast<unsigned char>(opacity * back.m_pixels[offset + 1] / 255); 
-      front.m_pixels[offset + 2] += 
-        static_cast<unsigned char>(opacity * back.m_pixels[offset + 2] / 255); 
-      front.m_pixels[offset + 3] += 
-        static_cast<unsigned char>(opacity * back.m_pixels[offset + 3] / 255); 
-
-      float d1 = std::min(front.m_depths[i], 1.001f); 
-      float d2 = std::min(back.m_depths[i], 1.001f); 
-      float depth = std::min(d1,d2); 
+      const float depth = depth_buffer[in_row + x];
+      const int i = row + x;
+      // negative depths are background, same as Image::Init
+      if(depth < 0.f || depth > 1.f || front.m_depths[i] < depth)
+      {
+        continue;
+      }
+      const int in_offset = (in_row + x) * 4;
       front.m_depths[i] = depth;
+      front.m_pixels[i * 4 + 0] = ToByte(color_buffer[in_offset + 0]);
+      front.m_pixels[i * 4 + 1] = ToByte(color_buffer[in_offset + 1]);
+      front.m_pixels[i * 4 + 2] = ToByte(color_buffer[in_offset + 2]);
+      front.m_pixels[i * 4 + 3] = ToByte(color_buffer[in_offset + 3]);
     }
   }
+}
 
-void ZBufferComposite(vtkh::Image &front, const vtkh::Image &image)
+static unsigned char ToByte(const float value)
+{
+  return static_cast<unsigned char>(value * 255.f);
+}
+
+static unsigned char ToByte(const unsigned char value)
+{
+  return value;
+}
+
+//
+// Z-buffer composite the active pixels of a compressed image into front.
+//
+void ZBufferComposite(vtkh::Image &front, const vtkh::CompressedImage &image)
 {
   assert(front.m_depths.size() == front.m_pixels.size() / 4);
   assert(front.m_bounds.X.Min == image.m_bounds.X.Min); 
@@ -52,24 +179,52 @@ void ZBufferComposite(vtkh::Image &front, const vtkh::Image &image)
   assert(front.m_bounds.X.Max == image.m_bounds.X.Max); 
   assert(front.m_bounds.Y.Max == image.m_bounds.Y.Max); 
 
-  const int size = static_cast<int>(front.m_depths.size()); 
+  if(image.IsEmpty())
+  {
+    return;
+  }
+
+  std::vector<int> pixel_offsets, active_offsets;
+  image.GetRunOffsets(pixel_offsets, active_offsets);
+  const int num_runs = image.GetNumberOfRuns();
 
-#ifdef vtkh_USE_OPENMP
+#ifdef VTKH_USE_OPENMP
   #pragma omp parallel for 
 #endif
-  for(int i = 0; i < size; ++i)
+  for(int r = 0; r < num_runs; ++r)
   {
-    const float depth = image.m_depths[i];
-    if(depth > 1.f  || front.m_depths[i] < depth)
+    const int count = image.m_runs[r * 2 + 1];
+    if(count == 0)
     {
       continue;
     }
-    const int offset = i * 4;
-    front.m_depths[i] = depth;
-    front.m_pixels[offset + 0] = image.m_pixels[offset + 0];
-    front.m_pixels[offset + 1] = image.m_pixels[offset + 1];
-    front.m_pixels[offset + 2] = image.m_pixels[offset + 2];
-    front.m_pixels[offset + 3] = image.m_pixels[offset + 3];
+    const int start = pixel_offsets[r];
+    const int active_start = active_offsets[r];
+    detail::ZBufferPixels(&front.m_pixels[start * 4],
+                          &front.m_depths[start],
+                          &image.m_pixels[active_start * 4],
+                          &image.m_depths[active_start],
+                          count);
+  }
+}
+
+//
+// Images can cover different parts of the screen, so grow the
+// first image to cover all of them
+//
+void ExpandFront(std::vector<vtkh::Image> &images)
+{
+  const int total_images = images.size();
+  vtkm::Bounds bounds = images[0].m_bounds;
+  for(int i = 1; i < total_images; ++i)
+  {
+    bounds.Include(images[i].m_bounds);
+  }
+  if(bounds != images[0].m_bounds)
+  {
+    Image front;
+    front.SubsetFrom(images[0], bounds);
+    images[0].Swap(front);
   }
 }
 
@@ -77,119 +232,147 @@ void OrderedComposite(std::vector<vtkh::Image> &images)
 {
   const int total_images = images.size();
   std::sort(images.begin(), images.end(), CompositeOrderSort());
+  ExpandFront(images);
   for(int i = 1; i < total_images; ++i)
   {
     Blend(images[0], images[i]);
   }
 }
 
-void ZBufferComposite(std::vector<vtkh::Image> &images)
+//
+// Blend compressed images in composite order into output
+//
+void OrderedComposite(std::vector<vtkh::CompressedImage> &images, vtkh::Image &output)
 {
+  assert(images.size() != 0);
   const int total_images = images.size();
+  std::sort(images.begin(), images.end(), CompositeOrderSort());
+  images[0].Decompress(output);
   for(int i = 1; i < total_images; ++i)
   {
-    ZBufferComposite(images[0], images[i]);
+    Blend(output, images[i]);
   }
 }
 
-struct Pixel
+void ZBufferComposite(std::vector<vtkh::Image> &images)
 {
-  unsigned char m_color[4];  
-  float         m_depth;
-  int           m_pixel_id;  // local (sub-image) pixels id 
-
-  bool operator < (const Pixel &other) const
+  const int total_images = images.size();
+  ExpandFront(images);
+  for(int i = 1; i < total_images; ++i)
   {
-    if(m_pixel_id != other.m_pixel_id) 
-    {
-      return m_pixel_id < other.m_pixel_id;
-    }
-    else
-    {
-      return m_depth < other.m_depth;
-    }
+    ZBufferComposite(images[0], images[i]);
   }
-};
+}
 
-void CombineImages(const std::vector<vtkh::Image> &images, std::vector<Pixel> &pixels)
+//
+// One image's contribution to a pixel
+//
+struct Fragment
 {
+  float         m_depth;
+  unsigned char m_color[4];
+};
 
-  const int num_images = static_cast<int>(images.size());
-  for(int i = 0; i < num_images; ++i)
-  {
-    //
-    //  Extract the partial composites into a contiguous array
-    //
-
-    const int image_size = images[i].GetNumberOfPixels(); 
-    const int offset = i * image_size;
-    #pragma omp parallel for
-    for(int j = 0; j < image_size; ++j)
-    {
-      const int image_offset = j * 4;
-      pixels[offset + j].m_color[0] = images[i].m_pixels[image_offset + 0];
-      pixels[offset + j].m_color[1] = images[i].m_pixels[image_offset + 1];
-      pixels[offset + j].m_color[2] = images[i].m_pixels[image_offset + 2];
-      pixels[offset + j].m_color[3] = images[i].m_pixels[image_offset + 3];
-      pixels[offset + j].m_depth = images[i].m_depths[j];
-      pixels[offset + j].m_pixel_id = j;
-    } // for pixels
-  } // for images
-
-}
-
+//
+// Blend the fragments of all images at each pixel from front to back.
+// Fragments are insertion sorted into a small per-pixel buffer as they
+// are gathered, which beats a general sort for the handful of images
+// that overlap a pixel, and blending stops once a pixel is opaque.
+// The images can cover different parts of the screen and the result
+// in the first image covers all of them.
+//
 void ZBufferBlend(std::vector<vtkh::Image> &images)
 {
-  const int image_pixels = images[0].GetNumberOfPixels();
+  assert(images.size() != 0);
   const int num_images = static_cast<int>(images.size());
-  std::vector<Pixel> pixels;
-  CombineImages(images, pixels);
-  #pragma omp parallel for
-  for(int i = 0; i < image_pixels; ++i)
-  {
-    const int begin = image_pixels * i; 
-    const int end = image_pixels * i - 1; 
-    std::sort(pixels.begin() + begin, pixels.begin() + end);  
-  }
-  
-  // check to see if that worked
-  int pixel_id_0 = pixels[0].m_pixel_id;
+  vtkm::Bounds bounds = images[0].m_bounds;
   for(int i = 1; i < num_images; ++i)
   {
-    assert(pixel_id_0 == pixels[i].m_pixel_id);
+    bounds.Include(images[i].m_bounds);
   }
- 
 
-  #pragma omp parallel for
-  for(int i = 0; i < image_pixels; ++i)
+  Image result(bounds);
+  result.m_orig_bounds = images[0].m_orig_bounds;
+  const int dx = bounds.X.Max - bounds.X.Min + 1;
+  const int dy = bounds.Y.Max - bounds.Y.Min + 1;
+
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for 
+#endif
+  for(int y = 0; y < dy; ++y)
   {
-    const int index = i * num_images; 
-    Pixel pixel = pixels[index];
-    for(int j = 1; j < num_images; ++j)
+    const int screen_y = y + bounds.Y.Min;
+    // the images that cover this row and where the row starts in each
+    std::vector<int> rows;
+    std::vector<Fragment> fragments(num_images);
+    for(int i = 0; i < num_images; ++i)
+    {
+      const vtkm::Bounds &b = images[i].m_bounds;
+      if(screen_y < b.Y.Min || screen_y > b.Y.Max)
+      {
+        continue;
+      }
+      const int image_dx = b.X.Max - b.X.Min + 1;
+      rows.push_back(i);
+      rows.push_back((screen_y - b.Y.Min) * image_dx - b.X.Min);
+    }
+    const int num_rows = static_cast<int>(rows.size() / 2);
+
+    for(int x = 0; x < dx; ++x)
     {
-      if(pixel.m_color[3] == 255 || pixel.m_depth > 1.f)
+      const int screen_x = x + bounds.X.Min;
+      float min_depth = 2.f;
+      int count = 0;
+      for(int r = 0; r < num_rows; ++r)
+      {
+        const Image &image = images[rows[r * 2]];
+        if(screen_x < image.m_bounds.X.Min || screen_x > image.m_bounds.X.Max)
+        {
+          continue;
+        }
+        const int index = rows[r * 2 + 1] + screen_x;
+        const unsigned char *pixel = &image.m_pixels[index * 4];
+        const float depth = image.m_depths[index];
+        min_depth = std::min(min_depth, depth);
+        if(!CompressedImage::IsActive(pixel, depth))
+        {
+          continue;
+        }
+        // insert keeping the fragments front to back
+        int pos = count;
+        while(pos > 0 && fragments[pos - 1].m_depth > depth)
+        {
+          fragments[pos] = fragments[pos - 1];
+          pos--;
+        }
+        fragments[pos].m_depth = depth;
+        fragments[pos].m_color[0] = pixel[0];
+        fragments[pos].m_color[1] = pixel[1];
+        fragments[pos].m_color[2] = pixel[2];
+        fragments[pos].m_color[3] = pixel[3];
+        count++;
+      }
+
+      unsigned char color[4] = {0, 0, 0, 0};
+      for(int f = 0; f < count && color[3] != 255; ++f)
       {
-        break;
+        const unsigned int opacity = 255 - color[3];
+        color[0] += static_cast<unsigned char>(opacity * fragments[f].m_color[0] / 255); 
+        color[1] += static_cast<unsigned char>(opacity * fragments[f].m_color[1] / 255); 
+        color[2] += static_cast<unsigned char>(opacity * fragments[f].m_color[2] / 255); 
+        color[3] += static_cast<unsigned char>(opacity * fragments[f].m_color[3] / 255); 
       }
-      unsigned int alpha = pixel.m_color[3];
-      const unsigned int opacity = 255 - alpha;
-      pixel.m_color[0] 
-        += static_cast<unsigned char>(opacity * pixels[index + j].m_color[0] / 255); 
-      pixel.m_color[1] 
-        += static_cast<unsigned char>(opacity * pixels[index + j].m_color[1] / 255); 
-      pixel.m_color[2] 
-        += static_cast<unsigned char>(opacity * pixels[index + j].m_color[2] / 255); 
-      pixel.m_color[3] 
-        += static_cast<unsigned char>(opacity * pixels[index + j].m_color[3] / 255); 
-      pixel.m_depth = pixels[index + j].m_depth;
-    } // for each image
-    images[0].m_pixels[i * 4 + 0] = pixel.m_color[0]; 
-    images[0].m_pixels[i * 4 + 1] = pixel.m_color[1]; 
-    images[0].m_pixels[i * 4 + 2] = pixel.m_color[2]; 
-    images[0].m_pixels[i * 4 + 3] = pixel.m_color[3]; 
-    images[0].m_depths[i] = pixel.m_depth; 
-  } // for each pixel
 
+      const int i = y * dx + x;
+      result.m_pixels[i * 4 + 0] = color[0];
+      result.m_pixels[i * 4 + 1] = color[1];
+      result.m_pixels[i * 4 + 2] = color[2];
+      result.m_pixels[i * 4 + 3] = color[3];
+      result.m_depths[i] = count > 0 ? fragments[0].m_depth : min_depth;
+    } // for x
+  } // for y
+
+  images[0].Swap(result);
 }
 
 
@@ -0,0 +1,378 @@
+#ifndef VTKH_IMAGE_KERNELS_HPP
+#define VTKH_IMAGE_KERNELS_HPP
+
+#include <algorithm>
+
+//
+// The inner loops of compositing work on contiguous runs of RGBA8
+// pixels and float depths. On x86 they are vectorized with SSE2 and,
+// when the cpu supports it, AVX2. Everything else (including device
+// compilers) uses the scalar loops, which define the results: the
+// vector versions are bit for bit identical.
+//
+#if !defined(__CUDACC__) && defined(__GNUC__) && \
+    (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define VTKH_IMAGE_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+namespace vtkh
+{
+namespace detail
+{
+
+enum SIMDLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX2 };
+
+inline SIMDLevel GetSIMDLevel()
+{
+#ifdef VTKH_IMAGE_KERNELS_X86
+  static const SIMDLevel level = __builtin_cpu_supports("avx2") ? SIMD_AVX2
+                                                                : SIMD_SSE2;
+  return level;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+//----------------------------------------------------------------------------
+// scalar kernels
+//----------------------------------------------------------------------------
+
+//
+// front += (255 - front alpha) * back / 255 for each channel and
+// keep the closest (clamped) depth
+//
+inline void BlendScalar(unsigned char *front,
+                        float *front_depths,
+                        const unsigned char *back,
+                        const float *back_depths,
+                        const int count)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    const int offset = i * 4;
+    const unsigned int opacity = 255 - front[offset + 3];
+    front[offset + 0] += static_cast<unsigned char>(opacity * back[offset + 0] / 255);
+    front[offset + 1] += static_cast<unsigned char>(opacity * back[offset + 1] / 255);
+    front[offset + 2] += static_cast<unsigned char>(opacity * back[offset + 2] / 255);
+    front[offset + 3] += static_cast<unsigned char>(opacity * back[offset + 3] / 255);
+
+    float d1 = std::min(front_depths[i], 1.001f);
+    float d2 = std::min(back_depths[i], 1.001f);
+    front_depths[i] = std::min(d1,d2);
+  }
+}
+
+//
+// take the pixels that are in front and not empty
+//
+inline void ZBufferScalar(unsigned char *front,
+                          float *front_depths,
+                          const unsigned char *pixels,
+                          const float *depths,
+                          const int count)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    const float depth = depths[i];
+    if(depth > 1.f  || front_depths[i] < depth)
+    {
+      continue;
+    }
+    const int offset = i * 4;
+    front_depths[i] = depth;
+    front[offset + 0] = pixels[offset + 0];
+    front[offset + 1] = pixels[offset + 1];
+    front[offset + 2] = pixels[offset + 2];
+    front[offset + 3] = pixels[offset + 3];
+  }
+}
+
+inline void BlendBackgroundScalar(unsigned char *pixels,
+                                  const unsigned char *bg_color,
+                                  const int count)
+{
+  for(int i = 0; i < count; ++i)
+  {
+    const int offset = i * 4;
+    const unsigned int opacity = 255 - pixels[offset + 3];
+    pixels[offset + 0] += static_cast<unsigned char>(opacity * bg_color[0] / 255);
+    pixels[offset + 1] += static_cast<unsigned char>(opacity * bg_color[1] / 255);
+    pixels[offset + 2] += static_cast<unsigned char>(opacity * bg_color[2] / 255);
+    pixels[offset + 3] += static_cast<unsigned char>(opacity * bg_color[3] / 255);
+  }
+}
+
+#ifdef VTKH_IMAGE_KERNELS_X86
+//----------------------------------------------------------------------------
+// SSE2 kernels: 4 pixels at a time
+//----------------------------------------------------------------------------
+
+//
+// floor(x / 255) for x in [0, 255 * 255] without a divide
+//
+inline __m128i Div255SSE2(const __m128i x)
+{
+  const __m128i one = _mm_set1_epi16(1);
+  return _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x, one),
+                                      _mm_srli_epi16(x, 8)), 8);
+}
+
+//
+// (255 - alpha) * color / 255 for 2 pixels widened to 16 bits
+//
+inline __m128i OverSSE2(const __m128i front, const __m128i back)
+{
+  __m128i alpha = _mm_shufflelo_epi16(front, _MM_SHUFFLE(3,3,3,3));
+  alpha = _mm_shufflehi_epi16(alpha, _MM_SHUFFLE(3,3,3,3));
+  const __m128i opacity = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+  return Div255SSE2(_mm_mullo_epi16(opacity, back));
+}
+
+inline __m128i BlendPixelsSSE2(const __m128i front, const __m128i back)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i lo = OverSSE2(_mm_unpacklo_epi8(front, zero),
+                              _mm_unpacklo_epi8(back, zero));
+  const __m128i hi = OverSSE2(_mm_unpackhi_epi8(front, zero),
+                              _mm_unpackhi_epi8(back, zero));
+  // unsigned char arithmetic wraps, just like the scalar version
+  return _mm_add_epi8(front, _mm_packus_epi16(lo, hi));
+}
+
+inline void BlendSSE2(unsigned char *front,
+                      float *front_depths,
+                      const unsigned char *back,
+                      const float *back_depths,
+                      const int count)
+{
+  const __m128 max_depth = _mm_set1_ps(1.001f);
+  int i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(front + i * 4));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(back + i * 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(front + i * 4), BlendPixelsSSE2(f, b));
+
+    __m128 d1 = _mm_min_ps(_mm_loadu_ps(front_depths + i), max_depth);
+    __m128 d2 = _mm_min_ps(_mm_loadu_ps(back_depths + i), max_depth);
+    _mm_storeu_ps(front_depths + i, _mm_min_ps(d1, d2));
+  }
+  BlendScalar(front + i * 4, front_depths + i, back + i * 4, back_depths + i, count - i);
+}
+
+inline void ZBufferSSE2(unsigned char *front,
+                        float *front_depths,
+                        const unsigned char *pixels,
+                        const float *depths,
+                        const int count)
+{
+  const __m128 one = _mm_set1_ps(1.f);
+  int i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    const __m128 fd = _mm_loadu_ps(front_depths + i);
+    const __m128 d = _mm_loadu_ps(depths + i);
+    // one 32 bit lane per pixel for both depth and color
+    const __m128 take = _mm_and_ps(_mm_cmple_ps(d, one), _mm_cmpge_ps(fd, d));
+    if(_mm_movemask_ps(take) == 0)
+    {
+      continue;
+    }
+    _mm_storeu_ps(front_depths + i,
+                  _mm_or_ps(_mm_and_ps(take, d), _mm_andnot_ps(take, fd)));
+
+    const __m128i mask = _mm_castps_si128(take);
+    const __m128i f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(front + i * 4));
+    const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(front + i * 4),
+                     _mm_or_si128(_mm_and_si128(mask, p), _mm_andnot_si128(mask, f)));
+  }
+  ZBufferScalar(front + i * 4, front_depths + i, pixels + i * 4, depths + i, count - i);
+}
+
+inline void BlendBackgroundSSE2(unsigned char *pixels,
+                                const unsigned char *bg_color,
+                                const int count)
+{
+  const __m128i bg = _mm_set1_epi32(static_cast<int>(bg_color[0])         |
+                                    static_cast<int>(bg_color[1]) << 8    |
+                                    static_cast<int>(bg_color[2]) << 16   |
+                                    static_cast<int>(bg_color[3]) << 24);
+  int i = 0;
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i * 4), BlendPixelsSSE2(p, bg));
+  }
+  BlendBackgroundScalar(pixels + i * 4, bg_color, count - i);
+}
+
+//----------------------------------------------------------------------------
+// AVX2 kernels: 8 pixels at a time, only called when the cpu has AVX2
+//----------------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+inline __m256i BlendPixelsAVX2(const __m256i front, const __m256i back)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i max = _mm256_set1_epi16(255);
+  __m256i res[2];
+  for(int h = 0; h < 2; ++h)
+  {
+    // the unpacks and packs work within 128 bit lanes, so the
+    // order of the pixels is preserved
+    const __m256i f = h == 0 ? _mm256_unpacklo_epi8(front, zero)
+                             : _mm256_unpackhi_epi8(front, zero);
+    const __m256i b = h == 0 ? _mm256_unpacklo_epi8(back, zero)
+                             : _mm256_unpackhi_epi8(back, zero);
+    __m256i alpha = _mm256_shufflelo_epi16(f, _MM_SHUFFLE(3,3,3,3));
+    alpha = _mm256_shufflehi_epi16(alpha, _MM_SHUFFLE(3,3,3,3));
+    const __m256i x = _mm256_mullo_epi16(_mm256_sub_epi16(max, alpha), b);
+    res[h] = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x, one),
+                                                _mm256_srli_epi16(x, 8)), 8);
+  }
+  return _mm256_add_epi8(front, _mm256_packus_epi16(res[0], res[1]));
+}
+
+__attribute__((target("avx2")))
+inline void BlendAVX2(unsigned char *front,
+                      float *front_depths,
+                      const unsigned char *back,
+                      const float *back_depths,
+                      const int count)
+{
+  const __m256 max_depth = _mm256_set1_ps(1.001f);
+  int i = 0;
+  for(; i + 8 <= count; i += 8)
+  {
+    __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(front + i * 4));
+    __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(back + i * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(front + i * 4), BlendPixelsAVX2(f, b));
+
+    __m256 d1 = _mm256_min_ps(_mm256_loadu_ps(front_depths + i), max_depth);
+    __m256 d2 = _mm256_min_ps(_mm256_loadu_ps(back_depths + i), max_depth);
+    _mm256_storeu_ps(front_depths + i, _mm256_min_ps(d1, d2));
+  }
+  BlendSSE2(front + i * 4, front_depths + i, back + i * 4, back_depths + i, count - i);
+}
+
+__attribute__((target("avx2")))
+inline void ZBufferAVX2(unsigned char *front,
+                        float *front_depths,
+                        const unsigned char *pixels,
+                        const float *depths,
+                        const int count)
+{
+  const __m256 one = _mm256_set1_ps(1.f);
+  int i = 0;
+  for(; i + 8 <= count; i += 8)
+  {
+    const __m256 fd = _mm256_loadu_ps(front_depths + i);
+    const __m256 d = _mm256_loadu_ps(depths + i);
+    const __m256 take = _mm256_and_ps(_mm256_cmp_ps(d, one, _CMP_LE_OQ),
+                                      _mm256_cmp_ps(fd, d, _CMP_GE_OQ));
+    if(_mm256_movemask_ps(take) == 0)
+    {
+      continue;
+    }
+    _mm256_storeu_ps(front_depths + i, _mm256_blendv_ps(fd, d, take));
+
+    const __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(front + i * 4));
+    const __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(front + i * 4),
+                        _mm256_blendv_epi8(f, p, _mm256_castps_si256(take)));
+  }
+  ZBufferSSE2(front + i * 4, front_depths + i, pixels + i * 4, depths + i, count - i);
+}
+
+__attribute__((target("avx2")))
+inline void BlendBackgroundAVX2(unsigned char *pixels,
+                                const unsigned char *bg_color,
+                                const int count)
+{
+  const __m256i bg = _mm256_set1_epi32(static_cast<int>(bg_color[0])         |
+                                       static_cast<int>(bg_color[1]) << 8    |
+                                       static_cast<int>(bg_color[2]) << 16   |
+                                       static_cast<int>(bg_color[3]) << 24);
+  int i = 0;
+  for(; i + 8 <= count; i += 8)
+  {
+    __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i * 4), BlendPixelsAVX2(p, bg));
+  }
+  BlendBackgroundSSE2(pixels + i * 4, bg_color, count - i);
+}
+#endif
+
+//----------------------------------------------------------------------------
+// dispatch
+//----------------------------------------------------------------------------
+inline void BlendPixels(unsigned char *front,
+                        float *front_depths,
+                        const unsigned char *back,
+                        const float *back_depths,
+                        const int count,
+                        const SIMDLevel level = GetSIMDLevel())
+{
+#ifdef VTKH_IMAGE_KERNELS_X86
+  if(level == SIMD_AVX2)
+  {
+    BlendAVX2(front, front_depths, back, back_depths, count);
+    return;
+  }
+  if(level == SIMD_SSE2)
+  {
+    BlendSSE2(front, front_depths, back, back_depths, count);
+    return;
+  }
+#endif
+  BlendScalar(front, front_depths, back, back_depths, count);
+}
+
+inline void ZBufferPixels(unsigned char *front,
+                          float *front_depths,
+                          const unsigned char *pixels,
+                          const float *depths,
+                          const int count,
+                          const SIMDLevel level = GetSIMDLevel())
+{
+#ifdef VTKH_IMAGE_KERNELS_X86
+  if(level == SIMD_AVX2)
+  {
+    ZBufferAVX2(front, front_depths, pixels, depths, count);
+    return;
+  }
+  if(level == SIMD_SSE2)
+  {
+    ZBufferSSE2(front, front_depths, pixels, depths, count);
+    return;
+  }
+#endif
+  ZBufferScalar(front, front_depths, pixels, depths, count);
+}
+
+inline void BlendBackgroundPixels(unsigned char *pixels,
+                                  const unsigned char *bg_color,
+                                  const int count,
+                                  const SIMDLevel level = GetSIMDLevel())
+{
+#ifdef VTKH_IMAGE_KERNELS_X86
+  if(level == SIMD_AVX2)
+  {
+    BlendBackgroundAVX2(pixels, bg_color, count);
+    return;
+  }
+  if(level == SIMD_SSE2)
+  {
+    BlendBackgroundSSE2(pixels, bg_color, count);
+    return;
+  }
+#endif
+  BlendBackgroundScalar(pixels, bg_color, count);
+}
+
+} // namespace detail
+} // namespace vtkh
+#endif
@@ -0,0 +1,307 @@
+#include "MacrocellGrid.hpp"
+
+#include <vtkh/utils/vtkm_dataset_info.hpp>
+
+#include <vtkm/cont/Algorithm.h>
+#include <vtkm/cont/ArrayHandleCartesianProduct.h>
+#include <vtkm/cont/ArrayHandleUniformPointCoordinates.h>
+#include <vtkm/cont/CellSetStructured.h>
+
+#include <limits>
+
+namespace vtkh {
+
+namespace detail
+{
+
+typedef VTKMDataSetInfo::UniformArrayHandle   UniformArrayHandle;
+typedef VTKMDataSetInfo::CartesianArrayHandle CartesianArrayHandle;
+typedef VTKMDataSetInfo::DefaultHandle        DefaultHandle;
+
+static bool IsPointField(const vtkm::cont::Field &field)
+{
+  return field.GetAssociation() == vtkm::cont::Field::Association::POINTS;
+}
+
+static bool IsSupported(const vtkm::cont::DataSet &domain, const std::string &field_name)
+{
+  int topo_dims;
+  if(!domain.HasField(field_name) ||
+     !VTKMDataSetInfo::IsStructured(domain, topo_dims) ||
+     topo_dims != 3)
+  {
+    return false;
+  }
+
+  const vtkm::cont::CoordinateSystem coords = domain.GetCoordinateSystem();
+  if(!VTKMDataSetInfo::IsUniform(coords) && !VTKMDataSetInfo::IsRectilinear(coords))
+  {
+    return false;
+  }
+
+  const vtkm::cont::Field &field = domain.GetField(field_name);
+  if(!IsPointField(field) &&
+     field.GetAssociation() != vtkm::cont::Field::Association::CELL_SET)
+  {
+    return false;
+  }
+  return field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float32>()) ||
+         field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float64>());
+}
+
+//
+// min and max over each macrocell. Point fields include the points on
+// both faces of a macrocell, since samples in its cells interpolate them.
+//
+template<typename T>
+void ComputeRanges(const vtkm::cont::ArrayHandle<T> &values,
+                   const bool points,
+                   const vtkm::Id3 &cell_dims,
+                   const vtkm::Id3 &dims,
+                   std::vector<vtkm::Float64> &mins,
+                   std::vector<vtkm::Float64> &maxs)
+{
+  auto portal = values.GetPortalConstControl();
+  const vtkm::Id3 value_dims = points ? cell_dims + vtkm::Id3(1, 1, 1) : cell_dims;
+  const vtkm::Id extra = points ? 1 : 0;
+  const int num_blocks = static_cast<int>(dims[0] * dims[1] * dims[2]);
+  mins.resize(num_blocks);
+  maxs.resize(num_blocks);
+
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int index = 0; index < num_blocks; ++index)
+  {
+    const vtkm::Id3 block(index % dims[0],
+                          (index / dims[0]) % dims[1],
+                          index / (dims[0] * dims[1]));
+    vtkm::Id3 first, last;
+    for(int axis = 0; axis < 3; ++axis)
+    {
+      first[axis] = block[axis] * MacrocellGrid::BLOCK_SIZE;
+      last[axis] = std::min(first[axis] + MacrocellGrid::BLOCK_SIZE + extra,
+                            value_dims[axis]);
+    }
+
+    vtkm::Float64 min_value = std::numeric_limits<vtkm::Float64>::max();
+    vtkm::Float64 max_value = std::numeric_limits<vtkm::Float64>::lowest();
+    for(vtkm::Id z = first[2]; z < last[2]; ++z)
+      for(vtkm::Id y = first[1]; y < last[1]; ++y)
+      {
+        const vtkm::Id row = (z * value_dims[1] + y) * value_dims[0];
+        for(vtkm::Id x = first[0]; x < last[0]; ++x)
+        {
+          const vtkm::Float64 value = static_cast<vtkm::Float64>(portal.Get(row + x));
+          min_value = std::min(min_value, value);
+          max_value = std::max(max_value, value);
+        }
+      }
+    mins[index] = min_value;
+    maxs[index] = max_value;
+  }
+}
+
+// copies the box of values from first to last (inclusive)
+template<typename T>
+vtkm::cont::ArrayHandle<T> CropValues(const vtkm::cont::ArrayHandle<T> &values,
+                                      const vtkm::Id3 &value_dims,
+                                      const vtkm::Id3 &first,
+                                      const vtkm::Id3 &last)
+{
+  const vtkm::Id3 out_dims = last - first + vtkm::Id3(1, 1, 1);
+  vtkm::cont::ArrayHandle<T> out;
+  out.Allocate(out_dims[0] * out_dims[1] * out_dims[2]);
+  auto in_portal = values.GetPortalConstControl();
+  auto out_portal = out.GetPortalControl();
+  const int num_rows = static_cast<int>(out_dims[1] * out_dims[2]);
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int row = 0; row < num_rows; ++row)
+  {
+    const vtkm::Id y = row % out_dims[1];
+    const vtkm::Id z = row / out_dims[1];
+    const vtkm::Id in_offset =
+      ((first[2] + z) * value_dims[1] + first[1] + y) * value_dims[0] + first[0];
+    const vtkm::Id out_offset = row * out_dims[0];
+    for(vtkm::Id x = 0; x < out_dims[0]; ++x)
+    {
+      out_portal.Set(out_offset + x, in_portal.Get(in_offset + x));
+    }
+  }
+  return out;
+}
+
+static DefaultHandle CropAxis(const DefaultHandle &axis,
+                              const vtkm::Id first,
+                              const vtkm::Id last)
+{
+  DefaultHandle out;
+  vtkm::cont::Algorithm::CopySubRange(axis, first, last - first + 1, out);
+  return out;
+}
+
+} // namespace detail
+
+const vtkm::Id MacrocellGrid::BLOCK_SIZE;
+
+MacrocellGrid::MacrocellGrid()
+  : m_cell_dims(0, 0, 0),
+    m_dims(0, 0, 0)
+{
+}
+
+bool
+MacrocellGrid::Build(const vtkm::cont::DataSet &domain, const std::string &field_name)
+{
+  if(!detail::IsSupported(domain, field_name))
+  {
+    return false;
+  }
+
+  int cell_dims[3];
+  VTKMDataSetInfo::GetCellDims(domain.GetCellSet(), cell_dims);
+  if(cell_dims[0] < 1 || cell_dims[1] < 1 || cell_dims[2] < 1)
+  {
+    return false;
+  }
+  for(int axis = 0; axis < 3; ++axis)
+  {
+    m_cell_dims[axis] = cell_dims[axis];
+    m_dims[axis] = (m_cell_dims[axis] + BLOCK_SIZE - 1) / BLOCK_SIZE;
+  }
+
+  m_field_name = field_name;
+  m_cellset = domain.GetCellSet();
+  const vtkm::cont::Field &field = domain.GetField(field_name);
+  const bool points = detail::IsPointField(field);
+  if(field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float32>()))
+  {
+    m_float_values = field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float32>>();
+    m_double_values = vtkm::cont::ArrayHandle<vtkm::Float64>();
+    detail::ComputeRanges(m_float_values, points, m_cell_dims, m_dims, m_mins, m_maxs);
+  }
+  else
+  {
+    m_double_values = field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float64>>();
+    m_float_values = vtkm::cont::ArrayHandle<vtkm::Float32>();
+    detail::ComputeRanges(m_double_values, points, m_cell_dims, m_dims, m_mins, m_maxs);
+  }
+  return true;
+}
+
+bool
+MacrocellGrid::IsBuiltFrom(const vtkm::cont::DataSet &domain,
+                           const std::string &field_name) const
+{
+  if(m_mins.empty() ||
+     field_name != m_field_name ||
+     !domain.HasField(field_name) ||
+     &domain.GetCellSet().CastToBase() != &m_cellset.CastToBase())
+  {
+    return false;
+  }
+
+  const vtkm::cont::Field &field = domain.GetField(field_name);
+  if(field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float32>()))
+  {
+    return field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float32>>() == m_float_values;
+  }
+  if(field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float64>()))
+  {
+    return field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float64>>() == m_double_values;
+  }
+  return false;
+}
+
+vtkm::Id3
+MacrocellGrid::GetCellDims() const
+{
+  return m_cell_dims;
+}
+
+size_t
+MacrocellGrid::GetNumberOfBytes() const
+{
+  const size_t values = m_float_values.GetNumberOfValues() * sizeof(vtkm::Float32) +
+                        m_double_values.GetNumberOfValues() * sizeof(vtkm::Float64);
+  return values + (m_mins.size() + m_maxs.size()) * sizeof(vtkm::Float64);
+}
+
+vtkm::cont::DataSet
+MacrocellGrid::Crop(const vtkm::cont::DataSet &domain,
+                    const std::string &field_name,
+                    const vtkm::Id3 &cell_min,
+                    const vtkm::Id3 &cell_max)
+{
+  int dims[3];
+  VTKMDataSetInfo::GetCellDims(domain.GetCellSet(), dims);
+  const vtkm::Id3 cell_dims(dims[0], dims[1], dims[2]);
+  const vtkm::Id3 point_dims = cell_max - cell_min + vtkm::Id3(2, 2, 2);
+
+  vtkm::cont::DataSet cropped;
+  const vtkm::cont::CoordinateSystem coords = domain.GetCoordinateSystem();
+  if(VTKMDataSetInfo::IsUniform(coords))
+  {
+    auto portal = coords.GetData().Cast<detail::UniformArrayHandle>().GetPortalConstControl();
+    const vtkm::Vec<vtkm::FloatDefault,3> spacing = portal.GetSpacing();
+    vtkm::Vec<vtkm::FloatDefault,3> origin = portal.GetOrigin();
+    for(int axis = 0; axis < 3; ++axis)
+    {
+      origin[axis] += static_cast<vtkm::FloatDefault>(cell_min[axis]) * spacing[axis];
+    }
+    cropped.AddCoordinateSystem(
+      vtkm::cont::CoordinateSystem(coords.GetName(), point_dims, origin, spacing));
+  }
+  else
+  {
+    detail::CartesianArrayHandle rect = coords.GetData().Cast<detail::CartesianArrayHandle>();
+    const vtkm::Id3 point_max = cell_max + vtkm::Id3(1, 1, 1);
+    detail::DefaultHandle x = detail::CropAxis(rect.GetStorage().GetFirstArray(),
+                                               cell_min[0], point_max[0]);
+    detail::DefaultHandle y = detail::CropAxis(rect.GetStorage().GetSecondArray(),
+                                               cell_min[1], point_max[1]);
+    detail::DefaultHandle z = detail::CropAxis(rect.GetStorage().GetThirdArray(),
+                                               cell_min[2], point_max[2]);
+    cropped.AddCoordinateSystem(
+      vtkm::cont::CoordinateSystem(coords.GetName(),
+                                   vtkm::cont::make_ArrayHandleCartesianProduct(x, y, z)));
+  }
+
+  vtkm::cont::CellSetStructured<3> cellset(domain.GetCellSet().GetName());
+  cellset.SetPointDimensions(point_dims);
+  cropped.AddCellSet(cellset);
+
+  const vtkm::cont::Field &field = domain.GetField(field_name);
+  const bool points = detail::IsPointField(field);
+  const vtkm::Id3 value_dims = points ? cell_dims + vtkm::Id3(1, 1, 1) : cell_dims;
+  const vtkm::Id3 last = points ? cell_max + vtkm::Id3(1, 1, 1) : cell_max;
+
+  vtkm::cont::DynamicArrayHandle values;
+  if(field.GetData().IsSameType(vtkm::cont::ArrayHandle<vtkm::Float32>()))
+  {
+    values = detail::CropValues(field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float32>>(),
+                                value_dims, cell_min, last);
+  }
+  else
+  {
+    values = detail::CropValues(field.GetData().Cast<vtkm::cont::ArrayHandle<vtkm::Float64>>(),
+                                value_dims, cell_min, last);
+  }
+
+  if(points)
+  {
+    cropped.AddField(vtkm::cont::Field(field_name, field.GetAssociation(), values));
+  }
+  else
+  {
+    cropped.AddField(vtkm::cont::Field(field_name,
+                                       field.GetAssociation(),
+                                       cellset.GetName(),
+                                       values));
+  }
+  return cropped;
+}
+
+} // namespace vtkh
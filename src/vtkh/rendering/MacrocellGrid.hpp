@@ -0,0 +1,94 @@
+#ifndef VTK_H_MACROCELL_GRID_HPP
+#define VTK_H_MACROCELL_GRID_HPP
+
+#include <vtkm/cont/ArrayHandle.h>
+#include <vtkm/cont/DataSet.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace vtkh {
+//
+// The minimum and maximum of a scalar field over blocks of cells
+// (macrocells) of a 3D uniform or rectilinear domain. Given which
+// scalar values a transfer function makes visible, it finds the box of
+// cells that can contribute to a volume rendering, so the fully
+// transparent space around it does not have to be sampled.
+//
+class MacrocellGrid
+{
+public:
+  // cells per macrocell along each axis
+  static const vtkm::Id BLOCK_SIZE = 8;
+
+  MacrocellGrid();
+  //
+  // Returns false, and builds nothing, unless the domain has a 3D
+  // structured cell set with uniform or rectilinear coordinates and
+  // the field is a 32 or 64 bit scalar on the points or cells
+  //
+  bool Build(const vtkm::cont::DataSet &domain, const std::string &field_name);
+  //
+  // True if the grid was built from the same field array of the same
+  // cell set. Arrays that are changed in place are not detected.
+  //
+  bool IsBuiltFrom(const vtkm::cont::DataSet &domain, const std::string &field_name) const;
+  //
+  // Finds the (inclusive) range of cells covering every macrocell for
+  // which is_visible(min, max) is true. Returns false if there is none.
+  //
+  template<typename VisibleFunctor>
+  bool FindVisibleCells(const VisibleFunctor &is_visible,
+                        vtkm::Id3 &cell_min,
+                        vtkm::Id3 &cell_max) const
+  {
+    bool found = false;
+    for(vtkm::Id k = 0; k < m_dims[2]; ++k)
+      for(vtkm::Id j = 0; j < m_dims[1]; ++j)
+        for(vtkm::Id i = 0; i < m_dims[0]; ++i)
+        {
+          const vtkm::Id index = (k * m_dims[1] + j) * m_dims[0] + i;
+          if(!is_visible(m_mins[index], m_maxs[index])) continue;
+          const vtkm::Id3 block(i, j, k);
+          for(int axis = 0; axis < 3; ++axis)
+          {
+            const vtkm::Id first = block[axis] * BLOCK_SIZE;
+            const vtkm::Id last = std::min(first + BLOCK_SIZE, m_cell_dims[axis]) - 1;
+            cell_min[axis] = found ? std::min(cell_min[axis], first) : first;
+            cell_max[axis] = found ? std::max(cell_max[axis], last) : last;
+          }
+          found = true;
+        }
+    return found;
+  }
+
+  vtkm::Id3 GetCellDims() const;
+  //
+  // The memory the grid keeps alive: its ranges and the field array
+  // it was built from, which may also be held by the domain
+  //
+  size_t GetNumberOfBytes() const;
+  //
+  // The cells from cell_min to cell_max (inclusive) of the domain, with
+  // only the coordinate system and the given field
+  //
+  static vtkm::cont::DataSet Crop(const vtkm::cont::DataSet &domain,
+                                  const std::string &field_name,
+                                  const vtkm::Id3 &cell_min,
+                                  const vtkm::Id3 &cell_max);
+protected:
+  std::string                         m_field_name;
+  // held to recognize the arrays the grid was built from
+  vtkm::cont::DynamicCellSet          m_cellset;
+  vtkm::cont::ArrayHandle<vtkm::Float32> m_float_values;
+  vtkm::cont::ArrayHandle<vtkm::Float64> m_double_values;
+  vtkm::Id3                           m_cell_dims;
+  // macrocells along each axis
+  vtkm::Id3                           m_dims;
+  std::vector<vtkm::Float64>          m_mins;
+  std::vector<vtkm::Float64>          m_maxs;
+};
+
+} // namespace vtkh
+#endif
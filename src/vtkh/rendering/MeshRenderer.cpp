@@ -48,6 +48,16 @@ MeshRenderer::PreExecute()
   }
 }
 
+Renderer::vtkmMapperPtr
+MeshRenderer::NewMapper() const
+{
+  typedef vtkm::rendering::MapperWireframer MapperType;
+  auto mapper = std::make_shared<MapperType>();
+  mapper->SetShowInternalZones(m_show_internal);
+  mapper->SetIsOverlay(m_is_overlay); 
+  return mapper;
+}
+
 void
 MeshRenderer::SetIsOverlay(bool on)
 {
@@ -20,6 +20,7 @@ public:
   bool GetShowInternal() const;
 protected:
   void PreExecute() override;
+  vtkmMapperPtr NewMapper() const override;
   bool m_use_foreground_color;
   bool m_is_overlay;
   bool m_show_internal;
@@ -1,15 +1,14 @@
 #include "RayTracer.hpp"
+#include "RayTracerMapper.hpp"
 
 #include <vtkm/rendering/CanvasRayTracer.h>
-#include <vtkm/rendering/MapperRayTracer.h>
 #include <memory>
 
 namespace vtkh {
   
 RayTracer::RayTracer()
 {
-  typedef vtkm::rendering::MapperRayTracer TracerType;
-  auto mapper = std::make_shared<TracerType>();
+  auto mapper = std::make_shared<RayTracerMapper>();
   mapper->SetCompositeBackground(false);
   this->m_mapper = mapper;
 }
@@ -24,6 +23,21 @@ RayTracer::GetNewCanvas(int width, int height)
   return std::make_shared<vtkm::rendering::CanvasRayTracer>(width, height);
 }
 
+Renderer::vtkmMapperPtr
+RayTracer::NewMapper() const
+{
+  auto mapper = std::make_shared<RayTracerMapper>();
+  mapper->SetCompositeBackground(false);
+  return mapper;
+}
+
+void
+RayTracer::SetMapperDomain(vtkm::rendering::Mapper &mapper, const vtkm::Id domain_id)
+{
+  // the ray tracer keeps each domain's BVH across cameras and cycles
+  static_cast<RayTracerMapper&>(mapper).SetDomainId(domain_id);
+}
+
 std::string
 RayTracer::GetName() const
 {
@@ -12,6 +12,9 @@ public:
   virtual ~RayTracer();
   std::string GetName() const override;
   static Renderer::vtkmCanvasPtr GetNewCanvas(int width = 1024, int height = 1024);
+protected:
+  vtkmMapperPtr NewMapper() const override;
+  void SetMapperDomain(vtkm::rendering::Mapper &mapper, const vtkm::Id domain_id) override;
 };
 
 } // namespace vtkh
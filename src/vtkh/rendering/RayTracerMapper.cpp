@@ -0,0 +1,314 @@
+#include "RayTracerMapper.hpp"
+
+#include <vtkh/Error.hpp>
+
+#include <vtkm/rendering/raytracing/Camera.h>
+#include <vtkm/rendering/raytracing/RayOperations.h>
+#include <vtkm/rendering/raytracing/RayTracer.h>
+#include <vtkm/rendering/raytracing/TriangleExtractor.h>
+#include <vtkm/rendering/raytracing/TriangleIntersector.h>
+
+#include <list>
+#include <mutex>
+
+namespace vtkh {
+
+namespace detail
+{
+
+typedef vtkm::rendering::raytracing::TriangleIntersector TriangleIntersector;
+
+struct TriangleCacheEntry
+{
+  vtkm::Id                             m_domain_id;
+  // held so the arrays can't be freed and replaced by new ones at
+  // the same address while the entry exists
+  vtkm::cont::DynamicCellSet           m_cellset;
+  vtkm::cont::CoordinateSystem         m_coords;
+  vtkm::Id                             m_num_cells;
+  vtkm::Bounds                         m_bounds;
+  // null when the domain has no triangles
+  std::shared_ptr<TriangleIntersector> m_intersector;
+
+  bool Matches(const vtkm::cont::DynamicCellSet &cellset,
+               const vtkm::cont::CoordinateSystem &coords,
+               const vtkm::Bounds &bounds) const
+  {
+    return &m_cellset.CastToBase() == &cellset.CastToBase() &&
+           m_coords.GetData() == coords.GetData() &&
+           m_num_cells == cellset.GetNumberOfCells() &&
+           m_bounds == bounds;
+  }
+};
+
+class TriangleCache
+{
+public:
+  TriangleCache()
+    : m_max_entries(1024)
+  {}
+
+  bool Find(const vtkm::Id domain_id,
+            const vtkm::cont::DynamicCellSet &cellset,
+            const vtkm::cont::CoordinateSystem &coords,
+            const vtkm::Bounds &bounds,
+            std::shared_ptr<TriangleIntersector> &intersector)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+      if(it->m_domain_id == domain_id && it->Matches(cellset, coords, bounds))
+      {
+        intersector = it->m_intersector;
+        // most recently used first
+        m_entries.splice(m_entries.begin(), m_entries, it);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Add(const TriangleCacheEntry &entry)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    //
+    // an entry for the same domain and arrays is stale, since they
+    // were changed in place. Other meshes of the domain id, like those
+    // of other plots, stay until the least recently used are evicted.
+    //
+    m_entries.remove_if([&entry](const TriangleCacheEntry &other)
+    {
+      return other.m_domain_id == entry.m_domain_id &&
+             &other.m_cellset.CastToBase() == &entry.m_cellset.CastToBase() &&
+             other.m_coords.GetData() == entry.m_coords.GetData();
+    });
+    m_entries.push_front(entry);
+    Evict();
+  }
+
+  void Clear()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+  }
+
+  void SetMaxEntries(const size_t max_entries)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_entries = max_entries;
+    Evict();
+  }
+
+private:
+  void Evict()
+  {
+    while(m_entries.size() > m_max_entries)
+    {
+      m_entries.pop_back();
+    }
+  }
+
+  std::list<TriangleCacheEntry> m_entries;
+  size_t                        m_max_entries;
+  std::mutex                    m_mutex;
+};
+
+static TriangleCache& GetTriangleCache()
+{
+  static TriangleCache cache;
+  return cache;
+}
+
+static std::shared_ptr<TriangleIntersector>
+BuildTriangles(const vtkm::cont::DynamicCellSet &cellset,
+               const vtkm::cont::CoordinateSystem &coords)
+{
+  vtkm::rendering::raytracing::TriangleExtractor extractor;
+  extractor.ExtractCells(cellset);
+  if(extractor.GetNumberOfTriangles() == 0)
+  {
+    return std::shared_ptr<TriangleIntersector>();
+  }
+  auto intersector = std::make_shared<TriangleIntersector>();
+  intersector->SetData(coords, extractor.GetTriangles());
+  return intersector;
+}
+
+} // namespace detail
+
+struct RayTracerMapper::InternalsType
+{
+  vtkm::rendering::CanvasRayTracer                   *m_canvas;
+  vtkm::rendering::raytracing::RayTracer              m_tracer;
+  vtkm::rendering::raytracing::Camera                 m_ray_camera;
+  vtkm::rendering::raytracing::Ray<vtkm::Float32>     m_rays;
+  bool                                                m_composite_background;
+  bool                                                m_has_domain_id;
+  vtkm::Id                                            m_domain_id;
+
+  InternalsType()
+    : m_canvas(nullptr),
+      m_composite_background(true),
+      m_has_domain_id(false),
+      m_domain_id(-1)
+  {}
+};
+
+RayTracerMapper::RayTracerMapper()
+  : m_internals(new InternalsType())
+{
+}
+
+RayTracerMapper::~RayTracerMapper()
+{
+}
+
+void
+RayTracerMapper::SetCanvas(vtkm::rendering::Canvas *canvas)
+{
+  if(canvas != nullptr)
+  {
+    m_internals->m_canvas = dynamic_cast<vtkm::rendering::CanvasRayTracer*>(canvas);
+    if(m_internals->m_canvas == nullptr)
+    {
+      throw Error("RayTracerMapper: bad canvas type. Must be CanvasRayTracer");
+    }
+  }
+  else
+  {
+    m_internals->m_canvas = nullptr;
+  }
+}
+
+vtkm::rendering::Canvas*
+RayTracerMapper::GetCanvas() const
+{
+  return m_internals->m_canvas;
+}
+
+void
+RayTracerMapper::SetDomainId(const vtkm::Id domain_id)
+{
+  m_internals->m_has_domain_id = true;
+  m_internals->m_domain_id = domain_id;
+}
+
+void
+RayTracerMapper::RenderCells(const vtkm::cont::DynamicCellSet &cellset,
+                             const vtkm::cont::CoordinateSystem &coords,
+                             const vtkm::cont::Field &scalar_field,
+                             const vtkm::cont::ColorTable &vtkmNotUsed(color_table),
+                             const vtkm::rendering::Camera &camera,
+                             const vtkm::Range &scalar_range)
+{
+  InternalsType &internals = *m_internals;
+  internals.m_tracer.Clear();
+
+  std::shared_ptr<detail::TriangleIntersector> intersector;
+  // set when a new intersector should go into the cache
+  bool add_entry = false;
+  detail::TriangleCacheEntry entry;
+  if(internals.m_has_domain_id)
+  {
+    const vtkm::Bounds bounds = coords.GetBounds();
+    detail::TriangleCache &cache = detail::GetTriangleCache();
+    if(!cache.Find(internals.m_domain_id, cellset, coords, bounds, intersector))
+    {
+      intersector = detail::BuildTriangles(cellset, coords);
+      entry.m_domain_id = internals.m_domain_id;
+      entry.m_cellset = cellset;
+      entry.m_coords = coords;
+      entry.m_num_cells = cellset.GetNumberOfCells();
+      entry.m_bounds = bounds;
+      entry.m_intersector = intersector;
+      add_entry = true;
+    }
+    // the id only applies to one call
+    internals.m_has_domain_id = false;
+  }
+  else
+  {
+    intersector = detail::BuildTriangles(cellset, coords);
+  }
+
+  vtkm::Bounds shape_bounds;
+  if(intersector)
+  {
+    internals.m_tracer.AddShapeIntersector(intersector);
+    shape_bounds.Include(intersector->GetShapeBounds());
+  }
+
+  // the rest is what the vtk-m ray tracing mapper does
+  vtkm::rendering::raytracing::Camera &cam = internals.m_tracer.GetCamera();
+  cam.SetParameters(camera, *internals.m_canvas);
+  internals.m_ray_camera.SetParameters(camera, *internals.m_canvas);
+
+  internals.m_ray_camera.CreateRays(internals.m_rays, shape_bounds);
+  internals.m_rays.Buffers.at(0).InitConst(0.f);
+  vtkm::rendering::raytracing::RayOperations::MapCanvasToRays(internals.m_rays,
+                                                              camera,
+                                                              *internals.m_canvas);
+
+  internals.m_tracer.SetField(scalar_field, scalar_range);
+  internals.m_tracer.SetColorMap(this->ColorMap);
+  internals.m_tracer.Render(internals.m_rays);
+
+  internals.m_canvas->WriteToCanvas(internals.m_rays,
+                                    internals.m_rays.Buffers.at(0).Buffer,
+                                    camera);
+  if(internals.m_composite_background)
+  {
+    internals.m_canvas->BlendBackground();
+  }
+
+  //
+  // only shared once it has been used, so other threads never see
+  // its arrays before they are on the device
+  //
+  if(add_entry)
+  {
+    detail::GetTriangleCache().Add(entry);
+  }
+}
+
+void
+RayTracerMapper::SetCompositeBackground(bool on)
+{
+  m_internals->m_composite_background = on;
+}
+
+void
+RayTracerMapper::StartScene()
+{
+  // nothing needs to be done
+}
+
+void
+RayTracerMapper::EndScene()
+{
+  // nothing needs to be done
+}
+
+vtkm::rendering::Mapper*
+RayTracerMapper::NewCopy() const
+{
+  return new RayTracerMapper(*this);
+}
+
+void
+RayTracerMapper::ClearCache()
+{
+  detail::GetTriangleCache().Clear();
+}
+
+void
+RayTracerMapper::SetCacheSize(const int num_domains)
+{
+  if(num_domains < 0)
+  {
+    throw Error("RayTracerMapper: cache size can't be negative");
+  }
+  detail::GetTriangleCache().SetMaxEntries(static_cast<size_t>(num_domains));
+}
+
+} // namespace vtkh
@@ -0,0 +1,57 @@
+#ifndef VTK_H_RAY_TRACER_MAPPER_HPP
+#define VTK_H_RAY_TRACER_MAPPER_HPP
+
+#include <vtkm/rendering/CanvasRayTracer.h>
+#include <vtkm/rendering/Mapper.h>
+
+#include <memory>
+
+namespace vtkh {
+//
+// Surface ray tracing mapper that keeps the triangles and BVH of each
+// domain between calls. The ray tracer builds them from scratch for
+// every camera, which dominates the cost of rendering many cameras of
+// an unchanged mesh. Entries are keyed on the domain id and are only
+// reused while the cell set and coordinates are the same arrays, with
+// the same number of cells and spatial bounds. Meshes that are moved
+// in place without changing their bounds must clear the cache.
+//
+class RayTracerMapper : public vtkm::rendering::Mapper
+{
+public:
+  RayTracerMapper();
+  ~RayTracerMapper();
+
+  void SetCanvas(vtkm::rendering::Canvas *canvas) override;
+  vtkm::rendering::Canvas* GetCanvas() const override;
+
+  void RenderCells(const vtkm::cont::DynamicCellSet &cellset,
+                   const vtkm::cont::CoordinateSystem &coords,
+                   const vtkm::cont::Field &scalar_field,
+                   const vtkm::cont::ColorTable &color_table,
+                   const vtkm::rendering::Camera &camera,
+                   const vtkm::Range &scalar_range) override;
+
+  // the domain the next RenderCells call draws
+  void SetDomainId(const vtkm::Id domain_id);
+  void SetCompositeBackground(bool on);
+  void StartScene() override;
+  void EndScene() override;
+  vtkm::rendering::Mapper* NewCopy() const override;
+  //
+  // Drops every cached acceleration structure
+  //
+  static void ClearCache();
+  //
+  // Number of domains kept. The least recently used is dropped first.
+  // Defaults to 1024.
+  //
+  static void SetCacheSize(const int num_domains);
+
+private:
+  struct InternalsType;
+  std::shared_ptr<InternalsType> m_internals;
+};
+
+} // namespace vtkh
+#endif
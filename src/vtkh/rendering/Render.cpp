@@ -1,17 +1,77 @@
 #include "Render.hpp"
 #include <vtkh/rendering/Annotator.hpp>
-#include <vtkh/utils/PNGEncoder.hpp>
+#include <vtkh/rendering/BufferPool.hpp>
 #include <vtkh/utils/vtkm_array_utils.hpp>
 #include <vtkm/rendering/MapperRayTracer.h>
 #include <vtkm/rendering/View2D.h>
 #include <vtkm/rendering/View3D.h>
+#include <vtkm/Matrix.h>
+
+#include <algorithm>
+#include <cmath>
 
 namespace vtkh 
 {
 
+namespace detail
+{
+
+typedef vtkm::rendering::CanvasRayTracer PooledCanvasType;
+// canvases can outlive the pool during shutdown
+static bool canvas_pool_alive = false;
+
+struct CanvasPool
+{
+  BufferPool<std::unique_ptr<PooledCanvasType>> m_canvases;
+
+  CanvasPool()
+    : m_canvases(size_t(1) << 30)
+  {
+    canvas_pool_alive = true;
+  }
+
+  ~CanvasPool()
+  {
+    canvas_pool_alive = false;
+  }
+};
+
+static CanvasPool& GetCanvasPool()
+{
+  static CanvasPool pool;
+  return pool;
+}
+
+static void ReturnCanvas(PooledCanvasType *canvas)
+{
+  std::unique_ptr<PooledCanvasType> pooled(canvas);
+  if(canvas_pool_alive)
+  {
+    // rgba and depth
+    const size_t bytes = static_cast<size_t>(canvas->GetWidth()) *
+                         static_cast<size_t>(canvas->GetHeight()) * 
+                         5 * sizeof(float);
+    GetCanvasPool().m_canvases.Give(std::move(pooled), bytes);
+  }
+}
+
+} // namespace detail
+
+void
+Render::SetCanvasPoolCapacity(const size_t bytes)
+{
+  detail::GetCanvasPool().m_canvases.SetCapacity(bytes);
+}
+
 Render::Render()
   : m_width(1024),
-    m_height(1024)
+    m_height(1024),
+    m_render_annotations(true),
+    m_shared_canvas(true),
+    m_async_save(false),
+    m_save_depth(false),
+    m_image_format(ImageWriter::PNG),
+    m_composited_image(std::make_shared<Image>())
 {
 }
 
@@ -39,6 +99,11 @@ Render::GetDomainCanvas(const vtkm::Id &domain_id)
     throw Error(ss.str());
   }
 
+  if(m_shared_canvas)
+  {
+    dom = 0;
+  }
+
   if(m_canvases[dom] == nullptr)
   {
     m_canvases[dom] = this->CreateCanvas();
@@ -100,12 +165,210 @@ Render::AddDomain(vtkm::Id domain_id)
 {
   m_canvases.push_back(nullptr);
   m_domain_ids.push_back(domain_id);
+  m_screen_bounds.push_back(vtkm::Bounds());
+}
+
+void 
+Render::AddDomainBounds(const vtkm::Id &domain_id,
+                        const vtkm::Bounds &spatial_bounds)
+{
+  vtkm::Id dom = -1;
+  for(size_t i = 0; i < m_domain_ids.size(); ++i)
+  {
+    if(m_domain_ids[i] == domain_id)
+    {
+      dom = i;
+      break;
+    }
+  }
+
+  if(dom == -1)
+  {
+    std::stringstream ss;
+    ss<<"Render: canvas with domain id "<< domain_id <<" not found ";
+    throw Error(ss.str());
+  }
+
+  vtkm::Bounds screen_bounds;
+  screen_bounds.X.Min = 1;
+  screen_bounds.Y.Min = 1;
+  screen_bounds.X.Max = m_width;
+  screen_bounds.Y.Max = m_height;
+
+  float viewport[4];
+  m_camera.GetViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  const bool default_viewport = viewport[0] == -1.f && viewport[1] == 1.f &&
+                                viewport[2] == -1.f && viewport[3] == 1.f;
+  //
+  // Only project the corners of the bounds for the common case.
+  // Anything else covers the whole canvas.
+  //
+  if(m_camera.GetMode() == vtkm::rendering::Camera::MODE_3D && default_viewport)
+  {
+    vtkm::Matrix<vtkm::Float32,4,4> view_matrix = m_camera.CreateViewMatrix();
+    vtkm::Matrix<vtkm::Float32,4,4> proj_matrix = 
+      m_camera.CreateProjectionMatrix(m_width, m_height);
+    vtkm::Matrix<vtkm::Float32,4,4> world_to_clip = 
+      vtkm::MatrixMultiply(proj_matrix, view_matrix);
+
+    double x[2], y[2], z[2];
+    x[0] = spatial_bounds.X.Min;
+    x[1] = spatial_bounds.X.Max;
+    y[0] = spatial_bounds.Y.Min;
+    y[1] = spatial_bounds.Y.Max;
+    z[0] = spatial_bounds.Z.Min;
+    z[1] = spatial_bounds.Z.Max;
+
+    vtkm::Bounds projected;
+    bool behind_camera = false;
+    vtkm::Vec<vtkm::Float32,4> extent_point;
+    for(int i = 0; i < 2; i++)
+        for(int j = 0; j < 2; j++)
+            for(int k = 0; k < 2; k++)
+            {
+                extent_point[0] = static_cast<vtkm::Float32>(x[i]);
+                extent_point[1] = static_cast<vtkm::Float32>(y[j]);
+                extent_point[2] = static_cast<vtkm::Float32>(z[k]);
+                extent_point[3] = 1.f;
+                extent_point = vtkm::MatrixMultiply(world_to_clip, extent_point);
+                if(extent_point[3] <= 0.f)
+                {
+                  behind_camera = true;
+                }
+                // perform the perspective divide and map ndc to pixels
+                const double sx = (extent_point[0] / extent_point[3] + 1.) * 0.5 * m_width; 
+                const double sy = (extent_point[1] / extent_point[3] + 1.) * 0.5 * m_height; 
+                projected.X.Include(sx);
+                projected.Y.Include(sy);
+            }
+
+    if(!behind_camera)
+    {
+      // pad a couple of pixels to be safe with rounding in the mappers
+      const double pad = 2.;
+      screen_bounds.X.Min = std::max(1., std::floor(projected.X.Min - pad) + 1.);
+      screen_bounds.Y.Min = std::max(1., std::floor(projected.Y.Min - pad) + 1.);
+      screen_bounds.X.Max = std::min(double(m_width), std::ceil(projected.X.Max + pad));
+      screen_bounds.Y.Max = std::min(double(m_height), std::ceil(projected.Y.Max + pad));
+      if(screen_bounds.X.Min > screen_bounds.X.Max || 
+         screen_bounds.Y.Min > screen_bounds.Y.Max)
+      {
+        // completely off screen
+        return;
+      }
+    }
+  }
+
+  if(m_shared_canvas)
+  {
+    dom = 0;
+  }
+  m_screen_bounds[dom].X.Include(screen_bounds.X);
+  m_screen_bounds[dom].Y.Include(screen_bounds.Y);
+}
+
+vtkm::Bounds
+Render::GetScreenBounds(const vtkm::Id index) const
+{
+  assert(index >= 0 && index < m_screen_bounds.size());
+  vtkm::Bounds screen_bounds = m_screen_bounds[index];
+  if(!screen_bounds.X.IsNonEmpty() || !screen_bounds.Y.IsNonEmpty())
+  {
+    // nothing was rendered, but compositors always need a pixel 
+    screen_bounds.X.Min = 1;
+    screen_bounds.Y.Min = 1;
+    screen_bounds.X.Max = 1;
+    screen_bounds.Y.Max = 1;
+  }
+  return screen_bounds;
+}
+
+bool
+Render::IsRendered(const vtkm::Id index) const
+{
+  assert(index >= 0 && index < m_screen_bounds.size());
+  return m_screen_bounds[index].X.IsNonEmpty() && m_screen_bounds[index].Y.IsNonEmpty();
+}
+
+bool
+Render::IsOnScreen(const vtkm::Bounds &spatial_bounds) const
+{
+  float viewport[4];
+  m_camera.GetViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  const bool default_viewport = viewport[0] == -1.f && viewport[1] == 1.f &&
+                                viewport[2] == -1.f && viewport[3] == 1.f;
+  // same cases AddDomainBounds projects
+  if(m_camera.GetMode() != vtkm::rendering::Camera::MODE_3D || !default_viewport)
+  {
+    return true;
+  }
+
+  vtkm::Matrix<vtkm::Float32,4,4> view_matrix = m_camera.CreateViewMatrix();
+  vtkm::Matrix<vtkm::Float32,4,4> proj_matrix = 
+    m_camera.CreateProjectionMatrix(m_width, m_height);
+  vtkm::Matrix<vtkm::Float32,4,4> world_to_clip = 
+    vtkm::MatrixMultiply(proj_matrix, view_matrix);
+
+  double x[2], y[2], z[2];
+  x[0] = spatial_bounds.X.Min;
+  x[1] = spatial_bounds.X.Max;
+  y[0] = spatial_bounds.Y.Min;
+  y[1] = spatial_bounds.Y.Max;
+  z[0] = spatial_bounds.Z.Min;
+  z[1] = spatial_bounds.Z.Max;
+
+  //
+  // The box is off screen if all of its corners are on the outer side
+  // of the same plane: left, right, bottom, top, or behind the eye.
+  // The near and far planes are left alone, since the ray tracers
+  // don't clip to them.
+  //
+  int outside[5] = {0, 0, 0, 0, 0};
+  vtkm::Vec<vtkm::Float32,4> extent_point;
+  for(int i = 0; i < 2; i++)
+      for(int j = 0; j < 2; j++)
+          for(int k = 0; k < 2; k++)
+          {
+              extent_point[0] = static_cast<vtkm::Float32>(x[i]);
+              extent_point[1] = static_cast<vtkm::Float32>(y[j]);
+              extent_point[2] = static_cast<vtkm::Float32>(z[k]);
+              extent_point[3] = 1.f;
+              extent_point = vtkm::MatrixMultiply(world_to_clip, extent_point);
+              const vtkm::Float32 w = extent_point[3];
+              if(extent_point[0] < -w) outside[0]++;
+              if(extent_point[0] > w)  outside[1]++;
+              if(extent_point[1] < -w) outside[2]++;
+              if(extent_point[1] > w)  outside[3]++;
+              if(w <= 0.f)             outside[4]++;
+          }
+
+  for(int plane = 0; plane < 5; ++plane)
+  {
+    if(outside[plane] == 8)
+    {
+      return false;
+    }
+  }
+  return true;
 }
 
 int 
 Render::GetNumberOfCanvases() const
 {
-  return static_cast<int>(m_canvases.size());
+  const int num_canvases = static_cast<int>(m_canvases.size());
+  return m_shared_canvas ? std::min(1, num_canvases) : num_canvases;
+}
+
+void
+Render::SetSharedCanvas(bool shared)
+{
+  m_shared_canvas = shared;
+}
+
+bool
+Render::GetSharedCanvas() const
+{
+  return m_shared_canvas;
 }
 
 void
@@ -118,7 +381,9 @@ Render::ClearCanvases()
     {
       m_canvases[i] = nullptr;
     }
+    m_screen_bounds[i] = vtkm::Bounds();
   }
+  m_composited_image->Recycle();
 }
 
 bool 
@@ -176,11 +441,72 @@ Render::GetBackgroundColor() const
   return m_bg_color;
 }
 
+void 
+Render::DoRenderAnnotations(bool on)
+{
+  m_render_annotations = on;
+}
+
+bool
+Render::GetRenderAnnotations() const
+{
+  return m_render_annotations;
+}
+
+void
+Render::SetAsyncSave(bool async_save)
+{
+  m_async_save = async_save;
+}
+
+bool
+Render::GetAsyncSave() const
+{
+  return m_async_save;
+}
+
+void
+Render::SetImageFormat(ImageWriter::Format format)
+{
+  m_image_format = format;
+}
+
+ImageWriter::Format
+Render::GetImageFormat() const
+{
+  return m_image_format;
+}
+
+void
+Render::SetSaveDepth(bool save_depth)
+{
+  m_save_depth = save_depth;
+}
+
+bool
+Render::GetSaveDepth() const
+{
+  return m_save_depth;
+}
+
+AsyncImageWriter&
+Render::GetImageWriter()
+{
+  static AsyncImageWriter writer;
+  return writer;
+}
+
+void 
+Render::SetCompositedImage(Image &image)
+{
+  m_composited_image->Swap(image);
+}
+
 void 
 Render::RenderWorldAnnotations()
 {
   int size = m_canvases.size(); 
-  if(size < 1) return;
+  if(size < 1 || !m_render_annotations) return;
 
 #ifdef VTKH_PARALLEL
   if(vtkh::GetMPIRank() != 0) return;
@@ -197,7 +523,7 @@ Render::RenderScreenAnnotations(const std::vector<std::string> &field_names,
                                 const std::vector<vtkm::cont::ColorTable> &colors)
 {
   int size = m_canvases.size(); 
-  if(size < 1) return;
+  if(size < 1 || !m_render_annotations) return;
   
   m_canvases[0]->BlendBackground(); 
   Annotator annotator(*m_canvases[0], m_camera, m_scene_bounds);
@@ -207,7 +533,21 @@ Render::RenderScreenAnnotations(const std::vector<std::string> &field_names,
 Render::vtkmCanvasPtr
 Render::CreateCanvas()
 {
-  Render::vtkmCanvasPtr canvas = std::make_shared<vtkm::rendering::CanvasRayTracer>(m_width, m_height);
+  typedef vtkm::rendering::CanvasRayTracer CanvasType;
+  const int width = m_width;
+  const int height = m_height;
+  auto same_size = [width, height](const std::unique_ptr<CanvasType> &canvas)
+  {
+    return canvas->GetWidth() == width && canvas->GetHeight() == height;
+  };
+
+  std::unique_ptr<CanvasType> pooled;
+  if(!detail::GetCanvasPool().m_canvases.Take(same_size, pooled))
+  {
+    pooled.reset(new CanvasType(m_width, m_height));
+  }
+  // the canvas goes back to the pool once the last render drops it 
+  Render::vtkmCanvasPtr canvas(pooled.release(), detail::ReturnCanvas);
   canvas->SetBackgroundColor(m_bg_color);
   canvas->Clear();
   return canvas;
@@ -223,12 +563,75 @@ Render::Save()
 #ifdef VTKH_PARALLEL
   if(vtkh::GetMPIRank() != 0) return;
 #endif
-  float* color_buffer = &GetVTKMPointer(m_canvases[0]->GetColorBuffer())[0][0]; 
-  int height = m_canvases[0]->GetHeight(); 
-  int width = m_canvases[0]->GetWidth(); 
-  PNGEncoder encoder;
-  encoder.Encode(color_buffer, width, height);
-  encoder.Save(m_image_name + ".png");
+  std::shared_ptr<ImageWriter> writer = ImageWriter::Create(m_image_format);
+  const std::string file_name = m_image_name + "." + writer->GetExtension();
+  const bool save_depth = m_save_depth && writer->SavesDepth();
+
+  int width = 0;
+  int height = 0;
+  std::vector<unsigned char> pixels;
+  std::vector<float> depths;
+  if(!m_render_annotations && m_composited_image->GetNumberOfPixels() > 0)
+  {
+    // the background is normally blended with the screen annotations
+    float bg_color[4];
+    for(int i = 0; i < 4; ++i)
+    {
+      bg_color[i] = m_bg_color.Components[i];
+    }
+    m_composited_image->CompositeBackground(bg_color);
+    const vtkm::Bounds &bounds = m_composited_image->m_bounds;
+    width = bounds.X.Max - bounds.X.Min + 1;
+    height = bounds.Y.Max - bounds.Y.Min + 1;
+    // the image is cleared with the canvases, so the writer can take
+    // its buffers
+    pixels.swap(m_composited_image->m_pixels);
+    if(save_depth && m_composited_image->m_depths.size() * 4 == pixels.size())
+    {
+      depths.swap(m_composited_image->m_depths);
+    }
+  }
+  else
+  {
+    if(!m_render_annotations)
+    {
+      m_canvases[0]->BlendBackground(); 
+    }
+    // the canvas goes back to the pool, so the writer gets a copy
+    const float* color_buffer = &GetVTKMPointer(m_canvases[0]->GetColorBuffer())[0][0]; 
+    height = m_canvases[0]->GetHeight(); 
+    width = m_canvases[0]->GetWidth(); 
+    const int num_values = width * height * 4;
+    pixels.resize(num_values);
+#ifdef VTKH_USE_OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < num_values; ++i)
+    {
+      pixels[i] = static_cast<unsigned char>(color_buffer[i] * 255.f);
+    }
+    if(save_depth)
+    {
+      const float *depth_buffer = GetVTKMPointer(m_canvases[0]->GetDepthBuffer());
+      depths.assign(depth_buffer, depth_buffer + width * height);
+    }
+  }
+
+  if(m_async_save)
+  {
+    GetImageWriter().Write(writer,
+                           std::move(pixels),
+                           std::move(depths),
+                           width,
+                           height,
+                           file_name);
+    return;
+  }
+  writer->Write(&pixels[0],
+                depths.empty() ? nullptr : &depths[0],
+                width,
+                height,
+                file_name);
 }
 
 vtkh::Render 
@@ -1,9 +1,13 @@
 #ifndef VTK_H_RENDER_HPP
 #define VTK_H_RENDER_HPP
 
+#include <memory>
 #include <vector>
 #include <vtkh/DataSet.hpp>
 #include <vtkh/Error.hpp>
+#include <vtkh/rendering/Image.hpp>
+#include <vtkh/utils/AsyncImageWriter.hpp>
+#include <vtkh/utils/ImageWriter.hpp>
 
 #include <vtkm/rendering/Camera.h>
 #include <vtkm/rendering/CanvasRayTracer.h>
@@ -45,20 +49,87 @@ public:
   void                            ClearCanvases();
   bool                            HasCanvas(const vtkm::Id &domain_id) const;
   void                            AddDomain(vtkm::Id domain_id);
+  void                            AddDomainBounds(const vtkm::Id &domain_id,
+                                                  const vtkm::Bounds &spatial_bounds);
+  vtkm::Bounds                    GetScreenBounds(const vtkm::Id index) const;
+  // true if any domain drawn into the canvas is on screen
+  bool                            IsRendered(const vtkm::Id index) const;
+  //
+  // False if the spatial bounds are entirely outside the view of a 3D
+  // camera, i.e. a domain with them draws nothing. Other cameras see
+  // everything.
+  //
+  bool                            IsOnScreen(const vtkm::Bounds &spatial_bounds) const;
+  //
+  // When shared (the default), every domain is rendered into a
+  // single canvas and depth tested against what is already there,
+  // so there is one canvas to composite no matter how many domains
+  // a rank has. Ordered blending, i.e. volume rendering, needs a
+  // canvas per domain. Set this before anything is rendered.
+  //
+  void                            SetSharedCanvas(bool shared);
+  bool                            GetSharedCanvas() const;
   void                            RenderWorldAnnotations();
   void                            RenderScreenAnnotations(const std::vector<std::string> &field_names,
                                                           const std::vector<vtkm::Range> &ranges,
                                                           const std::vector<vtkm::cont::ColorTable> &colors);
+  //
+  // Without annotations the composited image is saved as is, and
+  // the canvas is never written back to
+  //
+  void                            DoRenderAnnotations(bool on);
+  bool                            GetRenderAnnotations() const;
+  //
+  // Hands over the final image in the byte format the encoder
+  // consumes. When set, Save encodes it instead of canvas 0.
+  //
+  void                            SetCompositedImage(Image &image);
   void                            Save();
+  //
+  // Save hands the pixels to the image writer and returns before the
+  // png is encoded and written. Call GetImageWriter().Flush() before
+  // reading the files back.
+  //
+  void                            SetAsyncSave(bool async_save);
+  bool                            GetAsyncSave() const;
+  //
+  // The file format Save writes, png by default. The extension of the
+  // format is appended to the image name.
+  //
+  void                            SetImageFormat(ImageWriter::Format format);
+  ImageWriter::Format             GetImageFormat() const;
+  //
+  // Saves the depth buffer along with the colors, for formats that
+  // can hold it (raw)
+  //
+  void                            SetSaveDepth(bool save_depth);
+  bool                            GetSaveDepth() const;
+  // the writer shared by every async save
+  static AsyncImageWriter&        GetImageWriter();
+  //
+  // Canvases dropped by ClearCanvases are kept for later renders of
+  // the same size, up to this many bytes. The ones idle the longest
+  // are freed first. Defaults to 1 GiB.
+  //
+  static void                     SetCanvasPoolCapacity(const size_t bytes);
 protected:
   std::vector<vtkmCanvasPtr>   m_canvases;
   std::vector<vtkm::Id>        m_domain_ids;
+  // screen space footprint (in pixels) of what was rendered into each canvas
+  std::vector<vtkm::Bounds>    m_screen_bounds;
   vtkm::rendering::Camera      m_camera; 
   std::string                  m_image_name;
   vtkm::Bounds                 m_scene_bounds;
   vtkm::Int32                  m_width;
   vtkm::Int32                  m_height;
   vtkm::rendering::Color       m_bg_color;
+  bool                         m_render_annotations;
+  bool                         m_shared_canvas;
+  bool                         m_async_save;
+  bool                         m_save_depth;
+  ImageWriter::Format          m_image_format;
+  // shared by copies of the render, like the canvases
+  std::shared_ptr<Image>       m_composited_image;
   vtkmCanvasPtr                CreateCanvas();
 }; 
 
@@ -5,20 +5,30 @@
 #include <vtkh/utils/vtkm_array_utils.hpp>
 #include <vtkh/utils/vtkm_dataset_info.hpp>
 #include <vtkh/utils/PNGEncoder.hpp>
+#include <vtkm/cont/DeviceAdapterListTag.h>
+#include <vtkm/cont/RuntimeDeviceTracker.h>
 #include <vtkm/rendering/raytracing/Logger.h>
 #ifdef VTKH_PARALLEL
+#include <mpi.h>
 #include "compositing/DIYCompositor.hpp"
 #endif
 
+#include <algorithm>
 #include <assert.h>
+#include <chrono>
+#include <exception>
 
 namespace vtkh {
 
 Renderer::Renderer()
   : m_do_composite(true),
+    m_save_tiles(false),
     m_color_table("Cool to Warm"),
     m_field_index(0),
-    m_has_color_table(true)
+    m_has_color_table(true),
+    m_async_composite(false),
+    m_render_threads(1),
+    m_composite_ms(0.)
 {
   m_compositor  = NULL; 
 #ifdef VTKH_PARALLEL
@@ -31,6 +41,11 @@ Renderer::Renderer()
 
 Renderer::~Renderer()
 {
+  // don't throw from here, just let the helper finish
+  if(m_composite_future.valid())
+  {
+    m_composite_future.wait();
+  }
   delete m_compositor;
 }
 
@@ -58,6 +73,72 @@ Renderer::SetDoComposite(bool do_composite)
   m_do_composite = do_composite;
 }
 
+void 
+Renderer::SetCompositeStrategy(Compositor::CompositeStrategy strategy)
+{
+  WaitForComposite();
+  m_compositor->SetCompositeStrategy(strategy);
+}
+
+void 
+Renderer::SetRadixKFactors(const std::vector<int> &factors)
+{
+  WaitForComposite();
+  m_compositor->SetRadixKFactors(factors);
+}
+
+void 
+Renderer::SetSaveTiles(bool save_tiles)
+{
+  WaitForComposite();
+  m_save_tiles = save_tiles;
+}
+
+void 
+Renderer::SetDepthOnlyComposite(bool depth_only)
+{
+  WaitForComposite();
+  m_compositor->SetDepthOnlyExchange(depth_only);
+}
+
+void 
+Renderer::SetCompositeThreads(const int num_threads)
+{
+  WaitForComposite();
+  m_compositor->SetThreads(num_threads);
+}
+
+void 
+Renderer::SetCompositeBlocksPerRank(const int blocks_per_rank)
+{
+  WaitForComposite();
+  m_compositor->SetBlocksPerRank(blocks_per_rank);
+}
+
+void 
+Renderer::SetNodeLocalComposite(bool node_local)
+{
+  WaitForComposite();
+  m_compositor->SetNodeLocalComposite(node_local);
+}
+
+void 
+Renderer::SetAsyncComposite(bool async_composite)
+{
+  WaitForComposite();
+  m_async_composite = async_composite;
+}
+
+void 
+Renderer::SetRenderThreads(const int num_threads)
+{
+  if(num_threads < 1)
+  {
+    throw Error("Renderer: number of render threads must be at least 1");
+  }
+  m_render_threads = num_threads;
+}
+
 void
 Renderer::AddRender(vtkh::Render &render)
 {
@@ -95,38 +176,196 @@ vtkm::cont::ColorTable Renderer::GetColorTable() const
 void 
 Renderer::Composite(const int &num_images)
 {
+  StartComposite(num_images, 
+                 Compositor::Z_BUFFER_SURFACE, 
+                 std::vector<std::vector<int>>());
+}
 
-  m_compositor->SetCompositeMode(Compositor::Z_BUFFER_SURFACE);
+void
+Renderer::StartComposite(const int num_images,
+                         const Compositor::CompositeMode mode,
+                         const std::vector<std::vector<int>> &vis_orders)
+{
+  // only one composite is in flight at a time
+  WaitForComposite();
+
+  m_compositor->SetCompositeMode(mode);
+  m_compositor->SetCollect(!m_save_tiles);
+  m_compositor->SetAsync(UseAsyncComposite());
+
+  //
+  // get the host buffers of the canvases up front, since the 
+  // compositor may read them from the helper thread
+  //
+  struct CanvasBuffers
+  {
+    float        *m_color;
+    float        *m_depth;
+    int           m_width;
+    int           m_height;
+    vtkm::Bounds  m_screen_bounds;
+    int           m_vis_order;
+  };
+
+  std::vector<std::vector<CanvasBuffers>> buffers(num_images);
   for(int i = 0; i < num_images; ++i)
   {
     const int num_canvases = m_renders[i].GetNumberOfCanvases();
-
     for(int dom = 0; dom < num_canvases; ++dom)
     {
-      float* color_buffer = &GetVTKMPointer(m_renders[i].GetCanvas(dom)->GetColorBuffer())[0][0]; 
-      float* depth_buffer = GetVTKMPointer(m_renders[i].GetCanvas(dom)->GetDepthBuffer()); 
-
-      int height = m_renders[i].GetCanvas(dom)->GetHeight();
-      int width = m_renders[i].GetCanvas(dom)->GetWidth();
+      //
+      // canvases of culled or off screen domains are left out, but
+      // every render hands the compositor at least one image
+      //
+      const bool last_chance = dom == num_canvases - 1 && buffers[i].empty();
+      if(!m_renders[i].IsRendered(dom) && !last_chance)
+      {
+        continue;
+      }
+      buffers[i].push_back(CanvasBuffers());
+      CanvasBuffers &canvas = buffers[i].back();
+      canvas.m_color = &GetVTKMPointer(m_renders[i].GetCanvas(dom)->GetColorBuffer())[0][0]; 
+      canvas.m_depth = GetVTKMPointer(m_renders[i].GetCanvas(dom)->GetDepthBuffer()); 
+      canvas.m_width = m_renders[i].GetCanvas(dom)->GetWidth();
+      canvas.m_height = m_renders[i].GetCanvas(dom)->GetHeight();
+      canvas.m_screen_bounds = m_renders[i].GetScreenBounds(dom);
+      canvas.m_vis_order = mode == Compositor::VIS_ORDER_BLEND ? vis_orders[i][dom] : -1;
+    }
+  }
 
-      m_compositor->AddImage(color_buffer,
-                             depth_buffer,
-                             width,
-                             height);
-    } //for dom
+  m_composite_renders.assign(m_renders.begin(), m_renders.begin() + num_images);
+  m_composite_results.clear();
 
-    Image result = m_compositor->Composite();
+  Compositor *compositor = m_compositor;
+  std::vector<Image> &results = m_composite_results;
+  // returns how long the composite took on the thread it ran on
+  auto composite = [compositor, &results, buffers, mode]()
+  {
+    typedef std::chrono::steady_clock Clock;
+    const Clock::time_point start = Clock::now();
+    const int num_renders = static_cast<int>(buffers.size());
+    int batch_start = 0;
+    while(batch_start < num_renders)
+    {
+      //
+      // consecutive renders of the same size are composited 
+      // together in a single exchange
+      //
+      const int width = buffers[batch_start].at(0).m_width;
+      const int height = buffers[batch_start].at(0).m_height;
+      int batch_end = batch_start + 1;
+      while(batch_end < num_renders &&
+            buffers[batch_end].at(0).m_width == width &&
+            buffers[batch_end].at(0).m_height == height)
+      {
+        batch_end++;
+      }
+
+      for(int i = batch_start; i < batch_end; ++i)
+      {
+        const int num_canvases = static_cast<int>(buffers[i].size());
+        for(int dom = 0; dom < num_canvases; ++dom)
+        {
+          const CanvasBuffers &canvas = buffers[i][dom];
+          if(mode == Compositor::VIS_ORDER_BLEND)
+          {
+            compositor->AddImage(canvas.m_color,
+                                 canvas.m_depth,
+                                 canvas.m_width,
+                                 canvas.m_height,
+                                 canvas.m_screen_bounds,
+                                 canvas.m_vis_order);
+          }
+          else
+          {
+            compositor->AddImage(canvas.m_color,
+                                 canvas.m_depth,
+                                 canvas.m_width,
+                                 canvas.m_height,
+                                 canvas.m_screen_bounds);
+          }
+        } //for dom
+        compositor->FinishImage();
+      } // for batch
+
+      std::vector<Image> batch_results = compositor->CompositeBatch();
+      for(size_t i = 0; i < batch_results.size(); ++i)
+      {
+        results.push_back(Image());
+        results.back().Swap(batch_results[i]);
+      }
+      compositor->ClearImages();
+      batch_start = batch_end;
+    } // for batch
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  };
+
+  if(UseAsyncComposite())
+  {
+    m_composite_future = std::async(std::launch::async, composite);
+  }
+  else
+  {
+    m_composite_ms = composite();
+    FinishComposite();
+  }
+}
 
+bool
+Renderer::UseAsyncComposite() const
+{
+  if(!m_async_composite)
+  {
+    return false;
+  }
 #ifdef VTKH_PARALLEL
-    if(vtkh::GetMPIRank() == 0)
+  // the calling thread keeps using MPI while the helper composites
+  int provided;
+  MPI_Query_thread(&provided);
+  return provided == MPI_THREAD_MULTIPLE;
+#else
+  return true;
+#endif
+}
+
+void
+Renderer::WaitForComposite()
+{
+  if(!m_composite_future.valid())
+  {
+    return;
+  }
+  // rethrows anything thrown by the composite
+  m_composite_ms = m_composite_future.get();
+  FinishComposite();
+}
+
+void
+Renderer::FinishComposite()
+{
+  const int num_images = static_cast<int>(m_composite_results.size());
+  for(int i = 0; i < num_images; ++i)
+  {
+    Image &result = m_composite_results[i];
+    if(m_save_tiles)
     {
-      ImageToCanvas(result, *m_renders[i].GetCanvas(0), true); 
+      SaveTile(result, m_composite_renders[i]);
     }
+    else
+    {
+#ifdef VTKH_PARALLEL
+      if(vtkh::GetMPIRank() == 0)
+      {
+        ResultToRender(result, m_composite_renders[i]); 
+      }
 #else
-    ImageToCanvas(result, *m_renders[i].GetCanvas(0), true); 
+      ResultToRender(result, m_composite_renders[i]); 
 #endif
-    m_compositor->ClearImages();
+    }
+    result.Recycle();
   } // for image
+  m_composite_results.clear();
+  m_composite_renders.clear();
 }
 
 void 
@@ -200,7 +439,193 @@ Renderer::DoExecute()
     throw Error(msg);
   }
 
-  int total_renders = static_cast<int>(m_renders.size());
+  // sampled once up front instead of for every domain
+  m_mapper->SetActiveColorTable(m_corrected_color_table);
+
+  const int num_threads = GetRenderThreads();
+  if(num_threads > 1)
+  {
+    RenderThreaded(num_threads);
+    return;
+  }
+
+  const int total_renders = static_cast<int>(m_renders.size());
+  for(int i = 0; i < total_renders; ++i)
+  {
+    RenderDomains(*m_mapper, i);
+  }
+}
+
+Renderer::vtkmMapperPtr
+Renderer::NewMapper() const
+{
+  return vtkmMapperPtr();
+}
+
+void
+Renderer::SetMapperDomain(vtkm::rendering::Mapper &vtkmNotUsed(mapper), 
+                          const vtkm::Id vtkmNotUsed(domain_id))
+{
+}
+
+bool
+Renderer::IsDomainVisible(const int vtkmNotUsed(dom)) const
+{
+  return true;
+}
+
+vtkm::Range
+Renderer::GetMapperRange() const
+{
+  return m_range;
+}
+
+int
+Renderer::GetRenderThreads() const
+{
+  const int total_renders = static_cast<int>(m_renders.size());
+  if(m_render_threads < 2 || total_renders < 2)
+  {
+    return 1;
+  }
+  // device renders are already spread over the whole device
+  vtkm::cont::RuntimeDeviceTracker tracker = vtkm::cont::GetGlobalRuntimeDeviceTracker();
+  if(tracker.CanRunOn(vtkm::cont::DeviceAdapterTagCuda()))
+  {
+    return 1;
+  }
+  return std::min(m_render_threads, total_renders);
+}
+
+void
+Renderer::RenderThreaded(const int num_threads)
+{
+  std::vector<vtkmMapperPtr> mappers(num_threads);
+  mappers[0] = m_mapper;
+  for(int t = 1; t < num_threads; ++t)
+  {
+    mappers[t] = NewMapper();
+    if(mappers[t].get() == nullptr)
+    {
+      // this renderer can't make more mappers
+      mappers.resize(1);
+      break;
+    }
+  }
+  const int threads = static_cast<int>(mappers.size());
+  const int total_renders = static_cast<int>(m_renders.size());
+  // color tables are sampled on this thread, never by the workers
+  for(int t = 1; t < threads; ++t)
+  {
+    mappers[t]->SetActiveColorTable(m_corrected_color_table);
+  }
+
+  //
+  // The first render of a domain moves its arrays to the device and
+  // fills the per domain caches of the mappers, which several threads
+  // can't do at once. Renders are drawn here, in order, until every
+  // domain that shows up in any of them has been drawn once, and the
+  // workers only ever get domains that are ready.
+  //
+  std::vector<vtkm::Bounds> pending;
+  const int num_domains = static_cast<int>(m_input->GetNumberOfDomains());
+  for(int dom = 0; dom < num_domains; ++dom)
+  {
+    vtkm::cont::DataSet data_set; 
+    vtkm::Id domain_id;
+    m_input->GetDomain(dom, data_set, domain_id);
+    if(!data_set.HasField(m_field_name) ||
+       data_set.GetCellSet().GetNumberOfCells() == 0 ||
+       !IsDomainVisible(dom))
+    {
+      continue;
+    }
+    const vtkm::Bounds bounds = data_set.GetCoordinateSystem().GetBounds();
+    for(int i = 0; i < total_renders; ++i)
+    {
+      if(m_renders[i].IsOnScreen(bounds))
+      {
+        pending.push_back(bounds);
+        break;
+      }
+    }
+  }
+
+  int first = 0;
+  while(first < total_renders && !pending.empty())
+  {
+    const vtkh::Render &render = m_renders[first];
+    RenderDomains(*mappers[0], first);
+    pending.erase(std::remove_if(pending.begin(), 
+                                 pending.end(),
+                                 [&render](const vtkm::Bounds &bounds)
+                                 {
+                                   return render.IsOnScreen(bounds);
+                                 }),
+                  pending.end());
+    first++;
+  }
+
+  //
+  // each thread takes every n-th render of the rest, and draws its 
+  // domains in the same order the serial path does
+  //
+  vtkm::cont::RuntimeDeviceTracker tracker = vtkm::cont::GetGlobalRuntimeDeviceTracker();
+  auto render = [this, &mappers, &tracker, threads, total_renders, first](const int thread)
+  {
+    // device selections are per thread
+    vtkm::cont::GetGlobalRuntimeDeviceTracker().DeepCopy(tracker);
+    for(int i = first + thread; i < total_renders; i += threads)
+    {
+      RenderDomains(*mappers[thread], i);
+    }
+  };
+
+  std::vector<std::future<void>> workers;
+  for(int t = 1; t < threads; ++t)
+  {
+    workers.push_back(std::async(std::launch::async, render, t));
+  }
+
+  std::exception_ptr error;
+  try
+  {
+    for(int i = first; i < total_renders; i += threads)
+    {
+      RenderDomains(*mappers[0], i);
+    }
+  }
+  catch(...)
+  {
+    error = std::current_exception();
+  }
+
+  // always join every worker before reporting anything
+  for(size_t t = 0; t < workers.size(); ++t)
+  {
+    try
+    {
+      workers[t].get();
+    }
+    catch(...)
+    {
+      if(!error)
+      {
+        error = std::current_exception();
+      }
+    }
+  }
+
+  if(error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+void
+Renderer::RenderDomains(vtkm::rendering::Mapper &mapper, const int render_index)
+{
+  vtkh::Render &render = m_renders[render_index];
   int num_domains = static_cast<int>(m_input->GetNumberOfDomains());
   for(int dom = 0; dom < num_domains; ++dom)
   {
@@ -217,26 +642,37 @@ Renderer::DoExecute()
     const vtkm::cont::Field &field = data_set.GetField(m_field_name);
     const vtkm::cont::CoordinateSystem &coords = data_set.GetCoordinateSystem();
     if(cellset.GetNumberOfCells() == 0) continue;
-
-    for(int i = 0; i < total_renders; ++i)
-    {
-
-      m_mapper->SetActiveColorTable(m_corrected_color_table);
-      
-      vtkmCanvasPtr p_canvas = m_renders[i].GetDomainCanvas(domain_id);
-      const vtkmCamera &camera = m_renders[i].GetCamera(); 
-      m_mapper->SetCanvas(&(*p_canvas));
-      m_mapper->RenderCells(cellset,
-                            coords,
-                            field,
-                            m_color_table,
-                            camera,
-                            m_range);
-
-    }
+    if(!IsDomainVisible(dom)) continue;
+    const vtkm::Bounds bounds = coords.GetBounds();
+    if(!render.IsOnScreen(bounds)) continue;
+
+    vtkmCanvasPtr p_canvas = render.GetDomainCanvas(domain_id);
+    const vtkmCamera &camera = render.GetCamera(); 
+    mapper.SetCanvas(&(*p_canvas));
+    SetMapperDomain(mapper, domain_id);
+    mapper.RenderCells(cellset,
+                       coords,
+                       field,
+                       m_color_table,
+                       camera,
+                       GetMapperRange());
+    render.AddDomainBounds(domain_id, bounds);
   }
+}
 
-
+void
+Renderer::ResultToRender(Image &result, Render &render)
+{
+  if(!render.GetRenderAnnotations())
+  {
+    // nothing is drawn on top, so keep the bytes for the encoder
+    render.SetCompositedImage(result);
+    return;
+  }
+  // only the 3d world annotations are depth tested 
+  const bool get_depth = 
+    render.GetCamera().GetMode() == vtkm::rendering::Camera::MODE_3D;
+  ImageToCanvas(result, *render.GetCanvas(0), get_depth); 
 }
 
 void 
@@ -260,6 +696,61 @@ Renderer::ImageToCanvas(Image &image, vtkm::rendering::Canvas &canvas, bool get_
   if(get_depth) memcpy(depth_buffer, &image.m_depths[0], sizeof(float) * size);
 }
 
+void 
+Renderer::SaveTile(Image &tile, const Render &render)
+{
+  const int tile_width = tile.m_bounds.X.Max - tile.m_bounds.X.Min + 1;
+  const int tile_height = tile.m_bounds.Y.Max - tile.m_bounds.Y.Min + 1;
+  if(tile_width <= 0 || tile_height <= 0)
+  {
+    return;
+  }
+
+  vtkm::rendering::Color color = render.GetBackgroundColor();
+  float bg_color[4];
+  bg_color[0] = color.Components[0];
+  bg_color[1] = color.Components[1];
+  bg_color[2] = color.Components[2];
+  bg_color[3] = color.Components[3];
+  tile.CompositeBackground(bg_color);
+  //
+  // name the tile by the pixel offset of its upper left 
+  // corner in the final image
+  //
+  const int x_offset = tile.m_bounds.X.Min - tile.m_orig_bounds.X.Min;
+  const int y_offset = tile.m_orig_bounds.Y.Max - tile.m_bounds.Y.Max;
+  // tiles are written like whole images, in the format of the render
+  std::shared_ptr<ImageWriter> writer = ImageWriter::Create(render.GetImageFormat());
+  std::stringstream name;
+  name<<render.GetImageName()<<"_tile_"<<x_offset<<"_"<<y_offset;
+  name<<"."<<writer->GetExtension();
+
+  // the tile is recycled afterwards, so the writer can take its buffers
+  std::vector<unsigned char> pixels;
+  std::vector<float> depths;
+  pixels.swap(tile.m_pixels);
+  if(render.GetSaveDepth() && writer->SavesDepth())
+  {
+    depths.swap(tile.m_depths);
+  }
+
+  if(render.GetAsyncSave())
+  {
+    Render::GetImageWriter().Write(writer,
+                                   std::move(pixels),
+                                   std::move(depths),
+                                   tile_width,
+                                   tile_height,
+                                   name.str());
+    return;
+  }
+  writer->Write(&pixels[0],
+                depths.empty() ? nullptr : &depths[0],
+                tile_width,
+                tile_height,
+                name.str());
+}
+
 std::vector<Render> 
 Renderer::GetRenders() const
 {
@@ -1,11 +1,13 @@
 #ifndef VTK_H_RENDERER_HPP
 #define VTK_H_RENDERER_HPP
 
+#include <future>
 #include <vector>
 #include <vtkh/Error.hpp>
 #include <vtkh/filters/Filter.hpp>
 #include <vtkh/rendering/Render.hpp>
 #include <vtkh/rendering/Image.hpp>
+#include <vtkh/rendering/compositing/Compositor.hpp>
 
 #include <vtkm/rendering/Camera.h>
 #include <vtkm/rendering/Canvas.h>
@@ -13,8 +15,6 @@
 
 namespace vtkh {
 
-class Compositor;
-
 class Renderer : public Filter
 {
 public:
@@ -32,6 +32,31 @@ public:
   void SetField(const std::string field_name);
   void SetColorTable(const vtkm::cont::ColorTable &color_table);
   void SetDoComposite(bool do_composite);
+  void SetCompositeStrategy(Compositor::CompositeStrategy strategy);
+  void SetRadixKFactors(const std::vector<int> &factors);
+  //
+  // Each rank saves its tile of the composited image instead of
+  // gathering the full image on rank 0
+  //
+  void SetSaveTiles(bool save_tiles);
+  void SetDepthOnlyComposite(bool depth_only);
+  void SetCompositeThreads(const int num_threads);
+  void SetCompositeBlocksPerRank(const int blocks_per_rank);
+  void SetNodeLocalComposite(bool node_local);
+  //
+  // The compositing exchange runs on a helper thread so the caller
+  // can go on rendering. Results are written to the canvases by
+  // WaitForComposite, or by the next composite of this renderer.
+  // Requires MPI_THREAD_MULTIPLE, otherwise composites are blocking.
+  //
+  void SetAsyncComposite(bool async_composite);
+  //
+  // Renders are drawn concurrently by this many threads, each with
+  // its own mapper. Every canvas still sees its domains in the same
+  // order, so images match the serial ones. Only used on host devices.
+  //
+  void SetRenderThreads(const int num_threads);
+  void WaitForComposite();
   void SetRenders(const std::vector<Render> &renders);
   void SetRange(const vtkm::Range &range);
 
@@ -50,19 +75,64 @@ protected:
   Compositor                              *m_compositor;
   std::string                              m_field_name;
   bool                                     m_do_composite;   
+  bool                                     m_save_tiles;   
   vtkmMapperPtr                            m_mapper;
   vtkm::Bounds                             m_bounds;
   vtkm::Range                              m_range;
   vtkm::cont::ColorTable              m_color_table;
   vtkm::cont::ColorTable              m_corrected_color_table;
   bool                                     m_has_color_table;  
+  bool                                     m_async_composite;
+  int                                      m_render_threads;
+  // the composite in flight and the renders it belongs to
+  std::future<double>                      m_composite_future;
+  std::vector<vtkh::Render>                m_composite_renders;
+  std::vector<Image>                       m_composite_results;
+  // how long the last finished composite took where it ran, in ms
+  double                                   m_composite_ms;
   // methods
   virtual void PreExecute() override;
   virtual void PostExecute() override;
   virtual void DoExecute() override;
 
+  //
+  // A new mapper set up like m_mapper, for rendering on another
+  // thread. Renderers that return nullptr always render serially.
+  //
+  virtual vtkmMapperPtr NewMapper() const;
+  //
+  // Tells the mapper which domain it is about to render, for mappers
+  // that keep per domain state. Does nothing by default.
+  //
+  virtual void SetMapperDomain(vtkm::rendering::Mapper &mapper, const vtkm::Id domain_id);
+  //
+  // False for a domain of the input that draws nothing no matter the
+  // camera, which is then neither rendered nor composited. Domains
+  // without cells or the field are always skipped.
+  //
+  virtual bool IsDomainVisible(const int dom) const;
+  // the range the mappers map the field over, m_range by default
+  virtual vtkm::Range GetMapperRange() const;
+  // renders the domains into the canvases of renders[render_index]
+  void RenderDomains(vtkm::rendering::Mapper &mapper, const int render_index);
+  void RenderThreaded(const int num_threads);
+  int  GetRenderThreads() const;
+
   virtual void Composite(const int &num_images);
+  //
+  // Composites the canvases of the first num_images renders. Images
+  // are only ordered by vis_orders (per render and domain) when the
+  // mode is VIS_ORDER_BLEND.
+  //
+  void StartComposite(const int num_images,
+                      const Compositor::CompositeMode mode,
+                      const std::vector<std::vector<int>> &vis_orders);
+  void FinishComposite();
+  bool UseAsyncComposite() const;
   void ImageToCanvas(Image &image, vtkm::rendering::Canvas &canvas, bool get_depth);
+  // hands the final image to the render in the form it is saved from
+  void ResultToRender(Image &result, Render &render);
+  void SaveTile(Image &tile, const Render &render);
 };
 
 } // namespace vtkh
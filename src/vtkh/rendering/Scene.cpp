@@ -8,7 +8,16 @@ namespace vtkh
 
 Scene::Scene()
   : m_has_volume(false),
-    m_batch_size(10)
+    m_batch_size(10),
+    m_composite_strategy(Compositor::AUTO),
+    m_save_tiles(false),
+    m_depth_only_composite(false),
+    m_composite_threads(1),
+    m_composite_blocks_per_rank(1),
+    m_node_local_composite(false),
+    m_async_composite(false),
+    m_render_threads(1),
+    m_async_save(false)
 {
 
 }
@@ -31,6 +40,69 @@ Scene::GetRenderBatchSize() const
   return m_batch_size;
 }
 
+void
+Scene::SetCompositeStrategy(Compositor::CompositeStrategy strategy)
+{
+  m_composite_strategy = strategy;
+}
+
+void
+Scene::SetRadixKFactors(const std::vector<int> &factors)
+{
+  m_radix_k_factors = factors;
+}
+
+void
+Scene::SetSaveTiles(bool save_tiles)
+{
+  m_save_tiles = save_tiles;
+}
+
+void
+Scene::SetDepthOnlyComposite(bool depth_only)
+{
+  m_depth_only_composite = depth_only;
+}
+
+void
+Scene::SetCompositeThreads(int num_threads)
+{
+  assert(num_threads > 0);
+  m_composite_threads = num_threads;
+}
+
+void
+Scene::SetCompositeBlocksPerRank(int blocks_per_rank)
+{
+  assert(blocks_per_rank > 0);
+  m_composite_blocks_per_rank = blocks_per_rank;
+}
+
+void
+Scene::SetNodeLocalComposite(bool node_local)
+{
+  m_node_local_composite = node_local;
+}
+
+void
+Scene::SetAsyncComposite(bool async_composite)
+{
+  m_async_composite = async_composite;
+}
+
+void
+Scene::SetRenderThreads(int num_threads)
+{
+  assert(num_threads > 0);
+  m_render_threads = num_threads;
+}
+
+void
+Scene::SetAsyncSave(bool async_save)
+{
+  m_async_save = async_save;
+}
+
 void 
 Scene::AddRender(vtkh::Render &render)
 {
@@ -123,6 +195,29 @@ Scene::Render()
 
   bool do_once = true;
 
+  const int plot_size = m_renderers.size(); 
+
+  // the composite options are the same for every batch
+  for(auto renderer = m_renderers.begin(); renderer != m_renderers.end(); ++renderer)
+  {
+    (*renderer)->SetCompositeStrategy(m_composite_strategy);
+    (*renderer)->SetRadixKFactors(m_radix_k_factors);
+    (*renderer)->SetSaveTiles(m_save_tiles);
+    (*renderer)->SetDepthOnlyComposite(m_depth_only_composite);
+    (*renderer)->SetCompositeThreads(m_composite_threads);
+    (*renderer)->SetCompositeBlocksPerRank(m_composite_blocks_per_rank);
+    (*renderer)->SetNodeLocalComposite(m_node_local_composite);
+    (*renderer)->SetAsyncComposite(m_async_composite);
+    (*renderer)->SetRenderThreads(m_render_threads);
+  }
+  // tiles are saved by the compositing renderer, so renders need the
+  // flag before they are drawn
+  for(size_t i = 0; i < m_renders.size(); ++i)
+  {
+    m_renders[i].SetAsyncSave(m_async_save);
+  }
+  vtkh::Renderer *compositing_renderer = plot_size > 0 ? m_renderers.back() : nullptr;
+
   //
   // We are going to render images in batches. With databases
   // like Cinema, we could be rendering hundres of images. Keeping
@@ -131,6 +226,14 @@ Scene::Render()
   // would consume 7GB of space. Not good on the GPU, where resources 
   // are limited.
   //
+  // With async compositing, a batch is composited while the next
+  // one renders, so at most two batches of canvases are alive. The
+  // previous batch is finished once its composite is done, which 
+  // the compositing renderer waits for before starting the next.
+  //
+  std::vector<vtkh::Render> pending_batch;
+  int pending_start = 0;
+
   const int render_size = m_renders.size();
   int batch_start = 0; 
   while(batch_start < render_size)
@@ -140,7 +243,15 @@ Scene::Render()
     auto end = m_renders.begin() + batch_end;
 
     std::vector<vtkh::Render> current_batch(begin, end);
-    const int plot_size = m_renderers.size(); 
+    if(m_has_volume)
+    {
+      // the volume plot blends a canvas per domain, so everything
+      // drawn before it has to be kept per domain as well
+      for(size_t i = 0; i < current_batch.size(); ++i)
+      {
+        current_batch[i].SetSharedCanvas(false);
+      }
+    }
     auto renderer = m_renderers.begin(); 
 
     for(int i = 0; i < plot_size; ++i)
@@ -175,18 +286,54 @@ Scene::Render()
       renderer++;
     }
     
-    // render screen annotations last and save
-    for(int i = 0; i < current_batch.size(); ++i)
+    if(m_async_composite)
     {
-      current_batch[i].RenderWorldAnnotations();
-      current_batch[i].RenderScreenAnnotations(field_names, ranges, color_tables);
-      current_batch[i].Save();
-      // free buffers
-      m_renders[batch_start + i].ClearCanvases();
+      if(pending_batch.size() > 0)
+      {
+        FinishBatch(pending_batch, pending_start, field_names, ranges, color_tables);
+      }
+      pending_batch.swap(current_batch);
+      pending_start = batch_start;
+    }
+    else
+    {
+      FinishBatch(current_batch, batch_start, field_names, ranges, color_tables);
     }
 
     batch_start = batch_end;
   } // while
+
+  if(compositing_renderer != nullptr)
+  {
+    compositing_renderer->WaitForComposite();
+  }
+  if(pending_batch.size() > 0)
+  {
+    FinishBatch(pending_batch, pending_start, field_names, ranges, color_tables);
+  }
+}
+
+void
+Scene::FinishBatch(std::vector<vtkh::Render> &batch,
+                   const int batch_start,
+                   std::vector<std::string> &field_names,
+                   std::vector<vtkm::Range> &ranges,
+                   std::vector<vtkm::cont::ColorTable> &color_tables)
+{
+  // render screen annotations last and save
+  for(int i = 0; i < batch.size(); ++i)
+  {
+    // tiles were already saved by the renderer
+    if(!m_save_tiles)
+    {
+      batch[i].RenderWorldAnnotations();
+      batch[i].RenderScreenAnnotations(field_names, ranges, color_tables);
+      batch[i].Save();
+    }
+    // free buffers
+    m_renders[batch_start + i].ClearCanvases();
+  }
+  batch.clear();
 }
 
 void 
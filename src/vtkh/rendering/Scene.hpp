@@ -16,6 +16,16 @@ private:
   std::vector<vtkh::Render>    m_renders;
   bool                         m_has_volume;
   int                          m_batch_size;
+  Compositor::CompositeStrategy m_composite_strategy;
+  std::vector<int>             m_radix_k_factors;
+  bool                         m_save_tiles;
+  bool                         m_depth_only_composite;
+  int                          m_composite_threads;
+  int                          m_composite_blocks_per_rank;
+  bool                         m_node_local_composite;
+  bool                         m_async_composite;
+  int                          m_render_threads;
+  bool                         m_async_save;
 public:
  Scene();
  ~Scene();
@@ -27,7 +37,35 @@ public:
   void Save();
   void SetRenderBatchSize(int batch_size);
   int  GetRenderBatchSize() const;
+  void SetCompositeStrategy(Compositor::CompositeStrategy strategy);
+  void SetRadixKFactors(const std::vector<int> &factors);
+  // each rank saves its own tile of the images (no annotations)
+  void SetSaveTiles(bool save_tiles);
+  // opaque surfaces exchange depth only and fetch colors at the end
+  void SetDepthOnlyComposite(bool depth_only);
+  // threads and screen blocks per rank used while compositing
+  void SetCompositeThreads(int num_threads);
+  void SetCompositeBlocksPerRank(int blocks_per_rank);
+  // surfaces are composited within each node before the exchange
+  void SetNodeLocalComposite(bool node_local);
+  // composite each batch while the next one renders
+  void SetAsyncComposite(bool async_composite);
+  // the images of a batch are rendered concurrently by this many threads
+  void SetRenderThreads(int num_threads);
+  //
+  // Rank 0, or every rank when saving tiles, encodes and writes images
+  // on a background thread and goes on to the next batch. Render
+  // returns before the last images are on disk;
+  // Render::GetImageWriter().Flush() waits for them.
+  //
+  void SetAsyncSave(bool async_save);
 protected:
+  // annotates and saves a rendered and composited batch
+  void FinishBatch(std::vector<vtkh::Render> &batch,
+                   const int batch_start,
+                   std::vector<std::string> &field_names,
+                   std::vector<vtkm::Range> &ranges,
+                   std::vector<vtkm::cont::ColorTable> &color_tables);
   bool IsMesh(vtkh::Renderer *renderer);
   bool IsVolume(vtkh::Renderer *renderer);
 }; // class scene
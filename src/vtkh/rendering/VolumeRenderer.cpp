@@ -1,11 +1,17 @@
 #include "VolumeRenderer.hpp"
 
+#include <vtkh/filters/Resample.hpp>
 #include <vtkh/utils/vtkm_array_utils.hpp>
+#include <vtkh/rendering/MacrocellGrid.hpp>
 #include <vtkh/rendering/compositing/Compositor.hpp>
 
 #include <vtkm/rendering/CanvasRayTracer.h>
 
+#include <algorithm>
+#include <chrono>
+#include <list>
 #include <memory>
+#include <utility>
 
 #ifdef VTKH_PARALLEL
 #include <mpi.h>
@@ -19,37 +25,360 @@ namespace vtkh {
 
 namespace detail
 {
-  struct VisOrdering
+  typedef vtkm::Matrix<vtkm::Float32,4,4> ViewMatrix;
+
+  static bool SameView(const ViewMatrix &a, const ViewMatrix &b)
+  {
+    for(int i = 0; i < 4; ++i)
+    {
+      for(int j = 0; j < 4; ++j)
+      {
+        if(a[i][j] != b[i][j]) return false;
+      }
+    }
+    return true;
+  }
+
+  //
+  // The bounds of every domain on every rank, in rank order, and the
+  // orderings of this rank's domains already computed from them for
+  // each camera view. Kept across renderers and cycles, since the
+  // orderings only change when a camera moves or a domain changes.
+  //
+  struct VisOrderCache
   {
-    int m_rank;
-    int m_domain_index;
-    int m_order;
-    float m_minz;
+    // what this rank contributed to the last exchange
+    std::vector<vtkm::Bounds>                           m_local_bounds;
+    std::vector<vtkm::Bounds>                           m_global_bounds;
+    // index of this rank's first domain in m_global_bounds
+    int                                                 m_local_offset;
+    bool                                                m_valid;
+    // most recently used first
+    std::list<std::pair<ViewMatrix, std::vector<int>>>  m_orders;
+
+    VisOrderCache()
+      : m_local_offset(0),
+        m_valid(false)
+    {}
   };
 
-  struct DepthOrder
+  static VisOrderCache& GetVisOrderCache()
+  {
+    static VisOrderCache cache;
+    return cache;
+  }
+
+  const size_t MAX_CACHED_ORDERS = 1024;
+
+  static bool SameBounds(const std::vector<vtkm::Bounds> &a,
+                         const std::vector<vtkm::Bounds> &b)
   {
-    inline bool operator()(const VisOrdering &lhs, const VisOrdering &rhs)
+    if(a.size() != b.size()) return false;
+    for(size_t i = 0; i < a.size(); ++i)
     {
-      return lhs.m_minz < rhs.m_minz;
+      if(!(a[i] == b[i])) return false;
     }
+    return true;
+  }
+
+  //
+  // Which field values the transfer function gives any opacity, using
+  // the same sampling of the color table as the vtk-m mappers
+  //
+  class OpacityLookup
+  {
+  public:
+    OpacityLookup(const vtkm::cont::ColorTable &color_table,
+                  const vtkm::Range &range)
+      : m_min(range.Min),
+        m_inv_delta(0.)
+    {
+      vtkm::cont::ArrayHandle<vtkm::Vec<vtkm::UInt8,4>> samples;
+      color_table.Sample(NUM_SAMPLES, samples);
+      auto portal = samples.GetPortalConstControl();
+      // number of samples with opacity before each index
+      m_visible_before.resize(NUM_SAMPLES + 1, 0);
+      for(int i = 0; i < NUM_SAMPLES; ++i)
+      {
+        const int visible = portal.Get(i)[3] > 0 ? 1 : 0;
+        m_visible_before[i + 1] = m_visible_before[i] + visible;
+      }
+      const vtkm::Float64 delta = range.Max - range.Min;
+      if(delta > 0.)
+      {
+        m_inv_delta = 1. / delta;
+      }
+    }
+
+    bool operator()(const vtkm::Float64 min_value, const vtkm::Float64 max_value) const
+    {
+      // one sample of slack on either side, in case the mapper
+      // interpolates between them
+      const int first = std::max(0, Index(min_value) - 1);
+      const int last = std::min(NUM_SAMPLES - 1, Index(max_value) + 1);
+      return m_visible_before[last + 1] - m_visible_before[first] > 0;
+    }
+
+  private:
+    int Index(const vtkm::Float64 value) const
+    {
+      vtkm::Float64 normalized = (value - m_min) * m_inv_delta;
+      normalized = std::max(0., std::min(1., normalized));
+      return static_cast<int>(normalized * (NUM_SAMPLES - 1));
+    }
+
+    static const int NUM_SAMPLES = 1024;
+    vtkm::Float64    m_min;
+    vtkm::Float64    m_inv_delta;
+    std::vector<int> m_visible_before;
+  };
+
+  struct MacrocellCacheEntry
+  {
+    vtkm::Id            m_domain_id;
+    std::string         m_field_name;
+    MacrocellGrid       m_grid;
+    // the latest crop and the (inclusive) cells it covers
+    bool                m_has_crop;
+    vtkm::Id3           m_crop_min;
+    vtkm::Id3           m_crop_max;
+    vtkm::cont::DataSet m_crop;
+    // the grid and the crop
+    size_t              m_bytes;
   };
 
-  struct RankOrder
+  // the memory of the cropped field values
+  static size_t GetCropBytes(const vtkm::cont::DataSet &crop, const std::string &field_name)
   {
-    inline bool operator()(const VisOrdering &lhs, const VisOrdering &rhs)
+    const vtkm::cont::DynamicArrayHandle &values = crop.GetField(field_name).GetData();
+    const size_t value_size =
+      values.IsSameType(vtkm::cont::ArrayHandle<vtkm::Float32>()) ? sizeof(vtkm::Float32)
+                                                                  : sizeof(vtkm::Float64);
+    return static_cast<size_t>(values.GetNumberOfValues()) * value_size;
+  }
+
+  //
+  // Macrocell grids of the most recently rendered domains, up to a
+  // number of bytes. Each keeps the crop of the box of cells that was
+  // last visible, so frames that see the same box do not copy the
+  // values again. Crops count towards the bytes, since they can be as
+  // large as the domains themselves.
+  //
+  class MacrocellCache
+  {
+  public:
+    MacrocellCache()
+      : m_bytes(0),
+        m_max_bytes(size_t(1) << 30)
+    {}
+    //
+    // The entry of the domain's field, with the grid built if it is
+    // not cached or the arrays have changed. Returns null if no grid
+    // can be built.
+    //
+    MacrocellCacheEntry* Get(const vtkm::cont::DataSet &domain,
+                             const vtkm::Id domain_id,
+                             const std::string &field_name)
     {
-      if(lhs.m_rank < rhs.m_rank)
+      auto it = m_entries.begin();
+      for(; it != m_entries.end(); ++it)
       {
-        return true;
+        if(it->m_domain_id == domain_id && it->m_field_name == field_name)
+        {
+          break;
+        }
       }
-      else if(lhs.m_rank == rhs.m_rank)
+
+      if(it != m_entries.end() && it->m_grid.IsBuiltFrom(domain, field_name))
       {
-        return lhs.m_domain_index < rhs.m_domain_index;
+        // most recently used first
+        m_entries.splice(m_entries.begin(), m_entries, it);
+        return &m_entries.front();
       }
-      return false;
+
+      if(it != m_entries.end())
+      {
+        m_bytes -= it->m_bytes;
+        m_entries.erase(it);
+      }
+
+      MacrocellCacheEntry entry;
+      entry.m_domain_id = domain_id;
+      entry.m_field_name = field_name;
+      entry.m_has_crop = false;
+      if(!entry.m_grid.Build(domain, field_name))
+      {
+        return nullptr;
+      }
+      entry.m_bytes = entry.m_grid.GetNumberOfBytes();
+      m_bytes += entry.m_bytes;
+      m_entries.push_front(std::move(entry));
+      Evict();
+      return &m_entries.front();
     }
+
+    //
+    // The crop of the cells from cell_min to cell_max (inclusive) of
+    // the domain the entry, which Get just returned, was built from
+    //
+    const vtkm::cont::DataSet& GetCrop(MacrocellCacheEntry &entry,
+                                       const vtkm::cont::DataSet &domain,
+                                       const vtkm::Id3 &cell_min,
+                                       const vtkm::Id3 &cell_max)
+    {
+      if(entry.m_has_crop && entry.m_crop_min == cell_min && entry.m_crop_max == cell_max)
+      {
+        return entry.m_crop;
+      }
+      if(entry.m_has_crop)
+      {
+        const size_t crop_bytes = GetCropBytes(entry.m_crop, entry.m_field_name);
+        entry.m_bytes -= crop_bytes;
+        m_bytes -= crop_bytes;
+      }
+      entry.m_crop = MacrocellGrid::Crop(domain, entry.m_field_name, cell_min, cell_max);
+      entry.m_crop_min = cell_min;
+      entry.m_crop_max = cell_max;
+      entry.m_has_crop = true;
+      const size_t crop_bytes = GetCropBytes(entry.m_crop, entry.m_field_name);
+      entry.m_bytes += crop_bytes;
+      m_bytes += crop_bytes;
+      Evict();
+      return entry.m_crop;
+    }
+
+    void Clear()
+    {
+      m_entries.clear();
+      m_bytes = 0;
+    }
+
+    void SetMaxBytes(const size_t max_bytes)
+    {
+      m_max_bytes = max_bytes;
+      Evict();
+    }
+
+  private:
+    //
+    // The latest entry is always kept, whatever its size, since the
+    // caller is still using it
+    //
+    void Evict()
+    {
+      while(m_bytes > m_max_bytes && m_entries.size() > 1)
+      {
+        m_bytes -= m_entries.back().m_bytes;
+        m_entries.pop_back();
+      }
+    }
+
+    std::list<MacrocellCacheEntry> m_entries;
+    size_t                         m_bytes;
+    size_t                         m_max_bytes;
   };
+
+  static MacrocellCache& GetMacrocellCache()
+  {
+    static MacrocellCache cache;
+    return cache;
+  }
+
+  //
+  // Whether any value of the domain's field is visible, from the range
+  // of the whole field
+  //
+  static bool HasVisibleValues(const vtkm::cont::DataSet &domain,
+                               const std::string &field_name,
+                               const OpacityLookup &is_visible)
+  {
+    if(!domain.HasField(field_name))
+    {
+      return true;
+    }
+    vtkm::cont::ArrayHandle<vtkm::Range> ranges = domain.GetField(field_name).GetRange();
+    if(ranges.GetNumberOfValues() != 1)
+    {
+      return true;
+    }
+    const vtkm::Range range = ranges.GetPortalConstControl().Get(0);
+    if(!range.IsNonEmpty())
+    {
+      return false;
+    }
+    return is_visible(range.Min, range.Max);
+  }
+
+  //
+  // Returns the part of the domain that can be visible, and sets
+  // visible to false if there is none
+  //
+  static vtkm::cont::DataSet CropDomain(const vtkm::cont::DataSet &domain,
+                                        const vtkm::Id domain_id,
+                                        const std::string &field_name,
+                                        const OpacityLookup &is_visible,
+                                        bool &visible)
+  {
+    visible = true;
+    MacrocellCache &cache = GetMacrocellCache();
+    MacrocellCacheEntry *entry = cache.Get(domain, domain_id, field_name);
+    if(entry == nullptr)
+    {
+      visible = HasVisibleValues(domain, field_name, is_visible);
+      return domain;
+    }
+
+    const vtkm::Id3 cell_dims = entry->m_grid.GetCellDims();
+    vtkm::Id3 cell_min, cell_max;
+    if(!entry->m_grid.FindVisibleCells(is_visible, cell_min, cell_max))
+    {
+      // the domain is culled, so it does not matter what is rendered
+      visible = false;
+      return domain;
+    }
+
+    if(cell_min == vtkm::Id3(0, 0, 0) && cell_max == cell_dims - vtkm::Id3(1, 1, 1))
+    {
+      return domain;
+    }
+    return cache.GetCrop(*entry, domain, cell_min, cell_max);
+  }
+
+  const vtkm::Float32 MIN_SAMPLES = 8.f;
+  const vtkm::Float32 MAX_SAMPLES = 4096.f;
+  // the transparent band below the transfer function, as a fraction
+  // of its range. It spans a few of the mapper's color map samples.
+  const vtkm::Float64 HOLE_BAND = 1. / 256.;
+
+  //
+  // Adds a band below the range of the color table that is fully
+  // transparent and ramps up to the opacity at the bottom of the
+  // range, leaving the table unchanged over its range
+  //
+  static void AddTransparentBand(vtkm::cont::ColorTable &color_table)
+  {
+    const vtkm::Range range = color_table.GetRange();
+    const vtkm::Float64 band = range.Length() * HOLE_BAND;
+    vtkm::Vec<vtkm::Float64,4> color;
+    vtkm::Vec<vtkm::Float64,4> alpha;
+    if(band <= 0. ||
+       !color_table.GetPoint(0, color) ||
+       !color_table.GetPointAlpha(0, alpha))
+    {
+      return;
+    }
+    // values below the first points get their colors and opacities
+    color_table.AddPoint(range.Min - band,
+                         vtkm::Vec<float,3>(static_cast<float>(color[1]),
+                                            static_cast<float>(color[2]),
+                                            static_cast<float>(color[3])));
+    if(alpha[0] > range.Min)
+    {
+      color_table.AddPointAlpha(range.Min, static_cast<float>(alpha[1]));
+    }
+    color_table.AddPointAlpha(range.Min - band, 0.f);
+    color_table.AddPointAlpha(range.Min - band * 0.5, 0.f);
+  }
 } //  namespace detail
 
 VolumeRenderer::VolumeRenderer()
@@ -64,6 +393,16 @@ VolumeRenderer::VolumeRenderer()
   m_color_table.AddPointAlpha(0.0f, .02);
   m_color_table.AddPointAlpha(.0f, .5);
   m_num_samples = 100.f;
+  m_time_budget = 0.;
+  m_frame_samples = 100.f;
+  m_has_frame_cost = false;
+  m_sample_cost = 0.;
+  m_overhead = 0.;
+  m_cost_samples = 0.f;
+  m_composite_call_ms = 0.;
+  m_sample_distance = 0.f;
+  m_empty_space_skipping = true;
+  m_mapper_range = m_range;
 }
 
 VolumeRenderer::~VolumeRenderer()
@@ -73,19 +412,244 @@ VolumeRenderer::~VolumeRenderer()
 void 
 VolumeRenderer::Update() 
 {
+  typedef std::chrono::steady_clock Clock;
+  typedef std::chrono::duration<double, std::milli> Milliseconds;
+  const Clock::time_point start = Clock::now();
+  m_composite_call_ms = 0.;
+
   PreExecute();
+  // the sample distance and range stay those of the full domains
+  vtkh::DataSet *input = m_input;
+  CropTransparent();
+  m_input = &m_cropped_input;
+  const Clock::time_point render_start = Clock::now();
   Renderer::DoExecute();
+  const Clock::time_point render_end = Clock::now();
   PostExecute();
+  m_input = input;
+
+  if(m_time_budget > 0.)
+  {
+    const double render_ms = Milliseconds(render_end - render_start).count();
+    const double total_ms = Milliseconds(Clock::now() - start).count();
+    //
+    // the time spent waiting on or running composites is swapped for
+    // how long the last composite took where it ran. An async one is
+    // still running, so it counts towards the next frame instead.
+    //
+    const double other_ms = total_ms - render_ms - m_composite_call_ms;
+    UpdateFrameCost(render_ms, other_ms + m_composite_ms);
+  }
+}
+
+void
+VolumeRenderer::SetTimeBudget(const double milliseconds)
+{
+  if(milliseconds < 0.)
+  {
+    throw Error("VolumeRenderer: time budget can't be negative");
+  }
+  m_time_budget = milliseconds;
+}
+
+vtkm::Float32
+VolumeRenderer::FindNumberOfSamples() const
+{
+  const vtkm::Float32 samples = static_cast<vtkm::Float32>(m_num_samples);
+  const int num_renders = static_cast<int>(m_renders.size());
+  if(m_time_budget <= 0. || num_renders == 0)
+  {
+    return samples;
+  }
+
+  if(!m_has_frame_cost)
+  {
+    // nothing was measured yet
+    return samples;
+  }
+
+  double pixels = 0.;
+  for(int i = 0; i < num_renders; ++i)
+  {
+    pixels += double(m_renders[i].GetWidth()) * double(m_renders[i].GetHeight());
+  }
+  pixels /= double(num_renders);
+
+  double fit = detail::MAX_SAMPLES;
+  if(m_sample_cost > 0.)
+  {
+    fit = (m_time_budget - m_overhead) / (m_sample_cost * pixels);
+  }
+  // move at most a factor of two per frame, since timings are noisy
+  fit = std::max(fit, 0.5 * m_cost_samples);
+  fit = std::min(fit, 2.0 * m_cost_samples);
+  fit = std::max(fit, double(detail::MIN_SAMPLES));
+  fit = std::min(fit, double(detail::MAX_SAMPLES));
+  return static_cast<vtkm::Float32>(fit);
+}
+
+void
+VolumeRenderer::UpdateFrameCost(const double render_ms, const double other_ms)
+{
+  const int num_renders = static_cast<int>(m_renders.size());
+  if(num_renders == 0)
+  {
+    return;
+  }
+
+  double times[2] = {render_ms, other_ms};
+#ifdef VTKH_PARALLEL
+  //
+  // the slowest rank sets the pace, and every rank has to pick the
+  // same number of samples
+  //
+  double local_times[2] = {render_ms, other_ms};
+  MPI_Allreduce(local_times, times, 2, MPI_DOUBLE, MPI_MAX, vtkh::GetMPIComm());
+#endif
+
+  double pixels = 0.;
+  for(int i = 0; i < num_renders; ++i)
+  {
+    pixels += double(m_renders[i].GetWidth()) * double(m_renders[i].GetHeight());
+  }
+  if(pixels <= 0.)
+  {
+    return;
+  }
+
+  const double sample_cost = times[0] / (pixels * double(m_frame_samples));
+  const double overhead = times[1] / double(num_renders);
+
+  if(!m_has_frame_cost)
+  {
+    m_sample_cost = sample_cost;
+    m_overhead = overhead;
+    m_has_frame_cost = true;
+  }
+  else
+  {
+    // average with the frames before
+    m_sample_cost = 0.5 * (m_sample_cost + sample_cost);
+    m_overhead = 0.5 * (m_overhead + overhead);
+  }
+  m_cost_samples = m_frame_samples;
+}
+
+void
+VolumeRenderer::SetEmptySpaceSkipping(bool on)
+{
+  m_empty_space_skipping = on;
+}
+
+void
+VolumeRenderer::ClearMacrocellCache()
+{
+  detail::GetMacrocellCache().Clear();
+}
+
+void
+VolumeRenderer::SetMacrocellCacheSize(const long long bytes)
+{
+  if(bytes < 0)
+  {
+    throw Error("VolumeRenderer: macrocell cache size can't be negative");
+  }
+  detail::GetMacrocellCache().SetMaxBytes(static_cast<size_t>(bytes));
+}
+
+void
+VolumeRenderer::CropTransparent()
+{
+  m_cropped_input = vtkh::DataSet();
+  const int num_domains = static_cast<int>(m_input->GetNumberOfDomains());
+  m_domain_visible.assign(num_domains, true);
+  if(!m_range.IsNonEmpty())
+  {
+    for(int dom = 0; dom < num_domains; ++dom)
+    {
+      vtkm::cont::DataSet data_set;
+      vtkm::Id domain_id;
+      m_input->GetDomain(dom, data_set, domain_id);
+      m_cropped_input.AddDomain(data_set, domain_id);
+    }
+    return;
+  }
+
+  //
+  // every domain is kept, culled or not, so that the domains stay
+  // lined up with the canvases and visibility orders
+  //
+  detail::OpacityLookup is_visible(m_corrected_color_table, m_mapper_range);
+  for(int dom = 0; dom < num_domains; ++dom)
+  {
+    vtkm::cont::DataSet data_set;
+    vtkm::Id domain_id;
+    m_input->GetDomain(dom, data_set, domain_id);
+    bool visible = true;
+    if(m_empty_space_skipping)
+    {
+      data_set = detail::CropDomain(data_set, domain_id, m_field_name, is_visible, visible);
+    }
+    else
+    {
+      visible = detail::HasVisibleValues(data_set, m_field_name, is_visible);
+    }
+    m_domain_visible[dom] = visible;
+    m_cropped_input.AddDomain(data_set, domain_id);
+  }
+}
+
+bool
+VolumeRenderer::IsDomainVisible(const int dom) const
+{
+  if(dom < 0 || dom >= static_cast<int>(m_domain_visible.size()))
+  {
+    return true;
+  }
+  return m_domain_visible[dom];
+}
+
+vtkm::Range
+VolumeRenderer::GetMapperRange() const
+{
+  return m_mapper_range;
 }
 
 void 
 VolumeRenderer::PreExecute() 
 {
+  const vtkm::Range requested_range = m_range;
   Renderer::PreExecute();
+  //
+  // the holes of resampled grids are below the range of the field,
+  // which is then taken from the samples inside cells
+  //
+  vtkm::cont::ArrayHandle<vtkm::Range> valid_ranges =
+    m_input->GetGlobalRange(Resample::GetValidRangeName(m_field_name));
+  const bool has_holes = valid_ranges.GetNumberOfValues() == 1;
+  if(has_holes)
+  {
+    const vtkm::Range valid_range = valid_ranges.GetPortalConstControl().Get(0);
+    if(requested_range.Min == vtkm::Infinity64())
+    {
+      m_range.Min = valid_range.Min;
+    }
+    if(requested_range.Max == vtkm::NegativeInfinity64())
+    {
+      m_range.Max = valid_range.Max;
+    }
+  }
+  // domains are blended in visibility order, so each needs a canvas
+  for(size_t i = 0; i < m_renders.size(); ++i)
+  {
+    m_renders[i].SetSharedCanvas(false);
+  }
+  m_frame_samples = FindNumberOfSamples();
   // we need to scale down the opacity to allow finer control
-  // transfer_functions
+  // transfer_functions. The correction goes with the sample distance,
+  // so the opacity over a given length stays the same for any count.
   const float correction_scalar = VTKH_OPACITY_CORRECTION;
-  float samples = m_num_samples;
+  float samples = m_frame_samples;
 
   float ratio = correction_scalar / samples;
   vtkm::cont::ColorTable corrected;
@@ -99,14 +663,31 @@ VolumeRenderer::PreExecute()
     corrected.UpdatePointAlpha(i,point); 
   }
 
+  m_mapper_range = m_range;
+  if(has_holes && m_range.Length() > 0.)
+  {
+    // holes are clamped to the bottom of the color map, which the
+    // band makes transparent
+    detail::AddTransparentBand(corrected);
+    m_mapper_range.Min -= m_range.Length() * detail::HOLE_BAND;
+  }
   this->m_corrected_color_table = corrected;
 
   vtkm::Vec<vtkm::Float32,3> extent; 
   extent[0] = static_cast<vtkm::Float32>(this->m_bounds.X.Length());
   extent[1] = static_cast<vtkm::Float32>(this->m_bounds.Y.Length());
   extent[2] = static_cast<vtkm::Float32>(this->m_bounds.Z.Length());
-  vtkm::Float32 dist = vtkm::Magnitude(extent) / samples; 
-  m_tracer->SetSampleDistance(dist);
+  m_sample_distance = vtkm::Magnitude(extent) / samples; 
+  m_tracer->SetSampleDistance(m_sample_distance);
+}
+
+Renderer::vtkmMapperPtr
+VolumeRenderer::NewMapper() const
+{
+  auto mapper = std::make_shared<vtkm::rendering::MapperVolume>();
+  mapper->SetCompositeBackground(false);
+  mapper->SetSampleDistance(m_sample_distance);
+  return mapper;
 }
 
 void 
@@ -176,193 +757,133 @@ VolumeRenderer::FindMinDepth(const vtkm::rendering::Camera &camera,
 void 
 VolumeRenderer::Composite(const int &num_images)
 {
-  const int num_domains = static_cast<int>(m_input->GetNumberOfDomains());
-
-  m_compositor->SetCompositeMode(Compositor::VIS_ORDER_BLEND);
-
+  typedef std::chrono::steady_clock Clock;
+  typedef std::chrono::duration<double, std::milli> Milliseconds;
+  // the previous composite may still be reading the orderings
+  Clock::time_point start = Clock::now();
+  WaitForComposite();
+  m_composite_call_ms += Milliseconds(Clock::now() - start).count();
   FindVisibilityOrdering(); 
+  start = Clock::now();
+  StartComposite(num_images, Compositor::VIS_ORDER_BLEND, m_visibility_orders);
+  m_composite_call_ms += Milliseconds(Clock::now() - start).count();
+}
 
-  for(int i = 0; i < num_images; ++i)
+void
+VolumeRenderer::ExchangeDomainBounds()
+{
+  detail::VisOrderCache &cache = detail::GetVisOrderCache();
+  const int num_domains = static_cast<int>(m_input->GetNumberOfDomains());
+  std::vector<vtkm::Bounds> local_bounds(num_domains);
+  for(int dom = 0; dom < num_domains; ++dom)
   {
-    const int num_canvases = m_renders[i].GetNumberOfCanvases();
+    local_bounds[dom] = m_input->GetDomainBounds(dom);
+  }
 
-    for(int dom = 0; dom < num_canvases; ++dom)
-    {
-      float* color_buffer = &GetVTKMPointer(m_renders[i].GetCanvas(dom)->GetColorBuffer())[0][0]; 
-      float* depth_buffer = GetVTKMPointer(m_renders[i].GetCanvas(dom)->GetDepthBuffer()); 
-      int height = m_renders[i].GetCanvas(dom)->GetHeight();
-      int width = m_renders[i].GetCanvas(dom)->GetWidth();
-
-      m_compositor->AddImage(color_buffer,
-                             depth_buffer,
-                             width,
-                             height,
-                             m_visibility_orders[i][dom]);
-    } //for dom
-
-    Image result = m_compositor->Composite();
-    const std::string image_name = m_renders[i].GetImageName() + ".png";
-#ifdef VTKH_PARALLEL
-    if(vtkh::GetMPIRank() == 0)
-    {
-#endif
-      ImageToCanvas(result, *m_renders[i].GetCanvas(0), true); 
+  int changed = !cache.m_valid || !detail::SameBounds(local_bounds, cache.m_local_bounds);
 #ifdef VTKH_PARALLEL
-    }
+  MPI_Comm comm = vtkh::GetMPIComm();
+  // every rank has to agree before the exchange can be skipped
+  int local_changed = changed;
+  MPI_Allreduce(&local_changed, &changed, 1, MPI_INT, MPI_MAX, comm);
 #endif
-    m_compositor->ClearImages();
-  } // for image
-}
+  if(!changed)
+  {
+    return;
+  }
 
-void 
-VolumeRenderer::DepthSort(int num_domains, 
-                          std::vector<float> &min_depths,
-                          std::vector<int> &local_vis_order)
-{
-  assert(min_depths.size() == num_domains);
-  assert(local_vis_order.size() == num_domains);
+  cache.m_orders.clear();
+  cache.m_local_bounds = local_bounds;
 #ifdef VTKH_PARALLEL
-  int root = 0;
-  MPI_Comm comm = vtkh::GetMPIComm();
-  int num_ranks = vtkh::GetMPISize();
-  int rank = vtkh::GetMPIRank();
-  int *domain_counts = NULL; 
-  int *domain_offsets = NULL; 
-  int *vis_order = NULL; 
-  float *depths = NULL;
-
-  if(rank == root)
-  {
-    domain_counts = new int[num_ranks]; 
-    domain_offsets = new int[num_ranks]; 
-  }
-
-  MPI_Gather(&num_domains,
-             1,
-             MPI_INT,
-             domain_counts,
-             1,
-             MPI_INT,
-            root,
-             comm);
-
-  int depths_size = 0;
-  if(rank == root)
-  {
-    //scan for dispacements
-    domain_offsets[0] = 0;
-    for(int i = 1; i < num_ranks; ++i)
-    {
-      domain_offsets[i] = domain_offsets[i - 1] + domain_counts[i - 1]; 
-    }
-
-    for(int i = 0; i < num_ranks; ++i)
-    {
-      depths_size += domain_counts[i];
-    }
-
-    depths = new float[depths_size];
-                 
+  const int num_ranks = vtkh::GetMPISize();
+  const int rank = vtkh::GetMPIRank();
+  std::vector<int> domain_counts(num_ranks);
+  MPI_Allgather(&num_domains, 1, MPI_INT, &domain_counts[0], 1, MPI_INT, comm);
+
+  // 6 doubles per domain
+  std::vector<int> value_counts(num_ranks);
+  std::vector<int> value_offsets(num_ranks);
+  int total_domains = 0;
+  cache.m_local_offset = 0;
+  for(int i = 0; i < num_ranks; ++i)
+  {
+    if(i == rank) cache.m_local_offset = total_domains;
+    value_counts[i] = domain_counts[i] * 6;
+    value_offsets[i] = total_domains * 6;
+    total_domains += domain_counts[i];
   }
-  
-  MPI_Gatherv(&min_depths[0],
-              num_domains,
-              MPI_FLOAT,
-              depths,
-              domain_counts,
-              domain_offsets,
-              MPI_FLOAT,
-              root,
-              comm);
-
-  if(rank == root)
-  {
-    std::vector<detail::VisOrdering> order;
-    order.resize(depths_size);
-
-    for(int i = 0; i < num_ranks; ++i)
-    {
-      for(int c = 0; c < domain_counts[i]; ++c)
-      {
-        int index = domain_offsets[i] + c;    
-        order[index].m_rank = i;
-        order[index].m_domain_index = c;
-        order[index].m_minz = depths[index];
-      }
-    }
-    
-    std::sort(order.begin(), order.end(), detail::DepthOrder());
-    
-    for(int i = 0; i < depths_size; ++i)
-    {
-      order[i].m_order = i;
-    }
 
-    std::sort(order.begin(), order.end(), detail::RankOrder());
-        
-    vis_order = new int[depths_size];
-    for(int i = 0; i < depths_size; ++i)
-    {
-      vis_order[i] = order[i].m_order;
-    }
+  std::vector<double> local_values(num_domains * 6);
+  for(int dom = 0; dom < num_domains; ++dom)
+  {
+    const vtkm::Bounds &b = local_bounds[dom];
+    double *values = &local_values[dom * 6];
+    values[0] = b.X.Min; values[1] = b.X.Max;
+    values[2] = b.Y.Min; values[3] = b.Y.Max;
+    values[4] = b.Z.Min; values[5] = b.Z.Max;
   }
-  
-  MPI_Scatterv(vis_order,
-               domain_counts,
-               domain_offsets,
-               MPI_INT,
-               &local_vis_order[0],
-               num_domains,
-               MPI_INT,
-               root,
-               comm);
-
-  if(rank == root)
-  {
-    delete[] domain_counts;
-    delete[] domain_offsets;
-    delete[] vis_order;
-    delete[] depths;
+
+  std::vector<double> global_values(total_domains * 6 + 1);
+  MPI_Allgatherv(num_domains > 0 ? &local_values[0] : NULL,
+                 num_domains * 6,
+                 MPI_DOUBLE,
+                 &global_values[0],
+                 &value_counts[0],
+                 &value_offsets[0],
+                 MPI_DOUBLE,
+                 comm);
+
+  cache.m_global_bounds.resize(total_domains);
+  for(int dom = 0; dom < total_domains; ++dom)
+  {
+    const double *values = &global_values[dom * 6];
+    cache.m_global_bounds[dom] = vtkm::Bounds(values[0], values[1],
+                                              values[2], values[3],
+                                              values[4], values[5]);
   }
 #else
+  cache.m_global_bounds = local_bounds;
+  cache.m_local_offset = 0;
+#endif
+  cache.m_valid = true;
+}
 
-  std::vector<detail::VisOrdering> order;
-  order.resize(num_domains);
-
-  for(int i = 0; i < num_domains; ++i)
+void
+VolumeRenderer::DepthSort(const vtkm::rendering::Camera &camera,
+                          std::vector<int> &local_vis_order) const
+{
+  const detail::VisOrderCache &cache = detail::GetVisOrderCache();
+  const int total_domains = static_cast<int>(cache.m_global_bounds.size());
+  std::vector<float> min_depths(total_domains);
+  std::vector<int> order(total_domains);
+  for(int dom = 0; dom < total_domains; ++dom)
   {
-      order[i].m_rank = 0;
-      order[i].m_domain_index = i;
-      order[i].m_minz = min_depths[i];
+    min_depths[dom] = FindMinDepth(camera, cache.m_global_bounds[dom]);
+    order[dom] = dom;
   }
-  std::sort(order.begin(), order.end(), detail::DepthOrder());
-  
-  for(int i = 0; i < num_domains; ++i)
+
+  // ties go to the lower rank and domain index, so all ranks agree
+  std::sort(order.begin(), order.end(), [&min_depths](const int lhs, const int rhs)
   {
-    order[i].m_order = i;
-  }
+    if(min_depths[lhs] != min_depths[rhs]) return min_depths[lhs] < min_depths[rhs];
+    return lhs < rhs;
+  });
 
-  std::sort(order.begin(), order.end(), detail::RankOrder());
-   
-  for(int i = 0; i < num_domains; ++i)
+  const int num_local = static_cast<int>(cache.m_local_bounds.size());
+  local_vis_order.resize(num_local);
+  for(int i = 0; i < total_domains; ++i)
   {
-    local_vis_order[i] = order[i].m_order;
+    const int local = order[i] - cache.m_local_offset;
+    if(local >= 0 && local < num_local)
+    {
+      local_vis_order[local] = i;
+    }
   }
-#endif
 }
 
 void
 VolumeRenderer::FindVisibilityOrdering()
 {
-  const int num_domains = static_cast<int>(m_input->GetNumberOfDomains());
-  const int num_cameras = static_cast<int>(m_renders.size());
-  m_visibility_orders.resize(num_cameras);
-
-  for(int i = 0; i < num_cameras; ++i)
-  {
-    m_visibility_orders[i].resize(num_domains);
-  }
-  
   //
   // In order for parallel volume rendering to composite correctly,
   // we nee to establish a visibility ordering to pass to IceT.
@@ -370,20 +891,40 @@ VolumeRenderer::FindVisibilityOrdering()
   // take the minimum z value. Then sort them while keeping 
   // track of rank, then pass the list in.
   //
-  std::vector<float> min_depths;     
-  min_depths.resize(num_domains);
+  // The bounds of all domains are exchanged once, and only when they
+  // change, and every rank sorts them for each camera itself.
+  //
+  ExchangeDomainBounds();
+
+  detail::VisOrderCache &cache = detail::GetVisOrderCache();
+  const int num_cameras = static_cast<int>(m_renders.size());
+  m_visibility_orders.resize(num_cameras);
 
   for(int i = 0; i < num_cameras; ++i)
   {
     const vtkm::rendering::Camera &camera = m_renders[i].GetCamera();
-    for(int dom = 0; dom < num_domains; ++dom)
+    const detail::ViewMatrix view = camera.CreateViewMatrix();
+
+    auto entry = cache.m_orders.begin();
+    for(; entry != cache.m_orders.end(); ++entry)
     {
-      vtkm::Bounds bounds = this->m_input->GetDomainBounds(dom);
-      min_depths[dom] = FindMinDepth(camera, bounds);
+      if(detail::SameView(entry->first, view)) break;
     }
-      
-    DepthSort(num_domains, min_depths, m_visibility_orders[i]); 
 
+    if(entry != cache.m_orders.end())
+    {
+      cache.m_orders.splice(cache.m_orders.begin(), cache.m_orders, entry);
+    }
+    else
+    {
+      cache.m_orders.push_front(std::make_pair(view, std::vector<int>()));
+      DepthSort(camera, cache.m_orders.front().second);
+      if(cache.m_orders.size() > detail::MAX_CACHED_ORDERS)
+      {
+        cache.m_orders.pop_back();
+      }
+    }
+    m_visibility_orders[i] = cache.m_orders.front().second;
   } // for each camera
 }
 
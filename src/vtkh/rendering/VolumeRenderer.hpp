@@ -2,6 +2,7 @@
 #define VTK_H_RENDERER_VOLUME_HPP
 
 #include <vtkh/rendering/Renderer.hpp>
+#include <vtkh/DataSet.hpp>
 #include <vtkm/rendering/MapperVolume.h>
 
 namespace vtkh {
@@ -13,6 +14,32 @@ public:
   virtual ~VolumeRenderer();
   std::string GetName() const override;
   void SetNumberOfSamples(const int num_samples);
+  //
+  // Picks the number of samples every frame so that rendering and
+  // compositing an image takes about this many milliseconds, going by
+  // the time the previous frames of this renderer took. Frames start
+  // from the count set by SetNumberOfSamples. An async composite is
+  // counted once it finishes, so it shapes the frame after. The
+  // opacity correction follows the count, so colors do not shift as
+  // it changes. 0, the default, keeps the count fixed.
+  //
+  void SetTimeBudget(const double milliseconds);
+  //
+  // Only the box of each domain that the transfer function does not
+  // make fully transparent is rendered. The min and max of the field
+  // over blocks of cells are kept for each domain between renders.
+  // Applies to 3D uniform and rectilinear domains. On by default.
+  // Domains that are fully transparent are skipped either way.
+  //
+  void SetEmptySpaceSkipping(bool on);
+  // forgets the min and max of every domain
+  static void ClearMacrocellCache();
+  //
+  // The most the min and max grids may keep alive, counting the field
+  // arrays they were built from and the last crop of each domain. The
+  // least recently rendered domains are dropped first. 1 GiB by default.
+  //
+  static void SetMacrocellCacheSize(const long long bytes);
   static Renderer::vtkmCanvasPtr GetNewCanvas(int width = 1024, int height = 1024);
 
   void Update() override;
@@ -20,17 +47,59 @@ protected:
   virtual void Composite(const int &num_images) override;
   virtual void PreExecute() override;
   virtual void PostExecute() override;
+  virtual vtkmMapperPtr NewMapper() const override;
 
   std::vector<std::vector<int>> m_visibility_orders;
+  //
+  // Fills m_cropped_input with the visible part of each domain, and
+  // finds the domains the transfer function makes fully transparent
+  //
+  void CropTransparent();
+  virtual bool IsDomainVisible(const int dom) const override;
+  virtual vtkm::Range GetMapperRange() const override;
   void FindVisibilityOrdering();
-  void DepthSort(int num_domains, 
-                 std::vector<float> &min_depths,
-                 std::vector<int> &local_vis_order);
+  //
+  // Gathers the bounds of every domain on all ranks, unless no rank's
+  // domains changed since the last call
+  //
+  void ExchangeDomainBounds();
+  // orders this rank's domains among all of them for the camera
+  void DepthSort(const vtkm::rendering::Camera &camera,
+                 std::vector<int> &local_vis_order) const;
+  // the number of samples for this frame
+  vtkm::Float32 FindNumberOfSamples() const;
+  // learns the cost of a sample from how long the frame took
+  void UpdateFrameCost(const double render_ms, const double other_ms);
   float FindMinDepth(const vtkm::rendering::Camera &camera, 
                      const vtkm::Bounds &bounds) const;
   
   std::shared_ptr<vtkm::rendering::MapperVolume> m_tracer;
   int m_num_samples;
+  double m_time_budget;
+  // the number used for the current frame
+  vtkm::Float32 m_frame_samples;
+  //
+  // What the frames so far have cost: a fixed overhead plus a cost per
+  // sample of each pixel, and the number of samples the last one used
+  //
+  bool m_has_frame_cost;
+  double m_sample_cost;
+  double m_overhead;
+  vtkm::Float32 m_cost_samples;
+  // time this frame's thread spent waiting on or running composites
+  double m_composite_call_ms;
+  // set on the mappers by PreExecute
+  vtkm::Float32 m_sample_distance;
+  bool m_empty_space_skipping;
+  //
+  // The range with a band below it that the corrected color table
+  // leaves transparent, when the input has the holes of resampled
+  // grids in it. Otherwise the range.
+  //
+  vtkm::Range m_mapper_range;
+  vtkh::DataSet m_cropped_input;
+  // false for domains that are culled as fully transparent
+  std::vector<bool> m_domain_visible;
 };
 
 } // namespace vtkh
@@ -1,5 +1,6 @@
 #include "Compositor.hpp"
 #include <vtkh/rendering/ImageCompositor.hpp>
+#include <vtkh/Error.hpp>
 
 #include <assert.h>
 #include <algorithm>
@@ -8,7 +9,14 @@ namespace vtkh
 {
 
 Compositor::Compositor() 
-  : m_composite_mode(Z_BUFFER_SURFACE)
+  : m_composite_mode(Z_BUFFER_SURFACE),
+    m_composite_strategy(AUTO),
+    m_collect(true),
+    m_depth_only(false),
+    m_threads(1),
+    m_blocks_per_rank(1),
+    m_node_local(false),
+    m_async(false)
 { 
 
 }
@@ -27,51 +35,91 @@ Compositor::SetCompositeMode(CompositeMode composite_mode)
 }
 
 void 
-Compositor::ClearImages()
+Compositor::SetCompositeStrategy(CompositeStrategy strategy)
 {
-  m_images.clear();
+  m_composite_strategy = strategy; 
 }
 
 void 
-Compositor::AddImage(const unsigned char *color_buffer,
-                     const float *        depth_buffer,
-                     const int            width,
-                     const int            height)
+Compositor::SetRadixKFactors(const std::vector<int> &factors)
 {
-  assert(m_composite_mode != VIS_ORDER_BLEND);
-  assert(depth_buffer != NULL);
-  Image image; 
-  if(m_images.size() == 0)
+  m_radix_k_factors = factors; 
+}
+
+void 
+Compositor::SetCollect(bool collect)
+{
+  m_collect = collect; 
+}
+
+void 
+Compositor::SetDepthOnlyExchange(bool depth_only)
+{
+  m_depth_only = depth_only; 
+}
+
+void
+Compositor::SetThreads(const int num_threads)
+{
+  if(num_threads < 1)
   {
-    m_images.push_back(image);
-    m_images[0].Init(color_buffer,
-                     depth_buffer,
-                     width,
-                     height);
-    //m_images[0].Save("first.png");
+    throw Error("Compositor: number of threads must be at least 1");
   }
-  else if(m_composite_mode == Z_BUFFER_SURFACE)
+  m_threads = num_threads; 
+}
+
+void
+Compositor::SetBlocksPerRank(const int blocks_per_rank)
+{
+  if(blocks_per_rank < 1)
   {
-    //
-    // Do local composite and keep a single image
-    //
-    image.Init(color_buffer,
-               depth_buffer,
-               width,
-               height);
-    vtkh::ImageCompositor compositor;
-    compositor.ZBufferComposite(m_images[0],image);
+    throw Error("Compositor: blocks per rank must be at least 1");
   }
-  else
+  m_blocks_per_rank = blocks_per_rank; 
+}
+
+void
+Compositor::SetNodeLocalComposite(bool node_local)
+{
+  m_node_local = node_local; 
+}
+
+void
+Compositor::SetAsync(bool async)
+{
+  m_async = async; 
+}
+
+void 
+Compositor::ClearImages()
+{
+  // keep the storage around for the next images
+  for(size_t i = 0; i < m_images.size(); ++i)
   {
-    const size_t image_index = m_images.size();
-    m_images.push_back(image);
-    m_images[image_index].Init(color_buffer,
-                               depth_buffer,
-                               width,
-                               height);
+    m_images[i].Recycle();
+  }
+  for(size_t b = 0; b < m_batch.size(); ++b)
+  {
+    for(size_t i = 0; i < m_batch[b].size(); ++i)
+    {
+      m_batch[b][i].Recycle();
+    }
   }
-    
+  m_images.clear();
+  m_batch.clear();
+}
+
+void 
+Compositor::AddImage(const unsigned char *color_buffer,
+                     const float *        depth_buffer,
+                     const int            width,
+                     const int            height)
+{
+  AddImage(color_buffer,
+           depth_buffer,
+           width,
+           height,
+           Image::CanvasBounds(width, height));
 }
 
 void 
@@ -79,41 +127,104 @@ Compositor::AddImage(const float *color_buffer,
                      const float *depth_buffer,
                      const int    width,
                      const int    height)
+{
+  AddImage(color_buffer,
+           depth_buffer,
+           width,
+           height,
+           Image::CanvasBounds(width, height));
+}
+
+void 
+Compositor::AddImage(const unsigned char *color_buffer,
+                     const float         *depth_buffer,
+                     const int            width,
+                     const int            height,
+                     const int            vis_order)
+{
+  AddImage(color_buffer,
+           depth_buffer,
+           width,
+           height,
+           Image::CanvasBounds(width, height),
+           vis_order);
+}
+
+void 
+Compositor::AddImage(const float *color_buffer,
+                     const float *depth_buffer,
+                     const int    width,
+                     const int    height,
+                     const int    vis_order)
+{
+  AddImage(color_buffer,
+           depth_buffer,
+           width,
+           height,
+           Image::CanvasBounds(width, height),
+           vis_order);
+}
+
+void 
+Compositor::AddImage(const unsigned char *color_buffer,
+                     const float *        depth_buffer,
+                     const int            width,
+                     const int            height,
+                     const vtkm::Bounds  &screen_bounds)
 {
   assert(m_composite_mode != VIS_ORDER_BLEND);
   assert(depth_buffer != NULL);
-  Image image; 
-  if(m_images.size() == 0)
-  {
-    m_images.push_back(image);
-    m_images[0].Init(color_buffer,
-                     depth_buffer,
-                     width,
-                     height);
-  }
-  else if(m_composite_mode == Z_BUFFER_SURFACE)
+  if(m_composite_mode == Z_BUFFER_SURFACE && m_images.size() != 0)
   {
-    //
-    // Do local composite and keep a single image
-    //
-    image.Init(color_buffer,
-               depth_buffer,
-               width,
-               height);
-
+    // composite straight from the canvas without a temporary image
+    GrowSurfaceImage(screen_bounds);
     vtkh::ImageCompositor compositor;
-    compositor.ZBufferComposite(m_images[0],image);
+    compositor.ZBufferComposite(m_images[0],
+                                color_buffer,
+                                depth_buffer,
+                                width,
+                                height,
+                                screen_bounds);
+    return;
   }
-  else
+  Image image; 
+  image.Init(color_buffer,
+             depth_buffer,
+             width,
+             height,
+             screen_bounds);
+  AddSurfaceImage(image);
+}
+
+void 
+Compositor::AddImage(const float         *color_buffer,
+                     const float         *depth_buffer,
+                     const int            width,
+                     const int            height,
+                     const vtkm::Bounds  &screen_bounds)
+{
+  assert(m_composite_mode != VIS_ORDER_BLEND);
+  assert(depth_buffer != NULL);
+  if(m_composite_mode == Z_BUFFER_SURFACE && m_images.size() != 0)
   {
-    const size_t image_index = m_images.size();
-    m_images.push_back(image);
-    m_images[image_index].Init(color_buffer,
-                               depth_buffer,
-                               width,
-                               height);
+    // composite straight from the canvas without a temporary image
+    GrowSurfaceImage(screen_bounds);
+    vtkh::ImageCompositor compositor;
+    compositor.ZBufferComposite(m_images[0],
+                                color_buffer,
+                                depth_buffer,
+                                width,
+                                height,
+                                screen_bounds);
+    return;
   }
-    
+  Image image; 
+  image.Init(color_buffer,
+             depth_buffer,
+             width,
+             height,
+             screen_bounds);
+  AddSurfaceImage(image);
 }
 
 void 
@@ -121,6 +232,7 @@ Compositor::AddImage(const unsigned char *color_buffer,
                      const float         *depth_buffer,
                      const int            width,
                      const int            height,
+                     const vtkm::Bounds  &screen_bounds,
                      const int            vis_order)
 {
   assert(m_composite_mode == VIS_ORDER_BLEND);
@@ -131,15 +243,17 @@ Compositor::AddImage(const unsigned char *color_buffer,
                              depth_buffer,
                              width,
                              height,
+                             screen_bounds,
                              vis_order);
 }
 
 void 
-Compositor::AddImage(const float *color_buffer,
-                     const float *depth_buffer,
-                     const int    width,
-                     const int    height,
-                     const int    vis_order)
+Compositor::AddImage(const float         *color_buffer,
+                     const float         *depth_buffer,
+                     const int            width,
+                     const int            height,
+                     const vtkm::Bounds  &screen_bounds,
+                     const int            vis_order)
 {
   assert(m_composite_mode == VIS_ORDER_BLEND);
   Image image;
@@ -150,9 +264,50 @@ Compositor::AddImage(const float *color_buffer,
                              depth_buffer,
                              width,
                              height,
+                             screen_bounds,
                              vis_order);
 }
 
+void 
+Compositor::AddSurfaceImage(Image &image)
+{
+  if(m_images.size() == 0)
+  {
+    m_images.push_back(Image());
+    m_images[0].Swap(image);
+  }
+  else if(m_composite_mode == Z_BUFFER_SURFACE)
+  {
+    //
+    // Do local composite and keep a single image that
+    // covers the footprints of everything added so far
+    //
+    GrowSurfaceImage(image.m_bounds);
+    vtkh::ImageCompositor compositor;
+    compositor.ZBufferComposite(m_images[0],image);
+  }
+  else
+  {
+    const size_t image_index = m_images.size();
+    m_images.push_back(Image());
+    m_images[image_index].Swap(image);
+  }
+}
+
+void
+Compositor::GrowSurfaceImage(const vtkm::Bounds &bounds)
+{
+  vtkm::Bounds grown = m_images[0].m_bounds;
+  grown.Include(bounds);
+  if(grown != m_images[0].m_bounds)
+  {
+    Image front;
+    front.SubsetFrom(m_images[0], grown);
+    m_images[0].Swap(front);
+    front.Recycle();
+  }
+}
+
 Image 
 Compositor::Composite()
 {
@@ -174,6 +329,53 @@ Compositor::Composite()
   return m_images[0];
 }
 
+void
+Compositor::FinishImage()
+{
+  m_batch.push_back(std::vector<Image>());
+  m_batch.back().swap(m_images);
+}
+
+std::vector<Image>
+Compositor::CompositeBatch()
+{
+  if(m_images.size() != 0)
+  {
+    FinishImage();
+  }
+  assert(m_batch.size() != 0);
+
+  const size_t batch_size = m_batch.size();
+  for(size_t i = 1; i < batch_size; ++i)
+  {
+    if(m_batch[i].at(0).m_orig_bounds != m_batch[0].at(0).m_orig_bounds)
+    {
+      throw Error("Compositor: all images in a batch must be the same size");
+    }
+  }
+
+  if(m_composite_mode == Z_BUFFER_SURFACE)
+  {
+    CompositeZBufferSurfaceBatch();
+  }
+  else if(m_composite_mode == Z_BUFFER_BLEND)
+  {
+    CompositeZBufferBlendBatch();
+  }
+  else if(m_composite_mode == VIS_ORDER_BLEND)
+  {
+    CompositeVisOrderBatch();
+  }
+
+  std::vector<Image> results(batch_size);
+  for(size_t i = 0; i < batch_size; ++i)
+  {
+    results[i].Swap(m_batch[i][0]);
+  }
+  m_batch.clear();
+  return results;
+}
+
 void
 Compositor::Cleanup()
 {
@@ -191,14 +393,17 @@ Compositor::GetLogString()
 void 
 Compositor::CompositeZBufferSurface()
 {
-  // nothing to do here. Images were composited as 
-  // they were added to the compositor
+  // Images were composited as they were added to the
+  // compositor, but they may only cover part of the screen
+  ExpandToScreen(m_images[0]);
 }
 
 void 
 Compositor::CompositeZBufferBlend()
 {
-  assert("this is not implemented yet" == "error");  
+  vtkh::ImageCompositor compositor;
+  compositor.ZBufferBlend(m_images);
+  ExpandToScreen(m_images[0]);
 }
 
 void 
@@ -206,6 +411,50 @@ Compositor::CompositeVisOrder()
 {
   vtkh::ImageCompositor compositor;
   compositor.OrderedComposite(m_images);
+  ExpandToScreen(m_images[0]);
+}
+
+void 
+Compositor::CompositeZBufferSurfaceBatch()
+{
+  for(size_t i = 0; i < m_batch.size(); ++i)
+  {
+    ExpandToScreen(m_batch[i][0]);
+  }
+}
+
+void 
+Compositor::CompositeZBufferBlendBatch()
+{
+  vtkh::ImageCompositor compositor;
+  for(size_t i = 0; i < m_batch.size(); ++i)
+  {
+    compositor.ZBufferBlend(m_batch[i]);
+    ExpandToScreen(m_batch[i][0]);
+  }
+}
+
+void 
+Compositor::CompositeVisOrderBatch()
+{
+  vtkh::ImageCompositor compositor;
+  for(size_t i = 0; i < m_batch.size(); ++i)
+  {
+    compositor.OrderedComposite(m_batch[i]);
+    ExpandToScreen(m_batch[i][0]);
+  }
+}
+
+void
+Compositor::ExpandToScreen(Image &image)
+{
+  if(image.m_bounds != image.m_orig_bounds)
+  {
+    Image full;
+    full.SubsetFrom(image, image.m_orig_bounds);
+    image.Swap(full);
+    full.Recycle();
+  }
 }
 
 } // namespace vtkh
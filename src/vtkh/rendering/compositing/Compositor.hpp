@@ -2,6 +2,7 @@
 #define VTKH_COMPOSITOR_BASE_HPP
 
 #include <sstream>
+#include <vector>
 #include <vtkh/rendering/Image.hpp>
 
 namespace vtkh 
@@ -15,12 +16,66 @@ public:
                          Z_BUFFER_BLEND,   // zbuffer composite with transparency 
                          VIS_ORDER_BLEND   // blend images in a specific order 
                        };
+    //
+    // How surface images are exchanged between ranks. Each strategy
+    // is a radix-k schedule with different group sizes per round.
+    // Vis order and blended images always use direct send.
+    //
+    enum CompositeStrategy {
+                             AUTO,           // pick factors from the rank count and image size
+                             RADIX_K,        // use the radix-k factors (default k = 8)
+                             BINARY_SWAP,    // groups of 2 
+                             TWO_THREE_SWAP, // groups of 2 and 3 
+                             DIRECT_SEND     // a single round with every rank 
+                           };
     Compositor();
 
     virtual ~Compositor();
 
     void SetCompositeMode(CompositeMode composite_mode);
 
+    void SetCompositeStrategy(CompositeStrategy strategy);
+    //
+    // Group size for each round of radix-k. The product of the
+    // factors must equal the number of ranks.
+    //
+    void SetRadixKFactors(const std::vector<int> &factors);
+    //
+    // When false, the final image is not gathered to rank 0 and
+    // Composite returns the tile of the image owned by each rank.
+    //
+    void SetCollect(bool collect);
+    //
+    // Opaque surfaces exchange only quantized depth and owner rank
+    // while compositing. Colors are fetched from the owners of the
+    // visible pixels at the end.
+    //
+    void SetDepthOnlyExchange(bool depth_only);
+    //
+    // Number of threads used to work on the blocks of each rank
+    // during the parallel exchange
+    //
+    void SetThreads(const int num_threads);
+    //
+    // Splits the screen into more blocks than ranks so the blocks
+    // of each rank can be composited concurrently. Only applies
+    // when the final image is collected.
+    //
+    void SetBlocksPerRank(const int blocks_per_rank);
+    //
+    // Opaque surfaces are first composited in shared memory by the
+    // ranks of each node, and only one rank per node takes part in
+    // the parallel exchange. Radix-k factors then apply to the number
+    // of nodes. Only applies when the final image is collected.
+    //
+    void SetNodeLocalComposite(bool node_local);
+    //
+    // The next composites run on a helper thread while the caller
+    // keeps using MPI. Must be set the same way on every rank, from
+    // the thread that adds the images.
+    //
+    virtual void SetAsync(bool async);
+
     void ClearImages();
     
     void AddImage(const unsigned char *color_buffer,
@@ -44,36 +99,78 @@ public:
                   const int    width,
                   const int    height,
                   const int    vis_order);
+    //
+    // The screen bounds are the (1-based, inclusive) region of the
+    // width x height canvas the data covers. Only that region is
+    // copied and composited.
+    //
+    void AddImage(const unsigned char *color_buffer,
+                  const float *        depth_buffer,
+                  const int            width,
+                  const int            height,
+                  const vtkm::Bounds  &screen_bounds);
+
+    void AddImage(const float         *color_buffer,
+                  const float         *depth_buffer,
+                  const int            width,
+                  const int            height,
+                  const vtkm::Bounds  &screen_bounds);
+
+    void AddImage(const unsigned char *color_buffer,
+                  const float *        depth_buffer,
+                  const int            width,
+                  const int            height,
+                  const vtkm::Bounds  &screen_bounds,
+                  const int            vis_order);
+
+    void AddImage(const float         *color_buffer,
+                  const float         *depth_buffer,
+                  const int            width,
+                  const int            height,
+                  const vtkm::Bounds  &screen_bounds,
+                  const int            vis_order);
     
     Image Composite();
+    //
+    // Several images (e.g. one per camera) can be composited in a
+    // single exchange. FinishImage ends the current image of the
+    // batch, and images added afterwards belong to the next one.
+    // CompositeBatch returns the results in the order the images
+    // were finished. All images of a batch must be the same size.
+    //
+    void FinishImage();
+
+    std::vector<Image> CompositeBatch();
 
     virtual void         Cleanup();
     
     std::string          GetLogString(); 
 
-    unsigned char * ConvertBuffer(const float *buffer, const int size)
-    {
-        unsigned char *ubytes = new unsigned char[size];
-
-#ifdef VTKH_USE_OPENMP
-        #pragma omp parallel for
-#endif
-        for(int i = 0; i < size; ++i)
-        {
-            ubytes[i] = static_cast<unsigned char>(buffer[i] * 255.f);
-        }
-
-        return ubytes;
-    }
-
 protected:
+    void AddSurfaceImage(Image &image);
+    // grows the local surface image to also cover bounds
+    void GrowSurfaceImage(const vtkm::Bounds &bounds);
+    void ExpandToScreen(Image &image);
     virtual void CompositeZBufferSurface();
     virtual void CompositeZBufferBlend();
     virtual void CompositeVisOrder();
+    virtual void CompositeZBufferSurfaceBatch();
+    virtual void CompositeZBufferBlendBatch();
+    virtual void CompositeVisOrderBatch();
 
     std::stringstream   m_log_stream;    
     CompositeMode       m_composite_mode;
+    CompositeStrategy   m_composite_strategy;
+    std::vector<int>    m_radix_k_factors;
+    bool                m_collect;
+    bool                m_depth_only;
+    int                 m_threads;
+    int                 m_blocks_per_rank;
+    bool                m_node_local;
+    bool                m_async;
     std::vector<Image>  m_images;
+    // finished images of the current batch
+    std::vector<std::vector<Image>> m_batch;
 };
 
 };
@@ -3,10 +3,11 @@
 //#include "alpine_config.h"
 //#include "ascent_logging.hpp"
 #include <vtkh/vtkh.hpp>
-#include <vtkh/rendering/compositing/DirectSendCompositor.hpp>
-#include <vtkh/rendering/compositing/RadixKCompositor.hpp>
+#include <vtkh/rendering/ImageKernels.hpp>
+#include <vtkh/rendering/compositing/DepthImage.hpp>
 #include <diy/mpi.hpp>
 
+#include <algorithm>
 #include <assert.h>
 #include <limits> 
 
@@ -17,42 +18,453 @@
 
 namespace vtkh 
 {
+
+//
+// Communicators and shared memory window used to composite the ranks
+// of a node. Each rank publishes its image in its own segment of the
+// window: the image bounds followed by its pixels and depths. The
+// segment of the node leader also holds the composited node image.
+//
+struct DIYCompositor::NodeContext
+{
+  enum { HeaderSize = 4 * sizeof(int) };
+
+  MPI_Comm                    m_node_comm;
+  int                         m_node_rank;
+  int                         m_node_size;
+  // only valid on the node leaders
+  MPI_Comm                    m_leader_comm;
+  MPI_Win                     m_window;
+  int                         m_num_pixels;
+  int                         m_num_result_pixels;
+  std::vector<unsigned char*> m_segments;
+  unsigned char              *m_result;
+
+  NodeContext(MPI_Comm comm)
+    : m_window(MPI_WIN_NULL),
+      m_num_pixels(0),
+      m_num_result_pixels(0),
+      m_result(nullptr)
+  {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &m_node_comm);
+    MPI_Comm_rank(m_node_comm, &m_node_rank);
+    MPI_Comm_size(m_node_comm, &m_node_size);
+    // ordered by rank, so rank 0 stays rank 0 among the leaders
+    MPI_Comm_split(comm, 
+                   m_node_rank == 0 ? 0 : MPI_UNDEFINED, 
+                   rank, 
+                   &m_leader_comm);
+  }
+
+  ~NodeContext()
+  {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if(finalized)
+    {
+      return;
+    }
+    if(m_window != MPI_WIN_NULL)
+    {
+      MPI_Win_free(&m_window);
+    }
+    if(m_leader_comm != MPI_COMM_NULL)
+    {
+      MPI_Comm_free(&m_leader_comm);
+    }
+    MPI_Comm_free(&m_node_comm);
+  }
+
+  static MPI_Aint SegmentSize(const int num_pixels)
+  {
+    return HeaderSize + static_cast<MPI_Aint>(num_pixels) * (4 + sizeof(float));
+  }
+
+  //
+  // Every segment holds the largest image on the node, and the node
+  // image covers the union of them. The window only grows.
+  //
+  void Allocate(const int num_pixels, const int num_result_pixels)
+  {
+    if(m_window != MPI_WIN_NULL && 
+       num_pixels <= m_num_pixels &&
+       num_result_pixels <= m_num_result_pixels)
+    {
+      return;
+    }
+    if(m_window != MPI_WIN_NULL)
+    {
+      MPI_Win_free(&m_window);
+    }
+
+    m_num_pixels = std::max(m_num_pixels, num_pixels);
+    m_num_result_pixels = std::max(m_num_result_pixels, num_result_pixels);
+    const MPI_Aint segment = SegmentSize(m_num_pixels);
+    const MPI_Aint size = m_node_rank == 0 
+                        ? segment + static_cast<MPI_Aint>(m_num_result_pixels) * (4 + sizeof(float))
+                        : segment;
+    unsigned char *base;
+    MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL, m_node_comm, &base, &m_window);
+
+    m_segments.resize(m_node_size);
+    for(int i = 0; i < m_node_size; ++i)
+    {
+      MPI_Aint seg_size;
+      int disp_unit;
+      MPI_Win_shared_query(m_window, i, &seg_size, &disp_unit, &m_segments[i]);
+    }
+    m_result = m_segments[0] + segment;
+  }
+};
+
 DIYCompositor::DIYCompositor()
-: m_rank(0)
+: m_diy_comm(vtkh::GetMPIComm()),
+  m_rank(0),
+  m_async_comm(MPI_COMM_NULL)
 {
-    m_diy_comm = diy::mpi::communicator(vtkh::GetMPIComm());
     m_rank = m_diy_comm.rank();
 }
   
 DIYCompositor::~DIYCompositor()
 {
+  int finalized;
+  MPI_Finalized(&finalized);
+  if(!finalized && m_async_comm != MPI_COMM_NULL)
+  {
+    MPI_Comm_free(&m_async_comm);
+  }
+}
+
+void
+DIYCompositor::SetAsync(bool async)
+{
+  Compositor::SetAsync(async);
+  if(async == (m_async_comm != MPI_COMM_NULL))
+  {
+    return;
+  }
+  //
+  // composites on a helper thread get a communicator of their own,
+  // so they don't mix with what the caller does with the vtkh
+  // communicator meanwhile. The duplicate is only made when needed
+  // since it is collective. The node and leader communicators were
+  // split from the old one, so they are made again on next use.
+  //
+  m_node_context.reset();
+  if(async)
+  {
+    MPI_Comm_dup(vtkh::GetMPIComm(), &m_async_comm);
+    m_diy_comm = diy::mpi::communicator(m_async_comm);
+  }
+  else
+  {
+    MPI_Comm_free(&m_async_comm);
+    m_diy_comm = diy::mpi::communicator(vtkh::GetMPIComm());
+  }
+}
+
+DIYCompositor::NodeContext&
+DIYCompositor::GetNodeContext()
+{
+  if(!m_node_context)
+  {
+    m_node_context.reset(new NodeContext(m_diy_comm));
+  }
+  return *m_node_context;
+}
+
+bool
+DIYCompositor::NodeComposite(Image &image)
+{
+  const vtkm::Bounds screen = image.m_orig_bounds;
+  NodeContext &ctx = GetNodeContext();
+  if(ctx.m_node_size == 1)
+  {
+    return true;
+  }
+
+  //
+  // agree on the largest image and the union of the images of
+  // the node, so the segments and the node image only cover the 
+  // parts of the screen something was drawn to
+  //
+  const int size = image.GetNumberOfPixels();
+  int footprint[5] = { size, 
+                       std::numeric_limits<int>::min(), 
+                       std::numeric_limits<int>::min(), 
+                       std::numeric_limits<int>::min(), 
+                       std::numeric_limits<int>::min() };
+  if(size > 0)
+  {
+    // mins are negated so a single max reduction does both
+    footprint[1] = -static_cast<int>(image.m_bounds.X.Min);
+    footprint[2] = -static_cast<int>(image.m_bounds.Y.Min);
+    footprint[3] = static_cast<int>(image.m_bounds.X.Max);
+    footprint[4] = static_cast<int>(image.m_bounds.Y.Max);
+  }
+  int node_footprint[5];
+  MPI_Allreduce(footprint, node_footprint, 5, MPI_INT, MPI_MAX, ctx.m_node_comm);
+
+  vtkm::Bounds node_bounds;
+  if(node_footprint[0] > 0)
+  {
+    node_bounds.X.Min = -node_footprint[1];
+    node_bounds.Y.Min = -node_footprint[2];
+    node_bounds.X.Max = node_footprint[3];
+    node_bounds.Y.Max = node_footprint[4];
+  }
+  else
+  {
+    // nothing on the whole node, send a single background pixel
+    node_bounds.X.Min = screen.X.Min;
+    node_bounds.Y.Min = screen.Y.Min;
+    node_bounds.X.Max = screen.X.Min;
+    node_bounds.Y.Max = screen.Y.Min;
+  }
+  const int width = node_bounds.X.Max - node_bounds.X.Min + 1;
+  const int height = node_bounds.Y.Max - node_bounds.Y.Min + 1;
+  const int num_pixels = width * height;
+  ctx.Allocate(node_footprint[0], num_pixels);
+
+  // publish our image to the node
+  unsigned char *segment = ctx.m_segments[ctx.m_node_rank];
+  int *header = reinterpret_cast<int*>(segment);
+  if(size > 0)
+  {
+    header[0] = image.m_bounds.X.Min;
+    header[1] = image.m_bounds.Y.Min;
+    header[2] = image.m_bounds.X.Max;
+    header[3] = image.m_bounds.Y.Max;
+    unsigned char *pixels = segment + NodeContext::HeaderSize;
+    std::copy(image.m_pixels.begin(), image.m_pixels.end(), pixels);
+    std::copy(image.m_depths.begin(), 
+              image.m_depths.end(), 
+              reinterpret_cast<float*>(pixels + size * 4));
+  }
+  else
+  {
+    header[0] = 1;
+    header[1] = 1;
+    header[2] = 0;
+    header[3] = 0;
+  }
+  MPI_Win_fence(0, ctx.m_window);
+
+  //
+  // every rank composites a band of rows of the node image
+  // straight from the segments of the other ranks
+  //
+  unsigned char *result_pixels = ctx.m_result;
+  float *result_depths = reinterpret_cast<float*>(ctx.m_result + num_pixels * 4);
+  const int row_begin = (height * ctx.m_node_rank) / ctx.m_node_size;
+  const int row_end = (height * (ctx.m_node_rank + 1)) / ctx.m_node_size;
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int y = row_begin; y < row_end; ++y)
+  {
+    unsigned char *pixels = result_pixels + y * width * 4;
+    float *depths = result_depths + y * width;
+    std::fill(pixels, pixels + width * 4, 0);
+    std::fill(depths, depths + width, 2.f);
+    const int screen_y = y + node_bounds.Y.Min;
+    for(int r = 0; r < ctx.m_node_size; ++r)
+    {
+      const unsigned char *other = ctx.m_segments[r];
+      const int *bounds = reinterpret_cast<const int*>(other);
+      const int dx = bounds[2] - bounds[0] + 1;
+      const int dy = bounds[3] - bounds[1] + 1;
+      if(dx <= 0 || screen_y < bounds[1] || screen_y > bounds[3])
+      {
+        continue;
+      }
+      const int row = (screen_y - bounds[1]) * dx;
+      const int x = bounds[0] - node_bounds.X.Min;
+      const unsigned char *other_pixels = other + NodeContext::HeaderSize;
+      const float *other_depths = reinterpret_cast<const float*>(other_pixels + dx * dy * 4);
+      detail::ZBufferPixels(pixels + x * 4, 
+                            depths + x, 
+                            other_pixels + row * 4, 
+                            other_depths + row, 
+                            dx);
+    }
+  }
+  MPI_Win_fence(0, ctx.m_window);
+
+  if(ctx.m_node_rank != 0)
+  {
+    return false;
+  }
+  image.m_bounds = node_bounds;
+  image.m_pixels.assign(result_pixels, result_pixels + num_pixels * 4);
+  image.m_depths.assign(result_depths, result_depths + num_pixels);
+  return true;
+}
+
+void
+DIYCompositor::ConfigureRadixK(const vtkm::Bounds &bounds, const int num_ranks)
+{
+  RadixKCompositor &compositor = m_radix_k;
+
+  const int num_pixels = (bounds.X.Length() + 1) *
+                         (bounds.Y.Length() + 1);
+  if(m_composite_strategy == AUTO)
+  {
+    compositor.SetFactors(RadixKCompositor::AutoFactors(num_ranks, num_pixels));
+  }
+  else if(m_composite_strategy == RADIX_K)
+  {
+    compositor.SetFactors(m_radix_k_factors);
+  }
+  else if(m_composite_strategy == BINARY_SWAP)
+  {
+    compositor.SetFactors(RadixKCompositor::Factor(num_ranks, 2));
+  }
+  else if(m_composite_strategy == TWO_THREE_SWAP)
+  {
+    compositor.SetFactors(RadixKCompositor::Factor(num_ranks, 3));
+  }
+  else if(m_composite_strategy == DIRECT_SEND)
+  {
+    compositor.SetFactors(std::vector<int>(1, num_ranks));
+  }
+
+  compositor.SetCollect(m_collect);
+  compositor.SetThreads(m_threads);
+  compositor.SetBlocksPerRank(m_blocks_per_rank);
 }
 
 void 
 DIYCompositor::CompositeZBufferSurface()
 {
   assert(m_images.size() == 1);
-  RadixKCompositor compositor;
+  RadixKCompositor &compositor = m_radix_k;
+  diy::mpi::communicator comm = m_diy_comm;
+  if(m_node_local && m_collect)
+  {
+    if(!NodeComposite(m_images[0]))
+    {
+      // the node leader takes it from here
+      return;
+    }
+    comm = diy::mpi::communicator(m_node_context->m_leader_comm);
+  }
 
-  compositor.CompositeSurface(m_diy_comm, this->m_images[0]);
+  const int num_ranks = comm.size();
+  ConfigureRadixK(m_images[0].m_orig_bounds, num_ranks);
+  if(m_depth_only && DepthImage::SupportsRanks(num_ranks))
+  {
+    compositor.CompositeSurfaceDepthOnly(comm, this->m_images[0]);
+  }
+  else
+  {
+    compositor.CompositeSurface(comm, this->m_images[0]);
+  }
   m_log_stream<<compositor.GetTimingString();
 
 }
 
+void 
+DIYCompositor::CompositeZBufferSurfaceBatch()
+{
+  assert(m_batch.size() != 0);
+  RadixKCompositor &compositor = m_radix_k;
+  const int batch_size = static_cast<int>(m_batch.size());
+  diy::mpi::communicator comm = m_diy_comm;
+  if(m_node_local && m_collect)
+  {
+    bool leader = true;
+    for(int i = 0; i < batch_size; ++i)
+    {
+      leader = NodeComposite(m_batch[i].at(0));
+    }
+    if(!leader)
+    {
+      return;
+    }
+    comm = diy::mpi::communicator(m_node_context->m_leader_comm);
+  }
+
+  const int num_ranks = comm.size();
+  ConfigureRadixK(m_batch[0].at(0).m_orig_bounds, num_ranks);
+  if(m_depth_only && DepthImage::SupportsRanks(num_ranks))
+  {
+    // the color fetch is per image, so each one is exchanged on its own
+    for(int i = 0; i < batch_size; ++i)
+    {
+      compositor.CompositeSurfaceDepthOnly(comm, m_batch[i].at(0));
+    }
+  }
+  else
+  {
+    std::vector<Image> images(batch_size);
+    for(int i = 0; i < batch_size; ++i)
+    {
+      assert(m_batch[i].size() == 1);
+      images[i].Swap(m_batch[i][0]);
+    }
+
+    compositor.CompositeSurface(comm, images);
+
+    for(int i = 0; i < batch_size; ++i)
+    {
+      m_batch[i][0].Swap(images[i]);
+    }
+  }
+  m_log_stream<<compositor.GetTimingString();
+}
+
+//
+// Blending fragments by depth needs every fragment of a pixel at
+// once, so each rank gathers the pieces of its part of the screen
+// from all ranks in a single direct send round.
+//
 void 
 DIYCompositor::CompositeZBufferBlend()
 {
-  assert("this is not implemented yet" == "error");  
+  assert(m_images.size() != 0);
+  DirectSendCompositor &compositor = m_direct_send;
+  compositor.SetCollect(m_collect);
+  compositor.SetThreads(m_threads);
+  compositor.SetBlocksPerRank(m_blocks_per_rank);
+  compositor.CompositeVolume(m_diy_comm, this->m_images);
+}
+
+void 
+DIYCompositor::CompositeZBufferBlendBatch()
+{
+  assert(m_batch.size() != 0);
+  DirectSendCompositor &compositor = m_direct_send;
+  compositor.SetCollect(m_collect);
+  compositor.SetThreads(m_threads);
+  compositor.SetBlocksPerRank(m_blocks_per_rank);
+  compositor.CompositeVolume(m_diy_comm, this->m_batch);
 }
 
 void 
 DIYCompositor::CompositeVisOrder()
 {
   assert(m_images.size() != 0);
-  DirectSendCompositor compositor;
+  DirectSendCompositor &compositor = m_direct_send;
+  compositor.SetCollect(m_collect);
+  compositor.SetThreads(m_threads);
+  compositor.SetBlocksPerRank(m_blocks_per_rank);
   compositor.CompositeVolume(m_diy_comm, this->m_images);
 }
 
+void 
+DIYCompositor::CompositeVisOrderBatch()
+{
+  assert(m_batch.size() != 0);
+  DirectSendCompositor &compositor = m_direct_send;
+  compositor.SetCollect(m_collect);
+  compositor.SetThreads(m_threads);
+  compositor.SetBlocksPerRank(m_blocks_per_rank);
+  compositor.CompositeVolume(m_diy_comm, this->m_batch);
+}
+
 void
 DIYCompositor::Cleanup()
 {
@@ -3,8 +3,11 @@
 
 #include <vtkh/rendering/Image.hpp>
 #include <vtkh/rendering/compositing/Compositor.hpp>
+#include <vtkh/rendering/compositing/DirectSendCompositor.hpp>
+#include <vtkh/rendering/compositing/RadixKCompositor.hpp>
 #include <diy/mpi.hpp>
 #include <iostream>
+#include <memory>
 
 namespace vtkh 
 {
@@ -16,13 +19,34 @@ public:
     ~DIYCompositor();
     
     void Cleanup() override;
+    void SetAsync(bool async) override;
     
 private:
     virtual void CompositeZBufferSurface() override;
     virtual void CompositeZBufferBlend() override;
     virtual void CompositeVisOrder() override;
+    virtual void CompositeZBufferSurfaceBatch() override;
+    virtual void CompositeZBufferBlendBatch() override;
+    virtual void CompositeVisOrderBatch() override;
+    // sets the radix-k schedule and options for images of this size
+    void ConfigureRadixK(const vtkm::Bounds &bounds, const int num_ranks);
+    //
+    // Composites the surface images of the ranks on this node in
+    // shared memory. Returns true on the node leader, which then
+    // holds the image of the whole node.
+    //
+    bool NodeComposite(Image &image);
+    struct NodeContext;
+    NodeContext& GetNodeContext();
     diy::mpi::communicator   m_diy_comm;
     int                      m_rank;
+    // kept across composites so their schedules are reused
+    RadixKCompositor         m_radix_k;
+    DirectSendCompositor     m_direct_send;
+    // split from m_diy_comm, and reset whenever it changes
+    std::unique_ptr<NodeContext> m_node_context;
+    // private duplicate of the vtkh communicator for async composites
+    MPI_Comm                 m_async_comm;
 };
 
 }; // namespace vtkh
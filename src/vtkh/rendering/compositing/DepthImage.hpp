@@ -0,0 +1,166 @@
+#ifndef VTKH_DIY_DEPTH_IMAGE_HPP
+#define VTKH_DIY_DEPTH_IMAGE_HPP
+
+#include <vtkh/rendering/Image.hpp>
+#include <algorithm>
+#include <vector>
+#include <vtkm/Bounds.h>
+
+namespace vtkh
+{
+//
+// Visibility only image used to composite opaque surfaces. Each pixel
+// is a 32 bit key holding the quantized depth in the high bits and the
+// rank that owns the pixel in the low bits, so the smallest key is the
+// closest surface and ties go to the lowest rank. Color is fetched from
+// the winning ranks once visibility is resolved.
+//
+struct DepthImage
+{
+    enum : unsigned int { EmptyKey = 0xffffffff };
+
+    vtkm::Bounds                 m_orig_bounds;
+    vtkm::Bounds                 m_bounds;
+    std::vector<unsigned int>    m_keys;
+    int                          m_rank_bits;
+
+    DepthImage()
+      : m_rank_bits(1)
+    {}
+    //
+    // Number of low bits needed to hold any rank. Keys have at least
+    // 16 bits of depth, so this supports up to 65536 ranks
+    //
+    static int RankBits(const int num_ranks)
+    {
+      int bits = 1;
+      while((1 << bits) < num_ranks)
+      {
+        bits++;
+      }
+      return bits;
+    }
+
+    static bool SupportsRanks(const int num_ranks)
+    {
+      return RankBits(num_ranks) <= 16;
+    }
+
+    static unsigned int MaxDepth(const int rank_bits)
+    {
+      // keep the all ones key free for empty pixels
+      return (1u << (32 - rank_bits)) - 2u;
+    }
+
+    static unsigned int MakeKey(const float depth,
+                                const int rank,
+                                const int rank_bits)
+    {
+      if(depth > 1.f)
+      {
+        return EmptyKey;
+      }
+      const unsigned int max_depth = MaxDepth(rank_bits);
+      const float clamped = std::max(depth, 0.f);
+      const unsigned int q = std::min(max_depth,
+                                      static_cast<unsigned int>(clamped * max_depth));
+      return (q << rank_bits) | static_cast<unsigned int>(rank);
+    }
+
+    int KeyRank(const unsigned int key) const
+    {
+      return static_cast<int>(key & ((1u << m_rank_bits) - 1u));
+    }
+
+    float KeyDepth(const unsigned int key) const
+    {
+      if(key == EmptyKey)
+      {
+        return 2.f;
+      }
+      return static_cast<float>(key >> m_rank_bits) / MaxDepth(m_rank_bits);
+    }
+
+    int GetNumberOfPixels() const
+    {
+      const int dx  = m_bounds.X.Max - m_bounds.X.Min + 1;
+      const int dy  = m_bounds.Y.Max - m_bounds.Y.Min + 1;
+      return dx * dy;
+    }
+
+    void Init(const Image &image, const int rank, const int rank_bits)
+    {
+      m_orig_bounds = image.m_orig_bounds;
+      m_bounds = image.m_bounds;
+      m_rank_bits = rank_bits;
+      const int size = static_cast<int>(image.m_depths.size());
+      m_keys.resize(size);
+#ifdef VTKH_USE_OPENMP
+      #pragma omp parallel for
+#endif
+      for(int i = 0; i < size; ++i)
+      {
+        m_keys[i] = MakeKey(image.m_depths[i], rank, rank_bits);
+      }
+    }
+    //
+    // Fill this image with a sub-region of another image. Parts of
+    // the sub-region outside of the other image are empty
+    //
+    void SubsetFrom(const DepthImage &image,
+                    const vtkm::Bounds &sub_region)
+    {
+      m_orig_bounds = image.m_orig_bounds;
+      m_bounds = sub_region;
+      m_rank_bits = image.m_rank_bits;
+
+      const int s_dx  = m_bounds.X.Max - m_bounds.X.Min + 1;
+      const int s_dy  = m_bounds.Y.Max - m_bounds.Y.Min + 1;
+      m_keys.assign(s_dx * s_dy, EmptyKey);
+
+      const vtkm::Bounds overlap = Image::Intersect(image.m_bounds, sub_region);
+      if(overlap.X.Min > overlap.X.Max || overlap.Y.Min > overlap.Y.Max)
+      {
+        return;
+      }
+
+      const int dx  = image.m_bounds.X.Max - image.m_bounds.X.Min + 1;
+      const int o_dx  = overlap.X.Max - overlap.X.Min + 1;
+      const int o_dy  = overlap.Y.Max - overlap.Y.Min + 1;
+#ifdef VTKH_USE_OPENMP
+      #pragma omp parallel for
+#endif
+      for(int y = 0; y < o_dy; ++y)
+      {
+        const int copy_from = (y + overlap.Y.Min - image.m_bounds.Y.Min) * dx +
+                              overlap.X.Min - image.m_bounds.X.Min;
+        const int copy_to = (y + overlap.Y.Min - m_bounds.Y.Min) * s_dx +
+                            overlap.X.Min - m_bounds.X.Min;
+        std::copy(image.m_keys.begin() + copy_from,
+                  image.m_keys.begin() + copy_from + o_dx,
+                  m_keys.begin() + copy_to);
+      }
+    }
+    //
+    // Keep the closest surface of this image and another one
+    // with the same bounds
+    //
+    void Composite(const DepthImage &image)
+    {
+      assert(m_bounds.X.Min == image.m_bounds.X.Min);
+      assert(m_bounds.Y.Min == image.m_bounds.Y.Min);
+      assert(m_bounds.X.Max == image.m_bounds.X.Max);
+      assert(m_bounds.Y.Max == image.m_bounds.Y.Max);
+      const int size = static_cast<int>(m_keys.size());
+#ifdef VTKH_USE_OPENMP
+      #pragma omp parallel for
+#endif
+      for(int i = 0; i < size; ++i)
+      {
+        m_keys[i] = std::min(m_keys[i], image.m_keys[i]);
+      }
+    }
+};
+
+} //namespace  vtkh
+#endif
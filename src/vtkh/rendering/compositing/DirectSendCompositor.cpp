@@ -10,6 +10,10 @@
 #include <diy/reduce.hpp>
 #include <diy/reduce-operations.hpp>
 
+#include <algorithm>
+#include <assert.h>
+#include <memory>
+
 namespace vtkh 
 {
 
@@ -23,18 +27,27 @@ struct Redistribute
 
   void operator()(void *v_block, const diy::ReduceProxy &proxy) const
   {
-    MultiImageBlock *block = static_cast<MultiImageBlock*>(v_block);
+    MultiImageBatchBlock *block = static_cast<MultiImageBatchBlock*>(v_block);
     //
-    // first round we have no incoming. Take the image we have,
-    // chop it up into pieces, and send it to the domain resposible
-    // for that portion 
+    // first round we have no incoming. Take the images we have,
+    // chop them up into pieces, and send them to the domain resposible
+    // for that portion. Each message holds the pieces of every image
+    // in the batch.
     //
     const int world_size = m_decomposer.nblocks;
-    const int local_images = block->m_images.size(); 
+    const int batch_size = block->m_images.size(); 
     if(proxy.in_link().size() == 0)
     {
-      std::map<diy::BlockID, std::vector<Image>> outgoing;
+      typedef std::vector<std::vector<CompressedImage>> BatchPieces;
+      std::map<diy::BlockID, BatchPieces> outgoing;
       
+      //
+      // when there are several blocks per rank, each one 
+      // sends its share of the local images
+      //
+      const int offset = block->m_send_offset;
+      const int stride = block->m_send_stride;
+
       for(int i = 0; i < world_size; ++i)
       {
         diy::DiscreteBounds sub_image_bounds;
@@ -42,72 +55,153 @@ struct Redistribute
         vtkm::Bounds vtkm_sub_bounds = DIYBoundsToVTKM(sub_image_bounds);
 
         diy::BlockID dest = proxy.out_link().target(i); 
-        outgoing[dest].resize(local_images); 
+        outgoing[dest].resize(batch_size); 
 
-        for(int img = 0;  img < local_images; ++img) 
+        for(int b = 0; b < batch_size; ++b)
         {
-          outgoing[dest][img].SubsetFrom(block->m_images[img], vtkm_sub_bounds); 
+          const std::vector<Image> &local = block->m_images[b];
+          const int local_images = local.size(); 
+          std::vector<CompressedImage> &pieces = outgoing[dest][b];
+          for(int img = offset;  img < local_images; img += stride) 
+          {
+            pieces.emplace_back();
+            pieces.back().Compress(local[img], vtkm_sub_bounds); 
+          }
         }
       } //for
 
-      typename std::map<diy::BlockID,std::vector<Image>>::iterator it;
+      typename std::map<diy::BlockID,BatchPieces>::iterator it;
       for(it = outgoing.begin(); it != outgoing.end(); ++it)
       {
         proxy.enqueue(it->first, it->second);
       }
+      return;
     } // if
-    else if(block->m_images.at(0).m_composite_order != -1)
+
+    std::vector<std::vector<CompressedImage>> images(batch_size);
+    for(int i = 0; i < proxy.in_link().size(); ++i)
     {
-      // blend images according to vis order
-      std::vector<Image> images;
-      for(int i = 0; i < proxy.in_link().size(); ++i)
+      std::vector<std::vector<CompressedImage>> incoming;
+      int gid = proxy.in_link().target(i).gid;
+      proxy.dequeue(gid, incoming); 
+      assert(static_cast<int>(incoming.size()) == batch_size);
+      for(int b = 0; b < batch_size; ++b)
       {
-
-        std::vector<Image> incoming;
-        int gid = proxy.in_link().target(i).gid;
-        proxy.dequeue(gid, incoming); 
-        const int in_size = incoming.size();
+        const int in_size = incoming[b].size();
         for(int img = 0; img < in_size; ++img)
         {
-          images.emplace_back(incoming[img]);
-          //std::cout<<"rank "<<rank<<" rec "<<incoming[img].ToString()<<"\n";
+          images[b].push_back(std::move(incoming[b][img]));
         }
-      } // for
-      
-      ImageCompositor compositor;
-      compositor.OrderedComposite(images);
+      }
+    } // for
 
-      block->m_output.Swap(images[0]);
-    } // else if
-    else if(block->m_images.at(0).m_composite_order == -1 &&
-            block->m_images.at(0).HasTransparency())
+    for(int b = 0; b < batch_size; ++b)
     {
-      std::vector<Image> images;
-      for(int i = 0; i < proxy.in_link().size(); ++i)
+      Image &first = block->m_images[b].at(0);
+      if(first.m_composite_order != -1)
       {
-
-        std::vector<Image> incoming;
-        int gid = proxy.in_link().target(i).gid;
-        proxy.dequeue(gid, incoming); 
-        const int in_size = incoming.size();
-        for(int img = 0; img < in_size; ++img)
+        // blend images according to vis order
+        ImageCompositor compositor;
+        compositor.OrderedComposite(images[b], block->m_outputs[b]);
+      } 
+      else
+      {
+        //
+        // we have images with a depth buffer and transparency,
+        // so blend all fragments of each pixel by depth
+        //
+        assert(images[b].size() != 0);
+        std::vector<Image> decompressed(images[b].size());
+        for(size_t img = 0; img < images[b].size(); ++img)
         {
-          images.emplace_back(incoming[img]);
-          //std::cout<<"rank "<<rank<<" rec "<<incoming[img].ToString()<<"\n";
+          images[b][img].Decompress(decompressed[img]);
         }
-      } // for
-      
-      //
-      // we have images with a depth buffer and transparency
-      //
-      ImageCompositor compositor;
-      compositor.ZBufferBlend(images);
+        ImageCompositor compositor;
+        compositor.ZBufferBlend(decompressed);
+        block->m_outputs[b].Swap(decompressed[0]);
+      }
     }
 
   } // operator
 };
 
+//
+// The decomposition of the screen and the blocks that exchange it.
+// It is built on the first composite and reused as long as the 
+// number of ranks, the image size and the blocking do not change.
+//
+struct DirectSendCompositor::Context
+{
+  typedef diy::RegularDecomposer<diy::DiscreteBounds> Decomposer;
+  // what the context was built for
+  MPI_Comm                                 m_comm;
+  int                                      m_num_ranks;
+  vtkm::Bounds                             m_bounds;
+  int                                      m_blocks_per_rank;
+  int                                      m_threads;
+
+  std::unique_ptr<Decomposer>              m_decomposer;
+  std::unique_ptr<diy::Master>             m_master;
+  std::unique_ptr<diy::ContiguousAssigner> m_assigner;
+
+  // buffers owned by the blocks: the local images of each entry
+  // in the batch and the outputs of each block
+  std::vector<std::vector<Image>>          m_images;
+  std::vector<std::vector<Image>>          m_outputs;
+  std::vector<Image>                       m_results;
+
+  bool Matches(diy::mpi::communicator &diy_comm,
+               const vtkm::Bounds &bounds,
+               const int blocks_per_rank,
+               const int threads) const
+  {
+    return m_comm == static_cast<MPI_Comm>(diy_comm) &&
+           m_num_ranks == diy_comm.size() &&
+           m_bounds == bounds &&
+           m_blocks_per_rank == blocks_per_rank &&
+           m_threads == threads;
+  }
+};
+
+DirectSendCompositor::Context&
+DirectSendCompositor::GetContext(diy::mpi::communicator &diy_comm,
+                                 const vtkm::Bounds &bounds,
+                                 const int blocks_per_rank)
+{
+  if(m_context && m_context->Matches(diy_comm, bounds, blocks_per_rank, m_threads))
+  {
+    return *m_context;
+  }
+
+  m_context.reset(new Context());
+  Context &ctx = *m_context;
+  ctx.m_comm = diy_comm;
+  ctx.m_num_ranks = diy_comm.size();
+  ctx.m_bounds = bounds;
+  ctx.m_blocks_per_rank = blocks_per_rank;
+  ctx.m_threads = m_threads;
+  ctx.m_outputs.resize(blocks_per_rank);
+
+  const int num_blocks = ctx.m_num_ranks * blocks_per_rank; 
+  const int dims = 2;
+  diy::DiscreteBounds global_bounds = VTKMBoundsToDIY(bounds);
+  ctx.m_decomposer.reset(new Context::Decomposer(dims, global_bounds, num_blocks));
+  ctx.m_master.reset(new diy::Master(diy_comm, 
+                                     m_threads, 
+                                     -1, 
+                                     0, 
+                                     &MultiImageBatchBlock::Destroy));
+  ctx.m_assigner.reset(new diy::ContiguousAssigner(ctx.m_num_ranks, num_blocks)); 
+
+  AddMultiImageBatchBlocks create(*ctx.m_master, ctx.m_images, ctx.m_outputs);
+  ctx.m_decomposer->decompose(diy_comm.rank(), *ctx.m_assigner, create);
+  return ctx;
+}
+
 DirectSendCompositor::DirectSendCompositor()
+  : m_collect(true),
+    m_threads(1),
+    m_blocks_per_rank(1)
 {
 
 }
@@ -121,51 +215,89 @@ void
 DirectSendCompositor::CompositeVolume(diy::mpi::communicator &diy_comm, 
                                       std::vector<Image>     &images)
 {
-  diy::DiscreteBounds global_bounds = VTKMBoundsToDIY(images.at(0).m_orig_bounds);
-  
-  const int num_threads = 1; 
-  const int num_blocks = diy_comm.size(); 
-  const int magic_k = 8;
-  Image sub_image;
+  std::vector<std::vector<Image>> batch(1);
+  batch[0].swap(images);
+  CompositeVolume(diy_comm, batch);
+  images.swap(batch[0]);
+}
+
+void
+DirectSendCompositor::CompositeVolume(diy::mpi::communicator &diy_comm, 
+                                      std::vector<std::vector<Image>> &images)
+{
+  assert(images.size() > 0);
+  const int batch_size = static_cast<int>(images.size());
   //
-  // DIY does not seem to like being called with different block types
-  // so we isolate them within separate blocks
+  // each rank's tiles are not contiguous when there are 
+  // several, so they only make sense when they are gathered
   //
+  const int blocks_per_rank = m_collect ? std::max(1, m_blocks_per_rank) : 1;
+  const int magic_k = 8;
+
+  Context &ctx = GetContext(diy_comm, images[0].at(0).m_orig_bounds, blocks_per_rank);
+  for(int i = 0; i < blocks_per_rank; ++i)
   {
-    diy::Master master(diy_comm, num_threads);
-    // create an assigner with one block per rank
-    diy::ContiguousAssigner assigner(num_blocks, num_blocks); 
-
-    AddMultiImageBlock create(master, images, sub_image);
-
-    const int dims = 2;
-    diy::RegularDecomposer<diy::DiscreteBounds> decomposer(dims, global_bounds, num_blocks);
-    decomposer.decompose(diy_comm.rank(), assigner, create);
-    
-    diy::all_to_all(master, 
-                    assigner, 
-                    Redistribute(decomposer), 
-                    magic_k);
-  }  
+    ctx.m_outputs[i].resize(batch_size);
+  }
 
+  // the blocks refer to the context's images 
+  ctx.m_images.swap(images);
+  diy::all_to_all(*ctx.m_master, 
+                  *ctx.m_assigner, 
+                  Redistribute(*ctx.m_decomposer), 
+                  magic_k);
+  ctx.m_images.swap(images);
+
+  if(m_collect)
+  {
+    // lay the tiles out image by image
+    std::vector<Image> tiles(batch_size * blocks_per_rank);
+    for(int b = 0; b < batch_size; ++b)
+    {
+      for(int i = 0; i < blocks_per_rank; ++i)
+      {
+        tiles[b * blocks_per_rank + i].Swap(ctx.m_outputs[i][b]);
+      }
+    }
+    ctx.m_results.resize(batch_size);
+    MPICollect(&tiles[0], blocks_per_rank, &ctx.m_results[0], batch_size, diy_comm); 
+    for(int b = 0; b < batch_size; ++b)
+    {
+      for(int i = 0; i < blocks_per_rank; ++i)
+      {
+        ctx.m_outputs[i][b].Swap(tiles[b * blocks_per_rank + i]);
+      }
+      if(diy_comm.rank() == 0)
+      {
+        images[b].at(0).Swap(ctx.m_results[b]);
+      }
+    }
+  }
+  else
   {
-    diy::Master master(diy_comm, num_threads);
-    diy::ContiguousAssigner assigner(num_blocks, num_blocks); 
-
-    const int dims = 2;
-    diy::RegularDecomposer<diy::DiscreteBounds> decomposer(dims, global_bounds, num_blocks);
-    AddImageBlock all_create(master, sub_image);
-    decomposer.decompose(diy_comm.rank(), assigner, all_create);
-    MPI_Barrier(diy_comm); 
-
-    MPICollect(sub_image,diy_comm); 
-    //diy::all_to_all(master,
-    //                assigner,
-    //                CollectImages(decomposer),
-    //                magic_k);
-  } 
-
-  images.at(0).Swap(sub_image);
+    for(int b = 0; b < batch_size; ++b)
+    {
+      images[b].at(0).Swap(ctx.m_outputs[0][b]);
+    }
+  }
+}
+
+void
+DirectSendCompositor::SetThreads(const int num_threads)
+{
+  m_threads = num_threads;
+}
+
+void
+DirectSendCompositor::SetBlocksPerRank(const int blocks_per_rank)
+{
+  m_blocks_per_rank = blocks_per_rank;
+}
+
+void
+DirectSendCompositor::SetCollect(bool collect)
+{
+  m_collect = collect;
 }
 
 std::string 
@@ -3,6 +3,7 @@
 
 #include <vtkh/rendering/Image.hpp>
 #include <diy/mpi.hpp>
+#include <memory>
 #include <sstream>
 
 namespace vtkh 
@@ -13,11 +14,45 @@ class DirectSendCompositor
 public:
   DirectSendCompositor();
   ~DirectSendCompositor();
+  //
+  // Images with a composite order are blended in that order. 
+  // Otherwise the fragments of each pixel are blended by depth.
+  //
   void CompositeVolume(diy::mpi::communicator &diy_comm, 
                        std::vector<Image>     &images); 
+  //
+  // Composites a batch of image lists of the same size in a single
+  // exchange. On return, the first image of each list holds its
+  // result. Every rank must pass the same number of lists.
+  //
+  void CompositeVolume(diy::mpi::communicator &diy_comm, 
+                       std::vector<std::vector<Image>> &images); 
+  //
+  // If false, each rank keeps its tile of the final image
+  // instead of sending it to rank 0
+  //
+  void SetCollect(bool collect);
+  //
+  // Number of threads diy uses to work on the local blocks
+  //
+  void SetThreads(const int num_threads);
+  //
+  // Splits the screen into this many more pieces than ranks. 
+  // Only used when collecting.
+  //
+  void SetBlocksPerRank(const int blocks_per_rank);
   std::string GetTimingString();
 private:
+  struct Context;
+  Context& GetContext(diy::mpi::communicator &diy_comm,
+                      const vtkm::Bounds &bounds,
+                      const int blocks_per_rank);
   std::stringstream m_timing_log;
+  bool              m_collect;
+  int               m_threads;
+  int               m_blocks_per_rank;
+  // decomposition kept across calls
+  std::unique_ptr<Context> m_context;
 };
 
 } // namespace vtkh
@@ -4,90 +4,257 @@
 #include <vtkh/rendering/Image.hpp>
 #include <diy/mpi.hpp>
 #include <sstream>
+#include <vector>
 
 namespace vtkh
 {
 
-static void MPICollect(Image &image, MPI_Comm comm)
+//
+// diy probes for messages with any tag, so a rank still finishing its
+// exchange would pick up tiles that are already on the way. Tiles are
+// sent on a duplicate of the communicator that is cached on it and
+// released with it.
+//
+static int vtkh_collect_comm_keyval = MPI_KEYVAL_INVALID;
+
+static int DeleteCollectComm(MPI_Comm, int, void *attr, void *)
+{
+  MPI_Comm *collect_comm = static_cast<MPI_Comm*>(attr);
+  MPI_Comm_free(collect_comm);
+  delete collect_comm;
+  return MPI_SUCCESS;
+}
+
+static MPI_Comm GetCollectComm(MPI_Comm comm)
+{
+  if(vtkh_collect_comm_keyval == MPI_KEYVAL_INVALID)
+  {
+    MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN,
+                           DeleteCollectComm,
+                           &vtkh_collect_comm_keyval,
+                           nullptr);
+  }
+
+  void *attr = nullptr;
+  int found = 0;
+  MPI_Comm_get_attr(comm, vtkh_collect_comm_keyval, &attr, &found);
+  if(found)
+  {
+    return *static_cast<MPI_Comm*>(attr);
+  }
+
+  MPI_Comm *collect_comm = new MPI_Comm;
+  MPI_Comm_dup(comm, collect_comm);
+  MPI_Comm_set_attr(comm, vtkh_collect_comm_keyval, collect_comm);
+  return *collect_comm;
+}
+
+//
+// Gathers the tiles of all ranks into the final images on rank 0.
+// Each rank can hold several tiles of a batch of images, and all
+// images of the batch are split into the same tiles: tile t of
+// image i is tiles[i * num_tiles + t]. Rank 0 posts a receive for 
+// every tile directly into the rows of the final images using a 
+// strided datatype, so tiles arrive in any order and no copies are 
+// needed after the fact. On rank 0, results hold the final images.
+//
+static void MPICollect(Image *tiles, 
+                       const int num_tiles,
+                       Image *results,
+                       const int num_images,
+                       MPI_Comm diy_comm)
 {
-   
+  MPI_Comm comm = GetCollectComm(diy_comm);
+
   int rank, size;
   MPI_Comm_rank(comm, &rank);
   MPI_Comm_size(comm, &size);
 
-  int bounds[4];
-  bounds[0] = image.m_bounds.X.Min;
-  bounds[1] = image.m_bounds.Y.Min;
-  bounds[2] = image.m_bounds.X.Max;
-  bounds[3] = image.m_bounds.Y.Max;
-
-  int xmin = image.m_bounds.X.Min;
-  int ymin = image.m_bounds.Y.Min;
-  int xmax = image.m_bounds.X.Max;
-  int ymax = image.m_bounds.Y.Max;
-  int pixels = (xmax - xmin + 1) *(ymax - ymin + 1);
-  
-  int *pixel_sizes = nullptr;
-  int *pixel_bounds = nullptr;
-  if(rank == 0)
+  std::vector<int> bounds(num_tiles * 4);
+  for(int t = 0; t < num_tiles; ++t)
   {
-    pixel_sizes = new int[size];
-    pixel_bounds = new int[size*4];
+    bounds[t*4 + 0] = tiles[t].m_bounds.X.Min;
+    bounds[t*4 + 1] = tiles[t].m_bounds.Y.Min;
+    bounds[t*4 + 2] = tiles[t].m_bounds.X.Max;
+    bounds[t*4 + 3] = tiles[t].m_bounds.Y.Max;
   }
-  
-  MPI_Gather(&bounds, 4, MPI_INT, pixel_bounds, 4, MPI_INT, 0, comm);
-
-  MPI_Barrier(comm);
-  // create the final image
-  vtkm::Bounds final_bounds; 
-  final_bounds.X.Min = 1;
-  final_bounds.Y.Min = 1;
-  final_bounds.X.Max = 1;
-  final_bounds.Y.Max = 1;
-  
+
+  std::vector<int> tile_counts;
+  std::vector<int> bounds_counts;
+  std::vector<int> bounds_offsets;
+  std::vector<int> pixel_bounds;
   if(rank == 0)
   {
-    final_bounds = image.m_orig_bounds;
+    tile_counts.resize(size);
   }
 
-  Image final_image(final_bounds); 
+  MPI_Gather(&num_tiles, 1, MPI_INT, 
+             rank == 0 ? &tile_counts[0] : nullptr, 1, MPI_INT, 0, comm);
+
   if(rank == 0)
   {
-    image.SubsetTo(final_image);
+    bounds_counts.resize(size);
+    bounds_offsets.resize(size);
+    int total = 0;
+    for(int i = 0; i < size; ++i)
+    {
+      bounds_counts[i] = tile_counts[i] * 4;
+      bounds_offsets[i] = total;
+      total += bounds_counts[i];
+    }
+    pixel_bounds.resize(total);
   }
-  
+
+  MPI_Gatherv(bounds.size() > 0 ? &bounds[0] : nullptr, 
+              num_tiles * 4,
+              MPI_INT, 
+              rank == 0 ? &pixel_bounds[0] : nullptr, 
+              rank == 0 ? &bounds_counts[0] : nullptr, 
+              rank == 0 ? &bounds_offsets[0] : nullptr, 
+              MPI_INT, 
+              0, 
+              comm);
+
   if(rank != 0)
   {
-    MPI_Send(&image.m_pixels[0], pixels * 4, MPI_UNSIGNED_CHAR, 0, 0, comm);
-    MPI_Send(&image.m_depths[0], pixels, MPI_FLOAT, 0, 0, comm);
+    std::vector<MPI_Request> requests;
+    requests.reserve(num_images * num_tiles * 2);
+    for(int img = 0; img < num_images; ++img)
+    {
+      for(int t = 0; t < num_tiles; ++t)
+      {
+        Image &tile = tiles[img * num_tiles + t];
+        const int pixels = tile.GetNumberOfPixels();
+        if(pixels <= 0)
+        {
+          continue;
+        }
+        const int tag = (img * num_tiles + t) * 2;
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Isend(&tile.m_pixels[0], pixels * 4, MPI_UNSIGNED_CHAR, 
+                  0, tag, comm, &requests.back());
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Isend(&tile.m_depths[0], pixels, MPI_FLOAT, 
+                  0, tag + 1, comm, &requests.back());
+      }
+    }
+    if(requests.size() > 0)
+    {
+      MPI_Waitall(static_cast<int>(requests.size()), &requests[0], MPI_STATUSES_IGNORE);
+    }
+    return;
+  }
+
+  // create the final images
+  const vtkm::Bounds orig_bounds = tiles[0].m_orig_bounds;
+  const int width = orig_bounds.X.Max - orig_bounds.X.Min + 1;
+  const int height = orig_bounds.Y.Max - orig_bounds.Y.Min + 1;
+  for(int img = 0; img < num_images; ++img)
+  {
+    results[img].m_orig_bounds = orig_bounds;
+    results[img].m_bounds = orig_bounds;
+    results[img].m_pixels.assign(width * height * 4, 0);
+    results[img].m_depths.assign(width * height, 2.f);
+  }
+
+  std::vector<MPI_Request> requests;
+  std::vector<MPI_Datatype> types;
+
+  for(int i = 1; i < size; ++i)
+  {
+    for(int t = 0; t < tile_counts[i]; ++t)
+    {
+      const int *tile_bounds = &pixel_bounds[bounds_offsets[i] + t * 4];
+      const int tile_x = tile_bounds[0] - orig_bounds.X.Min;
+      const int tile_y = tile_bounds[1] - orig_bounds.Y.Min;
+      const int tile_width = tile_bounds[2] - tile_bounds[0] + 1;
+      const int tile_height = tile_bounds[3] - tile_bounds[1] + 1;
+      if(tile_width <= 0 || tile_height <= 0)
+      {
+        continue;
+      }
+
+      // the tile as a sub-array of the row major final image
+      MPI_Datatype color_type, depth_type;
+      int color_sizes[2] = {height, width * 4};
+      int color_sub_sizes[2] = {tile_height, tile_width * 4};
+      int color_starts[2] = {tile_y, tile_x * 4};
+      MPI_Type_create_subarray(2,
+                               color_sizes,
+                               color_sub_sizes,
+                               color_starts,
+                               MPI_ORDER_C,
+                               MPI_UNSIGNED_CHAR,
+                               &color_type);
+      MPI_Type_commit(&color_type);
+
+      int depth_sizes[2] = {height, width};
+      int depth_sub_sizes[2] = {tile_height, tile_width};
+      int depth_starts[2] = {tile_y, tile_x};
+      MPI_Type_create_subarray(2,
+                               depth_sizes,
+                               depth_sub_sizes,
+                               depth_starts,
+                               MPI_ORDER_C,
+                               MPI_FLOAT,
+                               &depth_type);
+      MPI_Type_commit(&depth_type);
+
+      types.push_back(color_type);
+      types.push_back(depth_type);
+
+      // the same tile of every image in the batch
+      for(int img = 0; img < num_images; ++img)
+      {
+        const int tag = (img * tile_counts[i] + t) * 2;
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Irecv(&results[img].m_pixels[0], 1, color_type, 
+                  i, tag, comm, &requests.back());
+        requests.push_back(MPI_REQUEST_NULL);
+        MPI_Irecv(&results[img].m_depths[0], 1, depth_type, 
+                  i, tag + 1, comm, &requests.back());
+      }
+    }
   }
-  else
+
+  // copy our own tiles while the rest are in flight
+  for(int img = 0; img < num_images; ++img)
   {
-    for(int i = 1; i < size; ++i)
+    for(int t = 0; t < num_tiles; ++t)
     {
-      vtkm::Bounds inbound; 
-      inbound.X.Min = pixel_bounds[i*4 + 0];
-      inbound.Y.Min = pixel_bounds[i*4 + 1];
-      inbound.X.Max = pixel_bounds[i*4 + 2];
-      inbound.Y.Max = pixel_bounds[i*4 + 3];
-      Image incoming(inbound);
-
-      int rec_size = (inbound.X.Max - inbound.X.Min + 1) *
-                     (inbound.Y.Max - inbound.Y.Min + 1);
-
-      MPI_Status status;
-      MPI_Recv(&(incoming.m_pixels[0]), rec_size * 4, MPI_UNSIGNED_CHAR, i, 0, comm, &status);
-      MPI_Recv(&(incoming.m_depths[0]), rec_size, MPI_FLOAT, i, 0, comm, &status);
-      incoming.SubsetTo(final_image);
+      Image &tile = tiles[img * num_tiles + t];
+      if(tile.GetNumberOfPixels() > 0)
+      {
+        tile.SubsetTo(results[img]);
+      }
     }
   }
+
+  if(requests.size() > 0)
+  {
+    MPI_Waitall(static_cast<int>(requests.size()), &requests[0], MPI_STATUSES_IGNORE);
+  }
+
+  for(size_t i = 0; i < types.size(); ++i)
+  {
+    MPI_Type_free(&types[i]);
+  }
+}
+
+//
+// Gathers one tile per rank. On rank 0, the tile is replaced
+// by the final image
+//
+static void MPICollect(Image &image, MPI_Comm diy_comm)
+{
+  Image final_image;
+  MPICollect(&image, 1, &final_image, 1, diy_comm);
+  int rank;
+  MPI_Comm_rank(diy_comm, &rank);
   if(rank == 0)
   {
-    delete[] pixel_sizes;
-    delete[] pixel_bounds;
     image.Swap(final_image);
   }
-  //MPI_Barrier(comm);
 }
 
 }// namespace vtkh
@@ -10,44 +10,24 @@
 #include <diy/reduce.hpp>
 #include <diy/reduce-operations.hpp>
 
+#include <vtkh/Error.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+
 namespace vtkh
 {
 
-void reduce_images(void *b, 
-                   const diy::ReduceProxy &proxy,
-                   const diy::RegularSwapPartners &partners) 
+//
+// create balanced set of ranges for current dim
+//
+static std::vector<diy::DiscreteBounds> split_region(const vtkm::Bounds &region,
+                                                     const int group_size,
+                                                     const int current_dim)
 {
-  ImageBlock *block = reinterpret_cast<ImageBlock*>(b);
-  unsigned int round = proxy.round();
-  Image &image = block->m_image; 
-  // count the number of incoming pixels
-  if(proxy.in_link().size() > 0)
-  {
-      for(int i = 0; i < proxy.in_link().size(); ++i)
-      {
-        int gid = proxy.in_link().target(i).gid;
-        if(gid == proxy.gid())
-        {
-          //skip revieving from self since we sent nothing
-          continue;
-        }
-        Image incoming; 
-        proxy.dequeue(gid, incoming);
-        vtkh::ImageCompositor compositor;
-        compositor.ZBufferComposite(image, incoming);
-      } // for in links
-  } 
-
-  if(proxy.out_link().size() == 0)
-  {
-    return;
-  }
-  // do compositing?? intermediate stage?
-  const int group_size = proxy.out_link().size(); 
-  const int current_dim = partners.dim(round);
-  
-  //create balanced set of ranges for current dim
-  diy::DiscreteBounds image_bounds = VTKMBoundsToDIY(image.m_bounds);
+  diy::DiscreteBounds image_bounds = VTKMBoundsToDIY(region);
   int range_length = image_bounds.max[current_dim] - image_bounds.min[current_dim];
   int base_step = range_length / group_size;
   int rem = range_length % group_size;
@@ -64,7 +44,7 @@ void reduce_images(void *b,
   }
   assert(count == range_length);
 
-  std::vector<diy::DiscreteBounds> subset_bounds(group_size, VTKMBoundsToDIY(image.m_bounds));  
+  std::vector<diy::DiscreteBounds> subset_bounds(group_size, image_bounds);  
   int min_pixel = image_bounds.min[current_dim];
   for(int i = 0; i < group_size; ++i)
   {
@@ -84,28 +64,438 @@ void reduce_images(void *b,
     assert(subset_bounds[0].min[current_dim] == image_bounds.min[current_dim]);
     assert(subset_bounds[group_size-1].max[current_dim] == image_bounds.max[current_dim]);
   }
+  return subset_bounds;
+}
+
+//
+// each round splits the image along the dimension where 
+// the pieces are currently the longest
+//
+static void build_schedule(const std::vector<int> &factors,
+                           const vtkm::Bounds &bounds,
+                           diy::RegularPartners::DivisionVector &divisions,
+                           diy::RegularPartners::KVSVector &kvs)
+{
+  const int num_dims = 2;
+  divisions.assign(num_dims, 1);
+  kvs.clear();
+  const double extents[2] = { bounds.X.Length() + 1.,
+                              bounds.Y.Length() + 1. };
+  for(size_t i = 0; i < factors.size(); ++i)
+  {
+    if(factors[i] == 1)
+    {
+      continue;
+    }
+    const int dim = extents[0] / divisions[0] >= extents[1] / divisions[1] ? 0 : 1; 
+    divisions[dim] *= factors[i];
+    kvs.push_back(diy::RegularPartners::DimK(dim, factors[i]));
+  }
+}
+
+void reduce_images(void *b, 
+                   const diy::ReduceProxy &proxy,
+                   const diy::RegularSwapPartners &partners) 
+{
+  ImageBatchBlock *block = reinterpret_cast<ImageBatchBlock*>(b);
+  unsigned int round = proxy.round();
+  std::vector<Image> &images = block->m_images; 
+  const int batch_size = static_cast<int>(images.size());
+  // count the number of incoming pixels
+  if(proxy.in_link().size() > 0)
+  {
+      for(int i = 0; i < proxy.in_link().size(); ++i)
+      {
+        int gid = proxy.in_link().target(i).gid;
+        if(gid == proxy.gid())
+        {
+          //skip revieving from self since we sent nothing
+          continue;
+        }
+        std::vector<CompressedImage> &incoming = block->m_buffers; 
+        proxy.dequeue(gid, incoming);
+        assert(static_cast<int>(incoming.size()) == batch_size);
+        vtkh::ImageCompositor compositor;
+        for(int img = 0; img < batch_size; ++img)
+        {
+          compositor.ZBufferComposite(images[img], incoming[img]);
+        }
+      } // for in links
+  } 
+
+  if(proxy.out_link().size() == 0 || batch_size == 0)
+  {
+    return;
+  }
+  // do compositing?? intermediate stage?
+  const int group_size = proxy.out_link().size(); 
+  const int current_dim = partners.dim(round);
   
-  std::vector<Image> out_images(group_size);
+  //
+  // in the first round the images only cover the screen space
+  // footprint of the local data, but we are responsible for
+  // the whole region of the block. Afterwards, all images of
+  // the batch cover the same region.
+  //
+  const vtkm::Bounds region = round == 0 ? block->m_region : images[0].m_bounds;
+
+  std::vector<diy::DiscreteBounds> subset_bounds = split_region(region,
+                                                                group_size,
+                                                                current_dim);
+  
+  //
+  // only the active pixels of the pieces we give away go
+  // over the wire, and each message holds the piece of
+  // every image in the batch
+  //
+  int self = -1;
   for(int i = 0; i < group_size; ++i)
   {
-    out_images[i].SubsetFrom(image, DIYBoundsToVTKM(subset_bounds[i]));  
-  } //for
+      if(proxy.out_link().target(i).gid == proxy.gid())
+      {
+        self = i;
+      }
+      else
+      {
+        // the message is serialized on enqueue, so the buffers are reused
+        std::vector<CompressedImage> &out_images = block->m_buffers;
+        out_images.resize(batch_size);
+        const vtkm::Bounds sub_bounds = DIYBoundsToVTKM(subset_bounds[i]);
+        for(int img = 0; img < batch_size; ++img)
+        {
+          out_images[img].Compress(images[img], sub_bounds);
+        }
+        proxy.enqueue(proxy.out_link().target(i), out_images);
+      }
+  } //for 
+
+  if(self != -1)
+  {
+    const vtkm::Bounds sub_bounds = DIYBoundsToVTKM(subset_bounds[self]);
+    for(int img = 0; img < batch_size; ++img)
+    {
+      Image &sub_image = block->m_scratch;
+      sub_image.SubsetFrom(images[img], sub_bounds);  
+      images[img].Swap(sub_image);
+    }
+  }
+
+} // reduce images
+
+//
+// Same schedule as reduce_images, but only the visibility keys are
+// exchanged
+//
+void reduce_depths(void *b, 
+                   const diy::ReduceProxy &proxy,
+                   const diy::RegularSwapPartners &partners) 
+{
+  DepthImageBlock *block = reinterpret_cast<DepthImageBlock*>(b);
+  unsigned int round = proxy.round();
+  DepthImage &image = block->m_image; 
+
+  for(int i = 0; i < proxy.in_link().size(); ++i)
+  {
+    int gid = proxy.in_link().target(i).gid;
+    if(gid == proxy.gid())
+    {
+      continue;
+    }
+    DepthImage incoming; 
+    proxy.dequeue(gid, incoming);
+    image.Composite(incoming);
+  } // for in links
 
+  if(proxy.out_link().size() == 0)
+  {
+    return;
+  }
+
+  const int group_size = proxy.out_link().size(); 
+  const int current_dim = partners.dim(round);
+  const vtkm::Bounds region = round == 0 ? image.m_orig_bounds : image.m_bounds;
+  std::vector<diy::DiscreteBounds> subset_bounds = split_region(region,
+                                                                group_size,
+                                                                current_dim);
+  int self = -1;
   for(int i = 0; i < group_size; ++i)
   {
       if(proxy.out_link().target(i).gid == proxy.gid())
       {
-        image.Swap(out_images[i]);
+        self = i;
       }
       else
       {
-        proxy.enqueue(proxy.out_link().target(i), out_images[i]);
+        DepthImage out_image;
+        out_image.SubsetFrom(image, DIYBoundsToVTKM(subset_bounds[i]));
+        proxy.enqueue(proxy.out_link().target(i), out_image);
       }
   } //for 
 
-} // reduce images
+  if(self != -1)
+  {
+    DepthImage sub_image;
+    sub_image.SubsetFrom(image, DIYBoundsToVTKM(subset_bounds[self]));  
+    std::swap(image, sub_image);
+  }
+} // reduce depths
+
+//
+// Builds the color tile for the resolved visibility keys. The owner
+// of each visible pixel is asked for its color with a pair of 
+// all-to-all exchanges: pixel ids out, colors back.
+//
+static void resolve_colors(const Image &image,
+                           const DepthImage &keys,
+                           Image &tile,
+                           MPI_Comm comm)
+{
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  tile.m_orig_bounds = keys.m_orig_bounds;
+  tile.m_bounds = keys.m_bounds;
+  const int tile_size = keys.GetNumberOfPixels();
+  tile.m_pixels.assign(tile_size * 4, 0);
+  tile.m_depths.assign(tile_size, 2.f);
+
+  const int width = image.m_orig_bounds.X.Max - image.m_orig_bounds.X.Min + 1;
+  const int tile_dx = keys.m_bounds.X.Max - keys.m_bounds.X.Min + 1;
+  const int image_dx = image.m_bounds.X.Max - image.m_bounds.X.Min + 1;
+  const int tile_x = keys.m_bounds.X.Min - image.m_orig_bounds.X.Min;
+  const int tile_y = keys.m_bounds.Y.Min - image.m_orig_bounds.Y.Min;
+  const int image_x = image.m_bounds.X.Min - image.m_orig_bounds.X.Min;
+  const int image_y = image.m_bounds.Y.Min - image.m_orig_bounds.Y.Min;
+
+  // ids of the pixels we need from each rank and where they go
+  std::vector<std::vector<int>> requests(size);
+  std::vector<std::vector<int>> destinations(size);
+  for(int i = 0; i < tile_size; ++i)
+  {
+    const unsigned int key = keys.m_keys[i];
+    if(key == DepthImage::EmptyKey)
+    {
+      continue;
+    }
+    tile.m_depths[i] = keys.KeyDepth(key);
+    const int x = tile_x + i % tile_dx;
+    const int y = tile_y + i / tile_dx;
+    const int owner = keys.KeyRank(key);
+    if(owner == rank)
+    {
+      const int index = (y - image_y) * image_dx + x - image_x;
+      std::copy(&image.m_pixels[index * 4],
+                &image.m_pixels[index * 4] + 4,
+                &tile.m_pixels[i * 4]);
+    }
+    else
+    {
+      requests[owner].push_back(y * width + x);
+      destinations[owner].push_back(i);
+    }
+  }
+
+  std::vector<int> send_counts(size), send_offsets(size);
+  std::vector<int> recv_counts(size), recv_offsets(size);
+  std::vector<int> send_ids;
+  for(int i = 0; i < size; ++i)
+  {
+    send_counts[i] = static_cast<int>(requests[i].size());
+    send_offsets[i] = static_cast<int>(send_ids.size());
+    send_ids.insert(send_ids.end(), requests[i].begin(), requests[i].end());
+  }
+
+  MPI_Alltoall(&send_counts[0], 1, MPI_INT, &recv_counts[0], 1, MPI_INT, comm);
+
+  int total_recv = 0;
+  for(int i = 0; i < size; ++i)
+  {
+    recv_offsets[i] = total_recv;
+    total_recv += recv_counts[i];
+  }
+
+  // make sure we never hand MPI a pointer to an empty vector
+  send_ids.push_back(0);
+  std::vector<int> recv_ids(total_recv + 1);
+  MPI_Alltoallv(&send_ids[0], &send_counts[0], &send_offsets[0], MPI_INT,
+                &recv_ids[0], &recv_counts[0], &recv_offsets[0], MPI_INT,
+                comm);
+
+  // look up the requested colors in our image
+  std::vector<unsigned int> reply(total_recv + 1);
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int i = 0; i < total_recv; ++i)
+  {
+    const int x = recv_ids[i] % width;
+    const int y = recv_ids[i] / width;
+    const int index = (y - image_y) * image_dx + x - image_x;
+    std::memcpy(&reply[i], &image.m_pixels[index * 4], 4);
+  }
+
+  std::vector<unsigned int> colors(send_ids.size());
+  MPI_Alltoallv(&reply[0], &recv_counts[0], &recv_offsets[0], MPI_UNSIGNED,
+                &colors[0], &send_counts[0], &send_offsets[0], MPI_UNSIGNED,
+                comm);
+
+  for(int r = 0; r < size; ++r)
+  {
+    const int count = send_counts[r];
+    for(int i = 0; i < count; ++i)
+    {
+      const int dest = destinations[r][i];
+      std::memcpy(&tile.m_pixels[dest * 4], &colors[send_offsets[r] + i], 4);
+    }
+  }
+}
+
+//
+// Everything needed to run the exchange that only depends on the
+// number of ranks, the image size and the schedule. It is built on
+// the first composite and reused as long as none of those change.
+//
+struct RadixKCompositor::Context
+{
+  // what the context was built for
+  MPI_Comm                                    m_comm;
+  int                                         m_num_ranks;
+  vtkm::Bounds                                m_bounds;
+  std::vector<int>                            m_factors;
+  int                                         m_blocks_per_rank;
+  int                                         m_threads;
+  bool                                        m_depth_only;
+
+  // the schedule and the blocks that run it
+  std::vector<vtkm::Bounds>                   m_regions;
+  diy::RegularPartners::KVSVector             m_kvs;
+  std::unique_ptr<diy::Master>                m_master;
+  std::unique_ptr<diy::RoundRobinAssigner>    m_assigner;
+  std::unique_ptr<diy::RegularSwapPartners>   m_partners;
+
+  // buffers owned by the blocks, one batch per block
+  std::vector<std::vector<Image>>             m_images;
+  DepthImage                                  m_keys;
+  std::vector<Image>                          m_results;
+
+  bool Matches(diy::mpi::communicator &diy_comm,
+               const vtkm::Bounds &bounds,
+               const std::vector<int> &factors,
+               const int blocks_per_rank,
+               const int threads,
+               const bool depth_only) const
+  {
+    return m_comm == static_cast<MPI_Comm>(diy_comm) &&
+           m_num_ranks == diy_comm.size() &&
+           m_bounds == bounds &&
+           m_factors == factors &&
+           m_blocks_per_rank == blocks_per_rank &&
+           m_threads == threads &&
+           m_depth_only == depth_only;
+  }
+};
+
+RadixKCompositor::Context&
+RadixKCompositor::GetContext(diy::mpi::communicator &diy_comm,
+                             const vtkm::Bounds &bounds,
+                             const int blocks_per_rank,
+                             const bool depth_only)
+{
+  const int num_ranks = diy_comm.size(); 
+  const std::vector<int> factors = GetFactors(num_ranks);
+  std::unique_ptr<Context> &context = depth_only ? m_depth_context : m_context;
+  if(context && context->Matches(diy_comm, 
+                                 bounds, 
+                                 factors, 
+                                 blocks_per_rank, 
+                                 m_threads, 
+                                 depth_only))
+  {
+    return *context;
+  }
+
+  context.reset(new Context());
+  Context &ctx = *context;
+  ctx.m_comm = diy_comm;
+  ctx.m_num_ranks = num_ranks;
+  ctx.m_bounds = bounds;
+  ctx.m_factors = factors;
+  ctx.m_blocks_per_rank = blocks_per_rank;
+  ctx.m_threads = m_threads;
+  ctx.m_depth_only = depth_only;
+
+  //
+  // The screen is cut into horizontal strips, one per local block. 
+  // Each strip is composited by an independent radix-k reduction 
+  // over all ranks, so the strips never exchange pixels and diy 
+  // can work on the local blocks in separate threads.
+  //
+  if(blocks_per_rank == 1)
+  {
+    ctx.m_regions.push_back(bounds);
+  }
+  else
+  {
+    std::vector<diy::DiscreteBounds> strip_bounds = split_region(bounds,
+                                                                 blocks_per_rank,
+                                                                 1);
+    for(int i = 0; i < blocks_per_rank; ++i)
+    {
+      ctx.m_regions.push_back(DIYBoundsToVTKM(strip_bounds[i]));
+    }
+  }
+  ctx.m_images.resize(blocks_per_rank);
+
+  const int num_blocks = num_ranks * blocks_per_rank; 
+  const int num_dims = 3;
+  diy::RegularPartners::DivisionVector divisions;
+  build_schedule(factors, ctx.m_regions[0], divisions, ctx.m_kvs);
+  // the strips are never split or exchanged
+  divisions.push_back(blocks_per_rank);
+
+  diy::DiscreteBounds global_bounds = VTKMBoundsToDIY(bounds);
+  global_bounds.min[2] = 0;
+  global_bounds.max[2] = blocks_per_rank - 1;
+
+  diy::Master::DestroyBlock destroy = depth_only ? &DepthImageBlock::Destroy 
+                                                 : &ImageBatchBlock::Destroy;
+  ctx.m_master.reset(new diy::Master(diy_comm, m_threads, -1, 0, destroy));
+
+  // 
+  // block i of every rank works on strip i: 
+  // gid = rank + strip * num_ranks
+  //
+  ctx.m_assigner.reset(new diy::RoundRobinAssigner(num_ranks, num_blocks)); 
+  typedef diy::RegularDecomposer<diy::DiscreteBounds> Decomposer;
+  Decomposer decomposer(num_dims, 
+                        global_bounds, 
+                        num_blocks,
+                        Decomposer::BoolVector(),     // share face
+                        Decomposer::BoolVector(),     // wrap
+                        Decomposer::CoordinateVector(), // ghosts
+                        divisions);
+  if(depth_only)
+  {
+    AddDepthImageBlock create(*ctx.m_master, ctx.m_keys);
+    decomposer.decompose(diy_comm.rank(), *ctx.m_assigner, create);
+  }
+  else
+  {
+    AddImageBatchBlocks create(*ctx.m_master, ctx.m_images, ctx.m_regions);
+    decomposer.decompose(diy_comm.rank(), *ctx.m_assigner, create);
+  }
+
+  ctx.m_partners.reset(new diy::RegularSwapPartners(divisions, 
+                                                    ctx.m_kvs, 
+                                                    false)); // false == distance halving
+  return ctx;
+}
 
 RadixKCompositor::RadixKCompositor()
+  : m_collect(true),
+    m_threads(1),
+    m_blocks_per_rank(1)
 {
 
 }
@@ -115,35 +505,216 @@ RadixKCompositor::~RadixKCompositor()
 
 }
 
+void
+RadixKCompositor::SetCollect(bool collect)
+{
+  m_collect = collect;
+}
+
+void
+RadixKCompositor::SetThreads(const int num_threads)
+{
+  m_threads = num_threads;
+}
+
+void
+RadixKCompositor::SetBlocksPerRank(const int blocks_per_rank)
+{
+  m_blocks_per_rank = blocks_per_rank;
+}
+
+void
+RadixKCompositor::SetFactors(const std::vector<int> &factors)
+{
+  m_factors = factors;
+}
+
+std::vector<int>
+RadixKCompositor::Factor(const int num_ranks, const int max_k)
+{
+  assert(num_ranks > 0);
+  assert(max_k > 1);
+  std::vector<int> primes;
+  int rem = num_ranks;
+  for(int p = 2; p * p <= rem; ++p)
+  {
+    while(rem % p == 0)
+    {
+      primes.push_back(p);
+      rem /= p;
+    }
+  }
+  if(rem > 1)
+  {
+    primes.push_back(rem);
+  }
+
+  // pack the largest primes first into groups no bigger than max_k
+  std::sort(primes.begin(), primes.end(), std::greater<int>());
+  std::vector<int> factors;
+  for(size_t i = 0; i < primes.size(); ++i)
+  {
+    bool packed = false;
+    for(size_t f = 0; f < factors.size(); ++f)
+    {
+      if(factors[f] * primes[i] <= max_k)
+      {
+        factors[f] *= primes[i];
+        packed = true;
+        break;
+      }
+    }
+    if(!packed)
+    {
+      factors.push_back(primes[i]);
+    }
+  }
+
+  std::sort(factors.begin(), factors.end(), std::greater<int>());
+  return factors;
+}
+
+std::vector<int>
+RadixKCompositor::AutoFactors(const int num_ranks, const int num_pixels)
+{
+  const int pixels_per_rank = num_pixels / num_ranks;
+  int k = 8;
+  if(pixels_per_rank < 128 * 128)
+  {
+    k = 16;
+  }
+  else if(pixels_per_rank > 1024 * 1024)
+  {
+    k = 4;
+  }
+
+  if(num_ranks <= k)
+  {
+    // a single round of direct send
+    return std::vector<int>(1, num_ranks);
+  }
+  return Factor(num_ranks, k);
+}
+
+std::vector<int>
+RadixKCompositor::GetFactors(const int num_blocks) const
+{
+  const int magic_k = 8;
+
+  std::vector<int> factors = m_factors;
+  if(factors.size() == 0)
+  {
+    factors = Factor(num_blocks, magic_k);
+  }
+
+  int product = 1;
+  for(size_t i = 0; i < factors.size(); ++i)
+  {
+    product *= factors[i];
+  }
+  if(product != num_blocks)
+  {
+    std::stringstream msg;
+    msg<<"RadixKCompositor: the product of the factors ("<<product<<") ";
+    msg<<"does not match the number of ranks ("<<num_blocks<<")";
+    throw Error(msg.str());
+  }
+  return factors;
+}
+
 void
 RadixKCompositor::CompositeSurface(diy::mpi::communicator &diy_comm, Image &image)
 {
-  
-    diy::DiscreteBounds global_bounds = VTKMBoundsToDIY(image.m_orig_bounds);
+  std::vector<Image> images(1);
+  images[0].Swap(image);
+  CompositeSurface(diy_comm, images);
+  image.Swap(images[0]);
+}
 
-    // tells diy to use one thread
-    const int num_threads = 1; 
-    const int num_blocks = diy_comm.size(); 
-    const int magic_k = 8;
-
-    diy::Master master(diy_comm, num_threads);
-
-    // create an assigner with one block per rank
-    diy::ContiguousAssigner assigner(num_blocks, num_blocks); 
-    AddImageBlock create(master, image);
-    const int num_dims = 2;
-    diy::RegularDecomposer<diy::DiscreteBounds> decomposer(num_dims, global_bounds, num_blocks);
-    decomposer.decompose(diy_comm.rank(), assigner, create);
-    diy::RegularSwapPartners partners(decomposer, 
-                                      magic_k, 
-                                      false); // false == distance halving
-    diy::reduce(master,
-                assigner,
-                partners,
+void
+RadixKCompositor::CompositeSurface(diy::mpi::communicator &diy_comm, 
+                                   std::vector<Image> &images)
+{
+    assert(images.size() > 0);
+    const int batch_size = static_cast<int>(images.size());
+    const vtkm::Bounds orig_bounds = images[0].m_orig_bounds;
+    const int height = orig_bounds.Y.Max - orig_bounds.Y.Min + 1;
+    //
+    // each rank's tiles of separate screen strips are not contiguous
+    // so they only make sense when they are gathered
+    //
+    int blocks_per_rank = m_collect ? m_blocks_per_rank : 1;
+    blocks_per_rank = std::max(1, std::min(blocks_per_rank, height));
+
+    Context &ctx = GetContext(diy_comm, orig_bounds, blocks_per_rank, false);
+
+    if(blocks_per_rank == 1)
+    {
+      ctx.m_images[0].swap(images);
+    }
+    else
+    {
+      for(int i = 0; i < blocks_per_rank; ++i)
+      {
+        ctx.m_images[i].resize(batch_size);
+        for(int img = 0; img < batch_size; ++img)
+        {
+          vtkm::Bounds sub_region = Image::Intersect(images[img].m_bounds, 
+                                                     ctx.m_regions[i]);
+          if(sub_region.X.Min > sub_region.X.Max || sub_region.Y.Min > sub_region.Y.Max)
+          {
+            // we have nothing in this strip 
+            sub_region = ctx.m_regions[i];
+          }
+          ctx.m_images[i][img].SubsetFrom(images[img], sub_region);
+        }
+      }
+    }
+
+    diy::reduce(*ctx.m_master,
+                *ctx.m_assigner,
+                *ctx.m_partners,
                 reduce_images);
 
+    if(blocks_per_rank == 1)
+    {
+      images.swap(ctx.m_images[0]);
+      if(m_collect)
+      {
+        ctx.m_results.resize(batch_size);
+        MPICollect(&images[0], 1, &ctx.m_results[0], batch_size, diy_comm); 
+      }
+    }
+    else
+    {
+      // lay the tiles out image by image
+      std::vector<Image> tiles(batch_size * blocks_per_rank);
+      for(int img = 0; img < batch_size; ++img)
+      {
+        for(int i = 0; i < blocks_per_rank; ++i)
+        {
+          tiles[img * blocks_per_rank + i].Swap(ctx.m_images[i][img]);
+        }
+      }
+      ctx.m_results.resize(batch_size);
+      MPICollect(&tiles[0], blocks_per_rank, &ctx.m_results[0], batch_size, diy_comm); 
+      // hand the buffers back to the blocks
+      for(int img = 0; img < batch_size; ++img)
+      {
+        for(int i = 0; i < blocks_per_rank; ++i)
+        {
+          ctx.m_images[i][img].Swap(tiles[img * blocks_per_rank + i]);
+        }
+      }
+    }
 
-    MPICollect(image, diy_comm); 
+    if(m_collect && diy_comm.rank() == 0)
+    {
+      for(int img = 0; img < batch_size; ++img)
+      {
+        images[img].Swap(ctx.m_results[img]);
+      }
+    }
     //diy::all_to_all(master,
     //                assigner,
     //                CollectImages(decomposer),
@@ -151,11 +722,48 @@ RadixKCompositor::CompositeSurface(diy::mpi::communicator &diy_comm, Image &imag
   
     if(diy_comm.rank() == 0) 
     {
-      master.prof.output(m_timing_log);
+      ctx.m_master->prof.output(m_timing_log);
     }
   
 }
 
+void
+RadixKCompositor::CompositeSurfaceDepthOnly(diy::mpi::communicator &diy_comm, Image &image)
+{
+    const int num_blocks = diy_comm.size(); 
+    Context &ctx = GetContext(diy_comm, image.m_orig_bounds, 1, true);
+
+    DepthImage &keys = ctx.m_keys;
+    keys.Init(image, diy_comm.rank(), DepthImage::RankBits(num_blocks));
+
+    diy::reduce(*ctx.m_master,
+                *ctx.m_assigner,
+                *ctx.m_partners,
+                reduce_depths);
+
+    if(diy_comm.rank() == 0) 
+    {
+      ctx.m_master->prof.output(m_timing_log);
+    }
+
+    if(ctx.m_kvs.size() == 0)
+    {
+      // nothing was exchanged, so the keys still cover our image
+      DepthImage full;
+      full.SubsetFrom(keys, image.m_orig_bounds);
+      std::swap(keys, full);
+    }
+
+    Image tile;
+    resolve_colors(image, keys, tile, diy_comm);
+    image.Swap(tile);
+
+    if(m_collect)
+    {
+      MPICollect(image, diy_comm); 
+    }
+}
+
 std::string 
 RadixKCompositor::GetTimingString()
 {
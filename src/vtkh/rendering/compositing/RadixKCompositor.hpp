@@ -3,7 +3,9 @@
 
 #include <vtkh/rendering/Image.hpp>
 #include <diy/mpi.hpp>
+#include <memory>
 #include <sstream>
+#include <vector>
 
 namespace vtkh
 {
@@ -14,9 +16,63 @@ public:
   RadixKCompositor();
   ~RadixKCompositor();
   void CompositeSurface(diy::mpi::communicator &diy_comm, Image &image); 
+  //
+  // Composites a batch of images of the same size in a single
+  // set of rounds. Every rank must pass the same number of images.
+  //
+  void CompositeSurface(diy::mpi::communicator &diy_comm, 
+                        std::vector<Image> &images); 
+  //
+  // Composites opaque surfaces by exchanging only depth and owner 
+  // rank during the radix-k rounds. Afterwards, each tile fetches
+  // the colors from the ranks owning the visible pixels.
+  //
+  void CompositeSurfaceDepthOnly(diy::mpi::communicator &diy_comm, Image &image); 
+  //
+  // Group sizes for each round. If empty, the rank count 
+  // is factored with k = 8
+  //
+  void SetFactors(const std::vector<int> &factors);
+  //
+  // If false, each rank keeps its tile of the final image
+  // instead of sending it to rank 0
+  //
+  void SetCollect(bool collect);
+  //
+  // Number of threads diy uses to work on the local blocks
+  //
+  void SetThreads(const int num_threads);
+  //
+  // Splits the screen into this many strips that are composited
+  // as independent blocks on each rank. Only used when collecting.
+  //
+  void SetBlocksPerRank(const int blocks_per_rank);
   std::string GetTimingString();
+  //
+  // Factors num_ranks into groups no larger than max_k. Prime
+  // factors larger than max_k become their own round.
+  //
+  static std::vector<int> Factor(const int num_ranks, const int max_k);
+  //
+  // Picks a schedule from the number of ranks and pixels. Small
+  // pieces are latency bound and favor fewer, larger rounds.
+  //
+  static std::vector<int> AutoFactors(const int num_ranks, const int num_pixels);
 private:
+  struct Context;
+  std::vector<int> GetFactors(const int num_blocks) const;
+  Context& GetContext(diy::mpi::communicator &diy_comm,
+                      const vtkm::Bounds &bounds,
+                      const int blocks_per_rank,
+                      const bool depth_only);
   std::stringstream m_timing_log;
+  std::vector<int>  m_factors;
+  bool              m_collect;
+  int               m_threads;
+  int               m_blocks_per_rank;
+  // schedules kept across calls, one per exchange mode
+  std::unique_ptr<Context> m_context;
+  std::unique_ptr<Context> m_depth_context;
 };
 
 } // namspace vtkh
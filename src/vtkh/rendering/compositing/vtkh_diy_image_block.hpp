@@ -2,6 +2,8 @@
 #define VTKH_DIY_IMAGE_BLOCK_HPP
 
 #include <vtkh/rendering/Image.hpp>
+#include <vtkh/rendering/CompressedImage.hpp>
+#include <vtkh/rendering/compositing/DepthImage.hpp>
 #include <diy/master.hpp>
 
 namespace vtkh 
@@ -78,6 +80,170 @@ struct AddMultiImageBlock
   }
 }; 
 
+//
+// A batch of images (e.g. one per camera) that are composited 
+// together, so every message carries a piece of each image
+//
+struct ImageBatchBlock
+{
+  std::vector<Image>           &m_images;
+  // part of the screen this block is responsible for
+  vtkm::Bounds                  m_region;
+  // scratch space for messages and sub-images that keeps its
+  // capacity when the block is reused
+  std::vector<CompressedImage>  m_buffers;
+  Image                         m_scratch;
+
+  ImageBatchBlock(std::vector<Image> &images, const vtkm::Bounds &region)
+    : m_images(images),
+      m_region(region)
+  {
+  }
+
+  static void Destroy(void *b)
+  {
+    delete static_cast<ImageBatchBlock*>(b);
+  }
+};
+
+//
+// Adds one block per local batch. The i-th block added on
+// this rank owns images[i] and is responsible for regions[i]
+//
+struct AddImageBatchBlocks
+{
+  std::vector<std::vector<Image>> &m_images;
+  const std::vector<vtkm::Bounds> &m_regions;
+  const diy::Master               &m_master;
+
+  AddImageBatchBlocks(diy::Master &master,
+                      std::vector<std::vector<Image>> &images,
+                      const std::vector<vtkm::Bounds> &regions)
+    : m_images(images),
+      m_regions(regions),
+      m_master(master)
+  {
+  }
+  template<typename BoundsType, typename LinkType>                 
+  void operator()(int gid,
+                  const BoundsType &,  // local_bounds
+                  const BoundsType &,  // local_with_ghost_bounds
+                  const BoundsType &,  // domain_bounds
+                  const LinkType &link) const
+  {
+    diy::Master& master = const_cast<diy::Master&>(m_master);
+    const int index = master.size();
+    ImageBatchBlock *block = new ImageBatchBlock(m_images.at(index), 
+                                                 m_regions.at(index));
+    LinkType *linked = new LinkType(link);
+    master.add(gid, block, linked);
+  }
+}; 
+
+//
+// Several lists of images that are blended in order, one list
+// and one output per image of the batch
+//
+struct MultiImageBatchBlock
+{
+  std::vector<std::vector<Image>> &m_images;
+  std::vector<Image>              &m_outputs;
+  // the local images this block sends are
+  // m_send_offset, m_send_offset + m_send_stride, ...
+  int                              m_send_offset;
+  int                              m_send_stride;
+
+  MultiImageBatchBlock(std::vector<std::vector<Image>> &images,
+                       std::vector<Image> &outputs,
+                       const int send_offset,
+                       const int send_stride)
+    : m_images(images),
+      m_outputs(outputs),
+      m_send_offset(send_offset),
+      m_send_stride(send_stride)
+  {}
+
+  static void Destroy(void *b)
+  {
+    delete static_cast<MultiImageBatchBlock*>(b);
+  }
+};
+
+//
+// Adds several blocks sharing the same local images. Each block
+// sends an interleaved subset of the images and composites into
+// its own outputs
+//
+struct AddMultiImageBatchBlocks
+{
+  std::vector<std::vector<Image>> &m_images;
+  std::vector<std::vector<Image>> &m_outputs;
+  const diy::Master               &m_master;
+
+  AddMultiImageBatchBlocks(diy::Master &master, 
+                           std::vector<std::vector<Image>> &images,
+                           std::vector<std::vector<Image>> &outputs)
+    : m_images(images),
+      m_outputs(outputs),
+      m_master(master)
+  {}
+  template<typename BoundsType, typename LinkType>                 
+  void operator()(int gid,
+                  const BoundsType &,  // local_bounds
+                  const BoundsType &,  // local_with_ghost_bounds
+                  const BoundsType &,  // domain_bounds
+                  const LinkType &link) const
+  {
+    diy::Master& master = const_cast<diy::Master&>(m_master);
+    const int index = master.size();
+    const int stride = static_cast<int>(m_outputs.size());
+    MultiImageBatchBlock *block = new MultiImageBatchBlock(m_images, 
+                                                           m_outputs.at(index),
+                                                           index,
+                                                           stride);
+    LinkType *linked = new LinkType(link);
+    master.add(gid, block, linked);
+  }
+}; 
+
+struct DepthImageBlock
+{
+  DepthImage &m_image;
+  DepthImageBlock(DepthImage &image)
+    : m_image(image)
+  {
+  }
+
+  static void Destroy(void *b)
+  {
+    delete static_cast<DepthImageBlock*>(b);
+  }
+};
+
+struct AddDepthImageBlock
+{
+  DepthImage        &m_image;
+  const diy::Master &m_master;
+
+  AddDepthImageBlock(diy::Master &master, DepthImage &image)
+    : m_image(image),
+      m_master(master)
+  {
+  }
+  template<typename BoundsType, typename LinkType>                 
+  void operator()(int gid,
+                  const BoundsType &,  // local_bounds
+                  const BoundsType &,  // local_with_ghost_bounds
+                  const BoundsType &,  // domain_bounds
+                  const LinkType &link) const
+  {
+    DepthImageBlock *block = new DepthImageBlock(m_image);
+    LinkType *linked = new LinkType(link);
+    diy::Master& master = const_cast<diy::Master&>(m_master);
+    master.add(gid, block, linked);
+  }
+}; 
+
 } //namespace  vtkh
 
 namespace diy {
@@ -130,6 +296,147 @@ struct Serialization<vtkh::Image>
   }
 };
 
+template<>
+struct Serialization<vtkh::CompressedImage>
+{
+  static void save(BinaryBuffer &bb, const vtkh::CompressedImage &image)
+  {
+    diy::save(bb, image.m_orig_bounds.X.Min);
+    diy::save(bb, image.m_orig_bounds.Y.Min);
+    diy::save(bb, image.m_orig_bounds.Z.Min);
+    diy::save(bb, image.m_orig_bounds.X.Max);
+    diy::save(bb, image.m_orig_bounds.Y.Max);
+    diy::save(bb, image.m_orig_bounds.Z.Max);
+
+    diy::save(bb, image.m_bounds.X.Min);
+    diy::save(bb, image.m_bounds.Y.Min);
+    diy::save(bb, image.m_bounds.Z.Min);
+    diy::save(bb, image.m_bounds.X.Max);
+    diy::save(bb, image.m_bounds.Y.Max);
+    diy::save(bb, image.m_bounds.Z.Max);
+
+    diy::save(bb, image.m_runs);
+    diy::save(bb, image.m_pixels);
+    diy::save(bb, image.m_depths);
+    diy::save(bb, image.m_orig_rank);
+    diy::save(bb, image.m_composite_order);
+  }
+
+  static void load(BinaryBuffer &bb, vtkh::CompressedImage &image)
+  {
+    diy::load(bb, image.m_orig_bounds.X.Min);
+    diy::load(bb, image.m_orig_bounds.Y.Min);
+    diy::load(bb, image.m_orig_bounds.Z.Min);
+    diy::load(bb, image.m_orig_bounds.X.Max);
+    diy::load(bb, image.m_orig_bounds.Y.Max);
+    diy::load(bb, image.m_orig_bounds.Z.Max);
+
+    diy::load(bb, image.m_bounds.X.Min);
+    diy::load(bb, image.m_bounds.Y.Min);
+    diy::load(bb, image.m_bounds.Z.Min);
+    diy::load(bb, image.m_bounds.X.Max);
+    diy::load(bb, image.m_bounds.Y.Max);
+    diy::load(bb, image.m_bounds.Z.Max);
+
+    diy::load(bb, image.m_runs);
+    diy::load(bb, image.m_pixels);
+    diy::load(bb, image.m_depths);
+    diy::load(bb, image.m_orig_rank);
+    diy::load(bb, image.m_composite_order);
+  }
+};
+
+//
+// Only non-empty keys go over the wire, preceded by alternating
+// counts of empty and non-empty keys
+//
+template<>
+struct Serialization<vtkh::DepthImage>
+{
+  static void save(BinaryBuffer &bb, const vtkh::DepthImage &image)
+  {
+    diy::save(bb, image.m_orig_bounds.X.Min);
+    diy::save(bb, image.m_orig_bounds.Y.Min);
+    diy::save(bb, image.m_orig_bounds.Z.Min);
+    diy::save(bb, image.m_orig_bounds.X.Max);
+    diy::save(bb, image.m_orig_bounds.Y.Max);
+    diy::save(bb, image.m_orig_bounds.Z.Max);
+
+    diy::save(bb, image.m_bounds.X.Min);
+    diy::save(bb, image.m_bounds.Y.Min);
+    diy::save(bb, image.m_bounds.Z.Min);
+    diy::save(bb, image.m_bounds.X.Max);
+    diy::save(bb, image.m_bounds.Y.Max);
+    diy::save(bb, image.m_bounds.Z.Max);
+
+    diy::save(bb, image.m_rank_bits);
+
+    std::vector<int> runs;
+    std::vector<unsigned int> keys;
+    const int size = static_cast<int>(image.m_keys.size());
+    int i = 0;
+    while(i < size)
+    {
+      int empty = 0;
+      while(i < size && image.m_keys[i] == vtkh::DepthImage::EmptyKey)
+      {
+        empty++;
+        i++;
+      }
+      int active = 0;
+      while(i < size && image.m_keys[i] != vtkh::DepthImage::EmptyKey)
+      {
+        keys.push_back(image.m_keys[i]);
+        active++;
+        i++;
+      }
+      runs.push_back(empty);
+      runs.push_back(active);
+    }
+    diy::save(bb, runs);
+    diy::save(bb, keys);
+  }
+
+  static void load(BinaryBuffer &bb, vtkh::DepthImage &image)
+  {
+    diy::load(bb, image.m_orig_bounds.X.Min);
+    diy::load(bb, image.m_orig_bounds.Y.Min);
+    diy::load(bb, image.m_orig_bounds.Z.Min);
+    diy::load(bb, image.m_orig_bounds.X.Max);
+    diy::load(bb, image.m_orig_bounds.Y.Max);
+    diy::load(bb, image.m_orig_bounds.Z.Max);
+
+    diy::load(bb, image.m_bounds.X.Min);
+    diy::load(bb, image.m_bounds.Y.Min);
+    diy::load(bb, image.m_bounds.Z.Min);
+    diy::load(bb, image.m_bounds.X.Max);
+    diy::load(bb, image.m_bounds.Y.Max);
+    diy::load(bb, image.m_bounds.Z.Max);
+
+    diy::load(bb, image.m_rank_bits);
+
+    std::vector<int> runs;
+    std::vector<unsigned int> keys;
+    diy::load(bb, runs);
+    diy::load(bb, keys);
+
+    image.m_keys.assign(image.GetNumberOfPixels(), vtkh::DepthImage::EmptyKey);
+    const int num_runs = static_cast<int>(runs.size() / 2);
+    int pixel = 0;
+    int active = 0;
+    for(int r = 0; r < num_runs; ++r)
+    {
+      pixel += runs[r * 2 + 0];
+      const int count = runs[r * 2 + 1];
+      std::copy(keys.begin() + active,
+                keys.begin() + active + count,
+                image.m_keys.begin() + pixel);
+      pixel += count;
+      active += count;
+    }
+  }
+};
+
 } // namespace diy
 
 #endif
@@ -0,0 +1,174 @@
+#include "AsyncImageWriter.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace vtkh
+{
+
+AsyncImageWriter::AsyncImageWriter()
+  : m_pending(0),
+    m_queue_size(4),
+    m_stop(false)
+{
+}
+
+AsyncImageWriter::~AsyncImageWriter()
+{
+  // don't throw from here, just report it
+  try
+  {
+    Finalize();
+  }
+  catch(const std::exception &e)
+  {
+    std::cerr<<"AsyncImageWriter: "<<e.what()<<"\n";
+  }
+  catch(...)
+  {
+    std::cerr<<"AsyncImageWriter: unknown error writing an image\n";
+  }
+}
+
+void
+AsyncImageWriter::Write(std::vector<unsigned char> &&rgba,
+                        const int width,
+                        const int height,
+                        const std::string &filename)
+{
+  Write(ImageWriter::Create(ImageWriter::PNG),
+        std::move(rgba),
+        std::vector<float>(),
+        width,
+        height,
+        filename);
+}
+
+void
+AsyncImageWriter::Write(const std::shared_ptr<ImageWriter> &writer,
+                        std::vector<unsigned char> &&rgba,
+                        std::vector<float> &&depth,
+                        const int width,
+                        const int height,
+                        const std::string &filename)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if(!m_thread.joinable())
+  {
+    m_stop = false;
+    m_thread = std::thread(&AsyncImageWriter::Run, this);
+  }
+
+  m_job_done.wait(lock, [this]() { return (int)m_jobs.size() < m_queue_size; });
+
+  m_jobs.push_back(Job());
+  Job &job = m_jobs.back();
+  job.m_writer = writer;
+  job.m_rgba = std::move(rgba);
+  job.m_depth = std::move(depth);
+  job.m_width = width;
+  job.m_height = height;
+  job.m_filename = filename;
+  m_pending++;
+  m_job_ready.notify_one();
+}
+
+void
+AsyncImageWriter::Flush()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_job_done.wait(lock, [this]() { return m_pending == 0; });
+  if(m_error)
+  {
+    std::exception_ptr error = m_error;
+    m_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+void
+AsyncImageWriter::Finalize()
+{
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_job_done.wait(lock, [this]() { return m_pending == 0; });
+    m_stop = true;
+  }
+  m_job_ready.notify_one();
+  if(m_thread.joinable())
+  {
+    m_thread.join();
+  }
+
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::swap(error, m_error);
+  }
+  if(error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+void
+AsyncImageWriter::SetQueueSize(const int queue_size)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_queue_size = std::max(1, queue_size);
+  // a larger queue can let waiting writers through
+  m_job_done.notify_all();
+}
+
+int
+AsyncImageWriter::GetQueueSize()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_queue_size;
+}
+
+void
+AsyncImageWriter::Run()
+{
+  while(true)
+  {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_job_ready.wait(lock, [this]() { return m_stop || !m_jobs.empty(); });
+      if(m_jobs.empty())
+      {
+        return;
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+      // room for the next image
+      m_job_done.notify_all();
+    }
+
+    std::exception_ptr error;
+    try
+    {
+      const float *depth = job.m_depth.empty() ? NULL : job.m_depth.data();
+      job.m_writer->Write(job.m_rgba.data(), depth, job.m_width, job.m_height, job.m_filename);
+    }
+    catch(...)
+    {
+      // the thread keeps writing the images after it
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if(error && !m_error)
+      {
+        m_error = error;
+      }
+      m_pending--;
+    }
+    m_job_done.notify_all();
+  }
+}
+
+} // namespace vtkh
@@ -0,0 +1,82 @@
+#ifndef VTKH_ASYNC_IMAGE_WRITER_HPP
+#define VTKH_ASYNC_IMAGE_WRITER_HPP
+
+#include <vtkh/utils/ImageWriter.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vtkh
+{
+//
+// Encodes and writes images on a background thread so the caller can
+// go on rendering. The writer takes ownership of the pixels (RGBA8,
+// bottom row first) and of the depth values, if any. At most a bounded
+// number of images wait in the queue; Write blocks while it is full,
+// which keeps the memory held by pending images in check. Anything a
+// write throws on the thread is rethrown by the next Flush or Finalize.
+//
+class AsyncImageWriter
+{
+public:
+  AsyncImageWriter();
+  // writes everything still queued
+  ~AsyncImageWriter();
+
+  // writes a png
+  void Write(std::vector<unsigned char> &&rgba,
+             const int width,
+             const int height,
+             const std::string &filename);
+  // depth can be empty
+  void Write(const std::shared_ptr<ImageWriter> &writer,
+             std::vector<unsigned char> &&rgba,
+             std::vector<float> &&depth,
+             const int width,
+             const int height,
+             const std::string &filename);
+  // blocks until every image written so far is on disk
+  void Flush();
+  // flushes and stops the thread. A later Write starts it again.
+  void Finalize();
+  // number of images that can wait to be written. Defaults to 4.
+  void SetQueueSize(const int queue_size);
+  int  GetQueueSize();
+
+private:
+  struct Job
+  {
+    std::shared_ptr<ImageWriter> m_writer;
+    std::vector<unsigned char>   m_rgba;
+    std::vector<float>           m_depth;
+    int                          m_width;
+    int                          m_height;
+    std::string                  m_filename;
+  };
+
+  void Run();
+
+  std::deque<Job>          m_jobs;
+  // queued jobs plus the one being encoded
+  int                      m_pending;
+  int                      m_queue_size;
+  bool                     m_stop;
+  // the first error thrown by a write since the last Flush or Finalize
+  std::exception_ptr       m_error;
+  std::thread              m_thread;
+  std::mutex               m_mutex;
+  // signaled when a job is queued or the writer is stopped
+  std::condition_variable  m_job_ready;
+  // signaled when a job is done
+  std::condition_variable  m_job_done;
+};
+
+} // namespace vtkh
+
+#endif
@@ -0,0 +1,327 @@
+#include "ImageWriter.hpp"
+#include "PNGEncoder.hpp"
+
+#include <stdint.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace vtkh
+{
+
+namespace detail
+{
+
+static void PutBigEndian(std::vector<unsigned char> &out, const uint32_t value)
+{
+  out.push_back(static_cast<unsigned char>(value >> 24));
+  out.push_back(static_cast<unsigned char>(value >> 16));
+  out.push_back(static_cast<unsigned char>(value >> 8));
+  out.push_back(static_cast<unsigned char>(value));
+}
+
+static void PutLittleEndian(std::vector<unsigned char> &out, const uint32_t value)
+{
+  out.push_back(static_cast<unsigned char>(value));
+  out.push_back(static_cast<unsigned char>(value >> 8));
+  out.push_back(static_cast<unsigned char>(value >> 16));
+  out.push_back(static_cast<unsigned char>(value >> 24));
+}
+
+static bool HostIsLittleEndian()
+{
+  const uint32_t one = 1;
+  unsigned char first;
+  memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+static bool CheckSize(const int width, const int height, const std::string &filename)
+{
+  if(width <= 0 || height <= 0)
+  {
+    std::cerr<<"ImageWriter: can't write an empty image to "<<filename<<"\n";
+    return false;
+  }
+  return true;
+}
+
+// writes the buffers one after the other
+static void WriteFile(const std::string &filename,
+                      const char *data0, const size_t size0,
+                      const char *data1 = NULL, const size_t size1 = 0,
+                      const char *data2 = NULL, const size_t size2 = 0)
+{
+  std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+  if(file.is_open())
+  {
+    file.write(data0, size0);
+    if(size1 > 0) file.write(data1, size1);
+    if(size2 > 0) file.write(data2, size2);
+  }
+  if(!file.is_open() || !file.good())
+  {
+    std::cerr<<"ImageWriter: error writing "<<filename<<"\n";
+  }
+}
+
+} // namespace detail
+
+ImageWriter::~ImageWriter()
+{
+}
+
+bool
+ImageWriter::SavesDepth() const
+{
+  return false;
+}
+
+std::shared_ptr<ImageWriter>
+ImageWriter::Create(const Format format)
+{
+  switch(format)
+  {
+    case PPM: return std::make_shared<PPMImageWriter>();
+    case QOI: return std::make_shared<QOIImageWriter>();
+    case RAW: return std::make_shared<RawImageWriter>();
+    default:  return std::make_shared<PNGImageWriter>();
+  }
+}
+
+PNGImageWriter::PNGImageWriter()
+  : m_compression_level(4)
+{
+}
+
+void
+PNGImageWriter::SetCompressionLevel(const int level)
+{
+  m_compression_level = level;
+}
+
+void
+PNGImageWriter::Write(const unsigned char *rgba,
+                      const float *,
+                      const int width,
+                      const int height,
+                      const std::string &filename)
+{
+  PNGEncoder encoder;
+  encoder.SetCompressionLevel(m_compression_level);
+  encoder.Encode(rgba, width, height);
+  encoder.Save(filename);
+}
+
+std::string
+PNGImageWriter::GetExtension() const
+{
+  return "png";
+}
+
+void
+PPMImageWriter::Write(const unsigned char *rgba,
+                      const float *,
+                      const int width,
+                      const int height,
+                      const std::string &filename)
+{
+  if(!detail::CheckSize(width, height, filename)) return;
+
+  const std::string header = "P6\n" + std::to_string(width) + " " +
+                             std::to_string(height) + "\n255\n";
+  const size_t row_size = static_cast<size_t>(width) * 3;
+  std::vector<unsigned char> rgb(row_size * height);
+#ifdef VTKH_USE_OPENMP
+  #pragma omp parallel for
+#endif
+  for(int y = 0; y < height; ++y)
+  {
+    // ppm rows go top to bottom
+    const unsigned char *in = rgba + static_cast<size_t>(height - y - 1) * width * 4;
+    unsigned char *out = &rgb[y * row_size];
+    for(int x = 0; x < width; ++x)
+    {
+      out[x * 3 + 0] = in[x * 4 + 0];
+      out[x * 3 + 1] = in[x * 4 + 1];
+      out[x * 3 + 2] = in[x * 4 + 2];
+    }
+  }
+  detail::WriteFile(filename,
+                    header.c_str(), header.size(),
+                    reinterpret_cast<const char*>(&rgb[0]), rgb.size());
+}
+
+std::string
+PPMImageWriter::GetExtension() const
+{
+  return "ppm";
+}
+
+void
+QOIImageWriter::Write(const unsigned char *rgba,
+                      const float *,
+                      const int width,
+                      const int height,
+                      const std::string &filename)
+{
+  if(!detail::CheckSize(width, height, filename)) return;
+
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  std::vector<unsigned char> out;
+  //
+  // rendered images mostly take runs and diffs of a byte or two per
+  // pixel. The worst case is 5 bytes per pixel, which the vector
+  // grows to if it has to.
+  //
+  out.reserve(14 + num_pixels * 2 + 8);
+  out.push_back('q');
+  out.push_back('o');
+  out.push_back('i');
+  out.push_back('f');
+  detail::PutBigEndian(out, width);
+  detail::PutBigEndian(out, height);
+  out.push_back(4); // channels
+  out.push_back(0); // srgb with linear alpha
+
+  unsigned char index[64][4];
+  memset(index, 0, sizeof(index));
+  unsigned char prev[4] = {0, 0, 0, 255};
+  int run = 0;
+
+  for(int y = 0; y < height; ++y)
+  {
+    // qoi rows go top to bottom
+    const unsigned char *row = rgba + static_cast<size_t>(height - y - 1) * width * 4;
+    for(int x = 0; x < width; ++x)
+    {
+      const unsigned char *px = row + x * 4;
+      const bool last = y == height - 1 && x == width - 1;
+      if(memcmp(px, prev, 4) == 0)
+      {
+        run++;
+        if(run == 62 || last)
+        {
+          out.push_back(static_cast<unsigned char>(0xc0 | (run - 1)));
+          run = 0;
+        }
+        continue;
+      }
+
+      if(run > 0)
+      {
+        out.push_back(static_cast<unsigned char>(0xc0 | (run - 1)));
+        run = 0;
+      }
+
+      const int hash = (px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64;
+      if(memcmp(index[hash], px, 4) == 0)
+      {
+        out.push_back(static_cast<unsigned char>(hash));
+      }
+      else
+      {
+        memcpy(index[hash], px, 4);
+        if(px[3] == prev[3])
+        {
+          const signed char dr = static_cast<signed char>(px[0] - prev[0]);
+          const signed char dg = static_cast<signed char>(px[1] - prev[1]);
+          const signed char db = static_cast<signed char>(px[2] - prev[2]);
+          const int dr_dg = dr - dg;
+          const int db_dg = db - dg;
+          if(dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+          {
+            out.push_back(static_cast<unsigned char>(0x40 | (dr + 2) << 4 |
+                                                     (dg + 2) << 2 | (db + 2)));
+          }
+          else if(dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 &&
+                  db_dg > -9 && db_dg < 8)
+          {
+            out.push_back(static_cast<unsigned char>(0x80 | (dg + 32)));
+            out.push_back(static_cast<unsigned char>((dr_dg + 8) << 4 | (db_dg + 8)));
+          }
+          else
+          {
+            out.push_back(0xfe);
+            out.push_back(px[0]);
+            out.push_back(px[1]);
+            out.push_back(px[2]);
+          }
+        }
+        else
+        {
+          out.push_back(0xff);
+          out.insert(out.end(), px, px + 4);
+        }
+      }
+      memcpy(prev, px, 4);
+    }
+  }
+
+  const unsigned char end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+  out.insert(out.end(), end_marker, end_marker + 8);
+  detail::WriteFile(filename, reinterpret_cast<const char*>(&out[0]), out.size());
+}
+
+std::string
+QOIImageWriter::GetExtension() const
+{
+  return "qoi";
+}
+
+void
+RawImageWriter::Write(const unsigned char *rgba,
+                      const float *depth,
+                      const int width,
+                      const int height,
+                      const std::string &filename)
+{
+  if(!detail::CheckSize(width, height, filename)) return;
+
+  const size_t num_pixels = static_cast<size_t>(width) * height;
+  std::vector<unsigned char> header;
+  const char magic[8] = {'V', 'T', 'K', 'H', 'R', 'A', 'W', '\0'};
+  header.insert(header.end(), magic, magic + 8);
+  detail::PutLittleEndian(header, 1);
+  detail::PutLittleEndian(header, width);
+  detail::PutLittleEndian(header, height);
+  detail::PutLittleEndian(header, 4);
+  detail::PutLittleEndian(header, depth != NULL ? 1 : 0);
+  detail::PutLittleEndian(header, 0);
+
+  std::vector<unsigned char> swapped;
+  const char *depth_bytes = reinterpret_cast<const char*>(depth);
+  if(depth != NULL && !detail::HostIsLittleEndian())
+  {
+    swapped.resize(num_pixels * 4);
+    const unsigned char *in = reinterpret_cast<const unsigned char*>(depth);
+    for(size_t i = 0; i < num_pixels * 4; i += 4)
+    {
+      swapped[i + 0] = in[i + 3];
+      swapped[i + 1] = in[i + 2];
+      swapped[i + 2] = in[i + 1];
+      swapped[i + 3] = in[i + 0];
+    }
+    depth_bytes = reinterpret_cast<const char*>(&swapped[0]);
+  }
+
+  detail::WriteFile(filename,
+                    reinterpret_cast<const char*>(&header[0]), header.size(),
+                    reinterpret_cast<const char*>(rgba), num_pixels * 4,
+                    depth_bytes, depth != NULL ? num_pixels * sizeof(float) : 0);
+}
+
+std::string
+RawImageWriter::GetExtension() const
+{
+  return "raw";
+}
+
+bool
+RawImageWriter::SavesDepth() const
+{
+  return true;
+}
+
+} // namespace vtkh
@@ -0,0 +1,106 @@
+#ifndef VTKH_IMAGE_WRITER_HPP
+#define VTKH_IMAGE_WRITER_HPP
+
+#include <memory>
+#include <string>
+
+namespace vtkh
+{
+//
+// Writes an RGBA8 image, stored bottom row first, to a file. The file
+// name is expected to end with GetExtension(). Failures are reported
+// on std::cerr, like the png encoder, since writes can happen on a
+// background thread.
+//
+class ImageWriter
+{
+public:
+  enum Format
+  {
+    PNG,  // deflate compressed, smallest and slowest
+    PPM,  // binary rgb, alpha is dropped
+    QOI,  // "quite ok image" format, lossless and cheap to encode
+    RAW   // header, rgba and optionally float depth, no encoding
+  };
+
+  virtual ~ImageWriter();
+  //
+  // depth holds one value per pixel in the same order, or is null.
+  // It is only written by formats where SavesDepth() is true.
+  //
+  virtual void        Write(const unsigned char *rgba,
+                            const float *depth,
+                            const int width,
+                            const int height,
+                            const std::string &filename) = 0;
+  virtual std::string GetExtension() const = 0;
+  virtual bool        SavesDepth() const;
+
+  static std::shared_ptr<ImageWriter> Create(const Format format);
+};
+
+class PNGImageWriter : public ImageWriter
+{
+public:
+  PNGImageWriter();
+  void        Write(const unsigned char *rgba,
+                    const float *depth,
+                    const int width,
+                    const int height,
+                    const std::string &filename) override;
+  std::string GetExtension() const override;
+  // see PNGEncoder
+  void        SetCompressionLevel(const int level);
+private:
+  int m_compression_level;
+};
+
+class PPMImageWriter : public ImageWriter
+{
+public:
+  void        Write(const unsigned char *rgba,
+                    const float *depth,
+                    const int width,
+                    const int height,
+                    const std::string &filename) override;
+  std::string GetExtension() const override;
+};
+
+class QOIImageWriter : public ImageWriter
+{
+public:
+  void        Write(const unsigned char *rgba,
+                    const float *depth,
+                    const int width,
+                    const int height,
+                    const std::string &filename) override;
+  std::string GetExtension() const override;
+};
+//
+// The file starts with a 32 byte header of little endian fields:
+//   char[8] magic      "VTKHRAW\0"
+//   uint32  version    1
+//   uint32  width
+//   uint32  height
+//   uint32  channels   4 (rgba8)
+//   uint32  has_depth  0 or 1
+//   uint32  reserved   0
+// followed by the rgba bytes and, when has_depth is 1, one 32 bit
+// float per pixel. Rows are stored bottom first, as rendered, so the
+// buffers can be loaded straight back into an image for compositing.
+//
+class RawImageWriter : public ImageWriter
+{
+public:
+  void        Write(const unsigned char *rgba,
+                    const float *depth,
+                    const int width,
+                    const int height,
+                    const std::string &filename) override;
+  std::string GetExtension() const override;
+  bool        SavesDepth() const override;
+};
+
+} // namespace vtkh
+
+#endif
@@ -1,8 +1,15 @@
+
 #include "PNGEncoder.hpp"
 
 // standard includes
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
 #include <iostream>
+#include <queue>
+#include <utility>
+#include <vector>
 
 // thirdparty includes
 #include <lodepng.h>
@@ -10,16 +17,682 @@
 namespace vtkh
 {
 
+namespace detail
+{
+
+const int    BYTES_PER_PIXEL = 4;
+// filtered bytes per independently deflated chunk of rows
+const size_t CHUNK_BYTES = 256 * 1024;
+
+const int    WINDOW_SIZE = 32768;
+const int    MIN_MATCH = 4;
+const int    MAX_MATCH = 258;
+const int    HASH_BITS = 15;
+
+const unsigned short LENGTH_BASE[29] =
+  { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const unsigned char LENGTH_EXTRA[29] =
+  { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const unsigned short DIST_BASE[30] =
+  { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577 };
+const unsigned char DIST_EXTRA[30] =
+  { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+static unsigned int ReverseBits(unsigned int code, const int num_bits)
+{
+    unsigned int res = 0;
+    for(int i = 0; i < num_bits; ++i)
+    {
+        res = (res << 1) | (code & 1);
+        code >>= 1;
+    }
+    return res;
+}
+
+//
+// The fixed huffman codes of deflate (RFC 1951 3.2.6), bit reversed
+// so they can be written least significant bit first, along with the
+// length and distance symbol of every match.
+//
+struct FixedCodes
+{
+    unsigned short m_lit_code[288];
+    unsigned char  m_lit_bits[288];
+    unsigned char  m_dist_code[30];
+    unsigned char  m_length_symbol[MAX_MATCH + 1];
+    unsigned char  m_dist_symbol[WINDOW_SIZE + 1];
+
+    FixedCodes()
+    {
+        for(int sym = 0; sym < 288; ++sym)
+        {
+            unsigned int code;
+            int bits;
+            if(sym < 144)      { code = 0x30 + sym;          bits = 8; }
+            else if(sym < 256) { code = 0x190 + (sym - 144); bits = 9; }
+            else if(sym < 280) { code = sym - 256;           bits = 7; }
+            else               { code = 0xc0 + (sym - 280);  bits = 8; }
+            m_lit_code[sym] = (unsigned short) ReverseBits(code, bits);
+            m_lit_bits[sym] = (unsigned char) bits;
+        }
+
+        for(int sym = 0; sym < 30; ++sym)
+        {
+            m_dist_code[sym] = (unsigned char) ReverseBits(sym, 5);
+        }
+
+        int sym = 0;
+        for(int len = LENGTH_BASE[0]; len <= MAX_MATCH; ++len)
+        {
+            while(sym < 28 && len >= LENGTH_BASE[sym + 1]) ++sym;
+            m_length_symbol[len] = (unsigned char) sym;
+        }
+
+        sym = 0;
+        for(int dist = 1; dist <= WINDOW_SIZE; ++dist)
+        {
+            while(sym < 29 && dist >= DIST_BASE[sym + 1]) ++sym;
+            m_dist_symbol[dist] = (unsigned char) sym;
+        }
+    }
+};
+
+static const FixedCodes& GetFixedCodes()
+{
+    static const FixedCodes codes;
+    return codes;
+}
+
+class BitWriter
+{
+public:
+    BitWriter(std::vector<unsigned char> &out)
+      : m_out(out),
+        m_bits(0),
+        m_count(0)
+    {}
+
+    void Write(const unsigned int value, const int num_bits)
+    {
+        m_bits |= (unsigned long long) value << m_count;
+        m_count += num_bits;
+        while(m_count >= 8)
+        {
+            m_out.push_back((unsigned char) (m_bits & 0xff));
+            m_bits >>= 8;
+            m_count -= 8;
+        }
+    }
+
+    // pads to the next byte boundary with zeros
+    void Align()
+    {
+        if(m_count > 0)
+        {
+            m_out.push_back((unsigned char) (m_bits & 0xff));
+        }
+        m_bits = 0;
+        m_count = 0;
+    }
+
+private:
+    std::vector<unsigned char> &m_out;
+    unsigned long long          m_bits;
+    int                         m_count;
+};
+
+static inline unsigned int Hash(const unsigned char *p)
+{
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// a match of length (bits 16-30) and distance (bits 0-15), or a literal
+const unsigned int MATCH_FLAG = 0x80000000u;
+const int NUM_LIT_CODES = 286;
+const int NUM_DIST_CODES = 30;
+const int NUM_LENGTH_CODES = 19;
+const int MAX_CODE_BITS = 15;
+const int MAX_LENGTH_CODE_BITS = 7;
+// the order the code length code lengths are written in
+const unsigned char LENGTH_CODE_ORDER[NUM_LENGTH_CODES] =
+  { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+//
+// Huffman code lengths of at most max_bits for the symbol counts.
+// Counts are halved until the tree is shallow enough. A lone symbol
+// gets a partner, since some decoders reject a code with one symbol.
+//
+static void BuildLengths(const unsigned int *counts,
+                         const int num_symbols,
+                         const int max_bits,
+                         unsigned char *lengths)
+{
+    std::vector<unsigned int> weights(counts, counts + num_symbols);
+    std::vector<int> used;
+    for(int sym = 0; sym < num_symbols; ++sym)
+    {
+        lengths[sym] = 0;
+        if(counts[sym] > 0) used.push_back(sym);
+    }
+    if(used.size() < 2)
+    {
+        const int first = used.empty() ? 0 : used[0];
+        lengths[first] = 1;
+        lengths[first == 0 ? 1 : 0] = 1;
+        return;
+    }
+
+    typedef std::pair<unsigned long long, int> Node;
+    const int num_leaves = (int) used.size();
+    std::vector<int> parent(2 * num_leaves - 1);
+    while(true)
+    {
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        for(int i = 0; i < num_leaves; ++i)
+        {
+            queue.push(Node(weights[used[i]], i));
+        }
+        int next = num_leaves;
+        while(queue.size() > 1)
+        {
+            const Node a = queue.top(); queue.pop();
+            const Node b = queue.top(); queue.pop();
+            parent[a.second] = next;
+            parent[b.second] = next;
+            queue.push(Node(a.first + b.first, next));
+            ++next;
+        }
+
+        // parents are always numbered after their children
+        const int root = next - 1;
+        std::vector<int> depth(next, 0);
+        int max_depth = 0;
+        for(int node = root - 1; node >= 0; --node)
+        {
+            depth[node] = depth[parent[node]] + 1;
+            max_depth = std::max(max_depth, depth[node]);
+        }
+        if(max_depth <= max_bits)
+        {
+            for(int i = 0; i < num_leaves; ++i)
+            {
+                lengths[used[i]] = (unsigned char) depth[i];
+            }
+            return;
+        }
+        for(int i = 0; i < num_leaves; ++i)
+        {
+            weights[used[i]] = (weights[used[i]] + 1) / 2;
+        }
+    }
+}
+
+// canonical codes for the lengths (RFC 1951 3.2.2), bit reversed
+static void BuildCodes(const unsigned char *lengths,
+                       const int num_symbols,
+                       unsigned short *codes)
+{
+    int bl_count[MAX_CODE_BITS + 1] = { 0 };
+    for(int sym = 0; sym < num_symbols; ++sym) bl_count[lengths[sym]]++;
+    bl_count[0] = 0;
+    unsigned int next_code[MAX_CODE_BITS + 1] = { 0 };
+    unsigned int code = 0;
+    for(int bits = 1; bits <= MAX_CODE_BITS; ++bits)
+    {
+        code = (code + bl_count[bits - 1]) << 1;
+        next_code[bits] = code;
+    }
+    for(int sym = 0; sym < num_symbols; ++sym)
+    {
+        const int len = lengths[sym];
+        codes[sym] = len == 0 ? 0 : (unsigned short) ReverseBits(next_code[len]++, len);
+    }
+}
+
+//
+// Run length codes (16, 17 and 18) of the code lengths, with the
+// repeat count of each in the high byte
+//
+static void RunLengthCodes(const unsigned char *lengths,
+                           const int size,
+                           std::vector<unsigned short> &symbols)
+{
+    int i = 0;
+    while(i < size)
+    {
+        const int len = lengths[i];
+        int run = 1;
+        while(i + run < size && lengths[i + run] == len) ++run;
+        i += run;
+        if(len == 0)
+        {
+            while(run >= 11)
+            {
+                const int n = std::min(run, 138);
+                symbols.push_back((unsigned short) (18 | ((n - 11) << 8)));
+                run -= n;
+            }
+            if(run >= 3)
+            {
+                symbols.push_back((unsigned short) (17 | ((run - 3) << 8)));
+                run = 0;
+            }
+        }
+        else
+        {
+            symbols.push_back((unsigned short) len);
+            --run;
+            while(run >= 3)
+            {
+                const int n = std::min(run, 6);
+                symbols.push_back((unsigned short) (16 | ((n - 3) << 8)));
+                run -= n;
+            }
+        }
+        for(; run > 0; --run) symbols.push_back((unsigned short) len);
+    }
+}
+
+//
+// Writes the tokens as one block with huffman codes built for them,
+// or with the fixed codes when the code tables would cost more than
+// they save
+//
+static void WriteHuffmanBlock(const std::vector<unsigned int> &tokens,
+                              const unsigned int *lit_counts,
+                              const unsigned int *dist_counts,
+                              BitWriter &writer)
+{
+    const FixedCodes &fixed = GetFixedCodes();
+    unsigned char lit_lengths[NUM_LIT_CODES];
+    unsigned char dist_lengths[NUM_DIST_CODES];
+    BuildLengths(lit_counts, NUM_LIT_CODES, MAX_CODE_BITS, lit_lengths);
+    BuildLengths(dist_counts, NUM_DIST_CODES, MAX_CODE_BITS, dist_lengths);
+
+    int num_lit = NUM_LIT_CODES;
+    while(num_lit > 257 && lit_lengths[num_lit - 1] == 0) --num_lit;
+    int num_dist = NUM_DIST_CODES;
+    while(num_dist > 1 && dist_lengths[num_dist - 1] == 0) --num_dist;
+
+    unsigned char all_lengths[NUM_LIT_CODES + NUM_DIST_CODES];
+    memcpy(all_lengths, lit_lengths, num_lit);
+    memcpy(all_lengths + num_lit, dist_lengths, num_dist);
+    std::vector<unsigned short> length_symbols;
+    RunLengthCodes(all_lengths, num_lit + num_dist, length_symbols);
+
+    unsigned int length_counts[NUM_LENGTH_CODES] = { 0 };
+    for(size_t i = 0; i < length_symbols.size(); ++i)
+    {
+        length_counts[length_symbols[i] & 0xff]++;
+    }
+    unsigned char length_lengths[NUM_LENGTH_CODES];
+    BuildLengths(length_counts, NUM_LENGTH_CODES, MAX_LENGTH_CODE_BITS, length_lengths);
+    int num_length_codes = NUM_LENGTH_CODES;
+    while(num_length_codes > 4 &&
+          length_lengths[LENGTH_CODE_ORDER[num_length_codes - 1]] == 0)
+    {
+        --num_length_codes;
+    }
+
+    // the extra bits are the same either way
+    unsigned long long dynamic_bits = 5 + 5 + 4 + 3 * num_length_codes;
+    for(size_t i = 0; i < length_symbols.size(); ++i)
+    {
+        const int sym = length_symbols[i] & 0xff;
+        dynamic_bits += length_lengths[sym] + (sym == 16 ? 2 : (sym == 17 ? 3 : (sym == 18 ? 7 : 0)));
+    }
+    unsigned long long fixed_bits = 0;
+    for(int sym = 0; sym < NUM_LIT_CODES; ++sym)
+    {
+        dynamic_bits += (unsigned long long) lit_counts[sym] * lit_lengths[sym];
+        fixed_bits += (unsigned long long) lit_counts[sym] * fixed.m_lit_bits[sym];
+    }
+    for(int sym = 0; sym < NUM_DIST_CODES; ++sym)
+    {
+        dynamic_bits += (unsigned long long) dist_counts[sym] * dist_lengths[sym];
+        fixed_bits += (unsigned long long) dist_counts[sym] * 5;
+    }
+
+    unsigned short lit_codes[NUM_LIT_CODES];
+    unsigned short dist_codes[NUM_DIST_CODES];
+    if(dynamic_bits < fixed_bits)
+    {
+        BuildCodes(lit_lengths, NUM_LIT_CODES, lit_codes);
+        BuildCodes(dist_lengths, NUM_DIST_CODES, dist_codes);
+        unsigned short length_codes[NUM_LENGTH_CODES];
+        BuildCodes(length_lengths, NUM_LENGTH_CODES, length_codes);
+
+        // BFINAL = 0, BTYPE = 10 (dynamic huffman codes)
+        writer.Write(4, 3);
+        writer.Write(num_lit - 257, 5);
+        writer.Write(num_dist - 1, 5);
+        writer.Write(num_length_codes - 4, 4);
+        for(int i = 0; i < num_length_codes; ++i)
+        {
+            writer.Write(length_lengths[LENGTH_CODE_ORDER[i]], 3);
+        }
+        for(size_t i = 0; i < length_symbols.size(); ++i)
+        {
+            const int sym = length_symbols[i] & 0xff;
+            const int repeat = length_symbols[i] >> 8;
+            writer.Write(length_codes[sym], length_lengths[sym]);
+            if(sym == 16) writer.Write(repeat, 2);
+            else if(sym == 17) writer.Write(repeat, 3);
+            else if(sym == 18) writer.Write(repeat, 7);
+        }
+    }
+    else
+    {
+        for(int sym = 0; sym < NUM_LIT_CODES; ++sym)
+        {
+            lit_codes[sym] = fixed.m_lit_code[sym];
+            lit_lengths[sym] = fixed.m_lit_bits[sym];
+        }
+        for(int sym = 0; sym < NUM_DIST_CODES; ++sym)
+        {
+            dist_codes[sym] = fixed.m_dist_code[sym];
+            dist_lengths[sym] = 5;
+        }
+        // BFINAL = 0, BTYPE = 01 (fixed huffman codes)
+        writer.Write(2, 3);
+    }
+
+    for(size_t i = 0; i < tokens.size(); ++i)
+    {
+        const unsigned int token = tokens[i];
+        if(!(token & MATCH_FLAG))
+        {
+            writer.Write(lit_codes[token], lit_lengths[token]);
+            continue;
+        }
+        const int len = (token >> 16) & 0x7fff;
+        const int dist = token & 0xffff;
+        const int len_sym = fixed.m_length_symbol[len];
+        writer.Write(lit_codes[257 + len_sym], lit_lengths[257 + len_sym]);
+        writer.Write(len - LENGTH_BASE[len_sym], LENGTH_EXTRA[len_sym]);
+        const int dist_sym = fixed.m_dist_symbol[dist];
+        writer.Write(dist_codes[dist_sym], dist_lengths[dist_sym]);
+        writer.Write(dist - DIST_BASE[dist_sym], DIST_EXTRA[dist_sym]);
+    }
+    // end of block
+    writer.Write(lit_codes[256], lit_lengths[256]);
+}
+
+//
+// Writes the data as non-final deflate blocks that end on a byte
+// boundary (an empty stored block, like a zlib sync flush), so the
+// outputs of separate chunks can be concatenated into one stream.
+//
+static void Deflate(const unsigned char *in,
+                    const size_t size,
+                    const int level,
+                    std::vector<unsigned char> &out)
+{
+    BitWriter writer(out);
+    if(level == 0)
+    {
+        size_t pos = 0;
+        while(pos < size)
+        {
+            const size_t len = std::min(size - pos, (size_t) 65535);
+            writer.Write(0, 3);
+            writer.Align();
+            out.push_back((unsigned char) (len & 0xff));
+            out.push_back((unsigned char) (len >> 8));
+            out.push_back((unsigned char) (~len & 0xff));
+            out.push_back((unsigned char) ((~len >> 8) & 0xff));
+            out.insert(out.end(), in + pos, in + pos + len);
+            pos += len;
+        }
+    }
+    else
+    {
+        const FixedCodes &codes = GetFixedCodes();
+        // each level doubles how many earlier matches are tried
+        const int max_chain = 1 << (level - 1);
+        const int nice_len = level < 4 ? 32 : (level < 7 ? 128 : MAX_MATCH);
+        const bool index_matches = level >= 4;
+
+        std::vector<int> head(1 << HASH_BITS, -1);
+        std::vector<int> prev(size);
+        // the matches and literals, and how often each symbol is used
+        std::vector<unsigned int> tokens;
+        tokens.reserve(size / 2);
+        unsigned int lit_counts[NUM_LIT_CODES] = { 0 };
+        unsigned int dist_counts[NUM_DIST_CODES] = { 0 };
+
+        size_t pos = 0;
+        while(pos + MIN_MATCH <= size)
+        {
+            const unsigned int h = Hash(in + pos);
+            const int max_len = (int) std::min(size - pos, (size_t) MAX_MATCH);
+            int best_len = 0;
+            int best_dist = 0;
+            int candidate = head[h];
+            int chain = max_chain;
+
+            while(candidate >= 0 &&
+                  (int) pos - candidate <= WINDOW_SIZE &&
+                  chain-- > 0)
+            {
+                const unsigned char *a = in + candidate;
+                const unsigned char *b = in + pos;
+                // a longer match has to differ from the best at best_len
+                if(a[best_len] == b[best_len])
+                {
+                    int len = 0;
+                    while(len < max_len && a[len] == b[len]) ++len;
+                    if(len > best_len)
+                    {
+                        best_len = len;
+                        best_dist = (int) pos - candidate;
+                        if(len >= nice_len || len == max_len) break;
+                    }
+                }
+                candidate = prev[candidate];
+            }
+
+            prev[pos] = head[h];
+            head[h] = (int) pos;
+
+            if(best_len >= MIN_MATCH)
+            {
+                tokens.push_back(MATCH_FLAG | ((unsigned int) best_len << 16) | best_dist);
+                lit_counts[257 + codes.m_length_symbol[best_len]]++;
+                dist_counts[codes.m_dist_symbol[best_dist]]++;
+
+                if(index_matches)
+                {
+                    const size_t end = std::min(pos + best_len, size - MIN_MATCH + 1);
+                    for(size_t p = pos + 1; p < end; ++p)
+                    {
+                        const unsigned int hp = Hash(in + p);
+                        prev[p] = head[hp];
+                        head[hp] = (int) p;
+                    }
+                }
+                pos += best_len;
+            }
+            else
+            {
+                tokens.push_back(in[pos]);
+                lit_counts[in[pos]]++;
+                ++pos;
+            }
+        }
+
+        for(; pos < size; ++pos)
+        {
+            tokens.push_back(in[pos]);
+            lit_counts[in[pos]]++;
+        }
+        lit_counts[256] = 1;
+        WriteHuffmanBlock(tokens, lit_counts, dist_counts, writer);
+    }
+
+    // empty stored block
+    writer.Write(0, 3);
+    writer.Align();
+    out.push_back(0x00);
+    out.push_back(0x00);
+    out.push_back(0xff);
+    out.push_back(0xff);
+}
+
+const unsigned int ADLER_MOD = 65521;
+
+static unsigned int Adler32(const unsigned char *data, size_t size)
+{
+    unsigned int a = 1;
+    unsigned int b = 0;
+    while(size > 0)
+    {
+        // largest run that can't overflow b
+        const size_t run = std::min(size, (size_t) 5552);
+        for(size_t i = 0; i < run; ++i)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= ADLER_MOD;
+        b %= ADLER_MOD;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+// checksum of the concatenation of two runs, given the length of the second
+static unsigned int Adler32Combine(const unsigned int adler1,
+                                   const unsigned int adler2,
+                                   const size_t size2)
+{
+    const unsigned long long a1 = adler1 & 0xffff;
+    const unsigned long long b1 = adler1 >> 16;
+    const unsigned long long a2 = adler2 & 0xffff;
+    const unsigned long long b2 = adler2 >> 16;
+    const unsigned long long len = size2 % ADLER_MOD;
+
+    const unsigned long long a = (a1 + a2 + ADLER_MOD - 1) % ADLER_MOD;
+    const unsigned long long b = (b1 + b2 + len * (a1 + ADLER_MOD - 1)) % ADLER_MOD;
+    return (unsigned int) ((b << 16) | a);
+}
+
+static inline unsigned char Paeth(const int a, const int b, const int c)
+{
+    const int p = a + b - c;
+    const int pa = abs(p - a);
+    const int pb = abs(p - b);
+    const int pc = abs(p - c);
+    if(pa <= pb && pa <= pc) return (unsigned char) a;
+    if(pb <= pc) return (unsigned char) b;
+    return (unsigned char) c;
+}
+
+// prev is a row of zeros for the first row of the image
+static void FilterRow(const unsigned char *row,
+                      const unsigned char *prev,
+                      const size_t stride,
+                      const int filter,
+                      unsigned char *out)
+{
+    const int bpp = BYTES_PER_PIXEL;
+    out[0] = (unsigned char) filter;
+    out++;
+    switch(filter)
+    {
+      case PNGEncoder::FILTER_NONE:
+          memcpy(out, row, stride);
+          break;
+      case PNGEncoder::FILTER_SUB:
+          for(size_t i = 0; i < bpp; ++i) out[i] = row[i];
+          for(size_t i = bpp; i < stride; ++i) out[i] = row[i] - row[i - bpp];
+          break;
+      case PNGEncoder::FILTER_UP:
+          for(size_t i = 0; i < stride; ++i) out[i] = row[i] - prev[i];
+          break;
+      case PNGEncoder::FILTER_AVERAGE:
+          for(size_t i = 0; i < bpp; ++i) out[i] = row[i] - (prev[i] >> 1);
+          for(size_t i = bpp; i < stride; ++i)
+          {
+              out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+          }
+          break;
+      case PNGEncoder::FILTER_PAETH:
+          for(size_t i = 0; i < bpp; ++i) out[i] = row[i] - prev[i];
+          for(size_t i = bpp; i < stride; ++i)
+          {
+              out[i] = row[i] - Paeth(row[i - bpp], prev[i], prev[i - bpp]);
+          }
+          break;
+    }
+}
+
+static size_t FilterCost(const unsigned char *filtered, const size_t stride)
+{
+    size_t sum = 0;
+    for(size_t i = 0; i < stride; ++i)
+    {
+        sum += (size_t) abs((int) (signed char) filtered[i]);
+    }
+    return sum;
+}
+
+static void WriteBigEndian(unsigned char *out, const unsigned int value)
+{
+    out[0] = (unsigned char) (value >> 24);
+    out[1] = (unsigned char) (value >> 16);
+    out[2] = (unsigned char) (value >> 8);
+    out[3] = (unsigned char) value;
+}
+
+static void WriteChunkHeader(unsigned char *chunk,
+                             const unsigned int length,
+                             const char *type)
+{
+    WriteBigEndian(chunk, length);
+    memcpy(chunk + 4, type, 4);
+}
+
+// the crc covers the chunk type and data
+static void WriteChunkCrc(unsigned char *chunk, const unsigned int length)
+{
+    WriteBigEndian(chunk + 8 + length, lodepng_crc32(chunk + 4, length + 4));
+}
+
+} // namespace detail
+
 PNGEncoder::PNGEncoder()
 :m_buffer(NULL),
- m_buffer_size(0)
+ m_buffer_size(0),
+ m_compression_level(4),
+ m_filter_strategy(FILTER_ADAPTIVE)
 {}
-  
+
 PNGEncoder::~PNGEncoder()
 {
     Cleanup();
 }
 
+void
+PNGEncoder::SetCompressionLevel(const int level)
+{
+    m_compression_level = std::max(0, std::min(9, level));
+}
+
+void
+PNGEncoder::SetFilterStrategy(FilterStrategy strategy)
+{
+    m_filter_strategy = strategy;
+}
+
 void
 PNGEncoder::Encode(const unsigned char *rgba_in,
                    const int width,
@@ -27,30 +700,147 @@ PNGEncoder::Encode(const unsigned char *rgba_in,
 {
     Cleanup();
 
-    // upside down relative to what lodepng wants
-    unsigned char *rgba_flip = new unsigned char[width * height *4];
+    if(width <= 0 || height <= 0)
+    {
+        std::cerr<<"PNGEncoder: can't encode an empty image\n";
+        return;
+    }
+
+    const size_t stride = (size_t) width * detail::BYTES_PER_PIXEL;
+    const size_t filtered_stride = stride + 1;
+    const int rows_per_chunk =
+      (int) std::max((size_t) 1, detail::CHUNK_BYTES / filtered_stride);
+    const int num_chunks = (height + rows_per_chunk - 1) / rows_per_chunk;
+
+    std::vector<std::vector<unsigned char>> streams(num_chunks);
+    std::vector<unsigned int> adlers(num_chunks);
+    const std::vector<unsigned char> zeros(stride, 0);
+    const int level = m_compression_level;
+    const FilterStrategy strategy = m_filter_strategy;
+
+#ifdef VTKH_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(int chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        const int row_begin = chunk * rows_per_chunk;
+        const int row_end = std::min(height, row_begin + rows_per_chunk);
+
+        std::vector<unsigned char> filtered(filtered_stride * (row_end - row_begin));
+        std::vector<unsigned char> candidate;
+        if(strategy == FILTER_ADAPTIVE)
+        {
+            candidate.resize(filtered_stride);
+        }
+
+        for(int y = row_begin; y < row_end; ++y)
+        {
+            // the input is upside down relative to png
+            const unsigned char *row = rgba_in + (size_t) (height - y - 1) * stride;
+            const unsigned char *prev = y == 0 ? &zeros[0] : row + stride;
+            unsigned char *out = &filtered[(y - row_begin) * filtered_stride];
+
+            if(strategy != FILTER_ADAPTIVE)
+            {
+                detail::FilterRow(row, prev, stride, strategy, out);
+                continue;
+            }
 
-    for (int y=0; y<height; ++y)
+            size_t best_cost = 0;
+            for(int filter = FILTER_NONE; filter <= FILTER_PAETH; ++filter)
+            {
+                detail::FilterRow(row, prev, stride, filter, &candidate[0]);
+                const size_t cost = detail::FilterCost(&candidate[1], stride);
+                if(filter == FILTER_NONE || cost < best_cost)
+                {
+                    best_cost = cost;
+                    memcpy(out, &candidate[0], filtered_stride);
+                }
+            }
+        }
+
+        adlers[chunk] = detail::Adler32(&filtered[0], filtered.size());
+        streams[chunk].reserve(filtered.size() / 2);
+        detail::Deflate(&filtered[0], filtered.size(), level, streams[chunk]);
+    }
+
+    unsigned int adler = adlers[0];
+    for(int chunk = 1; chunk < num_chunks; ++chunk)
     {
-        memcpy(&(rgba_flip[y*width*4]),
-               &(rgba_in[(height-y-1)*width*4]),
-               width*4);
+        const int rows = std::min(height, (chunk + 1) * rows_per_chunk) - chunk * rows_per_chunk;
+        adler = detail::Adler32Combine(adler, adlers[chunk], rows * filtered_stride);
     }
 
-     unsigned error = lodepng_encode_memory(&m_buffer,
-                                            &m_buffer_size,
-                                            &rgba_flip[0],
-                                            width,
-                                            height,
-                                            LCT_RGBA, // these settings match those for 
-                                            8);       // lodepng_encode32_file
+    // zlib stream: header, the chunk streams, an empty final block
+    // and the checksum of the uncompressed data
+    const unsigned char zlib_header[2] = { 0x78, 0x01 };
+    const unsigned char zlib_trailer[6] =
+      { 0x03, 0x00,
+        (unsigned char) (adler >> 24), (unsigned char) (adler >> 16),
+        (unsigned char) (adler >> 8), (unsigned char) adler };
 
-    delete [] rgba_flip;
-    
-    if(error)
+    // each chunk stream goes into its own IDAT chunk so the crcs can
+    // be computed in parallel
+    std::vector<size_t> offsets(num_chunks + 1);
+    const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    const size_t header_size = 8 + 12 + 13;
+    offsets[0] = header_size;
+    for(int chunk = 0; chunk < num_chunks; ++chunk)
     {
-      std::cerr<<"lodepng_encode_memory failed\n";
+        size_t data_size = streams[chunk].size();
+        if(chunk == 0) data_size += sizeof(zlib_header);
+        if(chunk == num_chunks - 1) data_size += sizeof(zlib_trailer);
+        offsets[chunk + 1] = offsets[chunk] + 12 + data_size;
     }
+
+    m_buffer_size = offsets[num_chunks] + 12;
+    m_buffer = (unsigned char *) malloc(m_buffer_size);
+    if(m_buffer == NULL)
+    {
+        m_buffer_size = 0;
+        std::cerr<<"PNGEncoder: failed to allocate the png buffer\n";
+        return;
+    }
+
+    memcpy(m_buffer, signature, 8);
+    const unsigned char ihdr[13] =
+      { (unsigned char) (width >> 24), (unsigned char) (width >> 16),
+        (unsigned char) (width >> 8), (unsigned char) width,
+        (unsigned char) (height >> 24), (unsigned char) (height >> 16),
+        (unsigned char) (height >> 8), (unsigned char) height,
+        8,    // bit depth
+        6,    // RGBA
+        0, 0, 0 };
+    detail::WriteChunkHeader(m_buffer + 8, 13, "IHDR");
+    memcpy(m_buffer + 16, ihdr, 13);
+    detail::WriteChunkCrc(m_buffer + 8, 13);
+
+#ifdef VTKH_USE_OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(int chunk = 0; chunk < num_chunks; ++chunk)
+    {
+        unsigned char *idat = m_buffer + offsets[chunk];
+        const unsigned int length = (unsigned int) (offsets[chunk + 1] - offsets[chunk] - 12);
+        detail::WriteChunkHeader(idat, length, "IDAT");
+
+        unsigned char *data = idat + 8;
+        if(chunk == 0)
+        {
+            memcpy(data, zlib_header, sizeof(zlib_header));
+            data += sizeof(zlib_header);
+        }
+        memcpy(data, &streams[chunk][0], streams[chunk].size());
+        data += streams[chunk].size();
+        if(chunk == num_chunks - 1)
+        {
+            memcpy(data, zlib_trailer, sizeof(zlib_trailer));
+        }
+        detail::WriteChunkCrc(idat, length);
+    }
+
+    detail::WriteChunkHeader(m_buffer + offsets[num_chunks], 0, "IEND");
+    detail::WriteChunkCrc(m_buffer + offsets[num_chunks], 0);
 }
 
 void
@@ -58,41 +848,28 @@ PNGEncoder::Encode(const float *rgba_in,
                    const int width,
                    const int height)
 {
-    Cleanup();
-
-    // upside down relative to what lodepng wants
-    unsigned char *rgba_flip = new unsigned char[width * height *4];
-
+    if(width <= 0 || height <= 0)
+    {
+        Cleanup();
+        std::cerr<<"PNGEncoder: can't encode an empty image\n";
+        return;
+    }
 
-    for(int x = 0; x < width; ++x)
+    std::vector<unsigned char> rgba((size_t) width * height * 4);
 
 #ifdef VTKH_USE_OPENMP
-        #pragma omp parrallel for
+    #pragma omp parallel for
 #endif
-        for (int y = 0; y < height; ++y)
-        {
-            int inOffset = (y * width + x) * 4;
-            int outOffset = ((height - y - 1) * width + x) * 4;
-            rgba_flip[outOffset + 0] = (unsigned char)(rgba_in[inOffset + 0] * 255.f);
-            rgba_flip[outOffset + 1] = (unsigned char)(rgba_in[inOffset + 1] * 255.f);
-            rgba_flip[outOffset + 2] = (unsigned char)(rgba_in[inOffset + 2] * 255.f);
-            rgba_flip[outOffset + 3] = (unsigned char)(rgba_in[inOffset + 3] * 255.f);
-        }
-
-     unsigned error = lodepng_encode_memory(&m_buffer,
-                                            &m_buffer_size,
-                                            &rgba_flip[0],
-                                            width,
-                                            height,
-                                            LCT_RGBA, // these settings match those for 
-                                            8);       // lodepng_encode32_file
-
-    delete [] rgba_flip;
-    
-    if(error)
+    for(int y = 0; y < height; ++y)
     {
-      std::cerr<<"lodepng_encode_memory failed\n";
+        const size_t offset = (size_t) y * width * 4;
+        for(size_t i = offset; i < offset + (size_t) width * 4; ++i)
+        {
+            rgba[i] = (unsigned char)(rgba_in[i] * 255.f);
+        }
     }
+
+    Encode(&rgba[0], width, height);
 }
 
 void
@@ -104,7 +881,7 @@ PNGEncoder::Save(const std::string &filename)
         /// we have a problem ...!
         return;
     }
-    
+
     unsigned error = lodepng_save_file(m_buffer,
                                        m_buffer_size,
                                        filename.c_str());
@@ -131,7 +908,7 @@ PNGEncoder::Cleanup()
 {
     if(m_buffer != NULL)
     {
-        //lodepng_free(m_buffer); 
+        //lodepng_free(m_buffer);
         // ^-- Not found even if LODEPNG_COMPILE_ALLOCATORS is defined?
         // simply use "free"
         free(m_buffer);
@@ -142,5 +919,3 @@ PNGEncoder::Cleanup()
 
 };
 
-
-
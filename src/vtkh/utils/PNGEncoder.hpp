@@ -3,15 +3,35 @@
 
 #include <string>
 
-namespace vtkh 
+namespace vtkh
 {
-
+//
+// Encodes RGBA8 images (bottom row first) as PNG. Rows are split into
+// chunks that are filtered and deflated independently, in parallel when
+// OpenMP is enabled. Each chunk is written as its own IDAT chunk, and
+// together their deflate streams make up the one zlib stream of the
+// image.
+//
 class PNGEncoder
 {
 public:
+    //
+    // How each row picks its PNG filter. ADAPTIVE chooses, per row,
+    // the filter with the smallest sum of absolute filtered values.
+    //
+    enum FilterStrategy
+    {
+      FILTER_NONE,
+      FILTER_SUB,
+      FILTER_UP,
+      FILTER_AVERAGE,
+      FILTER_PAETH,
+      FILTER_ADAPTIVE
+    };
+
     PNGEncoder();
     ~PNGEncoder();
-    
+
     void           Encode(const unsigned char *rgba_in,
                           const int width,
                           const int height);
@@ -24,10 +44,19 @@ public:
     size_t         PngBufferSize();
 
     void           Cleanup();
-    
+    //
+    // 0 stores the filtered rows uncompressed. 1 through 9 trade speed
+    // for size by searching further for matches. Defaults to 4.
+    //
+    void           SetCompressionLevel(const int level);
+    // defaults to FILTER_ADAPTIVE
+    void           SetFilterStrategy(FilterStrategy strategy);
+
 private:
     unsigned char *m_buffer;
     size_t         m_buffer_size;
+    int            m_compression_level;
+    FilterStrategy m_filter_strategy;
 };
 
 } // namespace vtkh